@@ -7,37 +7,53 @@
 #include <command.h>
 #include <config.h>
 #include <common.h>
+#include <blk.h>
 #include <malloc.h>
 #include <part.h>
 
 static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
+	struct block_cache_dev_stats dstats;
 	struct block_cache_stats stats;
+	int i;
+
+	/* fetch per-device counters first, blkcache_stats() resets them */
+	for (i = 0; !blkcache_dev_stats(i, &dstats); i++)
+		printf("%s %d: hits %u, misses %u, evictions %u, "
+		       "blocks %u, bytes %lu\n",
+		       blk_get_if_type_name(dstats.iftype), dstats.devnum,
+		       dstats.hits, dstats.misses, dstats.evictions,
+		       dstats.entries, dstats.bytes);
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
 	       "entries: %u\n"
+	       "bytes: %lu\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "max cache bytes: %lu\n",
+	       stats.hits, stats.misses, stats.evictions, stats.entries,
+	       stats.bytes, stats.max_blocks_per_entry, stats.max_bytes);
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
+	unsigned blocks_per_entry;
+	unsigned long max_bytes;
+
 	if (argc != 3)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
-	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	max_bytes = simple_strtoul(argv[2], 0, 0);
+	blkcache_configure(blocks_per_entry, max_bytes);
+	printf("changed to max of %lu bytes, at most %u blocks per read\n",
+	       max_bytes, blocks_per_entry);
 	return 0;
 }
 
@@ -83,6 +99,6 @@ U_BOOT_CMD(
 	blkcache, 4, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <bytes> "
+	"- set max blocks cached per read and the cache memory budget\n"
 );
@@ -111,3 +111,36 @@ U_BOOT_CMD(
 	fstypes, 1, 1, do_fstypes_wrapper,
 	"List supported filesystem types", ""
 );
+
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+static int do_mount_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
+			    char *const argv[])
+{
+	return do_fs_mount(cmdtp, flag, argc, argv);
+}
+
+U_BOOT_CMD(
+	mount,	3,	1,	do_mount_wrapper,
+	"List mounted filesystems, or mount one",
+	"\n"
+	"    - list the filesystems kept mounted between commands\n"
+	"mount <interface> <dev[:part]>\n"
+	"    - mount the filesystem on partition 'part' of device type\n"
+	"      'interface' instance 'dev'."
+);
+
+static int do_umount_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
+			     char *const argv[])
+{
+	return do_fs_umount(cmdtp, flag, argc, argv);
+}
+
+U_BOOT_CMD(
+	umount,	3,	1,	do_umount_wrapper,
+	"Drop filesystems from the mount table",
+	"\n"
+	"    - drop all filesystems\n"
+	"umount <interface> <dev[:part]>\n"
+	"    - drop the filesystems of device type 'interface' instance 'dev'."
+);
+#endif
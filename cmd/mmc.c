@@ -8,6 +8,7 @@
 #include <blk.h>
 #include <command.h>
 #include <console.h>
+#include <fs.h>
 #include <memalign.h>
 #include <mmc.h>
 #include <part.h>
@@ -155,6 +156,8 @@ static struct mmc *__init_mmc_device(int dev, bool force_init,
 	struct blk_desc *bd = mmc_get_blk_desc(mmc);
 	blkcache_invalidate(bd->if_type, bd->devnum);
 #endif
+	blk_readahead_invalidate(mmc_get_blk_desc(mmc));
+	fs_mount_invalidate(mmc_get_blk_desc(mmc));
 
 	return mmc;
 }
@@ -7,11 +7,56 @@
 #include <common.h>
 #include <blk.h>
 #include <command.h>
+#include <div64.h>
 #include <dm.h>
+#include <mapmem.h>
 #include <nvme.h>
 
 static int nvme_curr_dev;
 
+static ulong nvme_kib_per_sec(ulong blocks, ulong blksz, ulong us)
+{
+	u64 kib = ((u64)blocks * blksz) >> 10;
+
+	return lldiv(kib * 1000000, max(us, 1UL));
+}
+
+static int nvme_do_bench(char *const argv[])
+{
+	struct blk_desc *desc;
+	struct udevice *udev;
+	ulong addr, us_qd1, us_qdn;
+	lbaint_t blk, cnt;
+	int depth;
+	int ret;
+
+	ret = blk_get_device(IF_TYPE_NVME, nvme_curr_dev, &udev);
+	if (ret < 0)
+		return CMD_RET_FAILURE;
+	desc = dev_get_uclass_plat(udev);
+
+	addr = hextoul(argv[2], NULL);
+	blk = hextoul(argv[3], NULL);
+	cnt = hextoul(argv[4], NULL);
+
+	printf("NVMe bench: device %d, block # " LBAFU ", count " LBAFU
+	       " ...\n", nvme_curr_dev, blk, cnt);
+	ret = nvme_bench(udev, map_sysmem(addr, cnt * desc->blksz), blk, cnt,
+			 &us_qd1, &us_qdn, &depth);
+	unmap_sysmem((void *)addr);
+	if (ret) {
+		printf("failed (%d)\n", ret);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("queue depth  1: %lu us, %lu KiB/s\n", us_qd1,
+	       nvme_kib_per_sec(cnt, desc->blksz, us_qd1));
+	printf("queue depth %2d: %lu us, %lu KiB/s\n", depth, us_qdn,
+	       nvme_kib_per_sec(cnt, desc->blksz, us_qdn));
+
+	return CMD_RET_SUCCESS;
+}
+
 static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 		   char *const argv[])
 {
@@ -39,6 +84,9 @@ static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 		}
 	}
 
+	if (argc == 5 && !strcmp(argv[1], "bench"))
+		return nvme_do_bench(argv);
+
 	return blk_common_cmd(argc, argv, IF_TYPE_NVME, &nvme_curr_dev);
 }
 
@@ -53,5 +101,8 @@ U_BOOT_CMD(
 	"nvme read addr blk# cnt - read `cnt' blocks starting at block\n"
 	"     `blk#' to memory address `addr'\n"
 	"nvme write addr blk# cnt - write `cnt' blocks starting at block\n"
-	"     `blk#' from memory address `addr'"
+	"     `blk#' from memory address `addr'\n"
+	"nvme bench addr blk# cnt - read `cnt' blocks starting at block\n"
+	"     `blk#' to `addr', one command at a time and then with the\n"
+	"     queues full, and report the throughput of both"
 );
@@ -102,6 +102,13 @@ struct us_data {
 	trans_reset	transport_reset;	/* reset routine */
 	trans_cmnd	transport;		/* transport routine */
 	unsigned short	max_xfer_blk;		/* maximum transfer blocks */
+#if CONFIG_IS_ENABLED(USB_UAS)
+	unsigned char	ep_cmd;			/* UAS command pipe */
+	unsigned char	ep_status;		/* UAS status pipe */
+	unsigned int	uas_streams;		/* UAS commands in flight */
+	void		*uas_iu;		/* command and sense IUs */
+	struct scsi_cmd	*uas_srb;		/* commands of a batch */
+#endif
 };
 
 #if !CONFIG_IS_ENABLED(BLK)
@@ -954,6 +961,306 @@ do_retry:
 	return USB_STOR_TRANSPORT_FAILED;
 }
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+/*
+ * USB Attached SCSI: each command goes out as a command IU on the command
+ * pipe, while its data and its sense IU travel on the data and status pipes
+ * in the bulk stream whose ID is the command's tag. Every transfer of a
+ * command is queued before the command IU is sent, and up to uas_streams
+ * commands are sent together, so the device sees a full queue instead of
+ * one command per round trip.
+ */
+#define UAS_MAX_CMDS		16
+#define UAS_CMD_IU_SIZE		ALIGN(sizeof(struct uas_command_iu), \
+				      ARCH_DMA_MINALIGN)
+#define UAS_SENSE_IU_SIZE	ALIGN(sizeof(struct uas_sense_iu), \
+				      ARCH_DMA_MINALIGN)
+#define UAS_IU_SIZE		(UAS_CMD_IU_SIZE + UAS_SENSE_IU_SIZE)
+#define UAS_MAX_XFER_BLK	2048
+
+static void *uas_cmd_iu(struct us_data *us, int i)
+{
+	return us->uas_iu + i * UAS_IU_SIZE;
+}
+
+static void *uas_sense_iu(struct us_data *us, int i)
+{
+	return us->uas_iu + i * UAS_IU_SIZE + UAS_CMD_IU_SIZE;
+}
+
+static int usb_stor_UAS_reset(struct us_data *us)
+{
+	struct usb_device *udev = us->pusb_dev;
+	struct uas_task_mgmt_iu *tmf = uas_cmd_iu(us, 0);
+	struct uas_response_iu *resp = uas_sense_iu(us, 0);
+	struct usb_stream_xfer xfers[2] = {
+		{
+			.pipe = usb_rcvbulkpipe(udev, us->ep_status),
+			.stream_id = 1,
+			.buffer = resp,
+			.length = sizeof(struct uas_sense_iu),
+		}, {
+			.pipe = usb_sndbulkpipe(udev, us->ep_cmd),
+			.buffer = tmf,
+			.length = sizeof(*tmf),
+		},
+	};
+
+	memset(tmf, 0, sizeof(*tmf));
+	tmf->iu_id = UAS_IU_TASK_MGMT;
+	tmf->tag = cpu_to_be16(1);
+	tmf->function = UAS_TMF_LOGICAL_UNIT_RESET;
+
+	if (usb_bulk_msg_streams(udev, xfers, ARRAY_SIZE(xfers)) ||
+	    resp->iu_id != UAS_IU_RESPONSE ||
+	    (resp->response_code != UAS_RC_TMF_COMPLETE &&
+	     resp->response_code != UAS_RC_TMF_SUCCEEDED)) {
+		printf("UAS: logical unit reset failed\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Run @count commands at once, with tags (and stream IDs) 1..@count. Each
+ * srb gets its SCSI status, transferred byte count and, on CHECK CONDITION,
+ * its sense data filled in.
+ */
+static int usb_stor_UAS_run(struct us_data *us, struct scsi_cmd *srbs,
+			    int count)
+{
+	struct usb_device *udev = us->pusb_dev;
+	struct usb_stream_xfer xfers[UAS_MAX_CMDS * 3];
+	struct usb_stream_xfer *data[UAS_MAX_CMDS];
+	struct usb_stream_xfer *xfer = xfers, *status;
+	struct uas_command_iu *cmd;
+	struct uas_sense_iu *sense;
+	struct scsi_cmd *srb;
+	int result = USB_STOR_TRANSPORT_GOOD;
+	int i;
+
+	memset(xfers, 0, sizeof(xfers));
+
+	/* status and data first, so the device always has somewhere to go */
+	for (i = 0; i < count; i++) {
+		srb = &srbs[i];
+		status = xfer;
+		xfer->pipe = usb_rcvbulkpipe(udev, us->ep_status);
+		xfer->stream_id = i + 1;
+		xfer->buffer = uas_sense_iu(us, i);
+		xfer->length = sizeof(struct uas_sense_iu);
+		xfer++;
+
+		data[i] = NULL;
+		if (!srb->datalen)
+			continue;
+		data[i] = xfer;
+		if (US_DIRECTION(srb->cmd[0]))
+			xfer->pipe = usb_rcvbulkpipe(udev, us->ep_in);
+		else
+			xfer->pipe = usb_sndbulkpipe(udev, us->ep_out);
+		xfer->stream_id = i + 1;
+		xfer->buffer = srb->pdata;
+		xfer->length = srb->datalen;
+		/*
+		 * the sense IU comes after the data phase, or instead of it
+		 * when the command fails early
+		 */
+		status->cancel = xfer;
+		xfer++;
+	}
+
+	for (i = 0; i < count; i++) {
+		srb = &srbs[i];
+		cmd = uas_cmd_iu(us, i);
+		memset(cmd, 0, sizeof(*cmd));
+		cmd->iu_id = UAS_IU_COMMAND;
+		cmd->tag = cpu_to_be16(i + 1);
+		cmd->prio_attr = UAS_SIMPLE_TAG;
+		cmd->lun[1] = srb->lun;
+		memcpy(cmd->cdb, srb->cmd, min_t(int, srb->cmdlen,
+						 sizeof(cmd->cdb)));
+		xfer->pipe = usb_sndbulkpipe(udev, us->ep_cmd);
+		xfer->buffer = cmd;
+		xfer->length = sizeof(*cmd);
+		xfer++;
+	}
+
+	if (usb_bulk_msg_streams(udev, xfers, xfer - xfers)) {
+		debug("UAS transfer failed, status %lx\n", udev->status);
+		usb_stor_UAS_reset(us);
+		return USB_STOR_TRANSPORT_ERROR;
+	}
+
+	for (i = 0; i < count; i++) {
+		srb = &srbs[i];
+		sense = uas_sense_iu(us, i);
+		srb->trans_bytes = data[i] ? data[i]->act_len : 0;
+		if (sense->iu_id != UAS_IU_SENSE ||
+		    be16_to_cpu(sense->tag) != i + 1) {
+			debug("UAS: unexpected IU %x for tag %d\n",
+			      sense->iu_id, i + 1);
+			result = USB_STOR_TRANSPORT_ERROR;
+			continue;
+		}
+
+		srb->status = sense->status;
+		if (srb->status == S_GOOD)
+			continue;
+		memcpy(srb->sense_buf, sense->sense,
+		       min_t(int, be16_to_cpu(sense->len),
+			     sizeof(srb->sense_buf)));
+		if (result == USB_STOR_TRANSPORT_GOOD)
+			result = USB_STOR_TRANSPORT_FAILED;
+	}
+
+	return result;
+}
+
+static int usb_stor_UAS_transport(struct scsi_cmd *srb, struct us_data *us)
+{
+	return usb_stor_UAS_run(us, srb, 1);
+}
+
+/*
+ * Switch the interface to its UAS alternate setting if it has one and the
+ * device and host controller can do bulk streams. Returns -ENODEV if the
+ * device should keep using Bulk-Only Transport.
+ */
+static int usb_stor_UAS_probe(struct usb_device *dev,
+			      struct usb_interface *iface, struct us_data *ss)
+{
+	struct usb_descriptor_header *head;
+	struct usb_interface_descriptor *if_desc;
+	struct usb_endpoint_descriptor *ep_desc = NULL;
+	struct usb_ss_ep_comp_descriptor *comp_desc;
+	unsigned char ep_cmd = 0, ep_status = 0, ep_in = 0, ep_out = 0;
+	unsigned int max_streams = UAS_MAX_CMDS, ep_streams = 0;
+	unsigned long pipes[3];
+	unsigned char *buf;
+	bool in_uas = false;
+	int alt = -1, len, index, epnum, ret;
+
+	if (dev->speed < USB_SPEED_SUPER)
+		return -ENODEV;
+
+	len = usb_get_configuration_len(dev, dev->configno);
+	if (len < 0)
+		return -ENODEV;
+	buf = malloc_cache_aligned(len);
+	if (!buf)
+		return -ENOMEM;
+	ret = usb_get_configuration_no(dev, dev->configno, buf, len);
+	if (ret < 0)
+		goto out;
+
+	for (index = 0; index + 2 < len; index += head->bLength) {
+		head = (struct usb_descriptor_header *)&buf[index];
+		if (!head->bLength)
+			break;
+
+		switch (head->bDescriptorType) {
+		case USB_DT_INTERFACE:
+			if_desc = (struct usb_interface_descriptor *)head;
+			in_uas = if_desc->bInterfaceNumber ==
+					iface->desc.bInterfaceNumber &&
+				 if_desc->bInterfaceClass ==
+					USB_CLASS_MASS_STORAGE &&
+				 if_desc->bInterfaceSubClass == US_SC_SCSI &&
+				 if_desc->bInterfaceProtocol == US_PR_UAS;
+			if (in_uas)
+				alt = if_desc->bAlternateSetting;
+			ep_desc = NULL;
+			break;
+		case USB_DT_ENDPOINT:
+			ep_desc = (struct usb_endpoint_descriptor *)head;
+			ep_streams = 0;
+			break;
+		case USB_DT_SS_ENDPOINT_COMP:
+			comp_desc = (struct usb_ss_ep_comp_descriptor *)head;
+			if (comp_desc->bmAttributes & 0x1f)
+				ep_streams = 1 << (comp_desc->bmAttributes &
+						   0x1f);
+			break;
+		case USB_DT_PIPE_USAGE:
+			if (!in_uas || !ep_desc)
+				break;
+			epnum = ep_desc->bEndpointAddress &
+				USB_ENDPOINT_NUMBER_MASK;
+			switch (buf[index + 2]) {
+			case UAS_PIPE_CMD:
+				ep_cmd = epnum;
+				continue;
+			case UAS_PIPE_STATUS:
+				ep_status = epnum;
+				break;
+			case UAS_PIPE_DATA_IN:
+				ep_in = epnum;
+				break;
+			case UAS_PIPE_DATA_OUT:
+				ep_out = epnum;
+				break;
+			}
+			max_streams = min(max_streams, ep_streams);
+			break;
+		}
+	}
+
+	ret = -ENODEV;
+	if (alt < 0 || !ep_cmd || !ep_status || !ep_in || !ep_out ||
+	    max_streams < 1)
+		goto out;
+
+	debug("UAS: alt %d, cmd %d status %d in %d out %d, %u streams\n",
+	      alt, ep_cmd, ep_status, ep_in, ep_out, max_streams);
+
+	/* stream-less hosts (everything but xHCI) stay with Bulk-Only */
+	pipes[0] = usb_rcvbulkpipe(dev, ep_status);
+	pipes[1] = usb_rcvbulkpipe(dev, ep_in);
+	pipes[2] = usb_sndbulkpipe(dev, ep_out);
+	ret = usb_alloc_streams(dev, pipes, ARRAY_SIZE(pipes), max_streams);
+	if (ret < 1) {
+		debug("UAS: no bulk streams (%d)\n", ret);
+		ret = -ENODEV;
+		goto out;
+	}
+	ss->uas_streams = min_t(unsigned int, ret, UAS_MAX_CMDS);
+
+	ss->uas_iu = malloc_cache_aligned(ss->uas_streams * UAS_IU_SIZE);
+	ss->uas_srb = calloc(ss->uas_streams, sizeof(struct scsi_cmd));
+	if (!ss->uas_iu || !ss->uas_srb) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = usb_set_interface(dev, iface->desc.bInterfaceNumber, alt);
+	if (ret)
+		goto out;
+	iface->act_altsetting = alt;
+
+	ss->ep_cmd = ep_cmd;
+	ss->ep_status = ep_status;
+	ss->ep_in = ep_in;
+	ss->ep_out = ep_out;
+	ss->protocol = US_PR_UAS;
+	ss->transport = usb_stor_UAS_transport;
+	ss->transport_reset = usb_stor_UAS_reset;
+	debug("Transport: USB Attached SCSI, %u commands in flight\n",
+	      ss->uas_streams);
+out:
+	if (ret) {
+		free(ss->uas_iu);
+		free(ss->uas_srb);
+		ss->uas_iu = NULL;
+		ss->uas_srb = NULL;
+	}
+	free(buf);
+
+	return ret;
+}
+#endif
+
 static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 				      struct us_data *us)
 {
@@ -973,9 +1280,17 @@ static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 	 * Windows 7 limiting transfers to 128 sectors for both USB2 and USB3
 	 * and Apple Mac OS X 10.11 limiting transfers to 256 sectors for USB2
 	 * and 2048 for USB3 devices.
+	 *
+	 * UAS devices are USB3 only and postdate those limitations, so they
+	 * get the larger size.
 	 */
 	unsigned short blk = 240;
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+	if (us->protocol == US_PR_UAS)
+		blk = UAS_MAX_XFER_BLK;
+#endif
+
 #if CONFIG_IS_ENABLED(DM_USB)
 	size_t size;
 	int ret;
@@ -1081,11 +1396,11 @@ static int usb_read_capacity(struct scsi_cmd *srb, struct us_data *ss)
 	return -1;
 }
 
-static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
-		       unsigned long start, unsigned short blocks)
+static void usb_rw10_setup(struct scsi_cmd *srb, unsigned char opcode,
+			   unsigned long start, unsigned short blocks)
 {
 	memset(&srb->cmd[0], 0, 12);
-	srb->cmd[0] = SCSI_READ10;
+	srb->cmd[0] = opcode;
 	srb->cmd[1] = srb->lun << 5;
 	srb->cmd[2] = ((unsigned char) (start >> 24)) & 0xff;
 	srb->cmd[3] = ((unsigned char) (start >> 16)) & 0xff;
@@ -1094,6 +1409,12 @@ static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
 	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
 	srb->cmd[8] = (unsigned char) blocks & 0xff;
 	srb->cmdlen = 12;
+}
+
+static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
+		       unsigned long start, unsigned short blocks)
+{
+	usb_rw10_setup(srb, SCSI_READ10, start, blocks);
 	debug("read10: start %lx blocks %x\n", start, blocks);
 	return ss->transport(srb, ss);
 }
@@ -1101,20 +1422,64 @@ static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
 static int usb_write_10(struct scsi_cmd *srb, struct us_data *ss,
 			unsigned long start, unsigned short blocks)
 {
-	memset(&srb->cmd[0], 0, 12);
-	srb->cmd[0] = SCSI_WRITE10;
-	srb->cmd[1] = srb->lun << 5;
-	srb->cmd[2] = ((unsigned char) (start >> 24)) & 0xff;
-	srb->cmd[3] = ((unsigned char) (start >> 16)) & 0xff;
-	srb->cmd[4] = ((unsigned char) (start >> 8)) & 0xff;
-	srb->cmd[5] = ((unsigned char) (start)) & 0xff;
-	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
-	srb->cmd[8] = (unsigned char) blocks & 0xff;
-	srb->cmdlen = 12;
+	usb_rw10_setup(srb, SCSI_WRITE10, start, blocks);
 	debug("write10: start %lx blocks %x\n", start, blocks);
 	return ss->transport(srb, ss);
 }
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+/*
+ * Split the request into max_xfer_blk sized READ(10)/WRITE(10) commands and
+ * issue up to uas_streams of them at a time. Returns the number of blocks
+ * transferred.
+ */
+static lbaint_t usb_stor_UAS_rw(struct us_data *ss,
+				struct blk_desc *block_dev, lbaint_t start,
+				lbaint_t blkcnt, uintptr_t buf_addr, bool write)
+{
+	struct scsi_cmd *srb;
+	lbaint_t done = 0, blks;
+	int count, retry, i;
+
+	while (done < blkcnt) {
+		count = 0;
+		blks = 0;
+		while (count < ss->uas_streams && done + blks < blkcnt) {
+			srb = &ss->uas_srb[count++];
+			memset(srb, 0, sizeof(*srb));
+			srb->lun = block_dev->lun;
+			srb->datalen = min_t(lbaint_t, blkcnt - done - blks,
+					     ss->max_xfer_blk);
+			usb_rw10_setup(srb, write ? SCSI_WRITE10 : SCSI_READ10,
+				       start + done + blks, srb->datalen);
+			srb->pdata = (unsigned char *)buf_addr +
+				     (done + blks) * block_dev->blksz;
+			blks += srb->datalen;
+			srb->datalen *= block_dev->blksz;
+		}
+
+		debug("uas %s: start " LBAF " blocks " LBAF " in %d cmds\n",
+		      write ? "write" : "read", start + done, blks, count);
+		usb_show_progress();
+		for (retry = 2; retry >= 0; retry--) {
+			if (usb_stor_UAS_run(ss, ss->uas_srb, count) ==
+			    USB_STOR_TRANSPORT_GOOD)
+				break;
+			for (i = 0; i < count; i++)
+				ss->uas_srb[i].status = 0;
+		}
+		if (retry < 0) {
+			debug("%s ERROR\n", write ? "Write" : "Read");
+			ss->flags &= ~USB_READY;
+			break;
+		}
+		done += blks;
+	}
+
+	return done;
+}
+#endif
+
 
 #ifdef CONFIG_USB_BIN_FIXUP
 /*
@@ -1185,6 +1550,14 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	debug("\nusb_read: dev %d startblk " LBAF ", blccnt " LBAF " buffer %lx\n",
 	      block_dev->devnum, start, blks, buf_addr);
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+	if (ss->protocol == US_PR_UAS) {
+		blkcnt = usb_stor_UAS_rw(ss, block_dev, start, blkcnt,
+					 buf_addr, false);
+		goto out;
+	}
+#endif
+
 	do {
 		/* XXX need some comment here */
 		retry = 2;
@@ -1215,6 +1588,9 @@ retry_it:
 	debug("usb_read: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+out:
+#endif
 	usb_lock_async(udev, 0);
 	usb_disable_asynch(0); /* asynch transfer allowed */
 	if (blkcnt >= ss->max_xfer_blk)
@@ -1270,6 +1646,14 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 	debug("\nusb_write: dev %d startblk " LBAF ", blccnt " LBAF " buffer %lx\n",
 	      block_dev->devnum, start, blks, buf_addr);
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+	if (ss->protocol == US_PR_UAS) {
+		blkcnt = usb_stor_UAS_rw(ss, block_dev, start, blkcnt,
+					 buf_addr, true);
+		goto out;
+	}
+#endif
+
 	do {
 		/* If write fails retry for max retry count else
 		 * return with number of blocks written successfully.
@@ -1302,6 +1686,9 @@ retry_it:
 	debug("usb_write: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+out:
+#endif
 	usb_lock_async(udev, 0);
 	usb_disable_asynch(0); /* asynch transfer allowed */
 	if (blkcnt >= ss->max_xfer_blk)
@@ -1426,6 +1813,18 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 		dev->irq_handle = usb_stor_irq;
 	}
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+	/* prefer UAS over Bulk-Only when the device and host can do it */
+	if (ss->subclass == US_SC_SCSI) {
+		int ret = usb_stor_UAS_probe(dev, iface, ss);
+
+		if (ret && ret != -ENODEV) {
+			printf("UAS setup failed (err=%d)\n", ret);
+			return 0;
+		}
+	}
+#endif
+
 	/* Set the maximum transfer size per host controller setting */
 	usb_stor_set_max_xfer_blk(dev, ss);
 
@@ -1533,6 +1932,20 @@ static int usb_mass_storage_probe(struct udevice *dev)
 	return ret;
 }
 
+#if CONFIG_IS_ENABLED(USB_UAS)
+static int usb_mass_storage_remove(struct udevice *dev)
+{
+	struct us_data *ss = dev_get_plat(dev);
+
+	free(ss->uas_iu);
+	free(ss->uas_srb);
+	ss->uas_iu = NULL;
+	ss->uas_srb = NULL;
+
+	return 0;
+}
+#endif
+
 static const struct udevice_id usb_mass_storage_ids[] = {
 	{ .compatible = "usb-mass-storage" },
 	{ }
@@ -1543,6 +1956,9 @@ U_BOOT_DRIVER(usb_mass_storage) = {
 	.id	= UCLASS_MASS_STORAGE,
 	.of_match = usb_mass_storage_ids,
 	.probe = usb_mass_storage_probe,
+#if CONFIG_IS_ENABLED(USB_UAS)
+	.remove = usb_mass_storage_remove,
+#endif
 #if CONFIG_IS_ENABLED(BLK)
 	.plat_auto	= sizeof(struct us_data),
 #endif
@@ -10,6 +10,7 @@
 
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
 #include <log.h>
 #include <part.h>
 #include <vsprintf.h>
@@ -217,6 +218,8 @@ unsigned long dev_write(struct udevice *dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_readahead_invalidate(block_dev);
+	fs_mount_invalidate(block_dev);
 
 	return ops->write(dev, start, blkcnt, buffer);
 }
@@ -236,6 +239,8 @@ unsigned long dev_erase(struct udevice *dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_readahead_invalidate(block_dev);
+	fs_mount_invalidate(block_dev);
 
 	return ops->erase(dev, start, blkcnt);
 }
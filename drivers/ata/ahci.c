@@ -87,14 +87,30 @@ static void ahci_dcache_invalidate_range(unsigned long begin, unsigned long len)
 	invalidate_dcache_range(start, end);
 }
 
+static ulong ahci_cmd_tbl(struct ahci_ioports *pp, int slot)
+{
+	return pp->cmd_tbl + slot * (AHCI_CMD_TBL_SZ);
+}
+
 /*
- * Ensure data for SATA controller is flushed out of dcache and
- * written to physical memory.
+ * Ensure the command header and command table of each slot in @slots are
+ * flushed out of dcache and written to physical memory.
  */
-static void ahci_dcache_flush_sata_cmd(struct ahci_ioports *pp)
+static void ahci_dcache_flush_sata_cmd(struct ahci_ioports *pp, u32 slots)
 {
-	ahci_dcache_flush_range((unsigned long)pp->cmd_slot,
-				AHCI_PORT_PRIV_DMA_SZ);
+	unsigned long hdr;
+	int slot;
+
+	for (slot = 0; slots; slot++, slots >>= 1) {
+		if (!(slots & 1))
+			continue;
+		/* a header is smaller than a cache line */
+		hdr = round_down((unsigned long)&pp->cmd_slot[slot],
+				 ARCH_DMA_MINALIGN);
+		ahci_dcache_flush_range(hdr, ARCH_DMA_MINALIGN);
+		ahci_dcache_flush_range(ahci_cmd_tbl(pp, slot),
+					AHCI_CMD_TBL_SZ);
+	}
 }
 
 static int waiting_for_cmd_completed(void __iomem *offset,
@@ -448,11 +464,9 @@ static int ahci_init_one(struct ahci_uc_priv *uc_priv, struct udevice *dev)
 
 #define MAX_DATA_BYTE_COUNT  (4*1024*1024)
 
-static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port,
+static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, struct ahci_sg *ahci_sg,
 			unsigned char *buf, int buf_len)
 {
-	struct ahci_ioports *pp = &(uc_priv->port[port]);
-	struct ahci_sg *ahci_sg = pp->cmd_tbl_sg;
 	phys_addr_t pa = virt_to_phys(buf);
 	u32 sg_count;
 	int i;
@@ -482,15 +496,16 @@ static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port,
 	return sg_count;
 }
 
-static void ahci_fill_cmd_slot(struct ahci_ioports *pp, u32 opts)
+static void ahci_fill_cmd_slot(struct ahci_ioports *pp, int slot, u32 opts)
 {
-	phys_addr_t pa = virt_to_phys((void *)pp->cmd_tbl);
+	struct ahci_cmd_hdr *cmd_slot = &pp->cmd_slot[slot];
+	phys_addr_t pa = virt_to_phys((void *)ahci_cmd_tbl(pp, slot));
 
-	pp->cmd_slot->opts = cpu_to_le32(opts);
-	pp->cmd_slot->status = 0;
-	pp->cmd_slot->tbl_addr = cpu_to_le32(lower_32_bits(pa));
+	cmd_slot->opts = cpu_to_le32(opts);
+	cmd_slot->status = 0;
+	cmd_slot->tbl_addr = cpu_to_le32(lower_32_bits(pa));
 #ifdef CONFIG_PHYS_64BIT
-	pp->cmd_slot->tbl_addr_hi = cpu_to_le32(upper_32_bits(pa));
+	cmd_slot->tbl_addr_hi = cpu_to_le32(upper_32_bits(pa));
 #endif
 }
 
@@ -532,6 +547,8 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 		return -ENOMEM;
 	}
 	memset(mem, 0, AHCI_PORT_PRIV_DMA_SZ);
+	/* from here on only the slots issued are flushed */
+	ahci_dcache_flush_range((unsigned long)mem, AHCI_PORT_PRIV_DMA_SZ);
 
 	/*
 	 * First item in chunk of DMA memory: 32-slot command table,
@@ -540,7 +557,7 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 	pp->cmd_slot =
 		(struct ahci_cmd_hdr *)(uintptr_t)virt_to_phys((void *)mem);
 	debug("cmd_slot = %p\n", pp->cmd_slot);
-	mem += (AHCI_CMD_SLOT_SZ + 224);
+	mem += AHCI_CMD_LIST_SZ;
 
 	/*
 	 * Second item: Received-FIS area
@@ -549,8 +566,8 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 	mem += AHCI_RX_FIS_SZ;
 
 	/*
-	 * Third item: data area for storing a single command
-	 * and its scatter-gather table
+	 * Third item: data area for storing the command and scatter-gather
+	 * table of each slot
 	 */
 	pp->cmd_tbl = virt_to_phys((void *)mem);
 	debug("cmd_tbl_dma = %lx\n", pp->cmd_tbl);
@@ -609,11 +626,11 @@ static int ahci_device_data_io(struct ahci_uc_priv *uc_priv, u8 port, u8 *fis,
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, fis_len);
 
-	sg_count = ahci_fill_sg(uc_priv, port, buf, buf_len);
+	sg_count = ahci_fill_sg(uc_priv, pp->cmd_tbl_sg, buf, buf_len);
 	opts = (fis_len >> 2) | (sg_count << 16) | (is_write << 6);
-	ahci_fill_cmd_slot(pp, opts);
+	ahci_fill_cmd_slot(pp, 0, opts);
 
-	ahci_dcache_flush_sata_cmd(pp);
+	ahci_dcache_flush_sata_cmd(pp, BIT(0));
 	ahci_dcache_flush_range((unsigned long)buf, (unsigned long)buf_len);
 
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
@@ -632,6 +649,207 @@ static int ahci_device_data_io(struct ahci_uc_priv *uc_priv, u8 port, u8 *fis,
 	return 0;
 }
 
+/*
+ * Reset the link to the drive with a COMRESET. This clears whatever state the
+ * drive was left in, including queued commands and NCQ error conditions.
+ */
+static int ahci_port_comreset(struct ahci_uc_priv *uc_priv, u8 port)
+{
+	void __iomem *port_mmio = uc_priv->port[port].port_mmio;
+	u32 tmp;
+
+	debug("scsi_ahci: COMRESET on port %d\n", port);
+	tmp = readl(port_mmio + PORT_SCR_CTL) & ~PORT_SCR_CTL_DET_MASK;
+	writel_with_flush(tmp | PORT_SCR_CTL_DET_COMRESET,
+			  port_mmio + PORT_SCR_CTL);
+	msleep(1);
+	writel_with_flush(tmp, port_mmio + PORT_SCR_CTL);
+
+	if (ahci_link_up(uc_priv, port))
+		return -ENOLINK;
+	writel(readl(port_mmio + PORT_SCR_ERR), port_mmio + PORT_SCR_ERR);
+
+	return wait_spinup(port_mmio);
+}
+
+/*
+ * After an NCQ error the drive aborts every command until the NCQ command
+ * error log has been read, so read it and report the failed tag.
+ */
+static int ahci_read_ncq_log(struct ahci_uc_priv *uc_priv, u8 port)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, log, ATA_SECT_SIZE);
+	u8 fis[20];
+
+	memset(fis, 0, sizeof(fis));
+	fis[0] = 0x27;		/* Host to device FIS. */
+	fis[1] = 1 << 7;	/* Command FIS. */
+	fis[2] = ATA_CMD_READ_LOG_EXT;
+	fis[4] = ATA_LOG_SATA_NCQ;	/* log address */
+	fis[12] = 1;			/* one page */
+
+	if (ahci_device_data_io(uc_priv, port, fis, sizeof(fis), log,
+				ATA_SECT_SIZE, 0))
+		return -EIO;
+
+	if (!(log[0] & BIT(7)))
+		debug("scsi_ahci: port %d tag %d failed, status %02x error %02x\n",
+		      port, log[0] & 0x1f, log[2], log[3]);
+
+	return 0;
+}
+
+/*
+ * Bring a port back after a failed queued command: stopping the command list
+ * DMA engine clears PORT_CMD_ISSUE and PORT_SCR_ACT, so that any commands
+ * still outstanding are dropped on the host side. The drive itself is reset
+ * if it still holds commands or is stuck busy, otherwise its NCQ error state
+ * is cleared by reading the error log.
+ */
+static int ahci_port_restart(struct ahci_uc_priv *uc_priv, u8 port,
+			     bool timed_out)
+{
+	void __iomem *port_mmio = uc_priv->port[port].port_mmio;
+	bool reset = timed_out;
+	ulong start;
+	u32 tmp;
+	int ret;
+
+	tmp = readl(port_mmio + PORT_CMD);
+	writel_with_flush(tmp & ~PORT_CMD_START, port_mmio + PORT_CMD);
+
+	start = get_timer(0);
+	while (readl(port_mmio + PORT_CMD) & PORT_CMD_LIST_ON) {
+		if (get_timer(start) > 500) {
+			reset = true;
+			break;
+		}
+		udelay(100);
+	}
+
+	if (readl(port_mmio + PORT_TFDATA) & (ATA_BUSY | ATA_DRQ))
+		reset = true;
+
+	if (reset) {
+		ret = ahci_port_comreset(uc_priv, port);
+		if (ret) {
+			printf("scsi_ahci: port %d did not recover\n", port);
+			return ret;
+		}
+	}
+
+	writel(readl(port_mmio + PORT_SCR_ERR), port_mmio + PORT_SCR_ERR);
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+	writel_with_flush(tmp | PORT_CMD_START, port_mmio + PORT_CMD);
+
+	if (!reset)
+		return ahci_read_ncq_log(uc_priv, port);
+
+	return 0;
+}
+
+/*
+ * Read @blocks sectors with READ FPDMA QUEUED, keeping up to pp->ncq_depth
+ * commands outstanding on the drive at once. Each command transfers up to
+ * MAX_SATA_BLOCKS_READ_WRITE sectors into its own part of @buf.
+ */
+static int ahci_ncq_read(struct ahci_uc_priv *uc_priv, u8 port, lbaint_t lba,
+			 u32 blocks, u8 *buf)
+{
+	struct ahci_ioports *pp = &(uc_priv->port[port]);
+	void __iomem *port_mmio = pp->port_mmio;
+	ulong len = (ulong)blocks * ATA_SECT_SIZE;
+	u8 *data = buf;
+	u32 busy = 0, issue, done;
+	bool timed_out = false;
+	ulong start;
+	u8 fis[20];
+
+	debug("%s: port %d, %u blocks from lba 0x" LBAFU "\n", __func__, port,
+	      blocks, lba);
+
+	ahci_dcache_flush_range((unsigned long)data, len);
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+
+	start = get_timer(0);
+	while (blocks || busy) {
+		/* hand out every free tag, then issue the whole batch */
+		issue = 0;
+		while (blocks && hweight32(busy | issue) < pp->ncq_depth) {
+			u16 now_blocks = min_t(u32, MAX_SATA_BLOCKS_READ_WRITE,
+					       blocks);
+			int tag = ffs(~(busy | issue)) - 1;
+			ulong tbl = ahci_cmd_tbl(pp, tag);
+			int sg_count;
+
+			memset(fis, 0, sizeof(fis));
+			fis[0] = 0x27;		/* Host to device FIS. */
+			fis[1] = 1 << 7;	/* Command FIS. */
+			fis[2] = ATA_CMD_FPDMA_READ;
+			fis[3] = now_blocks & 0xff;	/* count in features */
+			fis[4] = (lba >> 0) & 0xff;
+			fis[5] = (lba >> 8) & 0xff;
+			fis[6] = (lba >> 16) & 0xff;
+			fis[7] = 1 << 6; /* device reg: set LBA mode */
+			fis[8] = (lba >> 24) & 0xff;
+#ifdef CONFIG_SYS_64BIT_LBA
+			fis[9] = (lba >> 32) & 0xff;
+			fis[10] = (lba >> 40) & 0xff;
+#endif
+			fis[11] = (now_blocks >> 8) & 0xff;
+			fis[12] = tag << 3;		/* NCQ tag */
+
+			memcpy((unsigned char *)tbl, fis, sizeof(fis));
+			sg_count = ahci_fill_sg(uc_priv, (struct ahci_sg *)
+						(tbl + AHCI_CMD_TBL_HDR), buf,
+						now_blocks * ATA_SECT_SIZE);
+			if (sg_count < 0)
+				return -EIO;
+			ahci_fill_cmd_slot(pp, tag,
+					   (sizeof(fis) >> 2) | (sg_count << 16));
+
+			issue |= BIT(tag);
+			buf += now_blocks * ATA_SECT_SIZE;
+			blocks -= now_blocks;
+			lba += now_blocks;
+		}
+
+		if (issue) {
+			ahci_dcache_flush_sata_cmd(pp, issue);
+			writel(issue, port_mmio + PORT_SCR_ACT);
+			writel_with_flush(issue, port_mmio + PORT_CMD_ISSUE);
+			busy |= issue;
+		}
+
+		/* the drive clears a tag's SActive bit when it completes */
+		done = busy & ~readl(port_mmio + PORT_SCR_ACT);
+		if (done) {
+			busy &= ~done;
+			start = get_timer(0);
+		} else if (readl(port_mmio + PORT_IRQ_STAT) &
+			   (PORT_IRQ_FATAL) ||
+			   readl(port_mmio + PORT_TFDATA) & ATA_ERR) {
+			printf("scsi_ahci: NCQ read error on port %d\n", port);
+			break;
+		} else if (get_timer(start) > WAIT_MS_DATAIO) {
+			printf("scsi_ahci: NCQ read timeout on port %d\n", port);
+			timed_out = true;
+			break;
+		}
+	}
+
+	if (busy || blocks) {
+		/* fall back to non-queued commands from now on */
+		pp->ncq_depth = 0;
+		ahci_port_restart(uc_priv, port, timed_out);
+		return -EIO;
+	}
+
+	ahci_dcache_invalidate_range((unsigned long)data, len);
+
+	return 0;
+}
+
 static char *ata_id_strcpy(u16 *target, u16 *src, int len)
 {
 	int i;
@@ -655,6 +873,7 @@ static int ata_scsiop_inquiry(struct ahci_uc_priv *uc_priv,
 	};
 	u8 fis[20];
 	u16 *idbuf;
+	struct ahci_ioports *pp;
 	ALLOC_CACHE_ALIGN_BUFFER(u16, tmpid, ATA_ID_WORDS);
 	u8 port;
 
@@ -694,6 +913,18 @@ static int ata_scsiop_inquiry(struct ahci_uc_priv *uc_priv,
 	memcpy(idbuf, tmpid, ATA_ID_WORDS * 2);
 	ata_swap_buf_le16(idbuf, ATA_ID_WORDS);
 
+	/* use native command queuing for reads if both ends support it */
+	pp = &uc_priv->port[port];
+	pp->ncq_depth = 0;
+	if ((uc_priv->cap & HOST_CAP_NCQ) && ata_id_has_ncq(idbuf)) {
+		pp->ncq_depth = min_t(int, ata_id_queue_depth(idbuf),
+				      HOST_CAP_NCS(uc_priv->cap));
+		if (pp->ncq_depth < 2)
+			pp->ncq_depth = 0;
+		debug("scsi_ahci: port %d NCQ depth %d\n", port,
+		      pp->ncq_depth);
+	}
+
 	memcpy(&pccb->pdata[8], "ATA     ", 8);
 	ata_id_strcpy((u16 *)&pccb->pdata[16], &idbuf[ATA_ID_PROD], 16);
 	ata_id_strcpy((u16 *)&pccb->pdata[32], &idbuf[ATA_ID_FW_REV], 4);
@@ -746,6 +977,21 @@ static int ata_scsiop_read_write(struct ahci_uc_priv *uc_priv,
 	debug("scsi_ahci: %s %u blocks starting from lba 0x" LBAFU "\n",
 	      is_write ?  "write" : "read", blocks, lba);
 
+	/*
+	 * Reads are queued to the drive in one go when it does NCQ; writes
+	 * stay one command at a time since each is followed by a flush.
+	 */
+	if (!is_write && uc_priv->port[pccb->target].ncq_depth) {
+		if (ATA_SECT_SIZE * blocks > user_buffer_size) {
+			printf("scsi_ahci: Error: buffer too small.\n");
+			return -EIO;
+		}
+		if (!ahci_ncq_read(uc_priv, pccb->target, lba, blocks,
+				   user_buffer))
+			return 0;
+		/* the port has dropped back to non-queued reads; retry */
+	}
+
 	/* Preset the FIS */
 	memset(fis, 0, sizeof(fis));
 	fis[0] = 0x27;		 /* Host to device FIS. */
@@ -1072,8 +1318,8 @@ static int ata_io_flush(struct ahci_uc_priv *uc_priv, u8 port)
 	fis[2] = ATA_CMD_FLUSH_EXT;
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, 20);
-	ahci_fill_cmd_slot(pp, cmd_fis_len);
-	ahci_dcache_flush_sata_cmd(pp);
+	ahci_fill_cmd_slot(pp, 0, cmd_fis_len);
+	ahci_dcache_flush_sata_cmd(pp, BIT(0));
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
 
 	if (waiting_for_cmd_completed(port_mmio + PORT_CMD_ISSUE,
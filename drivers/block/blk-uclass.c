@@ -9,8 +9,10 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -436,6 +438,158 @@ int blk_get_device(int if_type, int devnum, struct udevice **devp)
 	return device_probe(*devp);
 }
 
+/**
+ * struct blk_readahead - sequential readahead state of a block device
+ *
+ * @buf:	Readahead buffer, allocated on first use
+ * @start:	First block held in @buf
+ * @count:	Number of valid blocks in @buf
+ * @next:	Block which continues the last read, if the access is
+ *		sequential; (lbaint_t)-1 before the first read
+ * @window:	Current readahead window in blocks, 0 if the access
+ *		pattern is not (yet) sequential
+ * @hwpart:	Hardware partition the buffer was filled from
+ */
+struct blk_readahead {
+	char *buf;
+	lbaint_t start;
+	lbaint_t count;
+	lbaint_t next;
+	lbaint_t window;
+	int hwpart;
+};
+
+/**
+ * struct blk_uclass_priv - uclass-private data of a block device
+ *
+ * @queue_depth:	Maximum number of requests the driver accepts through
+ *			its submit() method before one must be reaped
+ * @in_flight:		Number of submitted requests not yet completed
+ * @ra:			Readahead state
+ */
+struct blk_uclass_priv {
+	int queue_depth;
+	int in_flight;
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	struct blk_readahead ra;
+#endif
+};
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/* smallest window used once a sequential access has been detected */
+#define BLK_RA_MIN_BLOCKS	16
+
+void blk_readahead_invalidate(struct blk_desc *block_dev)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(block_dev->bdev);
+
+	if (priv) {
+		priv->ra.count = 0;
+		priv->ra.window = 0;
+	}
+}
+
+static lbaint_t blk_ra_max_blocks(struct blk_desc *block_dev)
+{
+	return CONFIG_BLK_READAHEAD_SIZE / block_dev->blksz;
+}
+
+/*
+ * Serve a read through the readahead buffer. Reads which continue the
+ * previous one grow the window, up to the buffer size; anything else is
+ * passed straight to the driver and resets the window.
+ */
+static ulong blk_ra_read(struct blk_desc *block_dev, lbaint_t start,
+			 lbaint_t blkcnt, void *buffer)
+{
+	struct udevice *dev = block_dev->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+	lbaint_t max = blk_ra_max_blocks(block_dev);
+	lbaint_t done = 0, n, want;
+	struct blk_readahead *ra;
+	ulong blks_read;
+
+	if (!priv || !max)
+		return ops->read(dev, start, blkcnt, buffer);
+	ra = &priv->ra;
+
+	if (ra->hwpart != block_dev->hwpart) {
+		ra->count = 0;
+		ra->window = 0;
+		ra->hwpart = block_dev->hwpart;
+	}
+
+	if (start != ra->next)
+		ra->window = 0;
+	else if (ra->window)
+		ra->window = min_t(lbaint_t, ra->window * 2, max);
+	else
+		ra->window = min_t(lbaint_t, max_t(lbaint_t, blkcnt * 4,
+						   BLK_RA_MIN_BLOCKS), max);
+	ra->next = start + blkcnt;
+
+	while (done < blkcnt) {
+		lbaint_t blk = start + done;
+
+		/* copy whatever the buffer already holds */
+		if (ra->count && blk >= ra->start &&
+		    blk < ra->start + ra->count) {
+			n = min(blkcnt - done, ra->start + ra->count - blk);
+			memcpy(buffer + done * block_dev->blksz,
+			       ra->buf + (blk - ra->start) * block_dev->blksz,
+			       n * block_dev->blksz);
+			done += n;
+			continue;
+		}
+
+		want = blkcnt - done;
+		if (!ra->window || want >= ra->window)
+			break;
+
+		if (!ra->buf) {
+			ra->buf = malloc_cache_aligned(max * block_dev->blksz);
+			if (!ra->buf)
+				break;
+		}
+
+		n = ra->window;
+		if (block_dev->lba && blk + n > block_dev->lba)
+			n = block_dev->lba > blk ? block_dev->lba - blk : 0;
+		if (n <= want)
+			break;
+
+		log_debug("readahead: start " LBAF ", count " LBAFU "\n",
+			  blk, n);
+		ra->count = 0;
+		blks_read = ops->read(dev, blk, n, ra->buf);
+		if (blks_read != n)
+			break;
+		ra->start = blk;
+		ra->count = n;
+	}
+
+	if (done == blkcnt)
+		return blkcnt;
+
+	/* large or random reads go straight to the caller's buffer */
+	blks_read = ops->read(dev, start + done, blkcnt - done,
+			      buffer + done * block_dev->blksz);
+	if (IS_ERR_VALUE(blks_read))
+		return done ? done : blks_read;
+
+	return done + blks_read;
+}
+#else
+static ulong blk_ra_read(struct blk_desc *block_dev, lbaint_t start,
+			 lbaint_t blkcnt, void *buffer)
+{
+	struct udevice *dev = block_dev->bdev;
+
+	return blk_get_ops(dev)->read(dev, start, blkcnt, buffer);
+}
+#endif
+
 unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			lbaint_t blkcnt, void *buffer)
 {
@@ -449,7 +603,7 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
-	blks_read = ops->read(dev, start, blkcnt, buffer);
+	blks_read = blk_ra_read(block_dev, start, blkcnt, buffer);
 	if (blks_read == blkcnt)
 		blkcache_fill(block_dev->if_type, block_dev->devnum,
 			      start, blkcnt, block_dev->blksz, buffer);
@@ -457,6 +611,14 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	return blks_read;
 }
 
+/* drop whatever was read from the device before a change to it */
+static void blk_invalidate(struct blk_desc *desc)
+{
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	blk_readahead_invalidate(desc);
+	fs_mount_invalidate(desc);
+}
+
 unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt, const void *buffer)
 {
@@ -466,7 +628,7 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_invalidate(block_dev);
 	return ops->write(dev, start, blkcnt, buffer);
 }
 
@@ -479,10 +641,149 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->erase)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	blk_invalidate(block_dev);
 	return ops->erase(dev, start, blkcnt);
 }
 
+void blk_set_queue_depth(struct udevice *dev, int depth)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	priv->queue_depth = depth;
+}
+
+int blk_get_queue_depth(struct udevice *dev)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	if (!priv || !blk_get_ops(dev)->submit)
+		return 1;
+
+	return max(priv->queue_depth, 1);
+}
+
+void blk_req_done(struct udevice *dev, struct blk_request *req, long result)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	/*
+	 * A read issued while the request was in flight may have cached the
+	 * old data again
+	 */
+	if (req->op != BLK_REQ_READ)
+		blk_invalidate(dev_get_uclass_plat(dev));
+
+	priv->in_flight--;
+	req->result = result;
+	req->done = true;
+	if (req->complete)
+		req->complete(req);
+}
+
+/* carry out a request synchronously, for drivers without submit() */
+static int blk_submit_sync(struct blk_desc *desc, struct blk_request *req)
+{
+	ulong ret;
+
+	switch (req->op) {
+	case BLK_REQ_READ:
+		ret = blk_dread(desc, req->start, req->blkcnt, req->buffer);
+		break;
+	case BLK_REQ_WRITE:
+		ret = blk_dwrite(desc, req->start, req->blkcnt, req->buffer);
+		break;
+	case BLK_REQ_ERASE:
+		ret = blk_derase(desc, req->start, req->blkcnt);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	req->result = ret;
+	req->done = true;
+	if (req->complete)
+		req->complete(req);
+
+	return 0;
+}
+
+int blk_submit(struct udevice *dev, struct blk_request *req)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+	int ret;
+
+	req->dev = dev;
+	req->done = false;
+	req->result = 0;
+
+	if (!priv || !ops->submit)
+		return blk_submit_sync(desc, req);
+
+	if (req->op != BLK_REQ_READ)
+		blk_invalidate(desc);
+
+	/* wait for a free slot */
+	while (priv->in_flight >= blk_get_queue_depth(dev)) {
+		ret = blk_poll(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* the driver may complete the request before returning */
+	priv->in_flight++;
+	ret = ops->submit(dev, req);
+	if (ret) {
+		priv->in_flight--;
+		return ret;
+	}
+
+	return 0;
+}
+
+int blk_poll(struct udevice *dev)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	if (!priv || !ops->poll || !priv->in_flight)
+		return 0;
+
+	return ops->poll(dev);
+}
+
+long blk_wait(struct blk_request *req)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(req->dev);
+	int ret;
+
+	while (!req->done) {
+		/* not submitted, or submission failed */
+		if (!priv || !priv->in_flight)
+			return -EINVAL;
+		ret = blk_poll(req->dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return req->result;
+}
+
+int blk_wait_all(struct udevice *dev)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+	int ret;
+
+	while (priv && priv->in_flight) {
+		ret = blk_poll(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
 int blk_get_from_parent(struct udevice *parent, struct udevice **devp)
 {
 	struct udevice *dev;
@@ -741,6 +1042,37 @@ int blk_unbind_all(int if_type)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	__maybe_unused struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	fs_mount_invalidate(dev_get_uclass_plat(dev));
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	/* a device can be removed without having been probed */
+	if (!priv)
+		return 0;
+
+	free(priv->ra.buf);
+	priv->ra.buf = NULL;
+	priv->ra.count = 0;
+#endif
+
+	return 0;
+}
+
+static int blk_pre_probe(struct udevice *dev)
+{
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	/* so that a first read at block 0 is not taken as sequential */
+	priv->ra.next = (lbaint_t)-1;
+#endif
+
+	return 0;
+}
+
 static int blk_post_probe(struct udevice *dev)
 {
 	if (CONFIG_IS_ENABLED(PARTITIONS) &&
@@ -760,6 +1092,9 @@ static int blk_post_probe(struct udevice *dev)
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
+	.pre_probe	= blk_pre_probe,
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
+	.per_device_auto	= sizeof(struct blk_uclass_priv),
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
@@ -11,27 +11,49 @@
 #include <part.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
+#include <linux/errno.h>
 #include <linux/list.h>
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
-struct block_cache_node {
+/*
+ * The cache holds individual device blocks. Each block is looked up through
+ * a hash table keyed by (device, block number) and all blocks sit on a
+ * single LRU list which is trimmed whenever the memory budget is exceeded.
+ */
+#define BLKCACHE_HASH_BITS	10
+#define BLKCACHE_HASH_SIZE	(1 << BLKCACHE_HASH_BITS)
+
+/* per-device accounting, also used as part of the lookup key */
+struct block_cache_dev {
 	struct list_head lh;
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
+	unsigned hits;
+	unsigned misses;
+	unsigned evictions;
+	unsigned entries;
+	unsigned long bytes;
+};
+
+struct block_cache_node {
+	struct hlist_node hn;
+	struct list_head lru;
+	struct block_cache_dev *dev;
+	lbaint_t blknr;
 	unsigned long blksz;
-	char *cache;
+	char cache[];
 };
 
 static LIST_HEAD(block_cache);
+static LIST_HEAD(block_cache_devs);
+static struct hlist_head *block_cache_hash;
 
 static struct block_cache_stats _stats = {
 	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_bytes = CONFIG_BLOCK_CACHE_SIZE,
 };
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
@@ -42,49 +64,133 @@ int blkcache_init(void)
 	head->next = (uintptr_t)head->next + gd->reloc_off;
 	head->prev = (uintptr_t)head->prev + gd->reloc_off;
 
+	head = &block_cache_devs;
+	head->next = (uintptr_t)head->next + gd->reloc_off;
+	head->prev = (uintptr_t)head->prev + gd->reloc_off;
+
 	return 0;
 }
 #endif
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static inline unsigned long node_size(unsigned long blksz)
+{
+	return sizeof(struct block_cache_node) + blksz;
+}
+
+static struct hlist_head *cache_bucket(struct block_cache_dev *dev,
+				       lbaint_t blknr)
+{
+	u32 key = (u32)blknr ^ (u32)((u64)blknr >> 32) ^
+		  ((u32)(uintptr_t)dev >> 4);
+
+	/* multiplicative (Fibonacci) hashing */
+	key *= 0x9e370001U;
+
+	return &block_cache_hash[key >> (32 - BLKCACHE_HASH_BITS)];
+}
+
+static struct block_cache_dev *cache_dev_find(int iftype, int devnum,
+					      bool create)
+{
+	struct block_cache_dev *dev;
+
+	list_for_each_entry(dev, &block_cache_devs, lh)
+		if (dev->iftype == iftype && dev->devnum == devnum)
+			return dev;
+
+	if (!create)
+		return NULL;
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+	dev->iftype = iftype;
+	dev->devnum = devnum;
+	list_add_tail(&dev->lh, &block_cache_devs);
+
+	return dev;
+}
+
+static struct block_cache_node *cache_find(struct block_cache_dev *dev,
+					   lbaint_t blknr, unsigned long blksz)
 {
 	struct block_cache_node *node;
+	struct hlist_node *pos;
+
+	if (!block_cache_hash)
+		return NULL;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+	hlist_for_each_entry(node, pos, cache_bucket(dev, blknr), hn)
+		if (node->dev == dev && node->blknr == blknr &&
+		    node->blksz == blksz)
 			return node;
-		}
-	return 0;
+
+	return NULL;
+}
+
+static void cache_drop(struct block_cache_node *node)
+{
+	unsigned long bytes = node_size(node->blksz);
+
+	hlist_del(&node->hn);
+	list_del(&node->lru);
+	node->dev->entries--;
+	node->dev->bytes -= bytes;
+	_stats.entries--;
+	_stats.bytes -= bytes;
+	free(node);
+}
+
+/* evict least-recently-used blocks until @bytes more fit in the budget */
+static void cache_make_room(unsigned long bytes)
+{
+	struct block_cache_node *node;
+
+	while (!list_empty(&block_cache) &&
+	       _stats.bytes + bytes > _stats.max_bytes) {
+		node = list_last_entry(&block_cache, struct block_cache_node,
+				       lru);
+		debug("drop: blk " LBAF "\n", node->blknr);
+		node->dev->evictions++;
+		_stats.evictions++;
+		cache_drop(node);
+	}
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	struct block_cache_node *node;
+	struct block_cache_dev *dev;
+	lbaint_t i;
+
+	dev = cache_dev_find(iftype, devnum, false);
+	if (!dev)
+		goto miss;
+
+	/* only serve the request if every block is present */
+	for (i = 0; i < blkcnt; i++)
+		if (!cache_find(dev, start + i, blksz))
+			goto miss;
+
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(dev, start + i, blksz);
+		memcpy(buffer + i * blksz, node->cache, blksz);
+		/* maintain MRU ordering */
+		list_move(&node->lru, &block_cache);
 	}
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++dev->hits;
+	++_stats.hits;
+	return 1;
 
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
+	if (dev)
+		++dev->misses;
 	++_stats.misses;
 	return 0;
 }
@@ -93,98 +199,129 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
 	struct block_cache_node *node;
+	struct block_cache_dev *dev;
+	unsigned long bytes;
+	lbaint_t i;
+	int j;
 
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	bytes = node_size(blksz);
+	if (blkcnt * bytes > _stats.max_bytes)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
+	if (!block_cache_hash) {
+		block_cache_hash = malloc(BLKCACHE_HASH_SIZE *
+					  sizeof(*block_cache_hash));
+		if (!block_cache_hash)
 			return;
-		node->cache = 0;
+		for (j = 0; j < BLKCACHE_HASH_SIZE; j++)
+			INIT_HLIST_HEAD(&block_cache_hash[j]);
 	}
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
-	}
+	dev = cache_dev_find(iftype, devnum, true);
+	if (!dev)
+		return;
 
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(dev, start + i, blksz);
+		if (!node) {
+			cache_make_room(bytes);
+			node = malloc(bytes);
+			if (!node)
+				return;
+			node->dev = dev;
+			node->blknr = start + i;
+			node->blksz = blksz;
+			hlist_add_head(&node->hn, cache_bucket(dev, start + i));
+			list_add(&node->lru, &block_cache);
+			dev->entries++;
+			dev->bytes += bytes;
+			_stats.entries++;
+			_stats.bytes += bytes;
+		} else {
+			list_move(&node->lru, &block_cache);
+		}
+		memcpy(node->cache, buffer + i * blksz, blksz);
+	}
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_node *node, *n;
+	struct block_cache_dev *dev;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
-	}
+	dev = cache_dev_find(iftype, devnum, false);
+	if (!dev || !dev->entries)
+		return;
+
+	list_for_each_entry_safe(node, n, &block_cache, lru)
+		if (node->dev == dev)
+			cache_drop(node);
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_configure(unsigned blocks, unsigned long max_bytes)
 {
-	struct block_cache_node *node;
+	struct block_cache_node *node, *n;
+	struct block_cache_dev *dev;
+
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries)) {
+	    (max_bytes != _stats.max_bytes)) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
-		_stats.entries = 0;
+		list_for_each_entry_safe(node, n, &block_cache, lru)
+			cache_drop(node);
 	}
 
 	_stats.max_blocks_per_entry = blocks;
-	_stats.max_entries = entries;
+	_stats.max_bytes = max_bytes;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	list_for_each_entry(dev, &block_cache_devs, lh) {
+		dev->hits = 0;
+		dev->misses = 0;
+		dev->evictions = 0;
+	}
+}
+
+int blkcache_dev_stats(int idx, struct block_cache_dev_stats *stats)
+{
+	struct block_cache_dev *dev;
+
+	list_for_each_entry(dev, &block_cache_devs, lh) {
+		if (idx--)
+			continue;
+		stats->iftype = dev->iftype;
+		stats->devnum = dev->devnum;
+		stats->hits = dev->hits;
+		stats->misses = dev->misses;
+		stats->evictions = dev->evictions;
+		stats->entries = dev->entries;
+		stats->bytes = dev->bytes;
+		return 0;
+	}
+
+	return -ENOENT;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
 {
+	struct block_cache_dev *dev;
+
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	list_for_each_entry(dev, &block_cache_devs, lh) {
+		dev->hits = 0;
+		dev->misses = 0;
+		dev->evictions = 0;
+	}
 }
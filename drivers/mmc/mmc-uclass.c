@@ -9,6 +9,7 @@
 
 #include <common.h>
 #include <bootdev.h>
+#include <fs.h>
 #include <log.h>
 #include <mmc.h>
 #include <dm.h>
@@ -360,11 +361,29 @@ void mmc_do_preinit(void)
 
 		m->user_speed_mode = MMC_MODES_END;  /* Initialising user set speed mode */
 
-		if (m->preinit)
+		if (mmc_want_preinit(m))
 			mmc_start_init(m);
 	}
 }
 
+int mmc_poll_init_all(void)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+	int pending = 0;
+
+	if (uclass_get(UCLASS_MMC, &uc))
+		return 0;
+	uclass_foreach_dev(dev, uc) {
+		struct mmc *m = mmc_get_mmc_dev(dev);
+
+		if (m && m->init_in_progress && mmc_poll_init(m) == -EAGAIN)
+			pending++;
+	}
+
+	return pending;
+}
+
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 void print_mmc_devices(char separator)
 {
@@ -471,8 +490,10 @@ static int mmc_select_hwpart(struct udevice *bdev, int hwpart)
 		return -EMEDIUMTYPE;
 
 	ret = mmc_switch_part(mmc, hwpart);
-	if (!ret)
+	if (!ret) {
 		blkcache_invalidate(desc->if_type, desc->devnum);
+		fs_mount_invalidate(desc);
+	}
 
 	return ret;
 }
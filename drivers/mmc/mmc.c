@@ -398,16 +398,45 @@ int mmc_send_tuning(struct mmc *mmc, u32 opcode, int *cmd_error)
 }
 #endif
 
+/*
+ * Check whether a multi-block transfer of @blkcnt blocks can be announced
+ * with SET_BLOCK_COUNT, which saves the STOP_TRANSMISSION command (and its
+ * busy wait) at the end of the transfer
+ */
+static bool mmc_can_cmd23(struct mmc *mmc, lbaint_t blkcnt)
+{
+	if (!(mmc->card_caps & mmc->host_caps & MMC_CAP_CMD23))
+		return false;
+
+	/* eMMC only has 16 bits for the block count */
+	return IS_SD(mmc) || blkcnt <= 0xffff;
+}
+
+static int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blkcnt;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool sbc = false;
 
-	if (blkcnt > 1)
+	if (blkcnt > 1) {
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
-	else
+		sbc = mmc_can_cmd23(mmc, blkcnt) &&
+		      !mmc_set_block_count(mmc, blkcnt);
+	} else {
 		cmd.cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
+	}
 
 	if (mmc->high_capacity)
 		cmd.cmdarg = start;
@@ -421,10 +450,18 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	data.blocksize = mmc->read_bl_len;
 	data.flags = MMC_DATA_READ;
 
-	if (mmc_send_cmd(mmc, &cmd, &data))
+	if (mmc_send_cmd(mmc, &cmd, &data)) {
+		/* a predefined transfer must still be aborted on error */
+		if (sbc) {
+			cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
+			cmd.cmdarg = 0;
+			cmd.resp_type = MMC_RSP_R1b;
+			mmc_send_cmd(mmc, &cmd, NULL);
+		}
 		return 0;
+	}
 
-	if (blkcnt > 1) {
+	if (blkcnt > 1 && !sbc) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -591,54 +628,56 @@ static int mmc_switch_voltage(struct mmc *mmc, int signal_voltage)
 }
 #endif
 
-static int sd_send_op_cond(struct mmc *mmc, bool uhs_en)
+/* Time a card may take to power up, counted from the first op_cond command */
+#define MMC_OP_COND_TIMEOUT_MS	1000
+
+static int sd_send_op_cond_iter(struct mmc *mmc, bool uhs_en)
 {
-	int timeout = 1000;
-	int err;
 	struct mmc_cmd cmd;
+	int err;
 
-	while (1) {
-		cmd.cmdidx = MMC_CMD_APP_CMD;
-		cmd.resp_type = MMC_RSP_R1;
-		cmd.cmdarg = 0;
-
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	cmd.cmdidx = MMC_CMD_APP_CMD;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
 
-		if (err)
-			return err;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
-		cmd.resp_type = MMC_RSP_R3;
+	if (err)
+		return err;
 
-		/*
-		 * Most cards do not answer if some reserved bits
-		 * in the ocr are set. However, Some controller
-		 * can set bit 7 (reserved for low voltages), but
-		 * how to manage low voltages SD card is not yet
-		 * specified.
-		 */
-		cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
-			(mmc->cfg->voltages & 0xff8000);
+	cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
+	cmd.resp_type = MMC_RSP_R3;
 
-		if (mmc->version == SD_VERSION_2)
-			cmd.cmdarg |= OCR_HCS;
+	/*
+	 * Most cards do not answer if some reserved bits
+	 * in the ocr are set. However, Some controller
+	 * can set bit 7 (reserved for low voltages), but
+	 * how to manage low voltages SD card is not yet
+	 * specified.
+	 */
+	cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
+		(mmc->cfg->voltages & 0xff8000);
 
-		if (uhs_en)
-			cmd.cmdarg |= OCR_S18R;
+	if (mmc->version == SD_VERSION_2)
+		cmd.cmdarg |= OCR_HCS;
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (uhs_en)
+		cmd.cmdarg |= OCR_S18R;
 
-		if (err)
-			return err;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		if (cmd.response[0] & OCR_BUSY)
-			break;
+	if (err)
+		return err;
 
-		if (timeout-- <= 0)
-			return -EOPNOTSUPP;
+	mmc->ocr = cmd.response[0];
+	return 0;
+}
 
-		udelay(1000);
-	}
+/* Finish the SD power-up sequence once the card reports it is ready */
+static int sd_complete_op_cond(struct mmc *mmc, bool uhs_en)
+{
+	struct mmc_cmd cmd;
+	int err;
 
 	if (mmc->version != SD_VERSION_2)
 		mmc->version = SD_VERSION_1_0;
@@ -652,12 +691,12 @@ static int sd_send_op_cond(struct mmc *mmc, bool uhs_en)
 
 		if (err)
 			return err;
-	}
 
-	mmc->ocr = cmd.response[0];
+		mmc->ocr = cmd.response[0];
+	}
 
 #if CONFIG_IS_ENABLED(MMC_UHS_SUPPORT)
-	if (uhs_en && !(mmc_host_is_spi(mmc)) && (cmd.response[0] & 0x41000000)
+	if (uhs_en && !(mmc_host_is_spi(mmc)) && (mmc->ocr & 0x41000000)
 	    == 0x41000000) {
 		err = mmc_switch_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
 		if (err)
@@ -692,59 +731,35 @@ static int mmc_send_op_cond_iter(struct mmc *mmc, int use_arg)
 	return 0;
 }
 
+/*
+ * Start the eMMC power-up sequence: ask for the voltage window, then send it
+ * back. The card is then polled with mmc_poll_op_cond().
+ */
 static int mmc_send_op_cond(struct mmc *mmc)
 {
-	int err, i;
-	int timeout = 1000;
-	uint start;
+	int err;
 
 	/* Some cards seem to need this */
 	mmc_go_idle(mmc);
 
-	start = get_timer(0);
 	/* Asking to the card its capabilities */
-	for (i = 0; ; i++) {
-		err = mmc_send_op_cond_iter(mmc, i != 0);
-		if (err)
-			return err;
+	err = mmc_send_op_cond_iter(mmc, 0);
+	if (err)
+		return err;
 
-		/* exit if not busy (flag seems to be inverted) */
-		if (mmc->ocr & OCR_BUSY)
-			break;
+	/* exit if not busy (flag seems to be inverted) */
+	if (mmc->ocr & OCR_BUSY)
+		return 0;
 
-		if (get_timer(start) > timeout)
-			return -ETIMEDOUT;
-		udelay(100);
-	}
-	mmc->op_cond_pending = 1;
-	return 0;
+	return mmc_send_op_cond_iter(mmc, 1);
 }
 
+/* Finish the eMMC power-up sequence once the card reports it is ready */
 static int mmc_complete_op_cond(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
-	int timeout = 1000;
-	ulong start;
 	int err;
 
-	mmc->op_cond_pending = 0;
-	if (!(mmc->ocr & OCR_BUSY)) {
-		/* Some cards seem to need this */
-		mmc_go_idle(mmc);
-
-		start = get_timer(0);
-		while (1) {
-			err = mmc_send_op_cond_iter(mmc, 1);
-			if (err)
-				return err;
-			if (mmc->ocr & OCR_BUSY)
-				break;
-			if (get_timer(start) > timeout)
-				return -EOPNOTSUPP;
-			udelay(100);
-		}
-	}
-
 	if (mmc_host_is_spi(mmc)) { /* read OCR for spi */
 		cmd.cmdidx = MMC_CMD_SPI_READ_OCR;
 		cmd.resp_type = MMC_RSP_R3;
@@ -943,6 +958,10 @@ static int mmc_get_capabilities(struct mmc *mmc)
 	if (mmc_host_is_spi(mmc))
 		return 0;
 
+	/* SET_BLOCK_COUNT is mandatory since version 3.1 (SPEC_VERS 3) */
+	if (mmc->version >= MMC_VERSION_3)
+		mmc->card_caps |= MMC_CAP_CMD23;
+
 	/* Only version 4 supports high-speed */
 	if (mmc->version < MMC_VERSION_4)
 		return 0;
@@ -1342,6 +1361,9 @@ static int sd_get_capabilities(struct mmc *mmc)
 	if (mmc->scr[0] & SD_DATA_4BIT)
 		mmc->card_caps |= MMC_MODE_4BIT;
 
+	if (mmc->scr[0] & SD_CMD23_SUPPORT)
+		mmc->card_caps |= MMC_CAP_CMD23;
+
 	/* Version 1.0 doesn't support switching */
 	if (mmc->version == SD_VERSION_1_0)
 		return 0;
@@ -2771,14 +2793,122 @@ static int mmc_power_cycle(struct mmc *mmc)
 	return mmc_power_on(mmc);
 }
 
-int mmc_get_op_cond(struct mmc *mmc, bool quiet)
+/*
+ * Reset the card and send the first op_cond command. On success the card is
+ * powering up and has to be polled with mmc_poll_op_cond().
+ */
+static int mmc_reset_op_cond(struct mmc *mmc, bool quiet, bool uhs_en)
 {
-	bool uhs_en = supports_uhs(mmc->cfg->host_caps);
 	int err;
 
-	if (mmc->has_init)
+retry:
+	mmc_set_initial_state(mmc);
+
+	/* Reset the Card */
+	err = mmc_go_idle(mmc);
+
+	if (err)
+		return err;
+
+	/* The internal partition reset to user partition(0) at every CMD0 */
+	mmc_get_blk_desc(mmc)->hwpart = 0;
+
+	/* Test for SD version 2 */
+	err = mmc_send_if_cond(mmc);
+
+	/* Now try to get the SD card's operating condition */
+	err = sd_send_op_cond_iter(mmc, uhs_en);
+	if (err && uhs_en) {
+		uhs_en = false;
+		mmc_power_cycle(mmc);
+		goto retry;
+	}
+	mmc->sd_op_cond = !err;
+	mmc->uhs_en = uhs_en;
+
+	/* If the command timed out, we check for an MMC card */
+	if (err == -ETIMEDOUT) {
+		err = mmc_send_op_cond(mmc);
+
+		if (err) {
+#if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
+			if (!quiet)
+				pr_err("Card did not respond to voltage select! : %d\n", err);
+#endif
+			return -EOPNOTSUPP;
+		}
+	}
+
+	if (!err) {
+		mmc->op_cond_pending = 1;
+		mmc->op_cond_start = get_timer(0);
+	}
+
+	return err;
+}
+
+/*
+ * Check once whether the card has finished powering up, without waiting.
+ * Returns -EAGAIN while it is still busy, 0 once it is ready for
+ * mmc_startup().
+ */
+static int mmc_poll_op_cond(struct mmc *mmc)
+{
+	int err = 0;
+
+	if (!mmc->op_cond_pending)
 		return 0;
 
+	/* flag seems to be inverted: set when the card is not busy */
+	if (!(mmc->ocr & OCR_BUSY)) {
+		if (mmc->sd_op_cond)
+			err = sd_send_op_cond_iter(mmc, mmc->uhs_en);
+		else
+			err = mmc_send_op_cond_iter(mmc, 1);
+
+		if (!err && !(mmc->ocr & OCR_BUSY)) {
+			if (get_timer(mmc->op_cond_start) <=
+			    MMC_OP_COND_TIMEOUT_MS)
+				return -EAGAIN;
+			err = -EOPNOTSUPP;
+		}
+	}
+
+	mmc->op_cond_pending = 0;
+	if (!err) {
+		if (mmc->sd_op_cond)
+			err = sd_complete_op_cond(mmc, mmc->uhs_en);
+		else
+			err = mmc_complete_op_cond(mmc);
+	}
+
+	/* start over without UHS, as mmc_reset_op_cond() does */
+	if (err && mmc->sd_op_cond && mmc->uhs_en) {
+		mmc_power_cycle(mmc);
+		err = mmc_reset_op_cond(mmc, false, false);
+		if (!err)
+			err = -EAGAIN;
+	}
+
+	return err;
+}
+
+static int mmc_wait_op_cond(struct mmc *mmc)
+{
+	int err;
+
+	while ((err = mmc_poll_op_cond(mmc)) == -EAGAIN)
+		udelay(mmc->sd_op_cond ? 1000 : 100);
+
+	return err;
+}
+
+/* Power up the card and send the first op_cond command, without waiting */
+static int mmc_start_op_cond(struct mmc *mmc, bool quiet)
+{
+	bool uhs_en = supports_uhs(mmc->cfg->host_caps);
+	int err;
+
 	err = mmc_power_init(mmc);
 	if (err)
 		return err;
@@ -2818,43 +2948,21 @@ int mmc_get_op_cond(struct mmc *mmc, bool quiet)
 		return err;
 	mmc->ddr_mode = 0;
 
-retry:
-	mmc_set_initial_state(mmc);
+	return mmc_reset_op_cond(mmc, quiet, uhs_en);
+}
 
-	/* Reset the Card */
-	err = mmc_go_idle(mmc);
+int mmc_get_op_cond(struct mmc *mmc, bool quiet)
+{
+	int err;
+
+	if (mmc->has_init)
+		return 0;
 
+	err = mmc_start_op_cond(mmc, quiet);
 	if (err)
 		return err;
 
-	/* The internal partition reset to user partition(0) at every CMD0 */
-	mmc_get_blk_desc(mmc)->hwpart = 0;
-
-	/* Test for SD version 2 */
-	err = mmc_send_if_cond(mmc);
-
-	/* Now try to get the SD card's operating condition */
-	err = sd_send_op_cond(mmc, uhs_en);
-	if (err && uhs_en) {
-		uhs_en = false;
-		mmc_power_cycle(mmc);
-		goto retry;
-	}
-
-	/* If the command timed out, we check for an MMC card */
-	if (err == -ETIMEDOUT) {
-		err = mmc_send_op_cond(mmc);
-
-		if (err) {
-#if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
-			if (!quiet)
-				pr_err("Card did not respond to voltage select! : %d\n", err);
-#endif
-			return -EOPNOTSUPP;
-		}
-	}
-
-	return err;
+	return mmc_wait_op_cond(mmc);
 }
 
 int mmc_start_init(struct mmc *mmc)
@@ -2906,7 +3014,7 @@ int mmc_start_init(struct mmc *mmc)
 		return -ENOMEDIUM;
 	}
 
-	err = mmc_get_op_cond(mmc, false);
+	err = mmc_start_op_cond(mmc, false);
 
 	if (!err)
 		mmc->init_in_progress = 1;
@@ -2914,13 +3022,9 @@ int mmc_start_init(struct mmc *mmc)
 	return err;
 }
 
-static int mmc_complete_init(struct mmc *mmc)
+static int mmc_finish_init(struct mmc *mmc, int err)
 {
-	int err = 0;
-
 	mmc->init_in_progress = 0;
-	if (mmc->op_cond_pending)
-		err = mmc_complete_op_cond(mmc);
 
 	if (!err)
 		err = mmc_startup(mmc);
@@ -2931,6 +3035,27 @@ static int mmc_complete_init(struct mmc *mmc)
 	return err;
 }
 
+static int mmc_complete_init(struct mmc *mmc)
+{
+	return mmc_finish_init(mmc, mmc_wait_op_cond(mmc));
+}
+
+int mmc_poll_init(struct mmc *mmc)
+{
+	int err;
+
+	if (mmc->has_init)
+		return 0;
+	if (!mmc->init_in_progress)
+		return -EINVAL;
+
+	err = mmc_poll_op_cond(mmc);
+	if (err == -EAGAIN)
+		return err;
+
+	return mmc_finish_init(mmc, err);
+}
+
 int mmc_init(struct mmc *mmc)
 {
 	int err = 0;
@@ -3087,7 +3212,7 @@ int mmc_init_device(int num)
 
 	if (!m)
 		return 0;
-	if (m->preinit)
+	if (mmc_want_preinit(m))
 		mmc_start_init(m);
 
 	return 0;
@@ -24,10 +24,17 @@ struct mmc *find_mmc_device(int dev_num)
 void mmc_do_preinit(void)
 {
 	struct mmc *m = &mmc_static;
-	if (m->preinit)
+	if (mmc_want_preinit(m))
 		mmc_start_init(m);
 }
 
+int mmc_poll_init_all(void)
+{
+	struct mmc *m = &mmc_static;
+
+	return m->init_in_progress && mmc_poll_init(m) == -EAGAIN;
+}
+
 struct blk_desc *mmc_get_blk_desc(struct mmc *mmc)
 {
 	return &mmc->block_dev;
@@ -75,10 +82,26 @@ void mmc_do_preinit(void)
 	list_for_each(entry, &mmc_devices) {
 		m = list_entry(entry, struct mmc, link);
 
-		if (m->preinit)
+		if (mmc_want_preinit(m))
 			mmc_start_init(m);
 	}
 }
+
+int mmc_poll_init_all(void)
+{
+	struct mmc *m;
+	struct list_head *entry;
+	int pending = 0;
+
+	list_for_each(entry, &mmc_devices) {
+		m = list_entry(entry, struct mmc, link);
+
+		if (m->init_in_progress && mmc_poll_init(m) == -EAGAIN)
+			pending++;
+	}
+
+	return pending;
+}
 #endif
 
 void mmc_list_init(void)
@@ -29,6 +29,9 @@ struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	uint blk_count;	/* block count set by CMD23, 0 if none */
+	bool predefined; /* last multi-block transfer was set up by CMD23 */
+	int op_cond_busy; /* number of ACMD41s answered with 'busy' */
 };
 
 /**
@@ -36,6 +39,9 @@ struct sandbox_mmc_priv {
  *
  * This emulate an SD card version 2. Single-block reads result in zero data.
  * Multiple-block reads return a test string.
+ *
+ * Like a real card, a transfer set up with SET_BLOCK_COUNT must match the
+ * announced length and must not be followed by STOP_TRANSMISSION.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
@@ -50,7 +56,10 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
+		break;
 	case MMC_CMD_GO_IDLE_STATE:
+		/* the card takes a while to power up after a reset */
+		priv->op_cond_busy = 2;
 		break;
 	case SD_CMD_SEND_IF_COND:
 		cmd->response[0] = 0xaa;
@@ -77,17 +86,32 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 			resp[4] = (cmd->cmdarg & 0xF) << 24;
 		break;
 	}
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->blk_count = cmd->cmdarg;
+		break;
 	case MMC_CMD_READ_SINGLE_BLOCK:
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
+		if (priv->blk_count && priv->blk_count != data->blocks)
+			return -EIO;
+		priv->predefined = priv->blk_count != 0;
+		priv->blk_count = 0;
 		memcpy(data->dest, &priv->buf[cmd->cmdarg * data->blocksize],
 		       data->blocks * data->blocksize);
 		break;
 	case MMC_CMD_WRITE_SINGLE_BLOCK:
 	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		if (priv->blk_count && priv->blk_count != data->blocks)
+			return -EIO;
+		priv->predefined = priv->blk_count != 0;
+		priv->blk_count = 0;
 		memcpy(&priv->buf[cmd->cmdarg * data->blocksize], data->src,
 		       data->blocks * data->blocksize);
 		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		if (priv->predefined) {
+			priv->predefined = false;
+			return -EINVAL;
+		}
 		break;
 	case SD_CMD_ERASE_WR_BLK_START:
 		erase_start = cmd->cmdarg;
@@ -101,6 +125,10 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		break;
 	case SD_CMD_APP_SEND_OP_COND:
 		cmd->response[0] = OCR_BUSY | OCR_HCS;
+		if (priv->op_cond_busy) {
+			priv->op_cond_busy--;
+			cmd->response[0] &= ~OCR_BUSY;
+		}
 		cmd->response[1] = 0;
 		cmd->response[2] = 0;
 		break;
@@ -112,7 +140,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, with CMD23 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_CMD23_SUPPORT);
 		break;
 	}
 	default:
@@ -207,7 +236,8 @@ static int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT |
+			 MMC_CAP_CMD23;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
@@ -71,6 +71,20 @@ static void sdhci_transfer_pio(struct sdhci_host *host, struct mmc_data *data)
 }
 
 #if (defined(CONFIG_MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+/*
+ * SDMA transfers go through the bounce buffer if the controller cannot reach
+ * @buf. Suitably aligned buffers are always used directly.
+ */
+static bool sdhci_needs_bounce(struct sdhci_host *host, const void *buf)
+{
+	if (!(host->flags & USE_SDMA))
+		return false;
+
+	return host->force_align_buffer ||
+	       (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR &&
+		((unsigned long)buf & 0x7) != 0x0);
+}
+
 static void sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
 			      int *is_aligned, int trans_bytes)
 {
@@ -91,10 +105,7 @@ static void sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
 		ctrl |= SDHCI_CTRL_ADMA32;
 	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
 
-	if (host->flags & USE_SDMA &&
-	    (host->force_align_buffer ||
-	     (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR &&
-	      ((unsigned long)buf & 0x7) != 0x0))) {
+	if (sdhci_needs_bounce(host, buf)) {
 		*is_aligned = 0;
 		if (data->flags != MMC_DATA_READ)
 			memcpy(host->align_buffer, buf, trans_bytes);
@@ -121,6 +132,21 @@ static void sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
 	}
 #endif
 }
+
+/*
+ * Transfers which are bounced must fit in the bounce buffer, all others can
+ * use the full block count of the controller
+ */
+static int sdhci_b_max(struct mmc *mmc, void *dst)
+{
+	struct sdhci_host *host = mmc->priv;
+
+	if (sdhci_needs_bounce(host, dst))
+		return min_t(int, mmc->cfg->b_max,
+			     SDHCI_ALIGN_BUFFER_SIZE / mmc->read_bl_len);
+
+	return mmc->cfg->b_max;
+}
 #else
 static void sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
 			      int *is_aligned, int trans_bytes)
@@ -707,7 +733,7 @@ static int sdhci_init(struct mmc *mmc)
 	host->force_align_buffer = true;
 #else
 	if (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) {
-		host->align_buffer = memalign(8, 512 * 1024);
+		host->align_buffer = memalign(8, SDHCI_ALIGN_BUFFER_SIZE);
 		if (!host->align_buffer) {
 			printf("%s: Aligned buffer alloc failed!!!\n",
 			       __func__);
@@ -801,6 +827,13 @@ static int sdhci_wait_dat0(struct udevice *dev, int state,
 	return -ETIMEDOUT;
 }
 
+#if (defined(CONFIG_MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+static int sdhci_get_b_max(struct udevice *dev, void *dst, lbaint_t blkcnt)
+{
+	return sdhci_b_max(mmc_get_mmc_dev(dev), dst);
+}
+#endif
+
 #if CONFIG_IS_ENABLED(MMC_HS400_ES_SUPPORT)
 static int sdhci_set_enhanced_strobe(struct udevice *dev)
 {
@@ -823,15 +856,28 @@ const struct dm_mmc_ops sdhci_ops = {
 	.execute_tuning	= sdhci_execute_tuning,
 #endif
 	.wait_dat0	= sdhci_wait_dat0,
+#if (defined(CONFIG_MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+	.get_b_max	= sdhci_get_b_max,
+#endif
 #if CONFIG_IS_ENABLED(MMC_HS400_ES_SUPPORT)
 	.set_enhanced_strobe = sdhci_set_enhanced_strobe,
 #endif
 };
 #else
+#if (defined(CONFIG_MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+static int sdhci_get_b_max(struct mmc *mmc, void *dst, lbaint_t blkcnt)
+{
+	return sdhci_b_max(mmc, dst);
+}
+#endif
+
 static const struct mmc_ops sdhci_ops = {
 	.send_cmd	= sdhci_send_command,
 	.set_ios	= sdhci_set_ios,
 	.init		= sdhci_init,
+#if (defined(CONFIG_MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+	.get_b_max	= sdhci_get_b_max,
+#endif
 };
 #endif
 
@@ -946,6 +992,9 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 
 	cfg->host_caps |= MMC_MODE_4BIT;
 
+	/* CMD12 is never issued automatically, so CMD23 can be used */
+	cfg->host_caps |= MMC_CAP_CMD23;
+
 	/* Since Host Controller Version3.0 */
 	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300) {
 		if (!(caps & SDHCI_CAN_DO_8BIT))
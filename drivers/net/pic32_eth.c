@@ -30,6 +30,7 @@ DECLARE_GLOBAL_DATA_PTR;
 struct pic32eth_dev {
 	struct eth_dma_desc rxd_ring[MAX_RX_DESCR];
 	struct eth_dma_desc txd_ring[MAX_TX_DESCR];
+	uchar **rx_bufs; /* RX packet buffers, one per RX desc */
 	u32 rxd_idx; /* index of RX desc to read */
 	/* regs */
 	struct pic32_ectl_regs *ectl_regs;
@@ -290,7 +291,7 @@ static void pic32_rx_desc_init(struct pic32eth_dev *priv)
 		rxd->hdr = EDH_NPV | EDH_EOWN | EDH_STICKY;
 
 		/* packet buffer address */
-		rxd->data_buff = virt_to_phys(net_rx_packets[idx]);
+		rxd->data_buff = virt_to_phys(priv->rx_bufs[idx]);
 
 		/* link to next desc */
 		rxd->next_ed = virt_to_phys(rxd + 1);
@@ -330,6 +331,11 @@ static int pic32_eth_start(struct udevice *dev)
 	struct eth_pdata *pdata = dev_get_plat(dev);
 	struct pic32eth_dev *priv = dev_get_priv(dev);
 
+	/* RX buffers of our own, kept across restarts */
+	priv->rx_bufs = eth_alloc_rx_bufs(dev, MAX_RX_DESCR);
+	if (!priv->rx_bufs)
+		return -ENOMEM;
+
 	/* controller */
 	pic32_ctrl_reset(priv);
 
@@ -481,11 +487,11 @@ static int pic32_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 
 	/* invalidate dcache */
 	rx_count = RSV_RX_COUNT(rxd->stat2);
-	invalidate_dcache_range((ulong)net_rx_packets[idx],
-				(ulong)net_rx_packets[idx] + rx_count);
+	invalidate_dcache_range((ulong)priv->rx_bufs[idx],
+				(ulong)priv->rx_bufs[idx] + rx_count);
 
 	/* Pass the packet to protocol layer */
-	*packetp = net_rx_packets[idx];
+	*packetp = priv->rx_bufs[idx];
 
 	/* increment number of bytes rcvd (ignore CRC) */
 	return rx_count - 4;
@@ -499,7 +505,7 @@ static int pic32_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 	int idx = priv->rxd_idx;
 
 	/* sanity check */
-	if (packet != net_rx_packets[idx]) {
+	if (packet != priv->rx_bufs[idx]) {
 		printf("rxd_id %d: packet is not matched,\n", idx);
 		return -EAGAIN;
 	}
@@ -323,12 +323,17 @@ void sandbox_eth_set_priv(int index, void *priv)
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uchar **bufs;
 
 	debug("eth_sandbox: Start\n");
 
+	bufs = eth_alloc_rx_bufs(dev, PKTBUFSRX);
+	if (!bufs)
+		return -ENOMEM;
+
 	priv->recv_packets = 0;
 	for (int i = 0; i < PKTBUFSRX; i++) {
-		priv->recv_packet_buffer[i] = net_rx_packets[i];
+		priv->recv_packet_buffer[i] = bufs[i];
 		priv->recv_packet_length[i] = 0;
 	}
 
@@ -370,18 +375,20 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uchar *done;
 	int i;
 
 	if (!priv->recv_packets)
 		return 0;
 
+	/* move the buffers along rather than the packets in them */
+	done = priv->recv_packet_buffer[0];
 	--priv->recv_packets;
 	for (i = 0; i < priv->recv_packets; i++) {
 		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
-		memcpy(priv->recv_packet_buffer[i],
-		       priv->recv_packet_buffer[i + 1],
-		       priv->recv_packet_length[i + 1]);
+		priv->recv_packet_buffer[i] = priv->recv_packet_buffer[i + 1];
 	}
+	priv->recv_packet_buffer[priv->recv_packets] = done;
 	priv->recv_packet_length[priv->recv_packets] = 0;
 
 	return 0;
@@ -12,20 +12,21 @@
 #include <log.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <nvme.h>
 #include <time.h>
 #include <dm/device-internal.h>
 #include <linux/compat.h>
 #include "nvme.h"
 
+/* I/O queue depth of controllers with their own command submission */
 #define NVME_Q_DEPTH		2
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
-#define NVME_CQ_ALLOCATION	ALIGN(NVME_CQ_SIZE(NVME_Q_DEPTH), \
-				      ARCH_DMA_MINALIGN)
+#define NVME_CQ_ALLOCATION(depth)	ALIGN(NVME_CQ_SIZE(depth), \
+					      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
 
 static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 {
@@ -45,22 +46,31 @@ static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prps() - fill in the PRP list for a transfer
+ *
+ * @dev:	NVMe device
+ * @prp2:	Returns the value for the PRP2 field of the command
+ * @total_len:	Length of the transfer in bytes
+ * @dma_addr:	Address of the data buffer
+ * @prp_list:	PRP list to use, which must hold all entries needed
+ *		for the transfer, see nvme_prp_pages()
+ */
+static void nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
+			    int total_len, u64 dma_addr, u64 *prp_list)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
-	u64 *prp_pool;
+	u64 *prp_pool = prp_list;
 	int length = total_len;
 	int i, nprps;
 	u32 prps_per_page = page_size >> 3;
-	u32 num_pages;
 
 	length -= (page_size - offset);
 
 	if (length <= 0) {
 		*prp2 = 0;
-		return 0;
+		return;
 	}
 
 	if (length)
@@ -68,45 +78,37 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 
 	if (length <= page_size) {
 		*prp2 = dma_addr;
-		return 0;
+		return;
 	}
 
 	nprps = DIV_ROUND_UP(length, page_size);
-	num_pages = DIV_ROUND_UP(nprps, prps_per_page);
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
-		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = prps_per_page * num_pages;
-	}
-
-	prp_pool = dev->prp_pool;
 	i = 0;
 	while (nprps) {
-		if (i == ((page_size >> 3) - 1)) {
+		/* the last entry of a full page chains to the next page */
+		if (i == prps_per_page - 1 && nprps > 1) {
 			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
 					page_size);
 			i = 0;
-			prp_pool += page_size;
+			prp_pool += prps_per_page;
 		}
 		*(prp_pool + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)prp_list;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
-			   dev->prp_entry_num * sizeof(u64));
+	flush_dcache_range((ulong)prp_list,
+			   ALIGN((ulong)(prp_pool + i), ARCH_DMA_MINALIGN));
+}
 
-	return 0;
+/* Number of PRP list pages needed for the largest transfer */
+static u32 nvme_prp_pages(struct nvme_dev *dev)
+{
+	u32 prps_per_page = dev->page_size >> 3;
+	u32 nprps = (1U << dev->max_transfer_shift) / dev->page_size;
+
+	return max_t(u32, DIV_ROUND_UP(nprps, prps_per_page - 1), 1);
 }
 
 static __le16 nvme_get_cmd_id(void)
@@ -125,7 +127,7 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 	 * as the cache line should never become dirty.
 	 */
 	ulong start = (ulong)&nvmeq->cqes[0];
-	ulong stop = start + NVME_CQ_ALLOCATION;
+	ulong stop = start + NVME_CQ_ALLOCATION(nvmeq->q_depth);
 
 	invalidate_dcache_range(start, stop);
 
@@ -234,7 +236,7 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 		return NULL;
 	memset(nvmeq, 0, sizeof(*nvmeq));
 
-	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION);
+	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION(depth));
 	if (!nvmeq->cqes)
 		goto free_nvmeq;
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(depth));
@@ -244,6 +246,22 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 		goto free_queue;
 	memset((void *)nvmeq->sq_cmds, 0, NVME_SQ_SIZE(depth));
 
+	if (qid != NVME_ADMIN_Q) {
+		u32 pool_size = dev->prp_pages * dev->page_size;
+		int i;
+
+		/* one command slot and PRP list per queue entry */
+		nvmeq->slots = calloc(depth, sizeof(*nvmeq->slots));
+		if (!nvmeq->slots)
+			goto free_sq;
+		nvmeq->prp_pool = memalign(dev->page_size, depth * pool_size);
+		if (!nvmeq->prp_pool)
+			goto free_slots;
+		for (i = 0; i < depth; i++)
+			nvmeq->slots[i].prp_list = (void *)nvmeq->prp_pool +
+				i * pool_size;
+	}
+
 	nvmeq->dev = dev;
 
 	nvmeq->cq_head = 0;
@@ -260,6 +278,10 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 
 	return nvmeq;
 
+ free_slots:
+	free(nvmeq->slots);
+ free_sq:
+	free(nvmeq->sq_cmds);
  free_queue:
 	free((void *)nvmeq->cqes);
  free_nvmeq:
@@ -311,6 +333,8 @@ static void nvme_free_queue(struct nvme_queue *nvmeq)
 {
 	free((void *)nvmeq->cqes);
 	free(nvmeq->sq_cmds);
+	free(nvmeq->slots);
+	free(nvmeq->prp_pool);
 	free(nvmeq);
 }
 
@@ -329,14 +353,19 @@ static void nvme_free_queues(struct nvme_dev *dev, int lowest)
 static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 {
 	struct nvme_dev *dev = nvmeq->dev;
+	int i;
 
 	nvmeq->sq_tail = 0;
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
+	nvmeq->inflight = 0;
+	if (nvmeq->slots)
+		for (i = 0; i < nvmeq->q_depth; i++)
+			nvmeq->slots[i].busy = false;
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(nvmeq->q_depth));
 	flush_dcache_range((ulong)nvmeq->cqes,
-			   (ulong)nvmeq->cqes + NVME_CQ_ALLOCATION);
+			   (ulong)nvmeq->cqes + NVME_CQ_ALLOCATION(nvmeq->q_depth));
 	dev->online_queues++;
 }
 
@@ -587,16 +616,19 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	int nr_io_queues;
 	int result;
 
-	nr_io_queues = 1;
+	nr_io_queues = dev->nr_io_queues;
 	result = nvme_set_queue_count(dev, nr_io_queues);
 	if (result <= 0)
 		return result;
+	nr_io_queues = min(nr_io_queues, result);
 
 	dev->max_qid = nr_io_queues;
 
 	/* Free previously allocated queues */
 	nvme_free_queues(dev, nr_io_queues + 1);
 	nvme_create_io_queues(dev);
+	dev->nr_io_queues = dev->online_queues - 1;
+	dev->next_io_q = 0;
 
 	return 0;
 }
@@ -714,70 +746,243 @@ static int nvme_blk_probe(struct udevice *udev)
 	memcpy(desc->vendor, ndev->vendor, sizeof(ndev->vendor));
 	memcpy(desc->product, ndev->serial, sizeof(ndev->serial));
 	memcpy(desc->revision, ndev->firmware_rev, sizeof(ndev->firmware_rev));
+	blk_set_queue_depth(udev, ndev->nr_io_queues * ndev->max_inflight);
 
 	free(id);
 	return 0;
 }
 
-static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+/* Pick the next I/O queue with room for another command, if any */
+static struct nvme_queue *nvme_get_io_queue(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq;
+	unsigned i;
+
+	for (i = 0; i < dev->nr_io_queues; i++) {
+		nvmeq = dev->queues[NVME_IO_Q + dev->next_io_q];
+		if (++dev->next_io_q == dev->nr_io_queues)
+			dev->next_io_q = 0;
+		if (nvmeq->inflight < dev->max_inflight)
+			return nvmeq;
+	}
+
+	return NULL;
+}
+
+/* Drop a reference to a request, completing it if it was the last one */
+static void nvme_req_put(struct blk_request *req, int err)
+{
+	if (err)
+		req->result = err;
+	if (--req->drv_data)
+		return;
+
+	/* requests from nvme_blk_rw() are not known to the uclass */
+	if (req->dev)
+		blk_req_done(req->dev, req,
+			     req->result < 0 ? req->result : req->blkcnt);
+}
+
+static void nvme_io_done(struct nvme_io_slot *slot, int err)
+{
+	struct blk_request *req = slot->req;
+
+	if (slot->read && !err)
+		invalidate_dcache_range((ulong)slot->buffer,
+					(ulong)slot->buffer + slot->len);
+	if (!req)
+		return;
+
+	slot->req = NULL;
+	nvme_req_put(req, err);
+}
+
+/**
+ * nvme_poll_queue() - reap completed commands from an I/O queue
+ *
+ * @nvmeq:	Queue to check
+ * Return: number of commands completed
+ */
+static int nvme_poll_queue(struct nvme_queue *nvmeq)
+{
+	struct nvme_dev *dev = nvmeq->dev;
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	struct nvme_io_slot *slot;
+	int done = 0;
+	u16 status, id;
+	ulong now;
+	int i;
+
+	while (nvmeq->inflight) {
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
+			break;
+		id = readw(&nvmeq->cqes[head].command_id);
+
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+
+		if (id >= nvmeq->q_depth || !nvmeq->slots[id].busy)
+			continue;
+		slot = &nvmeq->slots[id];
+
+		if (ops && ops->complete_cmd)
+			ops->complete_cmd(nvmeq, &nvmeq->sq_cmds[slot->sq_idx]);
+
+		slot->busy = false;
+		nvmeq->inflight--;
+		status >>= 1;
+		if (status)
+			printf("ERROR: status = %x, qid = %d, cmd = %d\n",
+			       status, nvmeq->qid, id);
+		nvme_io_done(slot, status ? -EIO : 0);
+		done++;
+	}
+
+	if (head != nvmeq->cq_head || phase != nvmeq->cq_phase) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+
+	if (done || !nvmeq->inflight)
+		return done;
+
+	/*
+	 * Give up on commands which take too long. Their slot stays busy as
+	 * the controller may still complete them.
+	 */
+	now = timer_get_us();
+	for (i = 0; i < nvmeq->q_depth; i++) {
+		slot = &nvmeq->slots[i];
+		if (slot->busy && slot->req &&
+		    now - slot->start >= IO_TIMEOUT * 100000) {
+			printf("ERROR: timeout, qid = %d, cmd = %d\n",
+			       nvmeq->qid, i);
+			nvme_io_done(slot, -ETIMEDOUT);
+			done++;
+		}
+	}
+
+	return done;
+}
+
+static int nvme_poll_io(struct nvme_dev *dev)
+{
+	unsigned i;
+	int done = 0;
+
+	for (i = 0; i < dev->nr_io_queues; i++)
+		done += nvme_poll_queue(dev->queues[NVME_IO_Q + i]);
+
+	return done;
+}
+
+/**
+ * nvme_queue_rw() - queue the commands for a read or write request
+ *
+ * The request is split at the maximum transfer size of the controller and
+ * the commands are spread over the I/O queues, reaping completions whenever
+ * all queues are full. req->drv_data counts the commands still in flight.
+ *
+ * @ns:		Namespace to access
+ * @req:	Request to queue
+ */
+static void nvme_queue_rw(struct nvme_ns *ns, struct blk_request *req)
 {
-	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
+	bool read = req->op == BLK_REQ_READ;
+	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	uintptr_t temp_buffer = (uintptr_t)req->buffer;
+	u64 total_lbas = req->blkcnt;
+	u64 slba = req->start;
+	struct nvme_io_slot *slot;
+	struct nvme_queue *nvmeq;
 	struct nvme_command c;
-	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
+	ulong start;
 	u64 prp2;
-	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
-	uintptr_t temp_buffer = (uintptr_t)buffer;
-
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
-
-	flush_dcache_range((unsigned long)buffer,
-			   (unsigned long)buffer + total_len);
+	int id;
 
+	memset(&c, 0, sizeof(c));
 	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
 	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+
+	/* hold the request until every command has been queued */
+	req->drv_data = 1;
+	if (!dev->nr_io_queues)
+		req->result = -ENODEV;
+
+	while (total_lbas && !req->result) {
+		start = timer_get_us();
+		while (!(nvmeq = nvme_get_io_queue(dev))) {
+			if (timer_get_us() - start >= IO_TIMEOUT * 100000) {
+				req->result = -ETIMEDOUT;
+				goto out;
+			}
+			nvme_poll_io(dev);
 		}
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
-			return -EIO;
+		for (id = 0; nvmeq->slots[id].busy; id++)
+			;
+		slot = &nvmeq->slots[id];
+
+		if (total_lbas < lbas)
+			lbas = (u16)total_lbas;
+		total_lbas -= lbas;
+
+		slot->req = req;
+		slot->buffer = (void *)temp_buffer;
+		slot->len = lbas << ns->lba_shift;
+		slot->read = read;
+		slot->busy = true;
+		slot->sq_idx = nvmeq->sq_tail;
+		slot->start = timer_get_us();
+
+		flush_dcache_range(temp_buffer, temp_buffer + slot->len);
+		nvme_setup_prps(dev, &prp2, slot->len, temp_buffer,
+				slot->prp_list);
+		c.rw.command_id = cpu_to_le16(id);
 		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
 		c.rw.length = cpu_to_le16(lbas - 1);
 		c.rw.prp1 = cpu_to_le64(temp_buffer);
 		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
-			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		temp_buffer += lbas << ns->lba_shift;
+
+		req->drv_data++;
+		nvmeq->inflight++;
+		nvme_submit_cmd(nvmeq, &c);
+
+		slba += lbas;
+		temp_buffer += slot->len;
 	}
 
-	if (read)
-		invalidate_dcache_range((unsigned long)buffer,
-					(unsigned long)buffer + total_len);
+out:
+	/* drop the hold, which completes the request if nothing is left */
+	nvme_req_put(req, 0);
+}
 
-	return (total_len - temp_len) >> desc->log2blksz;
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct blk_request req = {
+		.op	= read ? BLK_REQ_READ : BLK_REQ_WRITE,
+		.start	= blknr,
+		.blkcnt	= blkcnt,
+		.buffer	= buffer,
+	};
+
+	nvme_queue_rw(ns, &req);
+	while (req.drv_data)
+		nvme_poll_io(ns->dev);
+
+	if (req.result < 0)
+		return req.result;
+
+	return blkcnt;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -792,11 +997,63 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 	return nvme_blk_rw(udev, blknr, blkcnt, (void *)buffer, false);
 }
 
+static int nvme_blk_submit(struct udevice *udev, struct blk_request *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	if (req->op != BLK_REQ_READ && req->op != BLK_REQ_WRITE)
+		return -ENOSYS;
+
+	nvme_queue_rw(ns, req);
+
+	return 0;
+}
+
+static int nvme_blk_poll(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	return nvme_poll_io(ns->dev);
+}
+
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
 };
 
+int nvme_bench(struct udevice *udev, void *buffer, lbaint_t blknr,
+	       lbaint_t blkcnt, ulong *us_qd1, ulong *us_qdn, int *depth)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	int max_inflight = dev->max_inflight;
+	unsigned nr_io_queues = dev->nr_io_queues;
+	ulong start, ret;
+
+	dev->max_inflight = 1;
+	dev->nr_io_queues = min(nr_io_queues, 1U);
+	dev->next_io_q = 0;
+	start = timer_get_us();
+	ret = nvme_blk_rw(udev, blknr, blkcnt, buffer, true);
+	*us_qd1 = timer_get_us() - start;
+	dev->max_inflight = max_inflight;
+	dev->nr_io_queues = nr_io_queues;
+	dev->next_io_q = 0;
+	if (ret != blkcnt)
+		return IS_ERR_VALUE(ret) ? ret : -EIO;
+
+	start = timer_get_us();
+	ret = nvme_blk_rw(udev, blknr, blkcnt, buffer, true);
+	*us_qdn = timer_get_us() - start;
+	if (ret != blkcnt)
+		return IS_ERR_VALUE(ret) ? ret : -EIO;
+	*depth = nr_io_queues * max_inflight;
+
+	return 0;
+}
+
 U_BOOT_DRIVER(nvme_blk) = {
 	.name	= "nvme-blk",
 	.id	= UCLASS_BLK,
@@ -808,6 +1065,7 @@ U_BOOT_DRIVER(nvme_blk) = {
 int nvme_init(struct udevice *udev)
 {
 	struct nvme_dev *ndev = dev_get_priv(udev);
+	struct nvme_ops *ops;
 	struct nvme_id_ns *id;
 	int ret;
 
@@ -819,38 +1077,44 @@ int nvme_init(struct udevice *udev)
 		goto free_nvme;
 	}
 
-	ndev->queues = malloc(NVME_Q_NUM * sizeof(struct nvme_queue *));
+	ops = (struct nvme_ops *)udev->driver->ops;
+	ndev->cap = nvme_readq(&ndev->bar->cap);
+	if (ops && ops->submit_cmd) {
+		/* commands are tracked by the controller-specific code */
+		ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1,
+				      NVME_Q_DEPTH);
+		ndev->nr_io_queues = 1;
+		ndev->max_inflight = 1;
+	} else {
+		ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1,
+				      CONFIG_NVME_QUEUE_DEPTH);
+		ndev->nr_io_queues = CONFIG_NVME_IO_QUEUES;
+		/* a full submission queue holds one entry less than its size */
+		ndev->max_inflight = ndev->q_depth - 1;
+	}
+	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
+	ndev->dbs = ((void __iomem *)ndev->bar) + 4096;
+
+	ndev->queues = calloc(NVME_IO_Q + ndev->nr_io_queues,
+			      sizeof(struct nvme_queue *));
 	if (!ndev->queues) {
 		ret = -ENOMEM;
 		printf("Error: %s: Out of memory!\n", udev->name);
 		goto free_nvme;
 	}
-	memset(ndev->queues, 0, NVME_Q_NUM * sizeof(struct nvme_queue *));
-
-	ndev->cap = nvme_readq(&ndev->bar->cap);
-	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
-	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
-	ndev->dbs = ((void __iomem *)ndev->bar) + 4096;
 
 	ret = nvme_configure_admin_queue(ndev);
 	if (ret)
 		goto free_queue;
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
+	/* The PRP lists of the I/O queues depend on the maximum transfer */
+	nvme_get_info_from_identify(ndev);
+	ndev->prp_pages = nvme_prp_pages(ndev);
 
 	ret = nvme_setup_io_queues(ndev);
 	if (ret)
 		goto free_queue;
 
-	nvme_get_info_from_identify(ndev);
-
 	/* Create a blk device for each namespace */
 
 	id = memalign(ndev->page_size, sizeof(struct nvme_id_ns));
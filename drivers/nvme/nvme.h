@@ -618,18 +618,51 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	u32 prp_entry_num;
+	u32 prp_pages;
 	u32 nn;
+	unsigned nr_io_queues;
+	unsigned next_io_q;
+	int max_inflight;
 };
 
-/* Admin queue and a single I/O queue. */
+/*
+ * The admin queue, followed by the I/O queues. Controllers with their own
+ * command submission only use a single I/O queue.
+ */
 enum nvme_queue_id {
 	NVME_ADMIN_Q,
 	NVME_IO_Q,
 	NVME_Q_NUM,
 };
 
+struct blk_request;
+
+/**
+ * struct nvme_io_slot - an I/O command in flight
+ *
+ * The index of the slot in its queue is used as the command id.
+ *
+ * @req:	Block request the command belongs to, NULL once the command
+ *		has been given up on
+ * @buffer:	Data buffer of the command
+ * @len:	Length of the data in bytes
+ * @read:	true for a read command
+ * @busy:	true while the command is owned by the controller
+ * @sq_idx:	Submission queue entry used by the command
+ * @start:	Time the command was submitted, in microseconds
+ * @prp_list:	Preallocated PRP list of the slot
+ */
+struct nvme_io_slot {
+	struct blk_request *req;
+	void *buffer;
+	u32 len;
+	bool read;
+	bool busy;
+	u16 sq_idx;
+	ulong start;
+	u64 *prp_list;
+};
+
 /*
  * An NVM Express queue. Each device has at least two (one for admin
  * commands and one for I/O commands).
@@ -647,6 +680,9 @@ struct nvme_queue {
 	u16 qid;
 	u8 cq_phase;
 	u8 cqe_seen;
+	int inflight;
+	struct nvme_io_slot *slots;
+	u64 *prp_pool;
 	unsigned long cmdid_data[];
 };
 
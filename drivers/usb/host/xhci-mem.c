@@ -151,9 +151,11 @@ static void xhci_free_virt_devices(struct xhci_ctrl *ctrl)
 
 		ctrl->dcbaa->dev_context_ptrs[slot_id] = 0;
 
-		for (i = 0; i < 31; ++i)
+		for (i = 0; i < 31; ++i) {
 			if (virt_dev->eps[i].ring)
 				xhci_ring_free(virt_dev->eps[i].ring);
+			xhci_free_stream_ctx(&virt_dev->eps[i]);
+		}
 
 		if (virt_dev->in_ctx)
 			xhci_free_container_ctx(virt_dev->in_ctx);
@@ -497,6 +499,69 @@ int xhci_alloc_virt_device(struct xhci_ctrl *ctrl, unsigned int slot_id)
 	return 0;
 }
 
+/**
+ * Frees the stream context array and stream rings of an endpoint, if any
+ *
+ * @param ep	endpoint whose streams are to be freed
+ * Return: none
+ */
+void xhci_free_stream_ctx(struct xhci_virt_ep *ep)
+{
+	unsigned int i;
+
+	if (!ep->stream_ctx)
+		return;
+
+	for (i = 1; i < ep->num_stream_ctxs; i++)
+		xhci_ring_free(ep->stream_rings[i]);
+	free(ep->stream_rings);
+	free(ep->stream_ctx);
+	ep->stream_rings = NULL;
+	ep->stream_ctx = NULL;
+	ep->num_stream_ctxs = 0;
+	ep->ep_state &= ~EP_HAS_STREAMS;
+}
+
+/**
+ * Allocates a linear primary stream context array for an endpoint and a
+ * transfer ring for each stream in it. Stream ID 0 is reserved, so
+ * num_stream_ctxs - 1 streams are usable.
+ *
+ * @param ctrl	Host controller data structure
+ * @param ep	endpoint to set up
+ * @param num_stream_ctxs	size of the array, a power of two
+ * Return: 0 on success else -ENOMEM
+ */
+int xhci_alloc_stream_ctx(struct xhci_ctrl *ctrl, struct xhci_virt_ep *ep,
+			  unsigned int num_stream_ctxs)
+{
+	struct xhci_ring *ring;
+	unsigned int i;
+	u64 val_64;
+
+	xhci_free_stream_ctx(ep);
+
+	ep->stream_rings = calloc(num_stream_ctxs, sizeof(*ep->stream_rings));
+	if (!ep->stream_rings)
+		return -ENOMEM;
+	ep->stream_ctx = xhci_malloc(num_stream_ctxs *
+				     sizeof(struct xhci_stream_ctx));
+	ep->num_stream_ctxs = num_stream_ctxs;
+
+	for (i = 1; i < num_stream_ctxs; i++) {
+		ring = xhci_ring_alloc(ctrl, 1, true);
+		ep->stream_rings[i] = ring;
+		val_64 = xhci_virt_to_bus(ctrl, ring->first_seg->trbs);
+		ep->stream_ctx[i].stream_ring = cpu_to_le64(val_64 |
+				SCT_FOR_CTX(SCT_PRI_TR) | ring->cycle_state);
+	}
+	xhci_flush_cache((uintptr_t)ep->stream_ctx,
+			 num_stream_ctxs * sizeof(struct xhci_stream_ctx));
+	ep->ep_state |= EP_HAS_STREAMS;
+
+	return 0;
+}
+
 /**
  * Allocates the necessary data structures
  * for XHCI host controller
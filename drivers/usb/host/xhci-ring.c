@@ -16,6 +16,7 @@
 #include <common.h>
 #include <cpu_func.h>
 #include <log.h>
+#include <malloc.h>
 #include <asm/byteorder.h>
 #include <usb.h>
 #include <asm/unaligned.h>
@@ -359,13 +360,14 @@ static u32 xhci_td_remainder(struct xhci_ctrl *ctrl, int transferred,
  *
  * @param udev		pointer to the USB device structure
  * @param ep_index	index of the endpoint
+ * @param stream_id	stream the TRBs were queued on, 0 if none
  * @param start_cycle	cycle flag of the first TRB
  * @param start_trb	pionter to the first TRB
  * Return: none
  */
 static void giveback_first_trb(struct usb_device *udev, int ep_index,
-				int start_cycle,
-				struct xhci_generic_trb *start_trb)
+			       unsigned int stream_id, int start_cycle,
+			       struct xhci_generic_trb *start_trb)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
 
@@ -382,7 +384,7 @@ static void giveback_first_trb(struct usb_device *udev, int ep_index,
 
 	/* Ringing EP doorbell here */
 	xhci_writel(&ctrl->dba->doorbell[udev->slot_id],
-				DB_VALUE(ep_index, 0));
+				DB_VALUE(ep_index, stream_id));
 
 	return;
 }
@@ -548,46 +550,56 @@ static void abort_td(struct usb_device *udev, int ep_index)
 	xhci_acknowledge_event(ctrl);
 }
 
-static void record_transfer_result(struct usb_device *udev,
-				   union xhci_trb *event, int length)
+static void get_transfer_result(union xhci_trb *event, int length,
+				int *act_len, unsigned long *status)
 {
-	udev->act_len = min(length, length -
+	*act_len = min(length, length -
 		(int)EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len)));
 
 	switch (GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len))) {
 	case COMP_SUCCESS:
-		BUG_ON(udev->act_len != length);
+		BUG_ON(*act_len != length);
 		/* fallthrough */
 	case COMP_SHORT_TX:
-		udev->status = 0;
+		*status = 0;
 		break;
 	case COMP_STALL:
-		udev->status = USB_ST_STALLED;
+		*status = USB_ST_STALLED;
 		break;
 	case COMP_DB_ERR:
 	case COMP_TRB_ERR:
-		udev->status = USB_ST_BUF_ERR;
+		*status = USB_ST_BUF_ERR;
 		break;
 	case COMP_BABBLE:
-		udev->status = USB_ST_BABBLE_DET;
+		*status = USB_ST_BABBLE_DET;
 		break;
 	default:
-		udev->status = 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
+		*status = 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
 	}
 }
 
+static void record_transfer_result(struct usb_device *udev,
+				   union xhci_trb *event, int length)
+{
+	get_transfer_result(event, length, &udev->act_len, &udev->status);
+}
+
 /**** Bulk and Control transfer methods ****/
 /**
- * Queues up the BULK Request
+ * Queues up a bulk TD on a transfer ring and rings the doorbell
  *
  * @param udev		pointer to the USB device structure
  * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param ring		endpoint or stream ring to queue on
+ * @param stream_id	stream of @ring, 0 for the endpoint ring
  * @param length	length of the buffer
  * @param buffer	buffer to be read/written based on the request
- * Return: returns 0 if successful else -1 on failure
+ * @param last_trb	returns the last TRB of the TD, which has IOC set
+ * Return: 0 if successful else error code on failure
  */
-int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-			int length, void *buffer)
+static int queue_bulk_td(struct usb_device *udev, unsigned long pipe,
+			 struct xhci_ring *ring, unsigned int stream_id,
+			 int length, void *buffer, void **last_trb)
 {
 	int num_trbs = 0;
 	struct xhci_generic_trb *start_trb;
@@ -600,8 +612,6 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	int ep_index;
 	struct xhci_virt_device *virt_dev;
 	struct xhci_ep_ctx *ep_ctx;
-	struct xhci_ring *ring;		/* EP transfer ring */
-	union xhci_trb *event;
 
 	int running_total, trb_buff_len;
 	bool more_trbs_coming = true;
@@ -610,13 +620,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	int ret;
 	u32 trb_fields[4];
 	u64 val_64 = xhci_virt_to_bus(ctrl, buffer);
-	void *last_transfer_trb_addr;
-	int available_length;
 
-	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
-		udev, pipe, buffer, length);
-
-	available_length = length;
 	ep_index = usb_pipe_ep_index(pipe);
 	virt_dev = ctrl->devs[slot_id];
 
@@ -625,7 +629,6 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 
 	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
 
-	ring = virt_dev->eps[ep_index].ring;
 	/*
 	 * How much data is (potentially) left before the 64KB boundary?
 	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
@@ -730,7 +733,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		trb_fields[2] = length_field;
 		trb_fields[3] = field | TRB_TYPE(TRB_NORMAL);
 
-		last_transfer_trb_addr = queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
+		*last_trb = queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
 
 		--num_trbs;
 
@@ -741,7 +744,46 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
 	} while (running_total < length);
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+	giveback_first_trb(udev, ep_index, stream_id, start_cycle, start_trb);
+
+	return 0;
+}
+
+/**
+ * Queues up the BULK Request
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written based on the request
+ * Return: returns 0 if successful else -1 on failure
+ */
+int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
+			int length, void *buffer)
+{
+	u32 field = 0;
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int slot_id = udev->slot_id;
+	int ep_index;
+	struct xhci_virt_device *virt_dev;
+	struct xhci_ring *ring;		/* EP transfer ring */
+	union xhci_trb *event;
+	int ret;
+	void *last_transfer_trb_addr;
+	int available_length;
+
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
+		udev, pipe, buffer, length);
+
+	available_length = length;
+	ep_index = usb_pipe_ep_index(pipe);
+	virt_dev = ctrl->devs[slot_id];
+
+	ring = virt_dev->eps[ep_index].ring;
+	ret = queue_bulk_td(udev, pipe, ring, 0, length, buffer,
+			    &last_transfer_trb_addr);
+	if (ret < 0)
+		return ret;
 
 again:
 	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
@@ -772,6 +814,284 @@ again:
 	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
 }
 
+/* Bookkeeping for one TD of a xhci_bulk_streams_tx() batch */
+struct stream_td {
+	struct xhci_ring *ring;
+	void *last_trb;
+	int available_length;
+	bool done;
+	bool cancelled;
+};
+
+static bool trb_in_ring(struct xhci_ctrl *ctrl, struct xhci_ring *ring,
+			u64 trb_addr)
+{
+	struct xhci_segment *seg = ring->first_seg;
+
+	do {
+		u64 start = xhci_virt_to_bus(ctrl, seg->trbs);
+
+		if (trb_addr >= start && trb_addr < start + SEGMENT_SIZE)
+			return true;
+		seg = seg->next;
+	} while (seg != ring->first_seg);
+
+	return false;
+}
+
+/*
+ * Point the dequeue pointer of an endpoint or stream ring at its enqueue
+ * pointer, dropping whatever is still queued there. The endpoint must be
+ * stopped or halted.
+ */
+static void set_ring_deq(struct usb_device *udev, int ep_index,
+			 unsigned int stream_id, struct xhci_ring *ring)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	union xhci_trb *event;
+	u32 fields[4];
+	u64 val_64;
+
+	val_64 = xhci_virt_to_bus(ctrl, ring->enqueue) | ring->cycle_state;
+	if (stream_id)
+		val_64 |= SCT_FOR_CTX(SCT_PRI_TR);
+
+	BUG_ON(prepare_ring(ctrl, ctrl->cmd_ring, EP_STATE_RUNNING));
+	fields[0] = lower_32_bits(val_64);
+	fields[1] = upper_32_bits(val_64);
+	fields[2] = STREAM_ID_FOR_TRB(stream_id);
+	fields[3] = TRB_TYPE(TRB_SET_DEQ) | SLOT_ID_FOR_TRB(udev->slot_id) |
+		    EP_ID_FOR_TRB(ep_index) | ctrl->cmd_ring->cycle_state;
+	queue_trb(ctrl, ctrl->cmd_ring, false, fields);
+	xhci_writel(&ctrl->dba->doorbell[0], DB_VALUE_HOST);
+
+	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
+	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
+		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
+		event->event_cmd.status)) != COMP_SUCCESS);
+	xhci_acknowledge_event(ctrl);
+
+	ring->dequeue = ring->enqueue;
+	ring->deq_seg = ring->enq_seg;
+}
+
+/*
+ * Wait for the completion event of a Stop or Reset Endpoint command. The
+ * TD the endpoint was stopped in reports a COMP_STOP transfer event first,
+ * which is dropped here.
+ */
+static union xhci_trb *wait_for_ep_cmd(struct xhci_ctrl *ctrl)
+{
+	unsigned long ts = get_timer(0);
+	union xhci_trb *event;
+	u32 code;
+
+	do {
+		event = ctrl->event_ring->dequeue;
+		if (!event_ready(ctrl))
+			continue;
+		if (TRB_FIELD_TO_TYPE(le32_to_cpu(event->event_cmd.flags)) !=
+		    TRB_TRANSFER)
+			break;
+		code = GET_COMP_CODE(le32_to_cpu(
+				event->trans_event.transfer_len));
+		if (code != COMP_STOP && code != COMP_STOP_INVAL)
+			break;
+		xhci_acknowledge_event(ctrl);
+	} while (get_timer(ts) < XHCI_TIMEOUT);
+
+	return xhci_wait_for_event(ctrl, TRB_COMPLETION);
+}
+
+/*
+ * Recover the endpoints of a failed batch: stop (or reset, if halted) each
+ * endpoint that still has a TD outstanding or reported an error, then skip
+ * over everything left on its rings. A halted endpoint has the dequeue
+ * pointer of every stream reset and its halt cleared on the device too.
+ */
+static void abort_stream_tds(struct usb_device *udev,
+			     struct usb_stream_xfer *xfers,
+			     struct stream_td *tds, int count)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	unsigned long pipe = 0;
+	struct xhci_virt_ep *ep;
+	u32 ep_mask = 0;
+	int ep_index, state, i;
+	union xhci_trb *event;
+	unsigned int sid;
+	bool halted;
+
+	for (i = 0; i < count; i++)
+		if (!tds[i].done || xfers[i].status)
+			ep_mask |= BIT(usb_pipe_ep_index(xfers[i].pipe));
+
+	for (ep_index = 0; ep_index < 31; ep_index++) {
+		if (!(ep_mask & BIT(ep_index)))
+			continue;
+		ep = &virt_dev->eps[ep_index];
+
+		xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+				 virt_dev->out_ctx->size);
+		state = le32_to_cpu(xhci_get_ep_ctx(ctrl, virt_dev->out_ctx,
+					ep_index)->ep_info) & EP_STATE_MASK;
+		halted = state == EP_STATE_HALTED;
+		if (halted || state == EP_STATE_RUNNING) {
+			if (halted)
+				printf("Resetting EP %d...\n", ep_index);
+			xhci_queue_command(ctrl, NULL, udev->slot_id, ep_index,
+					   halted ? TRB_RESET_EP : TRB_STOP_RING);
+			event = wait_for_ep_cmd(ctrl);
+			BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(
+				event->event_cmd.flags)) != udev->slot_id);
+			xhci_acknowledge_event(ctrl);
+		}
+
+		for (i = 0; i < count; i++) {
+			if (usb_pipe_ep_index(xfers[i].pipe) != ep_index)
+				continue;
+			pipe = xfers[i].pipe;
+			if (tds[i].done && !xfers[i].status)
+				continue;
+			if (!halted || !ep->num_stream_ctxs)
+				set_ring_deq(udev, ep_index, xfers[i].stream_id,
+					     tds[i].ring);
+			tds[i].done = true;
+		}
+
+		if (!halted)
+			continue;
+		for (sid = 1; sid < ep->num_stream_ctxs; sid++)
+			set_ring_deq(udev, ep_index, sid,
+				     ep->stream_rings[sid]);
+		usb_clear_halt(udev, pipe);
+	}
+}
+
+/**
+ * Queues a batch of bulk TDs, each on its endpoint ring or on one of the
+ * endpoint's stream rings, and waits for all of them. Everything is queued
+ * before waiting so that the device may complete the TDs in any order, as
+ * USB Attached SCSI does with its command, status and data pipes.
+ *
+ * The TDs queued on one ring must fit in it together. A transfer which
+ * names another one in its cancel field stops the wait for that one when it
+ * completes first; the superseded TD is then removed from its ring.
+ *
+ * @param udev		pointer to the USB device structure
+ * @param xfers		transfers to run; act_len and status are filled in
+ * @param count		number of entries in @xfers
+ * Return: 0 if all transfers completed successfully else error code
+ */
+int xhci_bulk_streams_tx(struct usb_device *udev,
+			 struct usb_stream_xfer *xfers, int count)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	struct usb_stream_xfer *xfer;
+	struct xhci_virt_ep *ep;
+	struct stream_td *tds;
+	union xhci_trb *event;
+	int i, ep_index, pending = 0, ret = 0;
+	bool cancelled = false;
+	u64 trb_addr;
+	u32 field;
+
+	tds = calloc(count, sizeof(*tds));
+	if (!tds)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		xfer = &xfers[i];
+		ep = &virt_dev->eps[usb_pipe_ep_index(xfer->pipe)];
+		xfer->act_len = 0;
+		xfer->status = USB_ST_NOT_PROC;
+		tds[i].available_length = xfer->length;
+		if (!xfer->stream_id) {
+			tds[i].ring = ep->ring;
+		} else if (xfer->stream_id < ep->num_stream_ctxs) {
+			tds[i].ring = ep->stream_rings[xfer->stream_id];
+		} else {
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = queue_bulk_td(udev, xfer->pipe, tds[i].ring,
+				    xfer->stream_id, xfer->length, xfer->buffer,
+				    &tds[i].last_trb);
+		if (ret < 0)
+			break;
+		pending++;
+	}
+	/* whatever was queued still has to complete or be aborted */
+	count = pending;
+
+	while (pending) {
+		event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
+		if (!event) {
+			debug("XHCI stream transfer timed out, aborting...\n");
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		field = le32_to_cpu(event->trans_event.flags);
+		ep_index = TRB_TO_EP_INDEX(field);
+		trb_addr = le64_to_cpu(event->trans_event.buffer);
+
+		/* TDs on one ring complete in order: find the oldest one */
+		for (i = 0; i < count; i++)
+			if (!tds[i].done && !tds[i].cancelled &&
+			    usb_pipe_ep_index(xfers[i].pipe) == ep_index &&
+			    trb_in_ring(ctrl, tds[i].ring, trb_addr))
+				break;
+		if (TRB_TO_SLOT_ID(field) != udev->slot_id || i == count) {
+			xhci_acknowledge_event(ctrl);
+			continue;
+		}
+
+		xfer = &xfers[i];
+		if (trb_addr != xhci_virt_to_bus(ctrl, tds[i].last_trb) &&
+		    (GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len))
+		     == COMP_SHORT_TX)) {
+			/* short packet in the middle of the TD */
+			tds[i].available_length -= (int)EVENT_TRB_LEN(
+				le32_to_cpu(event->trans_event.transfer_len));
+			xhci_acknowledge_event(ctrl);
+			continue;
+		}
+
+		get_transfer_result(event, tds[i].available_length,
+				    &xfer->act_len, &xfer->status);
+		xhci_acknowledge_event(ctrl);
+		xhci_inval_cache((uintptr_t)xfer->buffer, xfer->length);
+		tds[i].done = true;
+		pending--;
+		if (xfer->status) {
+			ret = -EIO;
+			break;
+		}
+
+		/* the device will not run the TD this one supersedes */
+		if (xfer->cancel) {
+			i = xfer->cancel - xfers;
+			if (i >= 0 && i < count && !tds[i].done &&
+			    !tds[i].cancelled) {
+				tds[i].cancelled = true;
+				xfers[i].status = 0;
+				cancelled = true;
+				pending--;
+			}
+		}
+	}
+
+	if (pending || ret || cancelled)
+		abort_stream_tds(udev, xfers, tds, count);
+	free(tds);
+
+	return ret;
+}
+
 /**
  * Queues up the Control Transfer Request
  *
@@ -943,7 +1263,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 
 	queue_trb(ctrl, ep_ring, false, trb_fields);
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+	giveback_first_trb(udev, ep_index, 0, start_cycle, start_trb);
 
 	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
 	if (!event)
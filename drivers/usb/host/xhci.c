@@ -36,6 +36,7 @@
 #include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/iopoll.h>
+#include <linux/log2.h>
 
 #ifndef CONFIG_USB_MAX_CONTROLLER_COUNT
 #define CONFIG_USB_MAX_CONTROLLER_COUNT 1
@@ -1477,6 +1478,81 @@ static int xhci_update_hub_device(struct udevice *dev, struct usb_device *udev)
 	return xhci_configure_endpoints(udev, false);
 }
 
+/*
+ * Give each endpoint of @pipes a linear primary stream context array with
+ * at least @num_streams usable streams, and reconfigure the endpoints so
+ * the xHC uses it. See xHCI spec 4.12.2.
+ */
+static int xhci_alloc_streams(struct udevice *dev, struct usb_device *udev,
+			      unsigned long *pipes, int num_pipes,
+			      unsigned int num_streams)
+{
+	struct xhci_ctrl *ctrl = dev_get_priv(dev);
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	struct xhci_container_ctx *out_ctx = virt_dev->out_ctx;
+	struct xhci_container_ctx *in_ctx = virt_dev->in_ctx;
+	struct xhci_input_control_ctx *ctrl_ctx;
+	struct xhci_ep_ctx *ep_ctx;
+	unsigned int num_stream_ctxs;
+	u32 hcc_params, ep_flags = 0;
+	int i, ep_index, ret;
+
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+
+	/* A MaxPSASize of 0 (two entries) means no stream support */
+	hcc_params = xhci_readl(&ctrl->hccr->cr_hccparams);
+	if (udev->speed < USB_SPEED_SUPER || HCC_MAX_PSA(hcc_params) < 4)
+		return -ENOSYS;
+
+	/* Stream 0 is reserved, the smallest array has four entries */
+	num_stream_ctxs = roundup_pow_of_two(num_streams + 1);
+	num_stream_ctxs = clamp_t(unsigned int, num_stream_ctxs, 4,
+				  HCC_MAX_PSA(hcc_params));
+
+	ctrl_ctx = xhci_get_input_control_ctx(in_ctx);
+	xhci_inval_cache((uintptr_t)out_ctx->bytes, out_ctx->size);
+	xhci_slot_copy(ctrl, in_ctx, out_ctx);
+
+	for (i = 0; i < num_pipes; i++) {
+		ep_index = usb_pipe_ep_index(pipes[i]);
+		ret = xhci_alloc_stream_ctx(ctrl, &virt_dev->eps[ep_index],
+					    num_stream_ctxs);
+		if (ret)
+			goto err;
+
+		xhci_endpoint_copy(ctrl, in_ctx, out_ctx, ep_index);
+		ep_ctx = xhci_get_ep_ctx(ctrl, in_ctx, ep_index);
+		ep_ctx->ep_info &= cpu_to_le32(~(EP_MAXPSTREAMS_MASK |
+						 EP_STATE_MASK));
+		ep_ctx->ep_info |= cpu_to_le32(EP_HAS_LSA |
+				EP_MAXPSTREAMS(ilog2(num_stream_ctxs) - 1));
+		ep_ctx->deq = cpu_to_le64(xhci_virt_to_bus(ctrl,
+					  virt_dev->eps[ep_index].stream_ctx));
+		ep_flags |= 1 << (ep_index + 1);
+	}
+
+	/* Drop and re-add the endpoints so the new contexts take effect */
+	ctrl_ctx->drop_flags = cpu_to_le32(ep_flags);
+	ctrl_ctx->add_flags = cpu_to_le32(ep_flags | SLOT_FLAG);
+
+	ret = xhci_configure_endpoints(udev, false);
+	if (ret)
+		goto err;
+
+	return num_stream_ctxs - 1;
+err:
+	for (i = 0; i < num_pipes; i++)
+		xhci_free_stream_ctx(&virt_dev->eps[usb_pipe_ep_index(pipes[i])]);
+	return ret;
+}
+
+static int xhci_bulk_streams(struct udevice *dev, struct usb_device *udev,
+			     struct usb_stream_xfer *xfers, int count)
+{
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+	return xhci_bulk_streams_tx(udev, xfers, count);
+}
+
 static int xhci_get_max_xfer_size(struct udevice *dev, size_t *size)
 {
 	/*
@@ -1545,6 +1621,8 @@ struct dm_usb_ops xhci_usb_ops = {
 	.alloc_device = xhci_alloc_device,
 	.update_hub_device = xhci_update_hub_device,
 	.get_max_xfer_size  = xhci_get_max_xfer_size,
+	.alloc_streams = xhci_alloc_streams,
+	.bulk_streams = xhci_bulk_streams,
 };
 
 #endif
@@ -7,52 +7,187 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
 #include "virtio_blk.h"
 
+/*
+ * Large transfers are split into requests of at most this many sectors,
+ * which are all put on the ring before the device is notified once.
+ */
+#define VIRTIO_BLK_REQ_SECTORS	1024
+/* Upper limit for the number of requests in flight */
+#define VIRTIO_BLK_MAX_INFLIGHT	64
+
+static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+};
+
+/* Header and status of one request, which must live until it completes */
+struct virtio_blk_slot {
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+	bool busy;
+	struct blk_request *req;
+};
+
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	struct virtio_blk_slot *slots;
+	int nslots;
+	int inflight;
+	lbaint_t req_sectors;
 };
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+static void virtio_blk_req_put(struct blk_request *req, int err)
+{
+	if (err)
+		req->result = err;
+	if (--req->drv_data)
+		return;
+
+	/* requests from virtio_blk_do_req() are not known to the uclass */
+	if (req->dev)
+		blk_req_done(req->dev, req,
+			     req->result < 0 ? req->result : req->blkcnt);
+}
+
+/**
+ * virtio_blk_reap() - complete the requests the device has handed back
+ *
+ * @dev:	virtio block device
+ * Return: number of requests completed
+ */
+static int virtio_blk_reap(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	unsigned int num_out = 0, num_in = 0;
+	struct virtio_blk_slot *slot;
+	void *hdr;
+	int done = 0;
+
+	/* the first buffer of each request is its header */
+	while ((hdr = virtqueue_get_buf(priv->vq, NULL))) {
+		slot = container_of(hdr, struct virtio_blk_slot, out_hdr);
+		slot->busy = false;
+		priv->inflight--;
+		virtio_blk_req_put(slot->req, slot->status == VIRTIO_BLK_S_OK ?
+				   0 : -EIO);
+		done++;
+	}
+
+	return done;
+}
+
+static struct virtio_blk_slot *virtio_blk_get_slot(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int i;
+
+	for (;;) {
+		if (priv->inflight < priv->nslots) {
+			for (i = 0; i < priv->nslots; i++)
+				if (!priv->slots[i].busy)
+					return &priv->slots[i];
+		}
+
+		/* let the device work through what is queued already */
+		virtqueue_kick(priv->vq);
+		virtio_blk_reap(dev);
+	}
+}
+
+/**
+ * virtio_blk_queue() - put a request on the ring
+ *
+ * The request is split into chunks of at most req_sectors, each of which
+ * becomes a separate virtio-blk request. The device is notified once, after
+ * all chunks are queued, unless the ring fills up before that.
+ *
+ * req->drv_data counts the chunks that are still outstanding.
+ *
+ * @dev:	virtio block device
+ * @req:	Request to queue
+ */
+static void virtio_blk_queue(struct udevice *dev, struct blk_request *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	bool out = req->op == BLK_REQ_WRITE;
+	u32 type = out ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	lbaint_t sector = req->start;
+	lbaint_t left = req->blkcnt;
+	void *buffer = req->buffer;
+	struct virtio_blk_slot *slot;
 	struct virtio_sg *sgs[3];
-	u8 status;
+	struct virtio_sg hdr_sg, data_sg, status_sg;
+	lbaint_t count;
 	int ret;
 
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
-	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	req->result = 0;
+	/* hold a reference until everything is queued */
+	req->drv_data = 1;
 
-	sgs[num_out++] = &hdr_sg;
+	while (left) {
+		count = min(left, priv->req_sectors);
+		slot = virtio_blk_get_slot(dev);
+		slot->out_hdr.type = cpu_to_virtio32(dev, type);
+		slot->out_hdr.ioprio = 0;
+		slot->out_hdr.sector = cpu_to_virtio64(dev, sector);
+		slot->status = VIRTIO_BLK_S_IOERR;
+		slot->req = req;
 
-	if (type & VIRTIO_BLK_T_OUT)
-		sgs[num_out++] = &data_sg;
-	else
-		sgs[num_out + num_in++] = &data_sg;
+		hdr_sg.addr = &slot->out_hdr;
+		hdr_sg.length = sizeof(slot->out_hdr);
+		data_sg.addr = buffer;
+		data_sg.length = count * 512;
+		status_sg.addr = &slot->status;
+		status_sg.length = sizeof(slot->status);
+		sgs[0] = &hdr_sg;
+		sgs[1] = &data_sg;
+		sgs[2] = &status_sg;
 
-	sgs[num_out + num_in++] = &status_sg;
+		ret = virtqueue_add(priv->vq, sgs, out ? 2 : 1, out ? 1 : 2);
+		if (ret == -ENOSPC) {
+			/* the ring is full, wait for some descriptors */
+			virtqueue_kick(priv->vq);
+			virtio_blk_reap(dev);
+			continue;
+		}
+		if (ret) {
+			req->result = ret;
+			break;
+		}
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
-		return ret;
+		slot->busy = true;
+		priv->inflight++;
+		req->drv_data++;
+		sector += count;
+		buffer += count * 512;
+		left -= count;
+	}
 
 	virtqueue_kick(priv->vq);
+	virtio_blk_req_put(req, 0);
+}
 
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
+			       lbaint_t blkcnt, void *buffer, u32 type)
+{
+	struct blk_request req = {
+		.op	= type == VIRTIO_BLK_T_OUT ? BLK_REQ_WRITE :
+						     BLK_REQ_READ,
+		.start	= sector,
+		.blkcnt	= blkcnt,
+		.buffer	= buffer,
+	};
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+	virtio_blk_queue(dev, &req);
+	while (req.drv_data)
+		virtio_blk_reap(dev);
+
+	return req.result < 0 ? req.result : blkcnt;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
@@ -69,6 +204,21 @@ static ulong virtio_blk_write(struct udevice *dev, lbaint_t start,
 				 VIRTIO_BLK_T_OUT);
 }
 
+static int virtio_blk_submit(struct udevice *dev, struct blk_request *req)
+{
+	if (req->op != BLK_REQ_READ && req->op != BLK_REQ_WRITE)
+		return -ENOSYS;
+
+	virtio_blk_queue(dev, req);
+
+	return 0;
+}
+
+static int virtio_blk_poll(struct udevice *dev)
+{
+	return virtio_blk_reap(dev);
+}
+
 static int virtio_blk_bind(struct udevice *dev)
 {
 	struct virtio_dev_priv *uc_priv = dev_get_uclass_priv(dev->parent);
@@ -98,7 +248,8 @@ static int virtio_blk_bind(struct udevice *dev)
 	desc->bdev = dev;
 
 	/* Indicate what driver features we support */
-	virtio_driver_features_init(uc_priv, NULL, 0, NULL, 0);
+	virtio_driver_features_init(uc_priv, feature, ARRAY_SIZE(feature),
+				    feature, ARRAY_SIZE(feature));
 
 	return 0;
 }
@@ -107,6 +258,7 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	u32 size_max;
 	u64 cap;
 	int ret;
 
@@ -119,12 +271,50 @@ static int virtio_blk_probe(struct udevice *dev)
 	virtio_cread(dev, struct virtio_blk_config, capacity, &cap);
 	desc->lba = cap;
 
+	/* each request carries its data in a single segment */
+	priv->req_sectors = VIRTIO_BLK_REQ_SECTORS;
+	ret = virtio_cread_feature(dev, VIRTIO_BLK_F_SIZE_MAX,
+				   struct virtio_blk_config, size_max,
+				   &size_max);
+	if (!ret && size_max >= 512)
+		priv->req_sectors = min_t(lbaint_t, priv->req_sectors,
+					  size_max / 512);
+
+	/*
+	 * Without indirect descriptors each request takes three entries of
+	 * the ring, with them it only takes one
+	 */
+	priv->nslots = priv->vq->vring.num;
+	if (!priv->vq->indirect)
+		priv->nslots /= 3;
+	priv->nslots = clamp(priv->nslots, 1, VIRTIO_BLK_MAX_INFLIGHT);
+	priv->slots = calloc(priv->nslots, sizeof(*priv->slots));
+	if (!priv->slots)
+		return -ENOMEM;
+	blk_set_queue_depth(dev, priv->nslots);
+
 	return 0;
 }
 
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	ret = virtio_reset(dev);
+	if (priv) {
+		free(priv->slots);
+		priv->slots = NULL;
+	}
+
+	return ret;
+}
+
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
@@ -133,7 +323,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto	= sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
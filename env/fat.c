@@ -16,6 +16,7 @@
 #include <search.h>
 #include <errno.h>
 #include <fat.h>
+#include <fs.h>
 #include <mmc.h>
 #include <asm/cache.h>
 #include <asm/global_data.h>
@@ -78,7 +79,7 @@ static int env_fat_save(void)
 		return 1;
 
 	dev = dev_desc->devnum;
-	if (fat_set_blk_dev(dev_desc, &info) != 0) {
+	if (fs_set_blk_dev_drv(fat_set_blk_dev, dev_desc, &info) != 0) {
 		/*
 		 * This printf is embedded in the messages from env_save that
 		 * will calling it. The missing \n is intentional.
@@ -135,7 +136,7 @@ static int env_fat_load(void)
 		goto err_env_relocate;
 
 	dev = dev_desc->devnum;
-	if (fat_set_blk_dev(dev_desc, &info) != 0) {
+	if (fs_set_blk_dev_drv(fat_set_blk_dev, dev_desc, &info) != 0) {
 		/*
 		 * This printf is embedded in the messages from env_save that
 		 * will calling it. The missing \n is intentional.
@@ -654,6 +654,42 @@ int btrfs_prev_leaf(struct btrfs_root *root, struct btrfs_path *path)
 	return 0;
 }
 
+/*
+ * Sequential walks visit the children of a node in order. If the child at
+ * @slot isn't cached yet, read it along with the siblings stored right
+ * behind it on disk.
+ */
+static void reada_node_slots(struct btrfs_fs_info *fs_info,
+			     struct extent_buffer *parent, int slot)
+{
+	u64 generations[BTRFS_READA_BLOCKS];
+	u32 nritems = btrfs_header_nritems(parent);
+	u32 nodesize = fs_info->nodesize;
+	struct extent_buffer *eb;
+	u64 bytenr;
+	int nr;
+
+	if (slot >= nritems)
+		return;
+
+	bytenr = btrfs_node_blockptr(parent, slot);
+	eb = btrfs_find_tree_block(fs_info, bytenr, nodesize);
+	if (eb) {
+		free_extent_buffer(eb);
+		return;
+	}
+
+	for (nr = 0; nr < BTRFS_READA_BLOCKS && slot + nr < nritems; nr++) {
+		if (btrfs_node_blockptr(parent, slot + nr) !=
+		    bytenr + (u64)nr * nodesize)
+			break;
+		generations[nr] = btrfs_node_ptr_generation(parent, slot + nr);
+	}
+
+	if (nr > 1)
+		readahead_tree_blocks(fs_info, bytenr, generations, nr);
+}
+
 /*
  * Walk up the tree as far as necessary to find the next sibling tree block.
  * More generic version of btrfs_next_leaf(), as it could find sibling nodes
@@ -684,6 +720,7 @@ int btrfs_next_sibling_tree_block(struct btrfs_fs_info *fs_info,
 			continue;
 		}
 
+		reada_node_slots(fs_info, c, slot);
 		next = read_node_slot(fs_info, c, slot);
 		if (!extent_buffer_uptodate(next))
 			return -EIO;
@@ -698,6 +735,7 @@ int btrfs_next_sibling_tree_block(struct btrfs_fs_info *fs_info,
 		path->slots[level] = 0;
 		if (level == path->lowest_level)
 			break;
+		reada_node_slots(fs_info, next, 0);
 		next = read_node_slot(fs_info, next, 0);
 		if (!extent_buffer_uptodate(next))
 			return -EIO;
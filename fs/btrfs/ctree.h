@@ -68,6 +68,9 @@ struct btrfs_path {
 
 #define BTRFS_MAX_EXTENT_SIZE SZ_128M
 
+/* sibling tree blocks read in one go by sequential tree walks */
+#define BTRFS_READA_BLOCKS	8
+
 enum btrfs_tree_block_status {
 	BTRFS_TREE_BLOCK_CLEAN,
 	BTRFS_TREE_BLOCK_INVALID_NRITEMS,
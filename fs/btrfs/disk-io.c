@@ -533,10 +533,79 @@ struct extent_buffer* read_tree_block(struct btrfs_fs_info *fs_info, u64 bytenr,
 	 * We failed to read this tree block, it be should deleted right now
 	 * to avoid stale cache populate the cache.
 	 */
-	free_extent_buffer(eb);
+	free_extent_buffer_nocache(eb);
 	return ERR_PTR(ret);
 }
 
+/*
+ * Read @nr tree blocks laid out one after the other from @bytenr on with a
+ * single device read, as far as the chunk mapping keeps them contiguous,
+ * and leave them in the extent buffer cache.
+ * @generations holds the parent transid of each of them.
+ *
+ * Blocks which don't verify are dropped again, read_tree_block() goes
+ * through the other mirrors for them when they are really needed.
+ */
+void readahead_tree_blocks(struct btrfs_fs_info *fs_info, u64 bytenr,
+			   const u64 *generations, int nr)
+{
+	u32 nodesize = fs_info->nodesize;
+	struct btrfs_multi_bio *multi = NULL;
+	struct btrfs_device *device;
+	struct extent_buffer *buf, *eb;
+	u64 read_len = (u64)nr * nodesize;
+	int i, ret;
+
+	ret = btrfs_map_block(fs_info, READ, bytenr, &read_len, &multi, 1,
+			      NULL);
+	if (ret)
+		goto out;
+
+	device = multi->stripes[0].dev;
+	nr = min_t(u64, nr, read_len / nodesize);
+	if (nr < 2 || !device->desc || !device->part)
+		goto out;
+
+	buf = alloc_dummy_extent_buffer(fs_info, bytenr, nr * nodesize);
+	if (!buf)
+		goto out;
+
+	ret = read_extent_from_disk(device->desc, device->part,
+				    multi->stripes[0].physical, buf, 0,
+				    nr * nodesize);
+	if (ret)
+		goto free_buf;
+
+	for (i = 0; i < nr; i++) {
+		eb = btrfs_find_create_tree_block(fs_info,
+						  bytenr + i * nodesize);
+		if (!eb)
+			break;
+
+		if (!extent_buffer_uptodate(eb)) {
+			copy_extent_buffer(eb, buf, 0, i * nodesize, nodesize);
+			if (csum_tree_block(fs_info, eb, 1) == 0 &&
+			    check_tree_block(fs_info, eb) == 0 &&
+			    verify_parent_transid(&fs_info->extent_cache, eb,
+						  generations[i], 0) == 0 &&
+			    (btrfs_header_level(eb) ?
+			     btrfs_check_node(fs_info, NULL, eb) :
+			     btrfs_check_leaf(fs_info, NULL, eb)) == 0)
+				btrfs_set_buffer_uptodate(eb);
+		}
+
+		if (extent_buffer_uptodate(eb))
+			free_extent_buffer(eb);
+		else
+			free_extent_buffer_nocache(eb);
+	}
+
+free_buf:
+	free_extent_buffer(buf);
+out:
+	kfree(multi);
+}
+
 int read_extent_data(struct btrfs_fs_info *fs_info, char *data, u64 logical,
 		     u64 *len, int mirror)
 {
@@ -14,6 +14,8 @@
 int read_whole_eb(struct btrfs_fs_info *info, struct extent_buffer *eb, int mirror);
 struct extent_buffer* read_tree_block(struct btrfs_fs_info *fs_info, u64 bytenr,
 		u64 parent_transid);
+void readahead_tree_blocks(struct btrfs_fs_info *fs_info, u64 bytenr,
+			   const u64 *generations, int nr);
 
 int read_extent_data(struct btrfs_fs_info *fs_info, char *data, u64 logical,
 		     u64 *len, int mirror);
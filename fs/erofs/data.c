@@ -206,6 +206,63 @@ static int erofs_read_raw_data(struct erofs_inode *inode, char *buffer,
 	return 0;
 }
 
+/*
+ * Compressed data is read in windows of up to this size ending at the
+ * pcluster being decompressed, so that the pclusters in front of it, which
+ * mkfs.erofs lays out just before it on disk, come in with the same request.
+ */
+#define Z_EROFS_READ_WINDOW	(256 * 1024)
+
+struct z_erofs_read_window {
+	char *buf;
+	unsigned int bufsize;
+	unsigned int deviceid;
+	erofs_off_t pa;
+	unsigned int len;
+};
+
+/*
+ * Return the compressed data of the pcluster at @pa, reading it along with
+ * the pclusters before it that back the @ahead bytes still to be decoded.
+ */
+static char *z_erofs_read_pcluster(struct z_erofs_read_window *win,
+				   struct erofs_map_dev *mdev,
+				   unsigned int plen, erofs_off_t ahead)
+{
+	erofs_off_t pa = mdev->m_pa;
+	erofs_off_t pend = pa + plen;
+	erofs_off_t len;
+	int ret;
+
+	if (win->len && win->deviceid == mdev->m_deviceid &&
+	    pa >= win->pa && pend <= win->pa + win->len)
+		return win->buf + (pa - win->pa);
+
+	len = plen + round_up(ahead, EROFS_BLKSIZ);
+	len = min_t(erofs_off_t, len, max_t(unsigned int, plen,
+					   Z_EROFS_READ_WINDOW));
+	len = min(len, pend);
+
+	if (len > win->bufsize) {
+		char *buf = realloc(win->buf, len);
+
+		if (!buf)
+			return ERR_PTR(-ENOMEM);
+		win->buf = buf;
+		win->bufsize = len;
+	}
+
+	win->len = 0;
+	ret = erofs_dev_read(mdev->m_deviceid, win->buf, pend - len, len);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	win->deviceid = mdev->m_deviceid;
+	win->pa = pend - len;
+	win->len = len;
+	return win->buf + (pa - win->pa);
+}
+
 static int z_erofs_read_data(struct erofs_inode *inode, char *buffer,
 			     erofs_off_t size, erofs_off_t offset)
 {
@@ -214,9 +271,10 @@ static int z_erofs_read_data(struct erofs_inode *inode, char *buffer,
 		.index = UINT_MAX,
 	};
 	struct erofs_map_dev mdev;
+	struct z_erofs_read_window win = { 0 };
+	struct z_erofs_decompress_ctx ctx = { 0 };
 	bool partial;
-	unsigned int bufsize = 0;
-	char *raw = NULL;
+	char *raw;
 	int ret = 0;
 
 	end = offset + size;
@@ -264,17 +322,12 @@ static int z_erofs_read_data(struct erofs_inode *inode, char *buffer,
 			continue;
 		}
 
-		if (map.m_plen > bufsize) {
-			bufsize = map.m_plen;
-			raw = realloc(raw, bufsize);
-			if (!raw) {
-				ret = -ENOMEM;
-				break;
-			}
-		}
-		ret = erofs_dev_read(mdev.m_deviceid, raw, mdev.m_pa, map.m_plen);
-		if (ret < 0)
+		raw = z_erofs_read_pcluster(&win, &mdev, map.m_plen,
+					    end - offset);
+		if (IS_ERR(raw)) {
+			ret = PTR_ERR(raw);
 			break;
+		}
 
 		ret = z_erofs_decompress(&(struct z_erofs_decompress_req) {
 					.in = raw,
@@ -283,13 +336,14 @@ static int z_erofs_read_data(struct erofs_inode *inode, char *buffer,
 					.inputsize = map.m_plen,
 					.decodedlength = length,
 					.alg = map.m_algorithmformat,
-					.partial_decoding = partial
+					.partial_decoding = partial,
+					.ctx = &ctx,
 					 });
 		if (ret < 0)
 			break;
 	}
-	if (raw)
-		free(raw);
+	z_erofs_decompress_ctx_free(&ctx);
+	free(win.buf);
 	return ret < 0 ? ret : 0;
 }
 
@@ -1,6 +1,27 @@
 // SPDX-License-Identifier: GPL-2.0+
 #include "decompress.h"
 
+/*
+ * Compressed data is aligned to the end of its pcluster with the leading
+ * bytes of the first block zero-filled, find out where it really starts.
+ */
+static int z_erofs_fixup_insize(struct z_erofs_decompress_req *rq,
+				unsigned int *inputmargin)
+{
+	const char *src = rq->in;
+	unsigned int margin = 0;
+
+	while (!src[margin & ~PAGE_MASK])
+		if (!(++margin & ~PAGE_MASK))
+			break;
+
+	if (margin >= rq->inputsize)
+		return -EIO;
+
+	*inputmargin = margin;
+	return 0;
+}
+
 #if IS_ENABLED(CONFIG_LZ4)
 #include <u-boot/lz4.h>
 static int z_erofs_decompress_lz4(struct z_erofs_decompress_req *rq)
@@ -15,12 +36,9 @@ static int z_erofs_decompress_lz4(struct z_erofs_decompress_req *rq)
 	if (erofs_sb_has_lz4_0padding()) {
 		support_0padding = true;
 
-		while (!src[inputmargin & ~PAGE_MASK])
-			if (!(++inputmargin & ~PAGE_MASK))
-				break;
-
-		if (inputmargin >= rq->inputsize)
-			return -EIO;
+		ret = z_erofs_fixup_insize(rq, &inputmargin);
+		if (ret)
+			return ret;
 	}
 
 	if (rq->decodedskip) {
@@ -56,6 +74,225 @@ out:
 }
 #endif
 
+#if IS_ENABLED(CONFIG_FS_EROFS_ZIP_LZMA)
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+
+static void *z_erofs_lzma_alloc(void *p, size_t size) { return malloc(size); }
+static void z_erofs_lzma_free(void *p, void *address) { free(address); }
+
+/*
+ * mkfs.erofs stores MicroLZMA streams: the first byte of the range coder,
+ * which is always zero in a plain LZMA stream, carries the bitwise negation
+ * of the lc/lp/pb properties byte and there is no header or end marker.
+ * The whole pcluster output fits in the destination, so it serves as the
+ * dictionary and the dictionary size recorded by mkfs doesn't matter.
+ */
+static int z_erofs_decompress_lzma(struct z_erofs_decompress_req *rq)
+{
+	ISzAlloc alloc = {
+		.Alloc = z_erofs_lzma_alloc,
+		.Free = z_erofs_lzma_free,
+	};
+	unsigned char props[LZMA_PROPS_SIZE] = { 0 };
+	unsigned int inputmargin;
+	unsigned char *src;
+	char *dest = rq->out;
+	char *buff = NULL;
+	SizeT inlen, outlen;
+	ELzmaStatus status;
+	SRes res;
+	int ret;
+
+	ret = z_erofs_fixup_insize(rq, &inputmargin);
+	if (ret)
+		return ret;
+	src = (unsigned char *)rq->in + inputmargin;
+
+	if (rq->decodedskip) {
+		buff = malloc(rq->decodedlength);
+		if (!buff)
+			return -ENOMEM;
+		dest = buff;
+	}
+
+	/* dictionary size: anything no smaller than the output will do */
+	props[0] = ~src[0];
+	put_unaligned_le32(rq->decodedlength, props + 1);
+
+	src[0] = 0;
+	inlen = rq->inputsize - inputmargin;
+	outlen = rq->decodedlength;
+	res = LzmaDecode((Byte *)dest, &outlen, src, &inlen, props,
+			 LZMA_PROPS_SIZE, LZMA_FINISH_ANY, &status, &alloc);
+	src[0] = ~props[0];
+
+	if (res != SZ_OK || outlen != rq->decodedlength) {
+		ret = -EIO;
+		goto out;
+	}
+
+	if (rq->decodedskip)
+		memcpy(rq->out, dest + rq->decodedskip,
+		       rq->decodedlength - rq->decodedskip);
+
+out:
+	if (buff)
+		free(buff);
+
+	return ret;
+}
+#endif
+
+#if IS_ENABLED(CONFIG_FS_EROFS_ZIP_DEFLATE)
+#include <u-boot/zlib.h>
+
+/* raw DEFLATE stream, stop once the requested output has been produced */
+static int z_erofs_decompress_deflate(struct z_erofs_decompress_req *rq)
+{
+	unsigned int inputmargin;
+	char *buff = NULL;
+	z_stream stream;
+	int ret, zret;
+
+	ret = z_erofs_fixup_insize(rq, &inputmargin);
+	if (ret)
+		return ret;
+
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+		return -ENOMEM;
+
+	stream.next_out = (unsigned char *)rq->out;
+	if (rq->decodedskip) {
+		buff = malloc(rq->decodedlength);
+		if (!buff) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		stream.next_out = (unsigned char *)buff;
+	}
+
+	stream.next_in = (unsigned char *)rq->in + inputmargin;
+	stream.avail_in = rq->inputsize - inputmargin;
+	stream.avail_out = rq->decodedlength;
+
+	zret = inflate(&stream, Z_SYNC_FLUSH);
+	if ((zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR) ||
+	    stream.total_out != rq->decodedlength) {
+		ret = -EIO;
+		goto out;
+	}
+
+	if (rq->decodedskip)
+		memcpy(rq->out, buff + rq->decodedskip,
+		       rq->decodedlength - rq->decodedskip);
+
+out:
+	inflateEnd(&stream);
+	if (buff)
+		free(buff);
+
+	return ret;
+}
+#endif
+
+#if IS_ENABLED(CONFIG_FS_EROFS_ZIP_ZSTD)
+#include <linux/zstd.h>
+
+/*
+ * Use the streaming API so that a partial decode can stop as soon as the
+ * requested output is there, sized by the window of the frame itself. The
+ * workspace is kept in the context and only grows within a read.
+ */
+static int z_erofs_decompress_zstd(struct z_erofs_decompress_req *rq)
+{
+	struct z_erofs_decompress_ctx *ctx = rq->ctx;
+	ZSTD_frameParams params;
+	ZSTD_inBuffer in_buf;
+	ZSTD_outBuffer out_buf;
+	ZSTD_DStream *stream;
+	unsigned int inputmargin;
+	size_t wsize, zret;
+	char *buff = NULL;
+	int ret;
+
+	ret = z_erofs_fixup_insize(rq, &inputmargin);
+	if (ret)
+		return ret;
+
+	in_buf.src = rq->in + inputmargin;
+	in_buf.size = rq->inputsize - inputmargin;
+	in_buf.pos = 0;
+
+	zret = ZSTD_getFrameParams(&params, in_buf.src, in_buf.size);
+	if (zret || !params.windowSize)
+		return -EIO;
+
+	wsize = ZSTD_DStreamWorkspaceBound(params.windowSize);
+	if (wsize > ctx->zstd_wsize) {
+		free(ctx->zstd_workspace);
+		ctx->zstd_wsize = 0;
+		ctx->zstd_workspace = malloc(wsize);
+		if (!ctx->zstd_workspace)
+			return -ENOMEM;
+		ctx->zstd_wsize = wsize;
+	}
+
+	stream = ZSTD_initDStream(params.windowSize, ctx->zstd_workspace,
+				  ctx->zstd_wsize);
+	if (!stream) {
+		ret = -EIO;
+		goto out;
+	}
+
+	out_buf.dst = rq->out;
+	if (rq->decodedskip) {
+		buff = malloc(rq->decodedlength);
+		if (!buff) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		out_buf.dst = buff;
+	}
+	out_buf.size = rq->decodedlength;
+	out_buf.pos = 0;
+
+	do {
+		size_t in_pos = in_buf.pos, out_pos = out_buf.pos;
+
+		zret = ZSTD_decompressStream(stream, &out_buf, &in_buf);
+		if (ZSTD_isError(zret) || !zret)
+			break;
+		/* out of input with nothing left buffered */
+		if (in_buf.pos == in_pos && out_buf.pos == out_pos)
+			break;
+	} while (out_buf.pos < out_buf.size);
+
+	if (ZSTD_isError(zret) || out_buf.pos != rq->decodedlength) {
+		ret = -EIO;
+		goto out;
+	}
+
+	if (rq->decodedskip)
+		memcpy(rq->out, buff + rq->decodedskip,
+		       rq->decodedlength - rq->decodedskip);
+
+out:
+	if (buff)
+		free(buff);
+
+	return ret;
+}
+#endif
+
+void z_erofs_decompress_ctx_free(struct z_erofs_decompress_ctx *ctx)
+{
+	free(ctx->zstd_workspace);
+	ctx->zstd_workspace = NULL;
+	ctx->zstd_wsize = 0;
+}
+
 int z_erofs_decompress(struct z_erofs_decompress_req *rq)
 {
 	if (rq->alg == Z_EROFS_COMPRESSION_SHIFTED) {
@@ -70,9 +307,25 @@ int z_erofs_decompress(struct z_erofs_decompress_req *rq)
 		return 0;
 	}
 
+	switch (rq->alg) {
 #if IS_ENABLED(CONFIG_LZ4)
-	if (rq->alg == Z_EROFS_COMPRESSION_LZ4)
+	case Z_EROFS_COMPRESSION_LZ4:
 		return z_erofs_decompress_lz4(rq);
 #endif
+#if IS_ENABLED(CONFIG_FS_EROFS_ZIP_LZMA)
+	case Z_EROFS_COMPRESSION_LZMA:
+		return z_erofs_decompress_lzma(rq);
+#endif
+#if IS_ENABLED(CONFIG_FS_EROFS_ZIP_DEFLATE)
+	case Z_EROFS_COMPRESSION_DEFLATE:
+		return z_erofs_decompress_deflate(rq);
+#endif
+#if IS_ENABLED(CONFIG_FS_EROFS_ZIP_ZSTD)
+	case Z_EROFS_COMPRESSION_ZSTD:
+		return z_erofs_decompress_zstd(rq);
+#endif
+	default:
+		break;
+	}
 	return -EOPNOTSUPP;
 }
@@ -4,6 +4,12 @@
 
 #include "internal.h"
 
+/* decompressor state kept across the pclusters of one read */
+struct z_erofs_decompress_ctx {
+	void *zstd_workspace;
+	size_t zstd_wsize;
+};
+
 struct z_erofs_decompress_req {
 	char *in, *out;
 
@@ -17,8 +23,11 @@ struct z_erofs_decompress_req {
 	/* indicate the algorithm will be used for decompression */
 	unsigned int alg;
 	bool partial_decoding;
+
+	struct z_erofs_decompress_ctx *ctx;
 };
 
 int z_erofs_decompress(struct z_erofs_decompress_req *rq);
+void z_erofs_decompress_ctx_free(struct z_erofs_decompress_ctx *ctx);
 
 #endif
@@ -100,6 +100,19 @@ int erofs_read_superblock(void)
 	sbi.build_time = le64_to_cpu(dsb->build_time);
 	sbi.build_time_nsec = le32_to_cpu(dsb->build_time_nsec);
 
+	if (erofs_sb_has_compr_cfgs()) {
+		sbi.available_compr_algs =
+			le16_to_cpu(dsb->u1.available_compr_algs);
+		if (sbi.available_compr_algs & ~Z_EROFS_ALL_COMPR_ALGS) {
+			erofs_err("unidentified algorithms %x, please upgrade",
+				  sbi.available_compr_algs &
+				  ~Z_EROFS_ALL_COMPR_ALGS);
+			return ret;
+		}
+	} else {
+		sbi.lz4_max_distance = le16_to_cpu(dsb->u1.lz4_max_distance);
+	}
+
 	memcpy(&sbi.uuid, dsb->uuid, sizeof(dsb->uuid));
 	return erofs_init_devices(&sbi, dsb);
 }
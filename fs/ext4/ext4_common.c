@@ -1566,6 +1566,172 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 	}
 }
 
+/*
+ * Extent maps: rather than walking the extent tree for every block that is
+ * read, flatten the whole tree of an inode into a sorted array of runs the
+ * first time the node is read and keep it with the node until it is freed.
+ */
+static int ext4fs_extent_map_add(struct ext4_extent_map **mapp, uint32_t lblk,
+				 uint32_t len, uint64_t pblk)
+{
+	struct ext4_extent_map *map = *mapp;
+	struct ext4_extent_run *run;
+
+	if (map->nr) {
+		run = &map->run[map->nr - 1];
+		if (lblk < run->lblk + run->len)
+			return -EINVAL;
+		/* merge physically contiguous extents */
+		if (run->lblk + run->len == lblk && run->pblk + run->len == pblk &&
+		    run->len + len > run->len) {
+			run->len += len;
+			return 0;
+		}
+	}
+
+	if (map->nr == map->size) {
+		map = realloc(map, sizeof(*map) +
+			      2 * map->size * sizeof(map->run[0]));
+		if (!map)
+			return -ENOMEM;
+		map->size *= 2;
+		*mapp = map;
+	}
+
+	run = &map->run[map->nr++];
+	run->lblk = lblk;
+	run->len = len;
+	run->pblk = pblk;
+
+	return 0;
+}
+
+static int ext4fs_extent_map_tree(struct ext4_extent_map **mapp,
+				  struct ext4_extent_header *eh, int depth)
+{
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+			 get_fs()->dev_desc->log2blksz;
+	struct ext4_extent_idx *index;
+	struct ext4_extent *extent;
+	uint64_t block;
+	char *buf;
+	int i, len, ret = 0;
+
+	if (le16_to_cpu(eh->eh_magic) != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(eh->eh_depth) != depth ||
+	    le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max))
+		return -EINVAL;
+
+	if (!depth) {
+		extent = (struct ext4_extent *)(eh + 1);
+		for (i = 0; i < le16_to_cpu(eh->eh_entries); i++) {
+			len = le16_to_cpu(extent[i].ee_len);
+			/* unwritten extents are left as holes */
+			if (len > EXT_INIT_MAX_LEN)
+				continue;
+			block = le16_to_cpu(extent[i].ee_start_hi);
+			block = (block << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			ret = ext4fs_extent_map_add(mapp,
+					le32_to_cpu(extent[i].ee_block),
+					len, block);
+			if (ret)
+				return ret;
+		}
+		return 0;
+	}
+
+	buf = zalloc(blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	index = (struct ext4_extent_idx *)(eh + 1);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++) {
+		block = le16_to_cpu(index[i].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    buf)) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4fs_extent_map_tree(mapp,
+					     (struct ext4_extent_header *)buf,
+					     depth - 1);
+		if (ret)
+			break;
+	}
+	free(buf);
+
+	return ret;
+}
+
+/**
+ * ext4fs_get_extent_map() - get the extent map of a node, building it
+ *
+ * @node:	node using extents, with its inode read
+ * Return:	the map, or NULL if the extent tree could not be read
+ */
+struct ext4_extent_map *ext4fs_get_extent_map(struct ext2fs_node *node)
+{
+	struct ext4_extent_header *eh;
+	struct ext4_extent_map *map;
+	int ret;
+
+	if (node->extent_map)
+		return node->extent_map;
+
+	eh = (struct ext4_extent_header *)node->inode.b.blocks.dir_blocks;
+	if (le16_to_cpu(eh->eh_depth) > EXT4_MAX_EXTENT_DEPTH)
+		return NULL;
+
+	map = malloc(sizeof(*map) + 4 * sizeof(map->run[0]));
+	if (!map)
+		return NULL;
+	map->nr = 0;
+	map->size = 4;
+
+	ret = ext4fs_extent_map_tree(&map, eh, le16_to_cpu(eh->eh_depth));
+	if (ret) {
+		printf("invalid extent block\n");
+		free(map);
+		return NULL;
+	}
+	debug("ext4: inode %d maps to %u run(s)\n", node->ino, map->nr);
+	node->extent_map = map;
+
+	return map;
+}
+
+/**
+ * ext4fs_find_extent() - find the run covering or following a block
+ *
+ * @map:	extent map
+ * @lblk:	logical block
+ * Return:	index of the last run starting at or before @lblk, -1 if
+ *		@lblk lies before the first run
+ */
+int ext4fs_find_extent(struct ext4_extent_map *map, uint32_t lblk)
+{
+	int lo = 0, hi = map->nr - 1, mid;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (map->run[mid].lblk > lblk)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return hi;
+}
+
+void ext4fs_free_extent_map(struct ext2fs_node *node)
+{
+	free(node->extent_map);
+	node->extent_map = NULL;
+}
+
 static int ext4fs_blockgroup
 	(struct ext2_data *data, int group, struct ext2_block_group *blkgrp)
 {
@@ -2035,6 +2201,7 @@ void ext4fs_close(void)
 		ext4fs_file = NULL;
 	}
 	if (ext4fs_root != NULL) {
+		ext4fs_free_extent_map(&ext4fs_root->diropen);
 		free(ext4fs_root);
 		ext4fs_root = NULL;
 	}
@@ -2042,25 +2209,20 @@ void ext4fs_close(void)
 	ext4fs_reinit_global();
 }
 
-int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
-				struct ext2fs_node **fnode, int *ftype)
+/*
+ * Walk the directory entries of @diro stored between byte offsets @fpos and
+ * @end. With @name, @fnode and @ftype set, stop at the entry called @name
+ * and return 1; otherwise list every entry. Returns 0 when nothing matched
+ * or on error.
+ */
+static int ext4fs_iterate_dirents(struct ext2fs_node *diro, unsigned int fpos,
+				  unsigned int end, char *name,
+				  struct ext2fs_node **fnode, int *ftype)
 {
-	unsigned int fpos = 0;
 	int status;
 	loff_t actread;
-	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
 
-#ifdef DEBUG
-	if (name != NULL)
-		printf("Iterate dir %s\n", name);
-#endif /* of DEBUG */
-	if (!diro->inode_read) {
-		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
-		if (status == 0)
-			return 0;
-	}
-	/* Search the file.  */
-	while (fpos < le32_to_cpu(diro->inode.size)) {
+	while (fpos < end) {
 		struct ext2_dirent dirent;
 
 		status = ext4fs_read_file(diro, fpos,
@@ -2177,6 +2339,240 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 	return 0;
 }
 
+/*
+ * HTree lookup: hash the name, walk the index blocks down to the leaf block
+ * that covers the hash and only scan that leaf (plus its successors while
+ * they continue a hash collision). Any inconsistency in the index makes
+ * the caller fall back to the linear scan.
+ */
+struct dx_frame {
+	char *buf;
+	struct dx_entry *entries;
+	struct dx_entry *at;
+};
+
+static int ext4fs_dx_read_block(struct ext2fs_node *diro, u32 blk, char *buf)
+{
+	unsigned int blksz = EXT2_BLOCK_SIZE(diro->data);
+	loff_t actread;
+
+	if ((u64)blk * blksz >= le32_to_cpu(diro->inode.size))
+		return -1;
+	if (ext4fs_read_file(diro, (loff_t)blk * blksz, blksz, buf,
+			     &actread) < 0 || actread != blksz)
+		return -1;
+
+	return 0;
+}
+
+static struct dx_entry *ext4fs_dx_entries(char *buf, unsigned int offset,
+					  unsigned int blksz)
+{
+	struct dx_countlimit *cl = (struct dx_countlimit *)(buf + offset);
+	unsigned int limit = le16_to_cpu(cl->limit);
+	unsigned int count = le16_to_cpu(cl->count);
+
+	if (!count || count > limit ||
+	    offset + limit * sizeof(struct dx_entry) > blksz)
+		return NULL;
+
+	return (struct dx_entry *)cl;
+}
+
+static inline unsigned int dx_get_count(struct dx_entry *entries)
+{
+	return le16_to_cpu(((struct dx_countlimit *)entries)->count);
+}
+
+static void ext4fs_dx_release(struct dx_frame *frames)
+{
+	int i;
+
+	for (i = 0; i < EXT4_HTREE_LEVEL; i++)
+		free(frames[i].buf);
+}
+
+/* find the index entry covering @hash in each level; returns the depth */
+static int ext4fs_dx_probe(struct ext2fs_node *diro, const char *name,
+			   u32 *hash, struct dx_frame *frames)
+{
+	struct ext2_sblock *sb = &diro->data->sblock;
+	unsigned int blksz = EXT2_BLOCK_SIZE(diro->data);
+	struct dx_entry *entries, *p, *q, *m;
+	struct dx_root_info *info;
+	unsigned int offset;
+	int version, levels, level;
+	char *buf;
+
+	buf = malloc(blksz);
+	if (!buf)
+		return -1;
+	frames[0].buf = buf;
+	if (ext4fs_dx_read_block(diro, 0, buf))
+		return -1;
+
+	/* the root info follows the "." and ".." entries, 12 bytes each */
+	info = (struct dx_root_info *)(buf + 24);
+	if (info->reserved_zero || info->info_length != 8)
+		return -1;
+
+	levels = info->indirect_levels + 1;
+	if (levels > (le32_to_cpu(sb->feature_incompat) &
+		      EXT4_FEATURE_INCOMPAT_LARGEDIR ?
+		      EXT4_HTREE_LEVEL : EXT4_HTREE_LEVEL_COMPAT))
+		return -1;
+
+	version = info->hash_version;
+	if (version <= DX_HASH_TEA &&
+	    le32_to_cpu(sb->flags) & EXT2_FLAGS_UNSIGNED_HASH)
+		version += 3;
+	if (ext4fs_dirhash(name, strlen(name), version, sb->hash_seed, hash))
+		return -1;
+
+	offset = 24 + info->info_length;
+	for (level = 0; ; level++) {
+		entries = ext4fs_dx_entries(buf, offset, blksz);
+		if (!entries)
+			return -1;
+
+		/* last entry whose hash is <= the one we look for */
+		p = entries + 1;
+		q = entries + dx_get_count(entries) - 1;
+		while (p <= q) {
+			m = p + (q - p) / 2;
+			if (le32_to_cpu(m->hash) > *hash)
+				q = m - 1;
+			else
+				p = m + 1;
+		}
+		frames[level].entries = entries;
+		frames[level].at = p - 1;
+
+		if (level + 1 == levels)
+			return levels;
+
+		buf = malloc(blksz);
+		if (!buf)
+			return -1;
+		frames[level + 1].buf = buf;
+		if (ext4fs_dx_read_block(diro,
+					 le32_to_cpu(frames[level].at->block),
+					 buf))
+			return -1;
+		/* interior nodes start with an empty dirent */
+		offset = sizeof(struct ext2_dirent);
+	}
+}
+
+/*
+ * Step to the next leaf if it continues a collision of @hash. Returns 1 if
+ * there is one, 0 if not and -1 on error.
+ */
+static int ext4fs_dx_next_leaf(struct ext2fs_node *diro, u32 hash,
+			       struct dx_frame *frames, int levels)
+{
+	unsigned int blksz = EXT2_BLOCK_SIZE(diro->data);
+	int level = levels - 1;
+	struct dx_entry *entries;
+
+	while (++frames[level].at >= frames[level].entries +
+	       dx_get_count(frames[level].entries)) {
+		if (!level)
+			return 0;
+		level--;
+	}
+
+	if ((le32_to_cpu(frames[level].at->hash) & ~1) != hash)
+		return 0;
+
+	/* reload the index blocks below the level we moved in */
+	while (++level < levels) {
+		if (ext4fs_dx_read_block(diro,
+					 le32_to_cpu(frames[level - 1].at->block),
+					 frames[level].buf))
+			return -1;
+		entries = ext4fs_dx_entries(frames[level].buf,
+					    sizeof(struct ext2_dirent), blksz);
+		if (!entries)
+			return -1;
+		frames[level].entries = entries;
+		frames[level].at = entries;
+	}
+
+	return 1;
+}
+
+/* returns -1 when the directory has no usable index */
+static int ext4fs_dx_find(struct ext2fs_node *diro, char *name,
+			  struct ext2fs_node **fnode, int *ftype)
+{
+	struct dx_frame frames[EXT4_HTREE_LEVEL] = {};
+	unsigned int blksz = EXT2_BLOCK_SIZE(diro->data);
+	u32 flags = le32_to_cpu(diro->inode.flags);
+	unsigned int fpos;
+	int levels, ret;
+	u32 hash;
+
+	if (!(le32_to_cpu(diro->data->sblock.feature_compatibility) &
+	      EXT4_FEATURE_COMPAT_DIR_INDEX) ||
+	    !(flags & EXT4_INDEX_FL) ||
+	    flags & (EXT4_ENCRYPT_FL | EXT4_CASEFOLD_FL))
+		return -1;
+
+	levels = ext4fs_dx_probe(diro, name, &hash, frames);
+	if (levels < 0) {
+		debug("ext4: unusable htree index, scanning directory\n");
+		ext4fs_dx_release(frames);
+		return -1;
+	}
+
+	for (;;) {
+		fpos = le32_to_cpu(frames[levels - 1].at->block) * blksz;
+		if (fpos >= le32_to_cpu(diro->inode.size)) {
+			ret = -1;
+			break;
+		}
+		ret = ext4fs_iterate_dirents(diro, fpos, fpos + blksz, name,
+					     fnode, ftype);
+		if (ret)
+			break;
+		ret = ext4fs_dx_next_leaf(diro, hash, frames, levels);
+		if (ret <= 0)
+			break;
+	}
+
+	ext4fs_dx_release(frames);
+	return ret;
+}
+
+int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
+				struct ext2fs_node **fnode, int *ftype)
+{
+	int status;
+	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
+
+#ifdef DEBUG
+	if (name != NULL)
+		printf("Iterate dir %s\n", name);
+#endif /* of DEBUG */
+	if (!diro->inode_read) {
+		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
+		if (status == 0)
+			return 0;
+	}
+
+	/* Use the hash tree index when looking up a name.  */
+	if (name && fnode && ftype) {
+		status = ext4fs_dx_find(diro, name, fnode, ftype);
+		if (status >= 0)
+			return status;
+	}
+
+	/* Search the file.  */
+	return ext4fs_iterate_dirents(diro, 0, le32_to_cpu(diro->inode.size),
+				      name, fnode, ftype);
+}
+
 static char *ext4fs_read_symlink(struct ext2fs_node *node)
 {
 	char *symlink;
@@ -2341,6 +2737,9 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
+	/* the filesystem may have stayed mounted since the last open */
+	if (ext4fs_file)
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
 	ext4fs_file = NULL;
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
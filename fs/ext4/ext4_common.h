@@ -56,6 +56,11 @@ int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
+int ext4fs_dirhash(const char *name, int len, int version,
+		   const __le32 *seed, u32 *hash);
+struct ext4_extent_map *ext4fs_get_extent_map(struct ext2fs_node *node);
+int ext4fs_find_extent(struct ext4_extent_map *map, uint32_t lblk);
+void ext4fs_free_extent_map(struct ext2fs_node *node);
 
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Directory hash functions used by ext3/ext4 HTree indexed directories.
+ *
+ * Based on fs/ext4/hash.c from the Linux kernel:
+ * Copyright (C) 2002 by Theodore Ts'o
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <ext4fs.h>
+#include <linux/errno.h>
+#include "ext4_common.h"
+
+#define DELTA 0x9E3779B9
+
+static inline u32 dx_rol32(u32 word, unsigned int shift)
+{
+	return (word << shift) | (word >> ((-shift) & 31));
+}
+
+static void dx_tea_transform(u32 buf[4], u32 const in[])
+{
+	u32 sum = 0;
+	u32 b0 = buf[0], b1 = buf[1];
+	u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* F, G and H are basic MD4 functions: selection, majority, parity */
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define DX_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + x, a = dx_rol32(a, s))
+#define K1 0
+#define K2 013240474631UL
+#define K3 015666365641UL
+
+/* Basic cut-down MD4 transform, returns only 32 bits of result */
+static void dx_half_md4_transform(u32 buf[4], u32 const in[8])
+{
+	u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* Round 1 */
+	DX_ROUND(F, a, b, c, d, in[0] + K1,  3);
+	DX_ROUND(F, d, a, b, c, in[1] + K1,  7);
+	DX_ROUND(F, c, d, a, b, in[2] + K1, 11);
+	DX_ROUND(F, b, c, d, a, in[3] + K1, 19);
+	DX_ROUND(F, a, b, c, d, in[4] + K1,  3);
+	DX_ROUND(F, d, a, b, c, in[5] + K1,  7);
+	DX_ROUND(F, c, d, a, b, in[6] + K1, 11);
+	DX_ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+	/* Round 2 */
+	DX_ROUND(G, a, b, c, d, in[1] + K2,  3);
+	DX_ROUND(G, d, a, b, c, in[3] + K2,  5);
+	DX_ROUND(G, c, d, a, b, in[5] + K2,  9);
+	DX_ROUND(G, b, c, d, a, in[7] + K2, 13);
+	DX_ROUND(G, a, b, c, d, in[0] + K2,  3);
+	DX_ROUND(G, d, a, b, c, in[2] + K2,  5);
+	DX_ROUND(G, c, d, a, b, in[4] + K2,  9);
+	DX_ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+	/* Round 3 */
+	DX_ROUND(H, a, b, c, d, in[3] + K3,  3);
+	DX_ROUND(H, d, a, b, c, in[7] + K3,  9);
+	DX_ROUND(H, c, d, a, b, in[2] + K3, 11);
+	DX_ROUND(H, b, c, d, a, in[6] + K3, 15);
+	DX_ROUND(H, a, b, c, d, in[1] + K3,  3);
+	DX_ROUND(H, d, a, b, c, in[5] + K3,  9);
+	DX_ROUND(H, c, d, a, b, in[0] + K3, 11);
+	DX_ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+#undef DX_ROUND
+#undef K1
+#undef K2
+#undef K3
+#undef F
+#undef G
+#undef H
+
+/* The old legacy hash */
+static u32 dx_hack_hash(const char *name, int len, bool is_unsigned)
+{
+	u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	int c;
+
+	while (len--) {
+		if (is_unsigned)
+			c = (unsigned char)*name++;
+		else
+			c = (signed char)*name++;
+		hash = hash1 + (hash0 ^ (c * 7152373));
+
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+static void dx_str2hashbuf(const char *msg, int len, u32 *buf, int num,
+			   bool is_unsigned)
+{
+	u32 pad, val;
+	int i, c;
+
+	pad = (u32)len | ((u32)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4)
+		len = num * 4;
+	for (i = 0; i < len; i++) {
+		if (is_unsigned)
+			c = (unsigned char)msg[i];
+		else
+			c = (signed char)msg[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+/**
+ * ext4fs_dirhash() - compute the HTree hash of a directory entry name
+ *
+ * @name:	name to hash (not necessarily NUL-terminated)
+ * @len:	length of @name
+ * @version:	one of the DX_HASH_* values, already adjusted for the
+ *		signedness requested by the superblock
+ * @seed:	s_hash_seed from the superblock
+ * @hash:	returns the major hash, with the low bit cleared
+ * Return:	0 on success, -EINVAL if @version is not supported
+ */
+int ext4fs_dirhash(const char *name, int len, int version,
+		   const __le32 *seed, u32 *hash)
+{
+	bool is_unsigned = false;
+	u32 in[8], buf[4];
+	u32 h;
+	int i;
+
+	/* Initialize the default seed for the hash checksum functions */
+	buf[0] = 0x67452301;
+	buf[1] = 0xefcdab89;
+	buf[2] = 0x98badcfe;
+	buf[3] = 0x10325476;
+
+	/* An all-zero seed means "use the default" */
+	for (i = 0; i < 4; i++) {
+		if (seed[i]) {
+			for (i = 0; i < 4; i++)
+				buf[i] = le32_to_cpu(seed[i]);
+			break;
+		}
+	}
+
+	switch (version) {
+	case DX_HASH_LEGACY_UNSIGNED:
+		is_unsigned = true;
+		/* fall through */
+	case DX_HASH_LEGACY:
+		h = dx_hack_hash(name, len, is_unsigned);
+		break;
+	case DX_HASH_HALF_MD4_UNSIGNED:
+		is_unsigned = true;
+		/* fall through */
+	case DX_HASH_HALF_MD4:
+		while (len > 0) {
+			dx_str2hashbuf(name, len, in, 8, is_unsigned);
+			dx_half_md4_transform(buf, in);
+			len -= 32;
+			name += 32;
+		}
+		h = buf[1];
+		break;
+	case DX_HASH_TEA_UNSIGNED:
+		is_unsigned = true;
+		/* fall through */
+	case DX_HASH_TEA:
+		while (len > 0) {
+			dx_str2hashbuf(name, len, in, 4, is_unsigned);
+			dx_tea_transform(buf, in);
+			len -= 16;
+			name += 16;
+		}
+		h = buf[0];
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	h &= ~1;
+	if (h == (EXT4_HTREE_EOF_32BIT << 1))
+		h = (EXT4_HTREE_EOF_32BIT - 1) << 1;
+	*hash = h;
+
+	return 0;
+}
@@ -40,8 +40,63 @@ struct ext_filesystem *get_fs(void)
 
 void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 {
-	if ((node != &ext4fs_root->diropen) && (node != currroot))
+	if ((node != &ext4fs_root->diropen) && (node != currroot)) {
+		ext4fs_free_extent_map(node);
 		free(node);
+	}
+}
+
+/* largest single device read, so the byte count fits in an int */
+#define EXT4_MAX_READ	(1 << 30)
+
+/*
+ * Read from a node that uses extents: one device read per run of the
+ * extent map, holes and unwritten extents are zero-filled.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node, loff_t pos,
+			       loff_t len, char *buf)
+{
+	int log2blksz = get_fs()->dev_desc->log2blksz;
+	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data);
+	int blocksize = 1 << log2_fs_blocksize;
+	struct ext4_extent_map *map;
+	struct ext4_extent_run *run;
+	loff_t end = pos + len;
+	loff_t run_end, chunk;
+	uint32_t lblk;
+	int i;
+
+	map = ext4fs_get_extent_map(node);
+	if (!map)
+		return -1;
+
+	while (pos < end) {
+		lblk = pos >> log2_fs_blocksize;
+		i = ext4fs_find_extent(map, lblk);
+		run = i >= 0 ? &map->run[i] : NULL;
+
+		if (run && lblk < run->lblk + run->len) {
+			run_end = (loff_t)(run->lblk + run->len) <<
+				  log2_fs_blocksize;
+			chunk = min3(end, run_end, pos + EXT4_MAX_READ) - pos;
+			if (!ext4fs_devread((lbaint_t)(run->pblk + lblk -
+						       run->lblk) <<
+					    (log2_fs_blocksize - log2blksz),
+					    pos & (blocksize - 1), chunk, buf))
+				return -1;
+		} else {
+			/* hole up to the next run */
+			run_end = i + 1 < map->nr ?
+				  (loff_t)map->run[i + 1].lblk <<
+				  log2_fs_blocksize : end;
+			chunk = min(end, run_end) - pos;
+			memset(buf, 0, chunk);
+		}
+		pos += chunk;
+		buf += chunk;
+	}
+
+	return 0;
 }
 
 /*
@@ -80,6 +135,14 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		ext_cache_fini(&cache);
+		if (ext4fs_read_extents(node, pos, len, buf))
+			return -1;
+		*actread = len;
+		return 0;
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
 	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
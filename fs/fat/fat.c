@@ -22,6 +22,8 @@
 #include <asm/cache.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 
 /*
  * Convert a string to lowercase.  Converts at most 'len' characters,
@@ -39,6 +41,8 @@ static void downcase(char *str, size_t len)
 static struct blk_desc *cur_dev;
 static struct disk_partition cur_part_info;
 
+static void fat_caches_free(void);
+
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
@@ -62,6 +66,7 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	fat_caches_free();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -304,6 +309,146 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/*
+ * Extent maps of recently read files
+ *
+ * Following the cluster chain costs a FAT lookup per cluster, and reading
+ * at an offset used to mean following it from the start of the file every
+ * time. Instead, the chain of a file is turned into a list of contiguous
+ * runs once and kept until the filesystem is closed or written, so reads
+ * only look up the run holding their position and fetch each run with a
+ * single disk_read().
+ */
+#define FAT_EXTENT_MAPS		8
+
+struct fat_extent {
+	__u32	fclust;		/* first cluster of the run, within the file */
+	__u32	clust;		/* first cluster of the run on disk */
+	__u32	count;		/* number of clusters in the run */
+};
+
+struct fat_extent_map {
+	__u32	start;		/* first cluster of the file */
+	__u32	clusters;	/* number of clusters mapped */
+	__u32	nr;		/* number of extents */
+	struct fat_extent ext[];
+};
+
+static struct fat_extent_map *fat_extent_maps[FAT_EXTENT_MAPS];
+static int fat_extent_next;
+
+static void fat_extent_maps_free(void)
+{
+	int i;
+
+	for (i = 0; i < FAT_EXTENT_MAPS; i++) {
+		free(fat_extent_maps[i]);
+		fat_extent_maps[i] = NULL;
+	}
+}
+
+/*
+ * Map the first 'clusters' clusters of the chain starting at 'start'.
+ * Return NULL if the chain is broken or memory runs out.
+ */
+static struct fat_extent_map *fat_map_chain(fsdata *mydata, __u32 start,
+					    __u32 clusters)
+{
+	struct fat_extent_map *map, *tmp;
+	struct fat_extent *ext;
+	__u32 max = 8, clust = start, i;
+
+	map = malloc(sizeof(*map) + max * sizeof(*ext));
+	if (!map)
+		return NULL;
+	map->start = start;
+	map->clusters = clusters;
+	map->nr = 0;
+	ext = NULL;
+
+	for (i = 0; i < clusters; i++) {
+		if (i)
+			clust = get_fatent(mydata, clust);
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			free(map);
+			return NULL;
+		}
+
+		if (ext && ext->clust + ext->count == clust) {
+			ext->count++;
+			continue;
+		}
+
+		if (map->nr == max) {
+			max *= 2;
+			tmp = realloc(map, sizeof(*map) + max * sizeof(*ext));
+			if (!tmp) {
+				free(map);
+				return NULL;
+			}
+			map = tmp;
+		}
+		ext = &map->ext[map->nr++];
+		ext->fclust = i;
+		ext->clust = clust;
+		ext->count = 1;
+	}
+	debug("FAT: chain at 0x%x: %u clusters in %u extents\n", start,
+	      clusters, map->nr);
+
+	return map;
+}
+
+static struct fat_extent_map *fat_get_extent_map(fsdata *mydata,
+						 __u32 start, __u32 clusters)
+{
+	struct fat_extent_map *map;
+	int i;
+
+	for (i = 0; i < FAT_EXTENT_MAPS; i++) {
+		map = fat_extent_maps[i];
+		if (map && map->start == start && map->clusters >= clusters)
+			return map;
+	}
+
+	map = fat_map_chain(mydata, start, clusters);
+	if (!map)
+		return NULL;
+
+	/* replace a map of the same file, or else the oldest one */
+	for (i = 0; i < FAT_EXTENT_MAPS; i++) {
+		if (fat_extent_maps[i] && fat_extent_maps[i]->start == start)
+			break;
+	}
+	if (i == FAT_EXTENT_MAPS) {
+		i = fat_extent_next;
+		fat_extent_next = (fat_extent_next + 1) % FAT_EXTENT_MAPS;
+	}
+	free(fat_extent_maps[i]);
+	fat_extent_maps[i] = map;
+
+	return map;
+}
+
+/* Find the extent holding cluster 'fclust' of the file */
+static struct fat_extent *fat_find_extent(struct fat_extent_map *map,
+					  __u32 fclust)
+{
+	__u32 lo = 0, hi = map->nr - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (map->ext[mid].fclust <= fclust)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return &map->ext[lo];
+}
+
 /**
  * get_contents() - read from file
  *
@@ -324,9 +469,10 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	struct fat_extent_map *map;
+	struct fat_extent *ext;
+	loff_t end, ext_end, off, actsize;
+	__u32 clust;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -336,106 +482,61 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		return 0;
 	}
 
-	if (maxsize > 0 && filesize > pos + maxsize)
-		filesize = pos + maxsize;
-
-	debug("%llu bytes\n", filesize);
-
-	actsize = bytesperclust;
+	end = filesize;
+	if (maxsize > 0 && end > pos + maxsize)
+		end = pos + maxsize;
 
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
+	debug("%llu bytes\n", end);
 
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
+	map = fat_get_extent_map(mydata, START(dentptr),
+				 div_u64(filesize + bytesperclust - 1,
+					 bytesperclust));
+	if (!map)
+		return -1;
 
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
-		}
+	ext = fat_find_extent(map, div_u64(pos, bytesperclust));
+	while (pos < end) {
+		ext_end = (loff_t)(ext->fclust + ext->count) * bytesperclust;
+		off = pos - (loff_t)ext->fclust * bytesperclust;
+		clust = ext->clust + div_u64(off, bytesperclust);
+		off -= (loff_t)(clust - ext->clust) * bytesperclust;
+
+		if (off) {
+			/* read up to the next cluster boundary via a bounce buffer */
+			__u8 *tmp_buffer;
+
+			actsize = min(end - pos + off, (loff_t)bytesperclust);
+			tmp_buffer = malloc_cache_aligned(actsize);
+			if (!tmp_buffer) {
+				debug("Error: allocating buffer\n");
+				return -1;
+			}
 
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
-			printf("Error reading cluster\n");
+			if (get_cluster(mydata, clust, tmp_buffer, actsize)) {
+				printf("Error reading cluster\n");
+				free(tmp_buffer);
+				return -1;
+			}
+			actsize -= off;
+			memcpy(buffer, tmp_buffer + off, actsize);
 			free(tmp_buffer);
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-	}
-
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
+		} else {
+			/* the rest of the run in one go */
+			actsize = min(end, ext_end) - pos;
+			if (get_cluster(mydata, clust, buffer, actsize)) {
+				printf("Error reading cluster\n");
 				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
 		}
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
 		buffer += actsize;
+		pos += actsize;
+		if (pos == ext_end)
+			ext++;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -1031,6 +1132,226 @@ static int fat_itr_isdir(fat_itr *itr)
 	return !!(itr->dent->attr & ATTR_DIR);
 }
 
+/*
+ * Directory name index
+ *
+ * Looking up a name used to mean reading every entry of the directory and
+ * rebuilding its long name. The first lookup in a directory now records a
+ * hash of each long and short name along with where its entry starts, and
+ * later lookups only step the iterator to the entries whose hash matches.
+ * The indexes are kept until the filesystem is closed or written. Without
+ * FS_MOUNT it is closed after every command, so an index would hardly be
+ * used again; lookups then scan the directory up to the first match.
+ */
+#define FAT_DIR_INDEXES		16
+
+struct fat_dir_name {
+	u32	hash;
+	u32	clust;		/* cluster holding the first slot of the entry */
+	u32	idx;		/* index of that slot within the cluster */
+	u32	next;		/* next name in the hash chain, 1-based */
+};
+
+struct fat_dir_index {
+	u32	start;		/* first cluster of the directory */
+	u32	mask;		/* number of hash chains - 1 */
+	struct fat_dir_name *names;
+	u32	chains[];
+};
+
+static struct fat_dir_index *fat_dir_indexes[FAT_DIR_INDEXES];
+static int fat_dir_index_next;
+
+static void fat_dir_index_free(struct fat_dir_index *index)
+{
+	if (index)
+		free(index->names);
+	free(index);
+}
+
+static void fat_caches_free(void)
+{
+	int i;
+
+	fat_extent_maps_free();
+	for (i = 0; i < FAT_DIR_INDEXES; i++) {
+		fat_dir_index_free(fat_dir_indexes[i]);
+		fat_dir_indexes[i] = NULL;
+	}
+}
+
+static u32 fat_name_hash(const char *name, size_t len)
+{
+	u32 hash = 0x811c9dc5;
+
+	/* FNV-1a over the lower-cased name, as names match case-insensitively */
+	while (len--) {
+		hash ^= tolower(*name++);
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+/* Move the iterator back to the start of its directory */
+static void fat_itr_rewind(fat_itr *itr)
+{
+	itr->clust = itr->start_clust;
+	itr->next_clust = itr->start_clust;
+	itr->dent = NULL;
+	itr->remaining = 0;
+	itr->last_cluster = 0;
+}
+
+/*
+ * Move the iterator so that the next call to fat_itr_next() starts at slot
+ * 'idx' of cluster 'clust' of its directory
+ */
+static int fat_itr_seek(fat_itr *itr, u32 clust, u32 idx)
+{
+	unsigned int nbytes;
+
+	fat_itr_rewind(itr);
+	itr->next_clust = clust;
+	if (!idx)
+		return 0;
+
+	if (!fat_next_cluster(itr, &nbytes))
+		return -EIO;
+	itr->dent = (dir_entry *)itr->block + idx - 1;
+	itr->remaining = nbytes / sizeof(dir_entry) - idx;
+
+	return 0;
+}
+
+/* Scan the directory of a rewound iterator and index its names */
+static struct fat_dir_index *fat_dir_index_build(fat_itr *itr)
+{
+	struct fat_dir_name *names = NULL, *tmp;
+	struct fat_dir_index *index;
+	u32 nr = 0, max = 0, size, i, chain;
+	const char *name;
+
+	while (fat_itr_next(itr)) {
+		if (nr + 2 > max) {
+			max = max ? max * 2 : 64;
+			tmp = realloc(names, max * sizeof(*names));
+			if (!tmp)
+				goto err;
+			names = tmp;
+		}
+
+		for (name = itr->name; name; ) {
+			names[nr].hash = fat_name_hash(name, strlen(name));
+			names[nr].clust = itr->dent_clust;
+			names[nr].idx = itr->dent_start - (dir_entry *)itr->block;
+			nr++;
+			name = name != itr->s_name ? itr->s_name : NULL;
+		}
+	}
+
+	/* a read error looks like the end of the directory */
+	if (!itr->dent && !itr->last_cluster)
+		goto err;
+
+	size = nr ? roundup_pow_of_two(nr) : 1;
+	index = malloc(sizeof(*index) + size * sizeof(u32));
+	if (!index)
+		goto err;
+	index->start = itr->start_clust;
+	index->mask = size - 1;
+	index->names = names;
+	memset(index->chains, 0, size * sizeof(u32));
+
+	/* chains list the names in directory order, as a linear scan would */
+	for (i = nr; i--; ) {
+		chain = names[i].hash & index->mask;
+		names[i].next = index->chains[chain];
+		index->chains[chain] = i + 1;
+	}
+	debug("FAT: indexed %u names of directory 0x%x\n", nr, index->start);
+
+	return index;
+err:
+	free(names);
+	return NULL;
+}
+
+static struct fat_dir_index *fat_dir_index_get(fat_itr *itr)
+{
+	struct fat_dir_index *index;
+	int i;
+
+	for (i = 0; i < FAT_DIR_INDEXES; i++) {
+		index = fat_dir_indexes[i];
+		if (index && index->start == itr->start_clust)
+			return index;
+	}
+
+	if (!CONFIG_IS_ENABLED(FS_MOUNT))
+		return NULL;
+
+	index = fat_dir_index_build(itr);
+	fat_itr_rewind(itr);
+	if (!index)
+		return NULL;
+
+	i = fat_dir_index_next;
+	fat_dir_index_next = (fat_dir_index_next + 1) % FAT_DIR_INDEXES;
+	fat_dir_index_free(fat_dir_indexes[i]);
+	fat_dir_indexes[i] = index;
+
+	return index;
+}
+
+/* Does the current entry match the path component 'name'? */
+static int fat_itr_match(fat_itr *itr, const char *name, size_t len)
+{
+	unsigned n = max(strlen(itr->name), len);
+
+	/* check both long and short name: */
+	if (!strncasecmp(name, itr->name, n))
+		return 1;
+
+	return itr->name != itr->s_name && !strncasecmp(name, itr->s_name, n);
+}
+
+/*
+ * Step a rewound iterator to the first entry matching the path component
+ * 'name'. Return 1 if found, 0 if not.
+ */
+static int fat_itr_find(fat_itr *itr, const char *name, size_t len)
+{
+	struct fat_dir_index *index = fat_dir_index_get(itr);
+	struct fat_dir_name *entry;
+	u32 hash, i;
+
+	if (index) {
+		hash = fat_name_hash(name, len);
+		for (i = index->chains[hash & index->mask]; i; i = entry->next) {
+			entry = &index->names[i - 1];
+			if (entry->hash != hash)
+				continue;
+			if (fat_itr_seek(itr, entry->clust, entry->idx) ||
+			    !fat_itr_next(itr))
+				goto scan;
+			if (fat_itr_match(itr, name, len))
+				return 1;
+		}
+
+		return 0;
+	}
+
+scan:
+	fat_itr_rewind(itr);
+	while (fat_itr_next(itr)) {
+		if (fat_itr_match(itr, name, len))
+			return 1;
+	}
+
+	return 0;
+}
+
 /*
  * Helpers:
  */
@@ -1097,39 +1418,25 @@ static int fat_itr_resolve(fat_itr *itr, const char *path, unsigned type)
 		}
 	}
 
-	while (fat_itr_next(itr)) {
-		int match = 0;
-		unsigned n = max(strlen(itr->name), (size_t)(next - path));
-
-		/* check both long and short name: */
-		if (!strncasecmp(path, itr->name, n))
-			match = 1;
-		else if (itr->name != itr->s_name &&
-			 !strncasecmp(path, itr->s_name, n))
-			match = 1;
-
-		if (!match)
-			continue;
+	if (!fat_itr_find(itr, path, next - path))
+		return -ENOENT;
 
-		if (fat_itr_isdir(itr)) {
-			/* recurse into directory: */
-			fat_itr_child(itr, itr);
-			return fat_itr_resolve(itr, next, type);
-		} else if (next[0]) {
-			/*
-			 * If next is not empty then we have a case
-			 * like: /path/to/realfile/nonsense
-			 */
-			debug("bad trailing path: %s\n", next);
-			return -ENOENT;
-		} else if (!(type & TYPE_FILE)) {
-			return -ENOTDIR;
-		} else {
-			return 0;
-		}
+	if (fat_itr_isdir(itr)) {
+		/* recurse into directory: */
+		fat_itr_child(itr, itr);
+		return fat_itr_resolve(itr, next, type);
+	} else if (next[0]) {
+		/*
+		 * If next is not empty then we have a case
+		 * like: /path/to/realfile/nonsense
+		 */
+		debug("bad trailing path: %s\n", next);
+		return -ENOENT;
+	} else if (!(type & TYPE_FILE)) {
+		return -ENOTDIR;
 	}
 
-	return -ENOENT;
+	return 0;
 }
 
 int file_fat_detectfs(void)
@@ -1374,6 +1681,7 @@ void fat_closedir(struct fs_dir_stream *dirs)
 
 void fat_close(void)
 {
+	fat_caches_free();
 }
 
 int fat_uuid(char *uuid_str)
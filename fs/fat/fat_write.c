@@ -1317,6 +1317,9 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 
 	debug("writing %s\n", filename);
 
+	/* cluster chains are about to change */
+	fat_caches_free();
+
 	filename_copy = strdup(filename);
 	if (!filename_copy)
 		return -ENOMEM;
@@ -1565,6 +1568,8 @@ int fat_unlink(const char *filename)
 	int n_entries, ret;
 	char *filename_copy, *dirname, *basename;
 
+	fat_caches_free();
+
 	filename_copy = strdup(filename);
 	if (!filename_copy) {
 		printf("Error: allocating memory\n");
@@ -1642,6 +1647,8 @@ int fat_mkdir(const char *dirname)
 	unsigned int bytesperclust;
 	dir_entry *dotdent = NULL;
 
+	fat_caches_free();
+
 	dirname_copy = strdup(dirname);
 	if (!dirname_copy)
 		goto exit;
@@ -12,6 +12,7 @@
 #include <env.h>
 #include <lmb.h>
 #include <log.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <part.h>
 #include <ext4fs.h>
@@ -24,6 +25,7 @@
 #include <asm/global_data.h>
 #include <asm/io.h>
 #include <div64.h>
+#include <linux/list.h>
 #include <linux/math64.h>
 #include <efi_loader.h>
 #include <squashfs.h>
@@ -415,12 +417,202 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
-int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+/*
+ * The mount table remembers which filesystem was found on each partition,
+ * so that later commands on it do not probe every filesystem type again.
+ * The filesystem drivers only hold the state of one filesystem at a time,
+ * so the most recently used mount (fs_live) is also left open between
+ * commands, along with whatever metadata its driver has cached.
+ */
+struct fs_mount {
+	struct list_head list;
+	struct blk_desc *desc;
+	int part;
+	int fstype;
+	bool stale;
+	unsigned int hits;
+};
+
+static LIST_HEAD(fs_mount_list);
+static struct fs_mount *fs_live;
+
+static struct fs_mount *fs_mount_find(struct blk_desc *desc, int part)
+{
+	struct fs_mount *mnt;
+
+	list_for_each_entry(mnt, &fs_mount_list, list) {
+		if (!mnt->stale && mnt->desc == desc && mnt->part == part)
+			return mnt;
+	}
+
+	return NULL;
+}
+
+static void fs_mount_free(struct fs_mount *mnt)
+{
+	list_del(&mnt->list);
+	free(mnt);
+}
+
+/* release the driver state still held for the live mount */
+static void fs_mount_close_live(void)
+{
+	struct fs_mount *mnt = fs_live;
+
+	if (!mnt)
+		return;
+
+	fs_live = NULL;
+	fs_get_info(mnt->fstype)->close();
+	if (mnt->stale)
+		fs_mount_free(mnt);
+}
+
+/* use the mount table entry for fs_dev_desc/@part, if there is one */
+static int fs_mount_reuse(int part, int fstype)
+{
+	struct fs_mount *mnt = NULL;
+
+	if (fs_dev_desc)
+		mnt = fs_mount_find(fs_dev_desc, part);
+	if (mnt && fstype != FS_TYPE_ANY && fstype != mnt->fstype)
+		mnt = NULL;
+
+	if (!mnt || mnt != fs_live) {
+		fs_mount_close_live();
+		if (!mnt)
+			return -ENOENT;
+
+		/* the type is known, so only that driver needs to look */
+		if (fs_get_info(mnt->fstype)->probe(fs_dev_desc,
+						    &fs_partition)) {
+			fs_mount_free(mnt);
+			return -ENOENT;
+		}
+		fs_live = mnt;
+	} else {
+		mnt->hits++;
+	}
+
+	fs_type = mnt->fstype;
+	fs_dev_part = part;
+
+	return 0;
+}
+
+static void fs_mount_add(int part)
+{
+	struct fs_mount *mnt;
+
+	if (!fs_dev_desc)
+		return;
+
+	/* replace an entry for a different filesystem type */
+	mnt = fs_mount_find(fs_dev_desc, part);
+	if (mnt)
+		fs_mount_free(mnt);
+
+	mnt = calloc(1, sizeof(*mnt));
+	if (!mnt)
+		return;
+	mnt->desc = fs_dev_desc;
+	mnt->part = part;
+	mnt->fstype = fs_type;
+	list_add(&mnt->list, &fs_mount_list);
+	fs_live = mnt;
+}
+
+void fs_mount_invalidate(struct blk_desc *desc)
+{
+	struct fs_mount *mnt, *next;
+
+	list_for_each_entry_safe(mnt, next, &fs_mount_list, list) {
+		if (desc && mnt->desc != desc)
+			continue;
+		if (mnt != fs_live) {
+			fs_mount_free(mnt);
+			continue;
+		}
+
+		/* an operation in progress gets to finish; fs_close() tidies up */
+		mnt->stale = true;
+		if (fs_type == FS_TYPE_ANY)
+			fs_mount_close_live();
+	}
+}
+
+int fs_mount_get_info(int idx, struct fs_mount_info *info)
+{
+	struct fs_mount *mnt;
+
+	list_for_each_entry(mnt, &fs_mount_list, list) {
+		if (mnt->stale || idx--)
+			continue;
+		info->desc = mnt->desc;
+		info->part = mnt->part;
+		info->type = fs_get_info(mnt->fstype)->name;
+		info->active = mnt == fs_live;
+		info->hits = mnt->hits;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+int fs_set_blk_dev_drv(int (*probe)(struct blk_desc *desc,
+				    struct disk_partition *info),
+		       struct blk_desc *desc, struct disk_partition *info)
+{
+	/* this replaces the driver state of any filesystem left mounted */
+	fs_mount_invalidate(NULL);
+
+	return probe(desc, info);
+}
+#endif
+
+/*
+ * Identify the filesystem on fs_dev_desc/fs_partition, only trying @fstype
+ * unless it is FS_TYPE_ANY
+ */
+static int fs_probe(int part, int fstype)
 {
 	struct fstype_info *info;
-	int part, i;
+	int i;
+
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+	if (!fs_mount_reuse(part, fstype))
+		return 0;
+#endif
+
+	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
+		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
+				fstype != info->fstype)
+			continue;
+
+		if (!fs_dev_desc && !info->null_dev_desc_ok)
+			continue;
+
+		if (!info->probe(fs_dev_desc, &fs_partition)) {
+			fs_type = info->fstype;
+			fs_dev_part = part;
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+			fs_mount_add(part);
+#endif
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
+{
+	int part;
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
+	struct fstype_info *info;
 	static int relocated;
+	int i;
 
 	if (!relocated) {
 		for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes);
@@ -441,29 +633,13 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
-	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
-		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
-				fstype != info->fstype)
-			continue;
-
-		if (!fs_dev_desc && !info->null_dev_desc_ok)
-			continue;
-
-		if (!info->probe(fs_dev_desc, &fs_partition)) {
-			fs_type = info->fstype;
-			fs_dev_part = part;
-			return 0;
-		}
-	}
-
-	return -1;
+	return fs_probe(part, fstype);
 }
 
 /* set current blk device w/ blk_desc + partition # */
 int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 {
-	struct fstype_info *info;
-	int ret, i;
+	int ret;
 
 	if (part >= 1)
 		ret = part_get_info(desc, part, &fs_partition);
@@ -473,21 +649,23 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 		return ret;
 	fs_dev_desc = desc;
 
-	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
-		if (!info->probe(fs_dev_desc, &fs_partition)) {
-			fs_type = info->fstype;
-			fs_dev_part = part;
-			return 0;
-		}
-	}
-
-	return -1;
+	return fs_probe(part, FS_TYPE_ANY);
 }
 
 void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+	/* keep the filesystem open for the next command */
+	if (fs_live && fs_type == fs_live->fstype) {
+		if (fs_live->stale)
+			fs_mount_close_live();
+		fs_type = FS_TYPE_ANY;
+		return;
+	}
+#endif
+
 	info->close();
 
 	fs_type = FS_TYPE_ANY;
@@ -905,6 +1083,7 @@ int do_fs_uuid(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 		return 1;
 
 	ret = fs_uuid(uuid);
+	fs_close();
 	if (ret)
 		return CMD_RET_FAILURE;
 
@@ -938,6 +1117,52 @@ int do_fs_type(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 	return CMD_RET_SUCCESS;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+int do_fs_mount(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
+{
+	struct fs_mount_info info;
+	int i;
+
+	if (argc == 3) {
+		if (fs_set_blk_dev(argv[1], argv[2], FS_TYPE_ANY))
+			return CMD_RET_FAILURE;
+		fs_close();
+		return CMD_RET_SUCCESS;
+	}
+	if (argc != 1)
+		return CMD_RET_USAGE;
+
+	for (i = 0; !fs_mount_get_info(i, &info); i++) {
+		printf("%s %d:%d type %s (%s, hits=%u)\n",
+		       blk_get_if_type_name(info.desc->if_type),
+		       info.desc->devnum, info.part, info.type,
+		       info.active ? "open" : "closed", info.hits);
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+int do_fs_umount(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
+{
+	struct disk_partition part_info;
+	struct blk_desc *desc;
+
+	if (argc == 1) {
+		fs_mount_invalidate(NULL);
+		return CMD_RET_SUCCESS;
+	}
+	if (argc != 3)
+		return CMD_RET_USAGE;
+
+	if (part_get_info_by_dev_and_name_or_num(argv[1], argv[2], &desc,
+						 &part_info, 1) < 0)
+		return CMD_RET_FAILURE;
+	fs_mount_invalidate(desc);
+
+	return CMD_RET_SUCCESS;
+}
+#endif
+
 int do_rm(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	  int fstype)
 {
@@ -56,170 +56,381 @@ static int sqfs_read_sblk(struct squashfs_super_block **sblk)
 	return 0;
 }
 
-static int sqfs_count_tokens(const char *filename)
+/*
+ * Reads 'len' bytes at byte position 'pos' of the partition. Used for the
+ * metadata and fragment blocks, which are not aligned to device blocks.
+ */
+static int sqfs_read_bytes(u64 pos, u32 len, void *dest)
 {
-	int token_count = 1, l;
+	u64 start, skip, n_blks;
+	unsigned char *buf;
+	int ret = 0;
 
-	for (l = 1; l < strlen(filename); l++) {
-		if (filename[l] == '/')
-			token_count++;
-	}
+	start = lldiv(pos, ctxt.cur_dev->blksz);
+	skip = pos - start * ctxt.cur_dev->blksz;
+	n_blks = DIV_ROUND_UP(skip + len, ctxt.cur_dev->blksz);
 
-	/* Ignore trailing '/' in path */
-	if (filename[strlen(filename) - 1] == '/')
-		token_count--;
+	buf = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!buf)
+		return -ENOMEM;
 
-	if (!token_count)
-		token_count = 1;
+	if (sqfs_disk_read(start, n_blks, buf) < 0)
+		ret = -EIO;
+	else
+		memcpy(dest, buf + skip, len);
 
-	return token_count;
+	free(buf);
+
+	return ret;
 }
 
-/*
- * Calculates how many blocks are needed for the buffer used in sqfs_disk_read.
- * The memory section (e.g. inode table) start offset and its end (i.e. the next
- * table start) must be specified. It also calculates the offset from which to
- * start reading the buffer.
- */
-static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
+static int sqfs_cache_init(struct squashfs_cache *cache, int count,
+			   u32 block_size)
 {
-	u64 start_, table_size;
+	cache->entries = calloc(count, sizeof(*cache->entries));
+	if (!cache->entries)
+		return -ENOMEM;
 
-	table_size = le64_to_cpu(end) - le64_to_cpu(start);
-	start_ = le64_to_cpu(start) / ctxt.cur_dev->blksz;
-	*offset = le64_to_cpu(start) - (start_ * ctxt.cur_dev->blksz);
+	cache->count = count;
+	cache->block_size = block_size;
+	cache->clock = 0;
 
-	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
+	return 0;
+}
+
+static void sqfs_cache_free(struct squashfs_cache *cache)
+{
+	int i;
+
+	if (!cache->entries)
+		return;
+
+	for (i = 0; i < cache->count; i++)
+		free(cache->entries[i].data);
+
+	free(cache->entries);
+	cache->entries = NULL;
+	cache->count = 0;
 }
 
 /*
- * Retrieves fragment block entry and returns true if the fragment block is
- * compressed
+ * Returns the decompressed block stored at disk position 'block', reading and
+ * decompressing it into the least recently used entry if it is not cached yet.
+ * 'size' is the size word of a data or fragment block; it is 0 for metadata
+ * blocks, which carry their size in a 16-bit header instead.
  */
-static int sqfs_frag_lookup(u32 inode_fragment_index,
-			    struct squashfs_fragment_block_entry *e)
+static int sqfs_cache_get(struct squashfs_cache *cache, u64 block, u32 size,
+			  struct squashfs_cache_entry **entryp)
 {
-	u64 start, n_blks, src_len, table_offset, start_block;
-	unsigned char *metadata_buffer, *metadata, *table;
-	struct squashfs_fragment_block_entry *entries;
-	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct squashfs_cache_entry *entry, *victim = NULL;
+	u64 bytes_used = get_unaligned_le64(&ctxt.sblk->bytes_used);
+	unsigned char *src, *data;
 	unsigned long dest_len;
-	int block, offset, ret;
+	u32 src_len, data_len;
+	bool comp;
 	u16 header;
+	int i, ret;
+
+	for (i = 0; i < cache->count; i++) {
+		entry = &cache->entries[i];
+		if (entry->valid && entry->block == block) {
+			entry->last_use = ++cache->clock;
+			*entryp = entry;
+			return 0;
+		}
 
-	metadata_buffer = NULL;
-	entries = NULL;
-	table = NULL;
+		if (!victim || (victim->valid && (!entry->valid ||
+		    entry->last_use < victim->last_use)))
+			victim = entry;
+	}
 
-	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
-		return -EINVAL;
+	if (size) {
+		src_len = SQFS_BLOCK_SIZE(size);
+	} else {
+		/* A metadata block cannot extend past the end of the image */
+		if (block + SQFS_HEADER_SIZE > bytes_used)
+			return -EINVAL;
+		src_len = min_t(u64, SQFS_HEADER_SIZE +
+				SQFS_METADATA_BLOCK_SIZE, bytes_used - block);
+	}
 
-	start = get_unaligned_le64(&sblk->fragment_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
-				  sblk->export_table_start,
-				  &table_offset);
+	if (!victim->data) {
+		victim->data = malloc(cache->block_size);
+		if (!victim->data)
+			return -ENOMEM;
+	}
 
-	/* Allocate a proper sized buffer to store the fragment index table */
-	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!table) {
-		ret = -ENOMEM;
+	src = malloc(src_len);
+	if (!src)
+		return -ENOMEM;
+
+	ret = sqfs_read_bytes(block, src_len, src);
+	if (ret)
 		goto out;
+
+	if (size) {
+		comp = SQFS_COMPRESSED_BLOCK(size);
+		data = src;
+		data_len = src_len;
+	} else {
+		header = get_unaligned_le16(src);
+		comp = SQFS_COMPRESSED_METADATA(header);
+		data = src + SQFS_HEADER_SIZE;
+		data_len = SQFS_METADATA_SIZE(header);
+		if (!data_len || data_len + SQFS_HEADER_SIZE > src_len) {
+			printf("Invalid metatada block size: %d bytes.\n",
+			       data_len);
+			ret = -EINVAL;
+			goto out;
+		}
 	}
 
-	if (sqfs_disk_read(start, n_blks, table) < 0) {
-		ret = -EINVAL;
-		goto out;
+	victim->valid = false;
+	if (comp) {
+		dest_len = cache->block_size;
+		ret = sqfs_decompress(&ctxt, victim->data, &dest_len, data,
+				      data_len);
+		if (ret) {
+			ret = -EINVAL;
+			goto out;
+		}
+	} else {
+		if (data_len > cache->block_size) {
+			ret = -EINVAL;
+			goto out;
+		}
+		memcpy(victim->data, data, data_len);
+		dest_len = data_len;
 	}
 
-	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
-	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+	victim->block = block;
+	victim->next = block + (data - src) + data_len;
+	victim->length = dest_len;
+	victim->last_use = ++cache->clock;
+	victim->valid = true;
+	*entryp = victim;
 
-	/*
-	 * Get the start offset of the metadata block that contains the right
-	 * fragment block entry
-	 */
-	start_block = get_unaligned_le64(table + table_offset + block *
-					 sizeof(u64));
+out:
+	free(src);
 
-	start = start_block / ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
-				  sblk->fragment_table_start, &table_offset);
+	return ret;
+}
 
-	metadata_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!metadata_buffer) {
-		ret = -ENOMEM;
-		goto out;
+/*
+ * Copies 'len' bytes of a metadata table (inode, directory or fragment table)
+ * to 'dest', starting 'offset' bytes into the metadata block at disk position
+ * 'block'. Both are advanced past the data read, so consecutive calls walk the
+ * table across block boundaries. A NULL 'dest' skips the data.
+ */
+static int sqfs_read_metadata(void *dest, u64 *block, u32 *offset, u32 len)
+{
+	struct squashfs_cache_entry *entry;
+	u32 n;
+	int ret;
+
+	while (len) {
+		ret = sqfs_cache_get(&ctxt.meta_cache, *block, 0, &entry);
+		if (ret)
+			return ret;
+
+		if (*offset >= entry->length)
+			return -EINVAL;
+
+		n = min(len, entry->length - *offset);
+		if (dest) {
+			memcpy(dest, entry->data + *offset, n);
+			dest += n;
+		}
+
+		*offset += n;
+		len -= n;
+		if (*offset == entry->length) {
+			*block = entry->next;
+			*offset = 0;
+		}
 	}
 
-	if (sqfs_disk_read(start, n_blks, metadata_buffer) < 0) {
-		ret = -EINVAL;
-		goto out;
+	return 0;
+}
+
+/*
+ * Reads the inode found 'offset' bytes into the metadata block that starts
+ * 'start' bytes into the inode table, along with its block list, directory
+ * index or symlink target. A symlink target gets a trailing null byte. The
+ * caller frees the returned inode.
+ */
+static void *sqfs_read_inode(u32 start, u32 offset)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	unsigned char head[sizeof(struct squashfs_lreg_inode)];
+	struct squashfs_base_inode *base = (void *)head;
+	struct squashfs_directory_index di;
+	struct squashfs_ldir_inode *ldir;
+	u32 index_offset, sz, i_count, i;
+	u64 block, index_block;
+	unsigned char *inode;
+	int fixed, size;
+	u16 type;
+
+	block = get_unaligned_le64(&sblk->inode_table_start) + start;
+	if (sqfs_read_metadata(head, &block, &offset, sizeof(*base)))
+		return NULL;
+
+	type = get_unaligned_le16(&base->inode_type);
+	fixed = sqfs_inode_fixed_size(type);
+	if (fixed < 0)
+		return NULL;
+
+	if (sqfs_read_metadata(head + sizeof(*base), &block, &offset,
+			       fixed - sizeof(*base)))
+		return NULL;
+
+	if (type == SQFS_LDIR_TYPE) {
+		/* Walk the directory index once to learn its size */
+		ldir = (struct squashfs_ldir_inode *)head;
+		i_count = get_unaligned_le16(&ldir->i_count);
+		index_block = block;
+		index_offset = offset;
+		size = fixed;
+		for (i = 0; i < i_count; i++) {
+			if (sqfs_read_metadata(&di, &index_block,
+					       &index_offset, sizeof(di)))
+				return NULL;
+			sz = get_unaligned_le32(&di.size) + 1;
+			if (sz > SQFS_METADATA_BLOCK_SIZE ||
+			    sqfs_read_metadata(NULL, &index_block,
+					       &index_offset, sz))
+				return NULL;
+			size += sizeof(di) + sz;
+		}
+	} else {
+		size = sqfs_inode_size(base,
+				       get_unaligned_le32(&sblk->block_size));
 	}
+	if (size < fixed)
+		return NULL;
 
-	/* Every metadata block starts with a 16-bit header */
-	header = get_unaligned_le16(metadata_buffer + table_offset);
-	metadata = metadata_buffer + table_offset + SQFS_HEADER_SIZE;
+	inode = malloc(size + 1);
+	if (!inode)
+		return NULL;
 
-	if (!metadata || !header) {
-		ret = -ENOMEM;
-		goto out;
+	memcpy(inode, head, fixed);
+	if (sqfs_read_metadata(inode + fixed, &block, &offset, size - fixed)) {
+		free(inode);
+		return NULL;
 	}
+	inode[size] = '\0';
 
-	entries = malloc(SQFS_METADATA_BLOCK_SIZE);
-	if (!entries) {
-		ret = -ENOMEM;
-		goto out;
+	return inode;
+}
+
+static void *sqfs_read_root_inode(void)
+{
+	u64 ref = get_unaligned_le64(&ctxt.sblk->root_inode);
+
+	return sqfs_read_inode(ref >> 16, ref & 0xffff);
+}
+
+static int sqfs_count_tokens(const char *filename)
+{
+	int token_count = 1, l;
+
+	for (l = 1; l < strlen(filename); l++) {
+		if (filename[l] == '/')
+			token_count++;
 	}
 
-	if (SQFS_COMPRESSED_METADATA(header)) {
-		src_len = SQFS_METADATA_SIZE(header);
-		dest_len = SQFS_METADATA_BLOCK_SIZE;
-		ret = sqfs_decompress(&ctxt, entries, &dest_len, metadata,
-				      src_len);
+	/* Ignore trailing '/' in path */
+	if (filename[strlen(filename) - 1] == '/')
+		token_count--;
+
+	if (!token_count)
+		token_count = 1;
+
+	return token_count;
+}
+
+/*
+ * Retrieves fragment block entry and returns true if the fragment block is
+ * compressed
+ */
+static int sqfs_frag_lookup(u32 inode_fragment_index,
+			    struct squashfs_fragment_block_entry *e)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	u32 fragments, offset;
+	int n_blks, ret;
+	u64 block;
+
+	fragments = get_unaligned_le32(&sblk->fragments);
+	if (inode_fragment_index >= fragments)
+		return -EINVAL;
+
+	/* The index of the fragment table is loaded once per mount */
+	if (!ctxt.frag_index) {
+		n_blks = DIV_ROUND_UP(fragments, SQFS_MAX_ENTRIES);
+		ctxt.frag_index = malloc(n_blks * sizeof(u64));
+		if (!ctxt.frag_index)
+			return -ENOMEM;
+
+		ret = sqfs_read_bytes(get_unaligned_le64(&sblk->fragment_table_start),
+				      n_blks * sizeof(u64), ctxt.frag_index);
 		if (ret) {
-			ret = -EINVAL;
-			goto out;
+			free(ctxt.frag_index);
+			ctxt.frag_index = NULL;
+			return ret;
 		}
-	} else {
-		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
 	}
 
-	*e = entries[offset];
-	ret = SQFS_COMPRESSED_BLOCK(e->size);
+	block = get_unaligned_le64(&ctxt.frag_index[SQFS_FRAGMENT_INDEX(inode_fragment_index)]);
+	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index) * sizeof(*e);
 
-out:
-	free(entries);
-	free(metadata_buffer);
-	free(table);
+	ret = sqfs_read_metadata(e, &block, &offset, sizeof(*e));
+	if (ret)
+		return -EINVAL;
 
-	return ret;
+	e->start = le64_to_cpu(e->start);
+	e->size = le32_to_cpu(e->size);
+
+	return SQFS_COMPRESSED_BLOCK(e->size);
 }
 
 /*
  * The entry name is a flexible array member, and we don't know its size before
- * actually reading the entry. So we need a first copy to retrieve this size so
- * we can finally copy the whole struct.
+ * actually reading the entry. So the fixed part is read first to retrieve this
+ * size, then the name follows it in the directory table.
  */
-static int sqfs_read_entry(struct squashfs_directory_entry **dest, void *src)
+static int sqfs_read_entry(struct squashfs_dir_stream *dirs)
 {
-	struct squashfs_directory_entry *tmp;
+	struct squashfs_directory_entry tmp, *entry;
 	u16 sz;
 
-	tmp = src;
-	sz = get_unaligned_le16(src + sizeof(*tmp) - sizeof(u16));
+	if (sqfs_read_metadata(&tmp, &dirs->table_block, &dirs->table_offset,
+			       SQFS_ENTRY_BASE_LENGTH))
+		return -EINVAL;
+
 	/*
-	 * 'src' points to the begin of a directory entry, and 'sz' gets its
-	 * 'name_size' member's value. name_size is actually the string
-	 * length - 1, so adding 2 compensates this difference and adds space
-	 * for the trailling null byte.
+	 * name_size is actually the string length - 1, so adding 2 compensates
+	 * this difference and adds space for the trailling null byte.
 	 */
-	*dest = malloc(sizeof(*tmp) + sz + 2);
-	if (!*dest)
+	sz = le16_to_cpu(tmp.name_size);
+	entry = malloc(sizeof(*entry) + sz + 2);
+	if (!entry)
 		return -ENOMEM;
 
-	memcpy(*dest, src, sizeof(*tmp) + sz + 1);
-	(*dest)->name[sz + 1] = '\0';
+	entry->offset = le16_to_cpu(tmp.offset);
+	entry->inode_offset = le16_to_cpu(tmp.inode_offset);
+	entry->type = le16_to_cpu(tmp.type);
+	entry->name_size = sz;
+
+	if (sqfs_read_metadata(entry->name, &dirs->table_block,
+			       &dirs->table_offset, sz + 1)) {
+		free(entry);
+		return -EINVAL;
+	}
+	entry->name[sz + 1] = '\0';
+
+	dirs->entry = entry;
 
 	return 0;
 }
@@ -437,22 +648,173 @@ static char *sqfs_resolve_symlink(struct squashfs_symlink_inode *sym,
 }
 
 /*
- * m_list contains each metadata block's position, and m_count is the number of
- * elements of m_list. Those metadata blocks come from the compressed directory
- * table.
+ * Points the directory stream at the listing of the directory inode 'dir_i'.
+ * On success the stream takes over the inode and frees it when closed.
+ */
+static int sqfs_dir_init(struct squashfs_dir_stream *dirs, void *dir_i)
+{
+	struct squashfs_base_inode *base = dir_i;
+	struct squashfs_ldir_inode *ldir;
+	struct squashfs_dir_inode *dir;
+	u32 start_block, offset, size;
+
+	switch (get_unaligned_le16(&base->inode_type)) {
+	case SQFS_DIR_TYPE:
+		dir = dir_i;
+		start_block = get_unaligned_le32(&dir->start_block);
+		offset = get_unaligned_le16(&dir->offset);
+		size = get_unaligned_le16(&dir->file_size);
+		break;
+	case SQFS_LDIR_TYPE:
+		ldir = dir_i;
+		start_block = get_unaligned_le32(&ldir->start_block);
+		offset = get_unaligned_le16(&ldir->offset);
+		size = get_unaligned_le32(&ldir->file_size);
+		break;
+	default:
+		printf("Error: this is not a directory.\n");
+		return -EINVAL;
+	}
+
+	free(dirs->dir_inode);
+	dirs->dir_inode = dir_i;
+	free(dirs->entry);
+	dirs->entry = NULL;
+	dirs->entry_count = 0;
+	dirs->table_block = get_unaligned_le64(&ctxt.sblk->directory_table_start) +
+		start_block;
+	dirs->table_offset = offset;
+	/* The size stored in the inode counts three extra bytes */
+	dirs->size = size > SQFS_EMPTY_FILE_SIZE ? size - SQFS_EMPTY_FILE_SIZE : 0;
+
+	return 0;
+}
+
+/*
+ * Reads the next entry of the directory listing into dirs->entry, along with
+ * the header preceding it if a new run of entries starts.
+ */
+static int sqfs_dir_next(struct squashfs_dir_stream *dirs)
+{
+	struct squashfs_directory_header *hdr = &dirs->dir_header;
+	u32 entry_size;
+
+	free(dirs->entry);
+	dirs->entry = NULL;
+
+	if (!dirs->entry_count) {
+		if (dirs->size <= SQFS_DIR_HEADER_SIZE) {
+			dirs->size = 0;
+			return -SQFS_STOP_READDIR;
+		}
+
+		if (sqfs_read_metadata(hdr, &dirs->table_block,
+				       &dirs->table_offset,
+				       SQFS_DIR_HEADER_SIZE))
+			return -SQFS_STOP_READDIR;
+
+		hdr->count = le32_to_cpu(hdr->count);
+		hdr->start = le32_to_cpu(hdr->start);
+		hdr->inode_number = le32_to_cpu(hdr->inode_number);
+		dirs->entry_count = hdr->count + 1;
+		dirs->size -= SQFS_DIR_HEADER_SIZE;
+	}
+
+	if (dirs->size <= SQFS_ENTRY_BASE_LENGTH ||
+	    sqfs_read_entry(dirs)) {
+		dirs->size = 0;
+		return -SQFS_STOP_READDIR;
+	}
+
+	entry_size = SQFS_ENTRY_BASE_LENGTH + dirs->entry->name_size + 1;
+	dirs->entry_count--;
+
+	/* Decrement size to be read */
+	if (dirs->size > entry_size)
+		dirs->size -= entry_size;
+	else
+		dirs->size = 0;
+
+	return 0;
+}
+
+/* Reads the inode of the directory entry last returned by sqfs_dir_next() */
+static void *sqfs_dir_entry_inode(struct squashfs_dir_stream *dirs)
+{
+	return sqfs_read_inode(dirs->dir_header.start, dirs->entry->offset);
+}
+
+/*
+ * Extended directories carry an index holding the first name of each
+ * metadata block of their listing. Skip straight to the last block whose
+ * first name is not past 'name', since the entries are sorted.
+ */
+static void sqfs_dir_seek(struct squashfs_dir_stream *dirs, const char *name)
+{
+	struct squashfs_ldir_inode *ldir = dirs->dir_inode;
+	struct squashfs_directory_index *di;
+	u32 i, i_count, sz, index = 0, start = 0;
+
+	if (get_unaligned_le16(&ldir->inode_type) != SQFS_LDIR_TYPE)
+		return;
+
+	i_count = get_unaligned_le16(&ldir->i_count);
+	di = ldir->index;
+	for (i = 0; i < i_count; i++) {
+		sz = get_unaligned_le32(&di->size) + 1;
+		/* The index name has no trailing null byte */
+		if (strncmp(di->name, name, sz) > 0)
+			break;
+
+		index = get_unaligned_le32(&di->index);
+		start = get_unaligned_le32(&di->start);
+		di = (void *)di + sizeof(*di) + sz;
+	}
+
+	if (!index || index >= dirs->size)
+		return;
+
+	dirs->table_block = get_unaligned_le64(&ctxt.sblk->directory_table_start) +
+		start;
+	dirs->table_offset = (get_unaligned_le16(&ldir->offset) + index) %
+		SQFS_METADATA_BLOCK_SIZE;
+	dirs->size -= index;
+	dirs->entry_count = 0;
+}
+
+/*
+ * Looks 'name' up in the directory 'dirs' was just set up to list and returns
+ * the inode of the matching entry, which the caller frees.
+ */
+static int sqfs_dir_lookup(struct squashfs_dir_stream *dirs, const char *name,
+			   void **inode)
+{
+	sqfs_dir_seek(dirs, name);
+
+	while (!sqfs_dir_next(dirs)) {
+		if (strcmp(dirs->entry->name, name))
+			continue;
+
+		*inode = sqfs_dir_entry_inode(dirs);
+
+		return *inode ? 0 : -EINVAL;
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Walks the path in token_list from the root directory and sets up 'dirs' to
+ * list the directory it leads to.
  */
 static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
-			   int token_count, u32 *m_list, int m_count)
+			   int token_count)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	char *path, *target, **sym_tokens, *res, *rem;
-	int j, ret = 0, new_inode_number, offset;
+	int i, j, ret = 0, sym_count = 0;
 	struct squashfs_symlink_inode *sym;
-	struct squashfs_ldir_inode *ldir;
-	struct squashfs_dir_inode *dir;
-	struct fs_dir_stream *dirsp;
-	struct fs_dirent *dent;
-	unsigned char *table;
+	void *inode;
+	u16 type;
 
 	res = NULL;
 	rem = NULL;
@@ -460,71 +822,38 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 	target = NULL;
 	sym_tokens = NULL;
 
-	dirsp = (struct fs_dir_stream *)dirs;
-
 	/* Start by root inode */
-	table = sqfs_find_inode(dirs->inode_table, le32_to_cpu(sblk->inodes),
-				sblk->inodes, sblk->block_size);
-
-	dir = (struct squashfs_dir_inode *)table;
-	ldir = (struct squashfs_ldir_inode *)table;
-
-	/* get directory offset in directory table */
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
-
-	/* Setup directory header */
-	dirs->dir_header = malloc(SQFS_DIR_HEADER_SIZE);
-	if (!dirs->dir_header)
-		return -ENOMEM;
-
-	memcpy(dirs->dir_header, dirs->table, SQFS_DIR_HEADER_SIZE);
-
-	/* Initialize squashfs_dir_stream members */
-	dirs->table += SQFS_DIR_HEADER_SIZE;
-	dirs->size = get_unaligned_le16(&dir->file_size) - SQFS_DIR_HEADER_SIZE;
-	dirs->entry_count = dirs->dir_header->count + 1;
+	inode = sqfs_read_root_inode();
+	if (!inode)
+		return -EINVAL;
 
 	/* No path given -> root directory */
-	if (!strcmp(token_list[0], "/")) {
-		dirs->table = &dirs->dir_table[offset];
-		memcpy(&dirs->i_dir, dir, sizeof(*dir));
-		return 0;
-	}
+	if (!strcmp(token_list[0], "/"))
+		goto done;
 
 	for (j = 0; j < token_count; j++) {
-		if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
+		if (!sqfs_is_dir(get_unaligned_le16(inode))) {
 			printf("** Cannot find directory. **\n");
 			ret = -EINVAL;
 			goto out;
 		}
 
-		while (!sqfs_readdir(dirsp, &dent)) {
-			ret = strcmp(dent->name, token_list[j]);
-			if (!ret)
-				break;
-			free(dirs->entry);
-			dirs->entry = NULL;
-		}
+		ret = sqfs_dir_init(dirs, inode);
+		if (ret)
+			goto out;
 
+		inode = NULL;
+		ret = sqfs_dir_lookup(dirs, token_list[j], &inode);
 		if (ret) {
 			printf("** Cannot find directory. **\n");
 			ret = -EINVAL;
 			goto out;
 		}
 
-		/* Redefine inode as the found token */
-		new_inode_number = dirs->entry->inode_offset +
-			dirs->dir_header->inode_number;
-
-		/* Get reference to inode in the inode table */
-		table = sqfs_find_inode(dirs->inode_table, new_inode_number,
-					sblk->inodes, sblk->block_size);
-		dir = (struct squashfs_dir_inode *)table;
-
 		/* Check for symbolic link and inode type sanity */
-		if (get_unaligned_le16(&dir->inode_type) == SQFS_SYMLINK_TYPE) {
-			sym = (struct squashfs_symlink_inode *)table;
+		type = get_unaligned_le16(inode);
+		if (type == SQFS_SYMLINK_TYPE) {
+			sym = inode;
 			/* Get first j + 1 tokens */
 			path = sqfs_concat_tokens(token_list, j + 1);
 			if (!path) {
@@ -553,354 +882,70 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			strcpy(res, target);
 			res[strlen(target)] = '/';
 			strcpy(res + strlen(target) + 1, rem);
-			token_count = sqfs_count_tokens(res);
-
-			if (token_count < 0) {
-				ret = -EINVAL;
-				goto out;
-			}
-
-			sym_tokens = malloc(token_count * sizeof(char *));
-			if (!sym_tokens) {
-				ret = -EINVAL;
-				goto out;
-			}
-
-			/* Fill tokens list */
-			ret = sqfs_tokenize(sym_tokens, token_count, res);
-			if (ret) {
-				ret = -EINVAL;
-				goto out;
-			}
-			free(dirs->entry);
-			dirs->entry = NULL;
-
-			ret = sqfs_search_dir(dirs, sym_tokens, token_count,
-					      m_list, m_count);
-			goto out;
-		} else if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
-			printf("** Cannot find directory. **\n");
-			free(dirs->entry);
-			dirs->entry = NULL;
-			ret = -EINVAL;
-			goto out;
-		}
-
-		/* Check if it is an extended dir. */
-		if (get_unaligned_le16(&dir->inode_type) == SQFS_LDIR_TYPE)
-			ldir = (struct squashfs_ldir_inode *)table;
-
-		/* Get dir. offset into the directory table */
-		offset = sqfs_dir_offset(table, m_list, m_count);
-		dirs->table = &dirs->dir_table[offset];
-
-		/* Copy directory header */
-		memcpy(dirs->dir_header, &dirs->dir_table[offset],
-		       SQFS_DIR_HEADER_SIZE);
-
-		/* Check for empty directory */
-		if (sqfs_is_empty_dir(table)) {
-			printf("Empty directory.\n");
-			free(dirs->entry);
-			dirs->entry = NULL;
-			ret = SQFS_EMPTY_DIR;
-			goto out;
-		}
-
-		dirs->table += SQFS_DIR_HEADER_SIZE;
-		dirs->size = get_unaligned_le16(&dir->file_size);
-		dirs->entry_count = dirs->dir_header->count + 1;
-		dirs->size -= SQFS_DIR_HEADER_SIZE;
-		free(dirs->entry);
-		dirs->entry = NULL;
-	}
-
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
-
-	if (get_unaligned_le16(&dir->inode_type) == SQFS_DIR_TYPE)
-		memcpy(&dirs->i_dir, dir, sizeof(*dir));
-	else
-		memcpy(&dirs->i_ldir, ldir, sizeof(*ldir));
-
-out:
-	free(res);
-	free(rem);
-	free(path);
-	free(target);
-	free(sym_tokens);
-	return ret;
-}
-
-/*
- * Inode and directory tables are stored as a series of metadata blocks, and
- * given the compressed size of this table, we can calculate how much metadata
- * blocks are needed to store the result of the decompression, since a
- * decompressed metadata block should have a size of 8KiB.
- */
-static int sqfs_count_metablks(void *table, u32 offset, int table_size)
-{
-	int count = 0, cur_size = 0, ret;
-	u32 data_size;
-	bool comp;
-
-	do {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		count++;
-	} while (cur_size < table_size);
-
-	return count;
-}
-
-/*
- * Storing the metadata blocks header's positions will be useful while looking
- * for an entry in the directory table, using the reference (index and offset)
- * given by its inode.
- */
-static int sqfs_get_metablk_pos(u32 *pos_list, void *table, u32 offset,
-				int metablks_count)
-{
-	u32 data_size, cur_size = 0;
-	int j, ret = 0;
-	bool comp;
-
-	if (!metablks_count)
-		return -EINVAL;
-
-	for (j = 0; j < metablks_count; j++) {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		pos_list[j] = cur_size;
-	}
-
-	return ret;
-}
-
-static int sqfs_read_inode_table(unsigned char **inode_table)
-{
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	u64 start, n_blks, table_offset, table_size;
-	int j, ret = 0, metablks_count;
-	unsigned char *src_table, *itb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-
-	table_size = get_unaligned_le64(&sblk->directory_table_start) -
-		get_unaligned_le64(&sblk->inode_table_start);
-	start = get_unaligned_le64(&sblk->inode_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->inode_table_start,
-				  sblk->directory_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (itb) to store the inode table */
-	itb = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!itb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, itb) < 0) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	/* Parse inode table (metadata block) header */
-	ret = sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-	if (ret) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	/* Calculate size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(itb, table_offset, table_size);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	*inode_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*inode_table) {
-		ret = -ENOMEM;
-		printf("Error: failed to allocate squashfs inode_table of size %i, increasing CONFIG_SYS_MALLOC_LEN could help\n",
-		       metablks_count * SQFS_METADATA_BLOCK_SIZE);
-		goto free_itb;
-	}
-
-	src_table = itb + table_offset + SQFS_HEADER_SIZE;
+			token_count = sqfs_count_tokens(res);
 
-	/* Extract compressed Inode table */
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *inode_table +
-					      dest_offset, &dest_len,
-					      src_table, src_len);
-			if (ret) {
-				free(*inode_table);
-				*inode_table = NULL;
-				goto free_itb;
+			if (token_count < 0) {
+				ret = -EINVAL;
+				goto out;
 			}
 
-			dest_offset += dest_len;
-		} else {
-			memcpy(*inode_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'itb' and to the decompression source, respectively.
-		 */
-
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-free_itb:
-	free(itb);
-
-	return ret;
-}
-
-static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
-{
-	u64 start, n_blks, table_offset, table_size;
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	int j, ret = 0, metablks_count = -1;
-	unsigned char *src_table, *dtb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-
-	*dir_table = NULL;
-	*pos_list = NULL;
-	/* DIRECTORY TABLE */
-	table_size = get_unaligned_le64(&sblk->fragment_table_start) -
-		get_unaligned_le64(&sblk->directory_table_start);
-	start = get_unaligned_le64(&sblk->directory_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->directory_table_start,
-				  sblk->fragment_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (dtb) to store the directory table */
-	dtb = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!dtb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, dtb) < 0)
-		goto out;
-
-	/* Parse directory table (metadata block) header */
-	ret = sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-	if (ret)
-		goto out;
-
-	/* Calculate total size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(dtb, table_offset, table_size);
-	if (metablks_count < 1)
-		goto out;
-
-	*dir_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*dir_table)
-		goto out;
-
-	*pos_list = malloc(metablks_count * sizeof(u32));
-	if (!*pos_list)
-		goto out;
-
-	ret = sqfs_get_metablk_pos(*pos_list, dtb, table_offset,
-				   metablks_count);
-	if (ret) {
-		metablks_count = -1;
-		goto out;
-	}
-
-	src_table = dtb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Directory table */
-	dest_offset = 0;
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *dir_table +
-					      (j * SQFS_METADATA_BLOCK_SIZE),
-					      &dest_len, src_table, src_len);
-			if (ret) {
-				metablks_count = -1;
+			sym_tokens = calloc(token_count, sizeof(char *));
+			if (!sym_tokens) {
+				ret = -EINVAL;
 				goto out;
 			}
 
-			if (dest_len < SQFS_METADATA_BLOCK_SIZE) {
-				dest_offset += dest_len;
-				break;
+			/* Fill tokens list */
+			ret = sqfs_tokenize(sym_tokens, token_count, res);
+			if (ret) {
+				ret = -EINVAL;
+				goto out;
 			}
+			sym_count = token_count;
 
-			dest_offset += dest_len;
-		} else {
-			memcpy(*dir_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
+			ret = sqfs_search_dir(dirs, sym_tokens, token_count);
+			goto out;
+		} else if (!sqfs_is_dir(type)) {
+			printf("** Cannot find directory. **\n");
+			ret = -EINVAL;
+			goto out;
 		}
 
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'dtb' and to the decompression source, respectively.
-		 */
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
+		/* Check for empty directory */
+		if (sqfs_is_empty_dir(inode)) {
+			printf("Empty directory.\n");
+			ret = SQFS_EMPTY_DIR;
+			goto out;
+		}
 	}
 
-out:
-	if (metablks_count < 1) {
-		free(*dir_table);
-		free(*pos_list);
-		*dir_table = NULL;
-		*pos_list = NULL;
-	}
-	free(dtb);
+done:
+	ret = sqfs_dir_init(dirs, inode);
+	if (!ret)
+		inode = NULL;
 
-	return metablks_count;
+out:
+	for (i = 0; i < sym_count; i++)
+		free(sym_tokens[i]);
+	free(inode);
+	free(res);
+	free(rem);
+	free(path);
+	free(target);
+	free(sym_tokens);
+	return ret;
 }
 
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
+	int j, token_count = 0, ret = 0;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
 		return -EINVAL;
 
-	/* these should be set to NULL to prevent dangling pointers */
-	dirs->dir_header = NULL;
-	dirs->entry = NULL;
-	dirs->table = NULL;
-	dirs->inode_table = NULL;
-	dirs->dir_table = NULL;
-
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto out;
-	}
-
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
 	if (token_count < 0) {
@@ -924,100 +969,45 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	ret = sqfs_tokenize(token_list, token_count, path);
 	if (ret)
 		goto out;
+
 	/*
-	 * ldir's (extended directory) size is greater than dir, so it works as
-	 * a general solution for the malloc size, since 'i' is a union.
+	 * Only the metadata blocks holding the inodes and the directory
+	 * listings on the way are read, through the metadata cache.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	ret = sqfs_search_dir(dirs, token_list, token_count);
 	if (ret)
 		goto out;
 
-	if (le16_to_cpu(dirs->i_dir.inode_type) == SQFS_DIR_TYPE)
-		dirs->size = le16_to_cpu(dirs->i_dir.file_size);
-	else
-		dirs->size = le32_to_cpu(dirs->i_ldir.file_size);
-
-	/* Setup directory header */
-	memcpy(dirs->dir_header, dirs->table, SQFS_DIR_HEADER_SIZE);
-	dirs->entry_count = dirs->dir_header->count + 1;
-	dirs->size -= SQFS_DIR_HEADER_SIZE;
-
-	/* Setup entry */
-	dirs->entry = NULL;
-	dirs->table += SQFS_DIR_HEADER_SIZE;
-
 	*dirsp = (struct fs_dir_stream *)dirs;
 
 out:
-	for (j = 0; j < token_count; j++)
+	for (j = 0; j < token_count && token_list; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
-	if (ret) {
-		free(inode_table);
-		free(dirs);
-	}
+	if (ret)
+		sqfs_closedir((struct fs_dir_stream *)dirs);
 
 	return ret;
 }
 
 int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_dir_stream *dirs;
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
-	int i_number, offset = 0, ret;
 	struct fs_dirent *dent;
-	unsigned char *ipos;
 	u16 name_size;
 
 	dirs = (struct squashfs_dir_stream *)fs_dirs;
-	if (!dirs->size) {
-		*dentp = NULL;
-		return -SQFS_STOP_READDIR;
-	}
-
 	dent = &dirs->dentp;
 
-	if (!dirs->entry_count) {
-		if (dirs->size > SQFS_DIR_HEADER_SIZE) {
-			dirs->size -= SQFS_DIR_HEADER_SIZE;
-		} else {
-			*dentp = NULL;
-			dirs->size = 0;
-			return -SQFS_STOP_READDIR;
-		}
-
-		if (dirs->size > SQFS_EMPTY_FILE_SIZE) {
-			/* Read follow-up (emitted) dir. header */
-			memcpy(dirs->dir_header, dirs->table,
-			       SQFS_DIR_HEADER_SIZE);
-			dirs->entry_count = dirs->dir_header->count + 1;
-			ret = sqfs_read_entry(&dirs->entry, dirs->table +
-					      SQFS_DIR_HEADER_SIZE);
-			if (ret)
-				return -SQFS_STOP_READDIR;
-
-			dirs->table += SQFS_DIR_HEADER_SIZE;
-		}
-	} else {
-		ret = sqfs_read_entry(&dirs->entry, dirs->table);
-		if (ret)
-			return -SQFS_STOP_READDIR;
+	if (sqfs_dir_next(dirs)) {
+		*dentp = NULL;
+		return -SQFS_STOP_READDIR;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
-
-	base = (struct squashfs_base_inode *)ipos;
-
 	/* Set entry type and size */
 	switch (dirs->entry->type) {
 	case SQFS_DIR_TYPE:
@@ -1028,15 +1018,21 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 	case SQFS_LREG_TYPE:
 		/*
 		 * Entries do not differentiate extended from regular types, so
-		 * it needs to be verified manually.
+		 * it needs to be verified manually. Only regular files need
+		 * their inode to be read.
 		 */
+		base = sqfs_dir_entry_inode(dirs);
+		if (!base)
+			return -SQFS_STOP_READDIR;
+
 		if (get_unaligned_le16(&base->inode_type) == SQFS_LREG_TYPE) {
-			lreg = (struct squashfs_lreg_inode *)ipos;
+			lreg = (struct squashfs_lreg_inode *)base;
 			dent->size = get_unaligned_le64(&lreg->file_size);
 		} else {
-			reg = (struct squashfs_reg_inode *)ipos;
+			reg = (struct squashfs_reg_inode *)base;
 			dent->size = get_unaligned_le32(&reg->file_size);
 		}
+		free(base);
 
 		dent->type = FS_DT_REG;
 		break;
@@ -1063,18 +1059,6 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 	strncpy(dent->name, dirs->entry->name, name_size);
 	dent->name[name_size] = '\0';
 
-	offset = dirs->entry->name_size + 1 + SQFS_ENTRY_BASE_LENGTH;
-	dirs->entry_count--;
-
-	/* Decrement size to be read */
-	if (dirs->size > offset)
-		dirs->size -= offset;
-	else
-		dirs->size = 0;
-
-	/* Keep a reference to the current entry before incrementing it */
-	dirs->table += offset;
-
 	*dentp = dent;
 
 	return 0;
@@ -1106,7 +1090,20 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 		goto error;
 	}
 
+	ret = sqfs_cache_init(&ctxt.meta_cache, SQFS_META_CACHE_ENTRIES,
+			      SQFS_METADATA_BLOCK_SIZE);
+	if (ret)
+		goto error_cache;
+
+	ret = sqfs_cache_init(&ctxt.frag_cache, SQFS_FRAG_CACHE_ENTRIES,
+			      get_unaligned_le32(&sblk->block_size));
+	if (ret)
+		goto error_cache;
+
 	return 0;
+error_cache:
+	sqfs_cache_free(&ctxt.meta_cache);
+	sqfs_decompressor_cleanup(&ctxt);
 error:
 	ctxt.cur_dev = NULL;
 	free(ctxt.sblk);
@@ -1233,6 +1230,32 @@ out:
 	return ret;
 }
 
+/*
+ * Looks a file up by its path and returns its inode, which the caller frees.
+ * -ENOENT means the directory was found but the file is not in it.
+ */
+static int sqfs_lookup(const char *filename, void **inode)
+{
+	struct fs_dir_stream *dirsp = NULL;
+	char *dir, *file;
+	int ret;
+
+	ret = sqfs_split_path(&file, &dir, filename);
+	if (ret)
+		return ret;
+
+	ret = sqfs_opendir(dir, &dirsp);
+	if (!ret)
+		ret = sqfs_dir_lookup((struct squashfs_dir_stream *)dirsp,
+				      file, inode);
+
+	sqfs_closedir(dirsp);
+	free(dir);
+	free(file);
+
+	return ret;
+}
+
 static int sqfs_get_regfile_info(struct squashfs_reg_inode *reg,
 				 struct squashfs_file_info *finfo,
 				 struct squashfs_fragment_block_entry *fentry,
@@ -1264,9 +1287,7 @@ static int sqfs_get_regfile_info(struct squashfs_reg_inode *reg,
 		datablk_count = DIV_ROUND_UP(finfo->size, le32_to_cpu(blksz));
 	}
 
-	finfo->blk_sizes = malloc(datablk_count * sizeof(u32));
-	if (!finfo->blk_sizes)
-		return -ENOMEM;
+	finfo->blk_sizes = reg->block_list;
 
 	return datablk_count;
 }
@@ -1302,9 +1323,7 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 		datablk_count = DIV_ROUND_UP(finfo->size, le32_to_cpu(blksz));
 	}
 
-	finfo->blk_sizes = malloc(datablk_count * sizeof(u32));
-	if (!finfo->blk_sizes)
-		return -ENOMEM;
+	finfo->blk_sizes = lreg->block_list;
 
 	return datablk_count;
 }
@@ -1312,22 +1331,21 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
+	char *data_buffer = NULL, *datablock = NULL, *resolved, *data;
 	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	u64 file_size, blk_len;
+	int ret, j, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
 	struct squashfs_symlink_inode *symlink;
-	struct fs_dir_stream *dirsp = NULL;
-	struct squashfs_dir_stream *dirs;
+	struct squashfs_cache_entry *fragment;
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
 	unsigned long dest_len;
-	struct fs_dirent *dent;
-	unsigned char *ipos;
+	void *ipos = NULL, *dest;
+	u32 block_size;
 
 	*actread = 0;
 
@@ -1339,38 +1357,11 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		return -EINVAL;
 	}
 
-	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
-	 */
-	sqfs_split_path(&file, &dir, filename);
-	ret = sqfs_opendir(dir, &dirsp);
-	if (ret) {
-		goto out;
-	}
-
-	dirs = (struct squashfs_dir_stream *)dirsp;
-
-	/* For now, only regular files are able to be loaded */
-	while (!sqfs_readdir(dirsp, &dent)) {
-		ret = strcmp(dent->name, file);
-		if (!ret)
-			break;
-
-		free(dirs->entry);
-		dirs->entry = NULL;
-	}
-
-	if (ret) {
+	ret = sqfs_lookup(filename, &ipos);
+	if (ret == -ENOENT)
 		printf("File not found.\n");
-		*actread = 0;
-		ret = -ENOENT;
+	if (ret)
 		goto out;
-	}
-
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
 
 	base = (struct squashfs_base_inode *)ipos;
 	switch (get_unaligned_le16(&base->inode_type)) {
@@ -1382,9 +1373,6 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			ret = -EINVAL;
 			goto out;
 		}
-
-		memcpy(finfo.blk_sizes, ipos + sizeof(*reg),
-		       datablk_count * sizeof(u32));
 		break;
 	case SQFS_LREG_TYPE:
 		lreg = (struct squashfs_lreg_inode *)ipos;
@@ -1395,9 +1383,6 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			ret = -EINVAL;
 			goto out;
 		}
-
-		memcpy(finfo.blk_sizes, ipos + sizeof(*lreg),
-		       datablk_count * sizeof(u32));
 		break;
 	case SQFS_SYMLINK_TYPE:
 	case SQFS_LSYMLINK_TYPE:
@@ -1421,6 +1406,7 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	}
 
 	/* If the user specifies a length, check its sanity */
+	file_size = finfo.size;
 	if (len) {
 		if (len > finfo.size) {
 			ret = -EINVAL;
@@ -1432,70 +1418,89 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		len = finfo.size;
 	}
 
+	block_size = get_unaligned_le32(&sblk->block_size);
 	if (datablk_count) {
 		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
-		if (!datablock) {
+		/* Any data block fits, whatever its offset into a device block */
+		n_blks = DIV_ROUND_UP(block_size, ctxt.cur_dev->blksz) + 1;
+		data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+		if (!data_buffer) {
 			ret = -ENOMEM;
 			goto out;
 		}
 	}
 
 	for (j = 0; j < datablk_count; j++) {
-		char *data_buffer;
-
 		start = lldiv(data_offset, ctxt.cur_dev->blksz);
 		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
 		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
 		n_blks = DIV_ROUND_UP(table_size + table_offset,
 				      ctxt.cur_dev->blksz);
+		/* Number of bytes of the file this block holds */
+		blk_len = min_t(u64, block_size, file_size - *actread);
 
-		/* Don't load any data for sparse blocks */
-		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-			if (!data_buffer) {
-				ret = -ENOMEM;
-				goto out;
-			}
-
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
-
-			data = data_buffer + table_offset;
+		if (table_size > block_size) {
+			ret = -EINVAL;
+			goto out;
 		}
 
-		/* Load the data */
+		/* Don't load any data for sparse blocks */
 		if (finfo.blk_sizes[j] == 0) {
 			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
+			sparse_size = block_size;
 			if ((*actread + sparse_size) > len)
 				sparse_size = len - *actread;
 			memset(buf + *actread, 0, sparse_size);
 			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
+			if (*actread >= len)
+				break;
+			continue;
+		}
+
+		ret = sqfs_disk_read(start, n_blks, data_buffer);
+		if (ret < 0) {
+			/*
+			 * Possible causes: too many data blocks or too large
+			 * SquashFS block size. Tip: re-compile the SquashFS
+			 * image with mksquashfs's -b <block_size> option.
+			 */
+			printf("Error: too many data blocks to be read.\n");
+			goto out;
+		}
+
+		data = data_buffer + table_offset;
+
+		/* Load the data */
+		if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
+			/*
+			 * A block the request fully covers is decompressed
+			 * straight into 'buf'. Only the last block of a
+			 * shortened read goes through a bounce buffer.
+			 */
+			if (*actread + blk_len <= len) {
+				dest = buf + *actread;
+				dest_len = blk_len;
+			} else {
+				if (!datablock) {
+					datablock = malloc(block_size);
+					if (!datablock) {
+						ret = -ENOMEM;
+						goto out;
+					}
+				}
+				dest = datablock;
+				dest_len = block_size;
+			}
+
+			ret = sqfs_decompress(&ctxt, dest, &dest_len, data,
+					      table_size);
 			if (ret)
 				goto out;
 
 			if ((*actread + dest_len) > len)
 				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
+			if (dest == datablock)
+				memcpy(buf + *actread, datablock, dest_len);
 			*actread += dest_len;
 		} else {
 			if ((*actread + table_size) > len)
@@ -1504,8 +1509,7 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			*actread += table_size;
 		}
 
-		data_offset += table_size;
-		free(data_buffer);
+		data_offset += SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
 		if (*actread >= len)
 			break;
 	}
@@ -1518,110 +1522,47 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	/* Files sharing a fragment block find it decompressed in the cache */
+	ret = sqfs_cache_get(&ctxt.frag_cache, frag_entry.start,
+			     frag_entry.size, &fragment);
+	if (ret)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	if (finfo.offset + finfo.size - *actread > fragment->length) {
+		ret = -EINVAL;
 		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
 	}
 
+	memcpy(buf + *actread, fragment->data + finfo.offset,
+	       finfo.size - *actread);
+	*actread = finfo.size;
+
 out:
-	free(fragment);
+	free(data_buffer);
 	free(datablock);
-	free(file);
-	free(dir);
-	free(finfo.blk_sizes);
-	sqfs_closedir(dirsp);
+	free(ipos);
 
 	return ret;
 }
 
 int sqfs_size(const char *filename, loff_t *size)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_symlink_inode *symlink;
-	struct fs_dir_stream *dirsp = NULL;
 	struct squashfs_base_inode *base;
-	struct squashfs_dir_stream *dirs;
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_reg_inode *reg;
-	char *dir, *file, *resolved;
-	struct fs_dirent *dent;
-	unsigned char *ipos;
-	int ret, i_number;
-
-	sqfs_split_path(&file, &dir, filename);
-	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
-	 */
-	ret = sqfs_opendir(dir, &dirsp);
-	if (ret) {
-		ret = -EINVAL;
-		goto free_strings;
-	}
-
-	dirs = (struct squashfs_dir_stream *)dirsp;
-
-	while (!sqfs_readdir(dirsp, &dent)) {
-		ret = strcmp(dent->name, file);
-		if (!ret)
-			break;
-		free(dirs->entry);
-		dirs->entry = NULL;
-	}
+	void *ipos = NULL;
+	char *resolved;
+	int ret;
 
+	ret = sqfs_lookup(filename, &ipos);
 	if (ret) {
-		printf("File not found.\n");
+		if (ret == -ENOENT)
+			printf("File not found.\n");
 		*size = 0;
-		ret = -EINVAL;
-		goto free_strings;
+		return -EINVAL;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
-	free(dirs->entry);
-	dirs->entry = NULL;
-
 	base = (struct squashfs_base_inode *)ipos;
 	switch (get_unaligned_le16(&base->inode_type)) {
 	case SQFS_REG_TYPE:
@@ -1654,55 +1595,28 @@ int sqfs_size(const char *filename, loff_t *size)
 		break;
 	}
 
-free_strings:
-	free(dir);
-	free(file);
-
-	sqfs_closedir(dirsp);
+	free(ipos);
 
 	return ret;
 }
 
 int sqfs_exists(const char *filename)
 {
-	struct fs_dir_stream *dirsp = NULL;
-	struct squashfs_dir_stream *dirs;
-	char *dir, *file;
-	struct fs_dirent *dent;
+	void *ipos = NULL;
 	int ret;
 
-	sqfs_split_path(&file, &dir, filename);
-	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
-	 */
-	ret = sqfs_opendir(dir, &dirsp);
-	if (ret) {
-		ret = -EINVAL;
-		goto free_strings;
-	}
-
-	dirs = (struct squashfs_dir_stream *)dirsp;
-
-	while (!sqfs_readdir(dirsp, &dent)) {
-		ret = strcmp(dent->name, file);
-		if (!ret)
-			break;
-		free(dirs->entry);
-		dirs->entry = NULL;
-	}
-
-	sqfs_closedir(dirsp);
-
-free_strings:
-	free(dir);
-	free(file);
+	ret = sqfs_lookup(filename, &ipos);
+	free(ipos);
 
 	return ret == 0;
 }
 
 void sqfs_close(void)
 {
+	sqfs_cache_free(&ctxt.meta_cache);
+	sqfs_cache_free(&ctxt.frag_cache);
+	free(ctxt.frag_index);
+	ctxt.frag_index = NULL;
 	sqfs_decompressor_cleanup(&ctxt);
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
@@ -1717,8 +1631,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
-	free(sqfs_dirs->dir_header);
+	free(sqfs_dirs->dir_inode);
+	free(sqfs_dirs->entry);
 	free(sqfs_dirs);
 }
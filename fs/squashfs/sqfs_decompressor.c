@@ -36,6 +36,14 @@ int sqfs_decompressor_init(struct squashfs_ctxt *ctxt)
 #endif
 #if IS_ENABLED(CONFIG_ZLIB)
 	case SQFS_COMP_ZLIB:
+		ctxt->zlib_stream = calloc(1, sizeof(*ctxt->zlib_stream));
+		if (!ctxt->zlib_stream)
+			return -ENOMEM;
+		if (inflateInit(ctxt->zlib_stream) != Z_OK) {
+			free(ctxt->zlib_stream);
+			ctxt->zlib_stream = NULL;
+			return -ENOMEM;
+		}
 		break;
 #endif
 #if IS_ENABLED(CONFIG_ZSTD)
@@ -43,6 +51,13 @@ int sqfs_decompressor_init(struct squashfs_ctxt *ctxt)
 		ctxt->zstd_workspace = malloc(ZSTD_DCtxWorkspaceBound());
 		if (!ctxt->zstd_workspace)
 			return -ENOMEM;
+		ctxt->zstd_dctx = ZSTD_initDCtx(ctxt->zstd_workspace,
+						ZSTD_DCtxWorkspaceBound());
+		if (!ctxt->zstd_dctx) {
+			free(ctxt->zstd_workspace);
+			ctxt->zstd_workspace = NULL;
+			return -ENOMEM;
+		}
 		break;
 #endif
 	default:
@@ -64,11 +79,17 @@ void sqfs_decompressor_cleanup(struct squashfs_ctxt *ctxt)
 #endif
 #if IS_ENABLED(CONFIG_ZLIB)
 	case SQFS_COMP_ZLIB:
+		if (ctxt->zlib_stream)
+			inflateEnd(ctxt->zlib_stream);
+		free(ctxt->zlib_stream);
+		ctxt->zlib_stream = NULL;
 		break;
 #endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
 		free(ctxt->zstd_workspace);
+		ctxt->zstd_workspace = NULL;
+		ctxt->zstd_dctx = NULL;
 		break;
 #endif
 	}
@@ -89,21 +110,55 @@ static void zlib_decompression_status(int ret)
 		break;
 	}
 }
+
+/*
+ * Inflates a whole block in one go with the stream kept for the mount, which
+ * saves setting up and tearing down the inflate state for every block.
+ */
+static int sqfs_zlib_decompress(struct squashfs_ctxt *ctxt, void *dest,
+				unsigned long *dest_len, void *source,
+				u32 src_len)
+{
+	z_stream *stream = ctxt->zlib_stream;
+	int ret;
+
+	ret = inflateReset(stream);
+	if (ret != Z_OK)
+		return ret;
+
+	stream->next_in = source;
+	stream->avail_in = src_len;
+	stream->next_out = dest;
+	stream->avail_out = *dest_len;
+
+	ret = inflate(stream, Z_FINISH);
+	*dest_len = stream->total_out;
+	if (ret == Z_STREAM_END)
+		return Z_OK;
+
+	/* Z_BUF_ERROR with room left in 'dest' means truncated input */
+	if (ret == Z_BUF_ERROR && stream->avail_out)
+		return Z_DATA_ERROR;
+
+	return ret;
+}
 #endif
 
 #if IS_ENABLED(CONFIG_ZSTD)
-static int sqfs_zstd_decompress(struct squashfs_ctxt *ctxt, void *dest,
-				unsigned long dest_len, void *source, u32 src_len)
+static size_t sqfs_zstd_decompress(struct squashfs_ctxt *ctxt, void *dest,
+				   unsigned long *dest_len, void *source,
+				   u32 src_len)
 {
-	ZSTD_DCtx *ctx;
-	size_t wsize;
-	int ret;
+	size_t ret;
 
-	wsize = ZSTD_DCtxWorkspaceBound();
-	ctx = ZSTD_initDCtx(ctxt->zstd_workspace, wsize);
-	ret = ZSTD_decompressDCtx(ctx, dest, dest_len, source, src_len);
+	ret = ZSTD_decompressDCtx(ctxt->zstd_dctx, dest, *dest_len, source,
+				  src_len);
+	if (ZSTD_isError(ret))
+		return ret;
 
-	return ZSTD_isError(ret);
+	*dest_len = ret;
+
+	return 0;
 }
 #endif /* CONFIG_ZSTD */
 
@@ -111,6 +166,9 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 		    unsigned long *dest_len, void *source, u32 src_len)
 {
 	u16 comp_type = get_unaligned_le16(&ctxt->sblk->compression);
+#if IS_ENABLED(CONFIG_ZSTD)
+	size_t zstd_ret;
+#endif
 	int ret = 0;
 
 	switch (comp_type) {
@@ -123,12 +181,15 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 			return -EINVAL;
 		}
 
+		*dest_len = lzo_dest_len;
+
 		break;
 	}
 #endif
 #if IS_ENABLED(CONFIG_ZLIB)
 	case SQFS_COMP_ZLIB:
-		ret = uncompress(dest, dest_len, source, src_len);
+		ret = sqfs_zlib_decompress(ctxt, dest, dest_len, source,
+					   src_len);
 		if (ret) {
 			zlib_decompression_status(ret);
 			return -EINVAL;
@@ -138,9 +199,11 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 #endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
-		ret = sqfs_zstd_decompress(ctxt, dest, *dest_len, source, src_len);
-		if (ret) {
-			printf("ZSTD Error code: %d\n", ZSTD_getErrorCode(ret));
+		zstd_ret = sqfs_zstd_decompress(ctxt, dest, dest_len, source,
+						src_len);
+		if (zstd_ret) {
+			printf("ZSTD Error code: %d\n",
+			       ZSTD_getErrorCode(zstd_ret));
 			return -EINVAL;
 		}
 
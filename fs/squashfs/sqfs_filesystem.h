@@ -50,6 +50,9 @@
 #define SQFS_LCHRDEV_TYPE 12
 #define SQFS_LFIFO_TYPE 13
 #define SQFS_LSOCKET_TYPE 14
+/* Decompressed metadata and fragment blocks kept around while mounted */
+#define SQFS_META_CACHE_ENTRIES 8
+#define SQFS_FRAG_CACHE_ENTRIES 3
 
 struct squashfs_super_block {
 	__le32 s_magic;
@@ -73,12 +76,46 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+/*
+ * A decompressed metadata or fragment block, keyed by its position on disk.
+ * 'next' is the disk position of the block that follows it, which is where a
+ * metadata table continues once this block is used up.
+ */
+struct squashfs_cache_entry {
+	u64 block;
+	u64 next;
+	u32 length;
+	u32 last_use;
+	bool valid;
+	void *data;
+};
+
+/*
+ * Small LRU cache of decompressed blocks. Entry buffers of 'block_size' bytes
+ * are only allocated when an entry is first filled.
+ */
+struct squashfs_cache {
+	struct squashfs_cache_entry *entries;
+	int count;
+	u32 block_size;
+	u32 clock;
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
 	struct squashfs_super_block *sblk;
+	struct squashfs_cache meta_cache;
+	struct squashfs_cache frag_cache;
+	/* Disk positions of the fragment table's metadata blocks */
+	u64 *frag_index;
+	/* Decompressor state, set up once per mount */
+#if IS_ENABLED(CONFIG_ZLIB)
+	struct z_stream_s *zlib_stream;
+#endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	void *zstd_workspace;
+	struct ZSTD_DCtx_s *zstd_dctx;
 #endif
 };
 
@@ -253,31 +290,26 @@ struct squashfs_dir_stream {
 	struct fs_dir_stream fs_dirs;
 	struct fs_dirent dentp;
 	/*
-	 * 'size' is the uncompressed size of the entire listing, including
-	 * headers. 'entry_count' is the number of entries following a
-	 * specific header. Both variables are decremented in sqfs_readdir() so
-	 * the function knows when the end of the directory is reached.
+	 * 'size' is the uncompressed size of the listing left to read,
+	 * including headers. 'entry_count' is the number of entries following
+	 * a specific header. Both variables are decremented in sqfs_readdir()
+	 * so the function knows when the end of the directory is reached.
 	 */
 	size_t size;
 	int entry_count;
-	/* SquashFS structures */
-	struct squashfs_directory_header *dir_header;
+	/* SquashFS structures, converted to CPU byte order */
+	struct squashfs_directory_header dir_header;
 	struct squashfs_directory_entry *entry;
 	/*
-	 * 'table' points to a position into the directory table. Both 'table'
-	 * and 'inode' are defined for the first time in sqfs_opendir().
-	 * 'table's value changes in sqfs_readdir().
+	 * Position of the next header or entry in the directory table: the
+	 * disk position of its metadata block and the offset into the
+	 * decompressed block. Set up in sqfs_opendir(), advanced by
+	 * sqfs_readdir().
 	 */
-	unsigned char *table;
-	union squashfs_inode i;
-	struct squashfs_dir_inode i_dir;
-	struct squashfs_ldir_inode i_ldir;
-	/*
-	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
-	 */
-	unsigned char *inode_table;
-	unsigned char *dir_table;
+	u64 table_block;
+	u32 table_offset;
+	/* Inode of the directory being listed */
+	void *dir_inode;
 };
 
 struct squashfs_file_info {
@@ -295,13 +327,9 @@ struct squashfs_file_info {
 	bool comp;
 };
 
-void *sqfs_find_inode(void *inode_table, int inode_number, __le32 inode_count,
-		      __le32 block_size);
-
-int sqfs_dir_offset(void *dir_i, u32 *m_list, int m_count);
+int sqfs_inode_fixed_size(u16 type);
 
-int sqfs_read_metablock(unsigned char *file_mapping, int offset,
-			bool *compressed, u32 *data_size);
+int sqfs_inode_size(struct squashfs_base_inode *inode, u32 blk_size);
 
 bool sqfs_is_empty_dir(void *dir_i);
 
@@ -672,23 +672,13 @@ static inline void *kmap(struct page *page)
 	return page->addr;
 }
 
-static int read_block(struct inode *inode, void *addr, unsigned int block,
-		      struct ubifs_data_node *dn)
+static int decompress_block(struct inode *inode, void *addr,
+			    unsigned int block, struct ubifs_data_node *dn)
 {
 	struct ubifs_info *c = inode->i_sb->s_fs_info;
 	int err, len, out_len;
-	union ubifs_key key;
 	unsigned int dlen;
 
-	data_key_init(c, &key, inode->i_ino, block);
-	err = ubifs_tnc_lookup(c, &key, dn);
-	if (err) {
-		if (err == -ENOENT)
-			/* Not found, so it must be a hole */
-			memset(addr, 0, UBIFS_BLOCK_SIZE);
-		return err;
-	}
-
 	ubifs_assert(le64_to_cpu(dn->ch.sqnum) > ubifs_inode(inode)->creat_sqnum);
 
 	len = le32_to_cpu(dn->size);
@@ -719,6 +709,73 @@ dump:
 	return -EINVAL;
 }
 
+static int read_block(struct inode *inode, void *addr, unsigned int block,
+		      struct ubifs_data_node *dn)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	union ubifs_key key;
+	int err;
+
+	data_key_init(c, &key, inode->i_ino, block);
+	err = ubifs_tnc_lookup(c, &key, dn);
+	if (err) {
+		if (err == -ENOENT)
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		return err;
+	}
+
+	return decompress_block(inode, addr, block, dn);
+}
+
+/*
+ * Read the data nodes of up to @nr blocks from @block on which sit one after
+ * the other in the same LEB with a single flash read, and decompress them
+ * straight into @addr. Returns the number of blocks filled in, holes
+ * included, or 0 if @block has to be read on its own.
+ */
+static int read_blocks_bulk(struct inode *inode, void *addr,
+			    unsigned int block, unsigned int nr)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct bu_info *bu = &c->bu;
+	unsigned int blk_cnt, i;
+	int n = 0, err;
+
+	data_key_init(c, &bu->key, inode->i_ino, block);
+	bu->buf_len = c->max_bu_buf_len;
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err || !bu->cnt)
+		return err;
+
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err)
+		return err;
+
+	blk_cnt = min_t(unsigned int, bu->blk_cnt, nr);
+	for (i = 0; i < blk_cnt; i++, addr += UBIFS_BLOCK_SIZE) {
+		struct ubifs_zbranch *zbr;
+
+		while (n < bu->cnt &&
+		       key_block(c, &bu->zbranch[n].key) < block + i)
+			n++;
+
+		zbr = &bu->zbranch[n];
+		if (n >= bu->cnt || key_block(c, &zbr->key) != block + i) {
+			/* Not in the index, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+			continue;
+		}
+
+		err = decompress_block(inode, addr, block + i,
+				       bu->buf + zbr->offs - bu->zbranch[0].offs);
+		if (err)
+			return err;
+	}
+
+	return blk_cnt;
+}
+
 static int do_readpage(struct ubifs_info *c, struct inode *inode,
 		       struct page *page, int last_block_size)
 {
@@ -839,8 +896,9 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	unsigned long inum;
 	struct inode *inode;
 	struct page page;
+	bool bulk = c->bu.buf;
 	int err = 0;
-	int i;
+	int i, n;
 	int count;
 	int last_block_size = 0;
 
@@ -891,6 +949,28 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	page.index = offset / PAGE_SIZE;
 	page.inode = inode;
 	for (i = 0; i < count; i++) {
+		/*
+		 * Everything up to the last page is read in bulk as far as
+		 * the data nodes allow it.
+		 */
+		if (bulk && i + 1 < count) {
+			n = read_blocks_bulk(inode, page.addr,
+					     page.index << UBIFS_BLOCKS_PER_PAGE_SHIFT,
+					     (count - i - 1) << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+			if (n < 0) {
+				ubifs_warn(c, "ignoring error %d and skipping bulk-read",
+					   n);
+				bulk = false;
+			}
+			n >>= UBIFS_BLOCKS_PER_PAGE_SHIFT;
+			if (n > 0) {
+				page.addr += n * PAGE_SIZE;
+				page.index += n;
+				i += n - 1;
+				continue;
+			}
+		}
+
 		/*
 		 * Make sure to not read beyond the requested size
 		 */
@@ -11,12 +11,16 @@
  */
 
 #include <common.h>
+#include <gzip.h>
 #include <log.h>
 #include <malloc.h>
 #include <linux/stat.h>
 #include <linux/time.h>
 #include <linux/ctype.h>
+#include <linux/list.h>
 #include <asm/byteorder.h>
+#include <asm/unaligned.h>
+#include <u-boot/lz4.h>
 #include "zfs_common.h"
 #include "div64.h"
 
@@ -174,19 +178,53 @@ struct zfs_data {
 	int (*userhook)(const char *, const struct zfs_dirhook_info *);
 	struct zfs_dirhook_info *dirinfo;
 
+	/* cache of decoded indirect and dnode blocks, see zfs_arc_read() */
+	struct list_head arc_mru;
+	struct list_head arc_mfu;
+	size_t arc_size;
 };
 
 
 
 
+/*
+ * ZFS stores gzip blocks in the zlib format, so skip the two byte zlib
+ * header and inflate the raw deflate stream behind it.
+ */
 static int
-zlib_decompress(void *s, void *d,
+gzip_decompress(void *s, void *d,
 				uint32_t slen, uint32_t dlen)
 {
-	if (zlib_decompress(s, d, slen, dlen) < 0)
+	unsigned long len = slen;
+
+	if (zunzip(d, dlen, s, &len, 1, 2) < 0)
+		return ZFS_ERR_BAD_FS;
+	return ZFS_ERR_NONE;
+}
+
+#if IS_ENABLED(CONFIG_LZ4)
+/*
+ * ZFS prefixes the LZ4 stream with its length as a big-endian 32-bit word,
+ * since the compressed block is padded out to a whole number of sectors.
+ */
+static int
+lz4_decompress(void *s, void *d,
+			   uint32_t slen, uint32_t dlen)
+{
+	uint32_t bufsiz;
+
+	if (slen < sizeof(bufsiz))
+		return ZFS_ERR_BAD_FS;
+
+	bufsiz = get_unaligned_be32(s);
+	if (bufsiz > slen - sizeof(bufsiz))
+		return ZFS_ERR_BAD_FS;
+
+	if (LZ4_decompress_safe((char *)s + sizeof(bufsiz), d, bufsiz, dlen) < 0)
 		return ZFS_ERR_BAD_FS;
 	return ZFS_ERR_NONE;
 }
+#endif
 
 static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{"inherit", NULL},		/* ZIO_COMPRESS_INHERIT */
@@ -194,15 +232,21 @@ static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{"off", NULL},		/* ZIO_COMPRESS_OFF */
 	{"lzjb", lzjb_decompress},	/* ZIO_COMPRESS_LZJB */
 	{"empty", NULL},		/* ZIO_COMPRESS_EMPTY */
-	{"gzip-1", zlib_decompress},  /* ZIO_COMPRESS_GZIP1 */
-	{"gzip-2", zlib_decompress},  /* ZIO_COMPRESS_GZIP2 */
-	{"gzip-3", zlib_decompress},  /* ZIO_COMPRESS_GZIP3 */
-	{"gzip-4", zlib_decompress},  /* ZIO_COMPRESS_GZIP4 */
-	{"gzip-5", zlib_decompress},  /* ZIO_COMPRESS_GZIP5 */
-	{"gzip-6", zlib_decompress},  /* ZIO_COMPRESS_GZIP6 */
-	{"gzip-7", zlib_decompress},  /* ZIO_COMPRESS_GZIP7 */
-	{"gzip-8", zlib_decompress},  /* ZIO_COMPRESS_GZIP8 */
-	{"gzip-9", zlib_decompress},  /* ZIO_COMPRESS_GZIP9 */
+	{"gzip-1", gzip_decompress},  /* ZIO_COMPRESS_GZIP1 */
+	{"gzip-2", gzip_decompress},  /* ZIO_COMPRESS_GZIP2 */
+	{"gzip-3", gzip_decompress},  /* ZIO_COMPRESS_GZIP3 */
+	{"gzip-4", gzip_decompress},  /* ZIO_COMPRESS_GZIP4 */
+	{"gzip-5", gzip_decompress},  /* ZIO_COMPRESS_GZIP5 */
+	{"gzip-6", gzip_decompress},  /* ZIO_COMPRESS_GZIP6 */
+	{"gzip-7", gzip_decompress},  /* ZIO_COMPRESS_GZIP7 */
+	{"gzip-8", gzip_decompress},  /* ZIO_COMPRESS_GZIP8 */
+	{"gzip-9", gzip_decompress},  /* ZIO_COMPRESS_GZIP9 */
+	{"zle", NULL},		/* ZIO_COMPRESS_ZLE */
+#if IS_ENABLED(CONFIG_LZ4)
+	{"lz4", lz4_decompress},	/* ZIO_COMPRESS_LZ4 */
+#else
+	{"lz4", NULL},		/* ZIO_COMPRESS_LZ4 */
+#endif
 };
 
 
@@ -356,13 +400,11 @@ uberblock_verify(uberblock_t *uber, int offset, struct zfs_data *data)
 	}
 
 	if (zfs_to_cpu64(uber->ub_magic, LITTLE_ENDIAN) == UBERBLOCK_MAGIC
-		&& zfs_to_cpu64(uber->ub_version, LITTLE_ENDIAN) > 0
-		&& zfs_to_cpu64(uber->ub_version, LITTLE_ENDIAN) <= SPA_VERSION)
+		&& SPA_VERSION_IS_SUPPORTED(zfs_to_cpu64(uber->ub_version, LITTLE_ENDIAN)))
 		endian = LITTLE_ENDIAN;
 
 	if (zfs_to_cpu64(uber->ub_magic, BIG_ENDIAN) == UBERBLOCK_MAGIC
-		&& zfs_to_cpu64(uber->ub_version, BIG_ENDIAN) > 0
-		&& zfs_to_cpu64(uber->ub_version, BIG_ENDIAN) <= SPA_VERSION)
+		&& SPA_VERSION_IS_SUPPORTED(zfs_to_cpu64(uber->ub_version, BIG_ENDIAN)))
 		endian = BIG_ENDIAN;
 
 	if (endian == UNKNOWN_ENDIAN) {
@@ -489,7 +531,7 @@ zio_read_gang(blkptr_t *bp, zfs_endian_t endian, dva_t *dva, void *buf,
 	endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
 
 	for (i = 0; i < SPA_GBH_NBLKPTRS; i++) {
-		if (zio_gb->zg_blkptr[i].blk_birth == 0)
+		if (BP_IS_HOLE(&zio_gb->zg_blkptr[i]))
 			continue;
 
 		err = zio_read_data(&zio_gb->zg_blkptr[i], endian, buf, data);
@@ -620,6 +662,107 @@ zio_read(blkptr_t *bp, zfs_endian_t endian, void **buf,
 	return ZFS_ERR_NONE;
 }
 
+/*
+ * Decoded indirect and dnode blocks are kept for the life of the mount, up
+ * to CONFIG_CMD_ZFS_ARC_SIZE bytes, so that walking down the block tree for
+ * every data block of a file does not read, verify and decompress the same
+ * indirect blocks each time.  As in the ARC, a block starts out on the MRU
+ * list and moves to the MFU list once it is hit again; the MRU list is
+ * evicted first, so a long run of indirect blocks that are each used once
+ * cannot push out the top of the tree.
+ */
+struct zfs_arc_buf {
+	struct list_head list;
+	dva_t dva;
+	uint64_t birth;
+	size_t size;
+	void *data;
+};
+
+static void
+zfs_arc_free(struct zfs_arc_buf *ab, struct zfs_data *data)
+{
+	list_del(&ab->list);
+	data->arc_size -= ab->size;
+	free(ab->data);
+	free(ab);
+}
+
+static void
+zfs_arc_evict(size_t size, struct zfs_data *data)
+{
+	struct list_head *head;
+
+	while (data->arc_size + size > CONFIG_CMD_ZFS_ARC_SIZE) {
+		head = list_empty(&data->arc_mru) ? &data->arc_mfu : &data->arc_mru;
+		if (list_empty(head))
+			break;
+		zfs_arc_free(list_last_entry(head, struct zfs_arc_buf, list), data);
+	}
+}
+
+static void
+zfs_arc_destroy(struct zfs_data *data)
+{
+	struct zfs_arc_buf *ab, *tmp;
+
+	list_for_each_entry_safe(ab, tmp, &data->arc_mru, list)
+		zfs_arc_free(ab, data);
+	list_for_each_entry_safe(ab, tmp, &data->arc_mfu, list)
+		zfs_arc_free(ab, data);
+}
+
+/*
+ * Returns the decoded block pointed to by bp in *buf, reading it in if it is
+ * not cached yet.  The buffer belongs to the cache and is only valid up to
+ * the next call.  Blocks are copy-on-write, so the first DVA and the birth
+ * txg identify one for good.
+ */
+static int
+zfs_arc_read(blkptr_t *bp, zfs_endian_t endian, void **buf,
+			 size_t *size, struct zfs_data *data)
+{
+	struct list_head *heads[] = { &data->arc_mfu, &data->arc_mru };
+	struct zfs_arc_buf *ab;
+	size_t lsize;
+	int err, i;
+
+	for (i = 0; i < ARRAY_SIZE(heads); i++) {
+		list_for_each_entry(ab, heads[i], list) {
+			if (ab->birth == bp->blk_birth &&
+				!memcmp(&ab->dva, &bp->blk_dva[0], sizeof(ab->dva))) {
+				list_move(&ab->list, &data->arc_mfu);
+				*buf = ab->data;
+				if (size)
+					*size = ab->size;
+				return ZFS_ERR_NONE;
+			}
+		}
+	}
+
+	ab = malloc(sizeof(*ab));
+	if (!ab)
+		return ZFS_ERR_OUT_OF_MEMORY;
+
+	err = zio_read(bp, endian, &ab->data, &lsize, data);
+	if (err) {
+		free(ab);
+		return err;
+	}
+
+	zfs_arc_evict(lsize, data);
+	ab->dva = bp->blk_dva[0];
+	ab->birth = bp->blk_birth;
+	ab->size = lsize;
+	list_add(&ab->list, &data->arc_mru);
+	data->arc_size += lsize;
+
+	*buf = ab->data;
+	if (size)
+		*size = lsize;
+	return ZFS_ERR_NONE;
+}
+
 /*
  * Get the block from a block id.
  * push the block onto the stack.
@@ -634,6 +777,7 @@ dmu_read(dnode_end_t *dn, uint64_t blkid, void **buf,
 	int epbs = dn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
 	blkptr_t *bp;
 	void *tmpbuf = 0;
+	size_t size;
 	zfs_endian_t endian;
 	int err = ZFS_ERR_NONE;
 
@@ -645,17 +789,13 @@ dmu_read(dnode_end_t *dn, uint64_t blkid, void **buf,
 	for (level = dn->dn.dn_nlevels - 1; level >= 0; level--) {
 		idx = (blkid >> (epbs * level)) & ((1 << epbs) - 1);
 		*bp = bp_array[idx];
-		if (bp_array != dn->dn.dn_blkptr) {
-			free(bp_array);
-			bp_array = 0;
-		}
 
 		if (BP_IS_HOLE(bp)) {
-			size_t size = zfs_to_cpu16(dn->dn.dn_datablkszsec,
-											dn->endian)
+			size = zfs_to_cpu16(dn->dn.dn_datablkszsec,
+								dn->endian)
 				<< SPA_MINBLOCKSHIFT;
 			*buf = malloc(size);
-			if (*buf) {
+			if (!*buf) {
 				err = ZFS_ERR_OUT_OF_MEMORY;
 				break;
 			}
@@ -663,19 +803,31 @@ dmu_read(dnode_end_t *dn, uint64_t blkid, void **buf,
 			endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
 			break;
 		}
+		if (level == 0 && dn->dn.dn_type == DMU_OT_DNODE) {
+			/* dnode blocks are cached, hand out a copy */
+			err = zfs_arc_read(bp, endian, &tmpbuf, &size, data);
+			endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
+			if (err)
+				break;
+			*buf = malloc(size);
+			if (!*buf) {
+				err = ZFS_ERR_OUT_OF_MEMORY;
+				break;
+			}
+			memcpy(*buf, tmpbuf, size);
+			break;
+		}
 		if (level == 0) {
 			err = zio_read(bp, endian, buf, 0, data);
 			endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
 			break;
 		}
-		err = zio_read(bp, endian, &tmpbuf, 0, data);
+		err = zfs_arc_read(bp, endian, &tmpbuf, NULL, data);
 		endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
 		if (err)
 			break;
 		bp_array = tmpbuf;
 	}
-	if (bp_array != dn->dn.dn_blkptr)
-		free(bp_array);
 	if (endian_out)
 		*endian_out = endian;
 
@@ -1708,6 +1860,62 @@ int_zfs_fetch_nvlist(struct zfs_data *data, char **nvlist)
 	return ZFS_ERR_NONE;
 }
 
+/*
+ * Features changing the on-disk format that we know how to read.  Any other
+ * feature a pool lists as needed for reading makes us refuse it.
+ */
+static const char *const spa_feature_names[] = {
+	"org.illumos:lz4_compress",
+	"com.delphix:hole_birth",
+	NULL
+};
+
+static int
+check_feature(const char *name, size_t name_len)
+{
+	int i;
+
+	for (i = 0; spa_feature_names[i]; i++)
+		if (strlen(spa_feature_names[i]) == name_len &&
+			!memcmp(spa_feature_names[i], name, name_len))
+			return 1;
+	return 0;
+}
+
+/*
+ * The features_for_read nvlist of the label holds one boolean nvpair, with
+ * no value, per feature the pool needs to be read.
+ */
+static int
+check_pool_features(char *nvlist)
+{
+	char *features, *nvpair;
+	int encode_size, name_len;
+	int err = ZFS_ERR_NONE;
+
+	features = zfs_nvlist_lookup_nvlist(nvlist,
+			ZPOOL_CONFIG_FEATURES_FOR_READ);
+	if (!features)
+		return ZFS_ERR_NONE;
+
+	/* skip the header, nvl_version, and nvl_nvflag */
+	nvpair = features + 4 * 3;
+	while ((encode_size = be32_to_cpu(*(uint32_t *) nvpair)) > 0) {
+		/* skip the encode/decode size to the name */
+		name_len = be32_to_cpu(*(uint32_t *) (nvpair + 4 * 2));
+		if (!check_feature(nvpair + 4 * 3, name_len)) {
+			printf("zpool needs unsupported feature %.*s\n",
+				   name_len, nvpair + 4 * 3);
+			err = ZFS_ERR_NOT_IMPLEMENTED_YET;
+			break;
+		}
+		nvpair += encode_size;	/* goto the next nvpair */
+	}
+
+	free(features);
+	return err;
+}
+
 /*
  * Check the disk label information and retrieve needed vdev name-value pairs.
  *
@@ -1765,14 +1973,21 @@ check_pool_label(struct zfs_data *data)
 		return ZFS_ERR_BAD_FS;
 	}
 
-	if (version > SPA_VERSION) {
+	if (!SPA_VERSION_IS_SUPPORTED(version)) {
 		free(nvlist);
-		printf("SPA version too new %llu > %llu\n",
-			   (unsigned long long) version,
-			   (unsigned long long) SPA_VERSION);
+		printf("SPA version %llu not supported\n",
+			   (unsigned long long) version);
 		return ZFS_ERR_NOT_IMPLEMENTED_YET;
 	}
 
+	if (version == SPA_VERSION_FEATURES) {
+		err = check_pool_features(nvlist);
+		if (err) {
+			free(nvlist);
+			return err;
+		}
+	}
+
 	vdevnvlist = zfs_nvlist_lookup_nvlist(nvlist, ZPOOL_CONFIG_VDEV_TREE);
 	if (!vdevnvlist) {
 		free(nvlist);
@@ -1831,6 +2046,7 @@ static uint64_t vdev_label_start(uint64_t psize, int l)
 void
 zfs_unmount(struct zfs_data *data)
 {
+	zfs_arc_destroy(data);
 	free(data->dnode_buf);
 	free(data->dnode_mdn);
 	free(data->file_buf);
@@ -1858,6 +2074,8 @@ zfs_mount(device_t dev)
 	if (!data)
 		return 0;
 	memset(data, 0, sizeof(*data));
+	INIT_LIST_HEAD(&data->arc_mru);
+	INIT_LIST_HEAD(&data->arc_mfu);
 
 	ub_array = malloc(VDEV_UBERBLOCK_RING);
 	if (!ub_array) {
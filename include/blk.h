@@ -170,10 +170,10 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @param blocks - maximum number of blocks cached from a single read
+ * @param max_bytes - memory budget of the cache in bytes
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(unsigned blocks, unsigned long max_bytes);
 
 /*
  * statistics of the block cache
@@ -181,18 +181,45 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
+	unsigned evictions;
+	unsigned entries; /* current number of cached blocks */
+	unsigned long bytes; /* current memory use, including overhead */
 	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	unsigned long max_bytes;
+};
+
+/*
+ * per-device statistics of the block cache
+ */
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned misses;
+	unsigned evictions;
+	unsigned entries;
+	unsigned long bytes;
 };
 
 /**
  * get_blkcache_stats() - return statistics and reset
  *
+ * This resets the hit, miss and eviction counters of every device as well
+ * as the global ones.
+ *
  * @param stats - statistics are copied here
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return statistics for one device seen by the cache
+ *
+ * @param idx - index of the device, starting at 0
+ * @param stats - statistics are copied here
+ * Return: 0 if OK, -ENOENT if there is no device with that index
+ */
+int blkcache_dev_stats(int idx, struct block_cache_dev_stats *stats);
+
 #else
 
 static inline int blkcache_read(int iftype, int dev,
@@ -210,8 +237,69 @@ static inline void blkcache_invalidate(int iftype, int dev) {}
 
 #endif
 
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/**
+ * blk_readahead_invalidate() - discard readahead data of a block device
+ *
+ * This must be called when the device contents change behind the back of
+ * blk_dwrite()/blk_derase(), e.g. after the medium was re-initialised.
+ *
+ * @block_dev:	Block device descriptor
+ */
+void blk_readahead_invalidate(struct blk_desc *block_dev);
+#else
+static inline void blk_readahead_invalidate(struct blk_desc *block_dev) {}
+#endif
+
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
+struct blk_request;
+
+/**
+ * enum blk_req_op - operation carried out by a block request
+ *
+ * @BLK_REQ_READ:	Read blocks into the request buffer
+ * @BLK_REQ_WRITE:	Write blocks from the request buffer
+ * @BLK_REQ_ERASE:	Erase blocks, the buffer is not used
+ */
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+	BLK_REQ_ERASE,
+};
+
+/**
+ * struct blk_request - asynchronous block request
+ *
+ * The submitter fills in @op, @start, @blkcnt, @buffer and optionally
+ * @complete and @priv, then calls blk_submit(). The remaining fields are
+ * set by the uclass and the driver.
+ *
+ * @op:		Operation to carry out
+ * @start:	First block number
+ * @blkcnt:	Number of blocks
+ * @buffer:	Data buffer, which must stay valid until the request completes
+ * @complete:	Called when the request completes, or NULL
+ * @priv:	Private data for use by the submitter
+ * @dev:	Block device the request was submitted to
+ * @result:	Number of blocks transferred, or -ve error; valid once @done
+ *		is true
+ * @done:	true once the request has completed
+ * @drv_data:	For use by the driver while the request is in flight, e.g.
+ *		to count the commands it was split into
+ */
+struct blk_request {
+	enum blk_req_op op;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	void (*complete)(struct blk_request *req);
+	void *priv;
+	struct udevice *dev;
+	long result;
+	bool done;
+	ulong drv_data;
+};
 
 /* Operations on block devices */
 struct blk_ops {
@@ -271,6 +359,36 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - start an asynchronous request
+	 *
+	 * Queue @req with the hardware and return without waiting for it to
+	 * complete. The driver must later call blk_req_done() for it, from
+	 * its poll() method, or from submit() itself if it has to reap
+	 * completions to make room for @req. The uclass never has more than
+	 * the number of requests set with blk_set_queue_depth() outstanding.
+	 *
+	 * This method is optional. Without it requests are carried out
+	 * synchronously through read(), write() and erase().
+	 *
+	 * @dev:	Device to use
+	 * @req:	Request to start
+	 * @return 0 if OK, -ve on error (the request is then not queued)
+	 */
+	int (*submit)(struct udevice *dev, struct blk_request *req);
+
+	/**
+	 * poll() - reap completed asynchronous requests
+	 *
+	 * Check the hardware for completed requests and call
+	 * blk_req_done() for each. A request which does not complete in a
+	 * reasonable time must be completed with -ETIMEDOUT.
+	 *
+	 * @dev:	Device to check
+	 * @return number of requests completed, or -ve on error
+	 */
+	int (*poll)(struct udevice *dev);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -288,6 +406,77 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_submit() - start an asynchronous block request
+ *
+ * If the driver supports asynchronous requests, @req is queued and this
+ * returns once it has been handed to the hardware, waiting for an earlier
+ * request to complete if the queue is full. Otherwise the request is
+ * carried out immediately and has completed when this returns.
+ *
+ * In both cases req->complete() is called once the request completes.
+ *
+ * @dev:	Block device to use
+ * @req:	Request to start
+ * Return: 0 if OK, -ve on error
+ */
+int blk_submit(struct udevice *dev, struct blk_request *req);
+
+/**
+ * blk_poll() - reap completed asynchronous requests
+ *
+ * @dev:	Block device to check
+ * Return: number of requests completed, or -ve on error
+ */
+int blk_poll(struct udevice *dev);
+
+/**
+ * blk_wait() - wait for an asynchronous request to complete
+ *
+ * @req:	Request submitted with blk_submit()
+ * Return: number of blocks transferred, or -ve on error
+ */
+long blk_wait(struct blk_request *req);
+
+/**
+ * blk_wait_all() - wait for all outstanding requests of a device
+ *
+ * @dev:	Block device to wait for
+ * Return: 0 if OK, -ve on error
+ */
+int blk_wait_all(struct udevice *dev);
+
+/**
+ * blk_req_done() - mark an asynchronous request as completed
+ *
+ * This is called by drivers from their poll() method.
+ *
+ * @dev:	Block device the request was submitted to
+ * @req:	Completed request
+ * @result:	Number of blocks transferred, or -ve error
+ */
+void blk_req_done(struct udevice *dev, struct blk_request *req, long result);
+
+/**
+ * blk_set_queue_depth() - set the number of requests a device can queue
+ *
+ * Drivers implementing submit() call this from their probe() method. The
+ * default is a single outstanding request.
+ *
+ * @dev:	Block device
+ * @depth:	Maximum number of requests in flight
+ */
+void blk_set_queue_depth(struct udevice *dev, int depth);
+
+/**
+ * blk_get_queue_depth() - get the number of requests a device can queue
+ *
+ * @dev:	Block device
+ * Return: maximum number of requests in flight, 1 for drivers without
+ *	   submit()
+ */
+int blk_get_queue_depth(struct udevice *dev);
+
 /**
  * blk_find_device() - Find a block device
  *
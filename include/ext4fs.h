@@ -31,12 +31,17 @@
 struct disk_partition;
 
 #define EXT4_INDEX_FL		0x00001000 /* Inode uses hash tree index */
+#define EXT4_ENCRYPT_FL		0x00000800 /* Encrypted inode */
+#define EXT4_CASEFOLD_FL	0x40000000 /* Casefolded directory */
 #define EXT4_EXTENTS_FL		0x00080000 /* Inode uses extents */
 #define EXT4_EXT_MAGIC			0xf30a
+#define EXT4_FEATURE_COMPAT_DIR_INDEX	0x0020
 #define EXT4_FEATURE_RO_COMPAT_GDT_CSUM	0x0010
 #define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM 0x0400
 #define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
 #define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR	0x4000
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
 #define EXT4_INDIRECT_BLOCKS		12
 
 #define EXT4_BG_INODE_UNINIT		0x0001
@@ -81,6 +86,61 @@ struct ext4_extent_header {
 	__le32	eh_generation;	/* generation of the tree */
 };
 
+/* ee_len above this marks an unwritten extent, which reads as zeroes */
+#define EXT_INIT_MAX_LEN	(1UL << 15)
+#define EXT4_MAX_EXTENT_DEPTH	5
+
+/*
+ * In-memory copy of the whole extent tree of an inode: the allocated runs
+ * sorted by logical block, with physically contiguous extents merged.
+ */
+struct ext4_extent_run {
+	uint32_t lblk;		/* first logical block */
+	uint32_t len;		/* number of blocks */
+	uint64_t pblk;		/* first physical block */
+};
+
+struct ext4_extent_map {
+	unsigned int nr;
+	unsigned int size;
+	struct ext4_extent_run run[];
+};
+
+/*
+ * HTree (dx_dir) directory index. Block 0 of an indexed directory holds
+ * the "." and ".." entries followed by a dx_root_info and an array of
+ * dx_entry; interior nodes hold a single empty dirent spanning the block
+ * followed by the array. The first dx_entry of each array is overlaid by
+ * a dx_countlimit.
+ */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+#define EXT4_HTREE_EOF_32BIT		0x7fffffffU
+#define EXT4_HTREE_LEVEL_COMPAT		2
+#define EXT4_HTREE_LEVEL		3
+
+struct dx_root_info {
+	__le32	reserved_zero;
+	__u8	hash_version;
+	__u8	info_length;	/* 8 */
+	__u8	indirect_levels;
+	__u8	unused_flags;
+};
+
+struct dx_entry {
+	__le32	hash;
+	__le32	block;		/* logical block within the directory */
+};
+
+struct dx_countlimit {
+	__le16	limit;
+	__le16	count;
+};
+
 struct ext_filesystem {
 	/* Total Sector of partition */
 	uint64_t total_sect;
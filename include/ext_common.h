@@ -198,11 +198,14 @@ struct ext2_dirent {
 	__u8 filetype;
 };
 
+struct ext4_extent_map;
+
 struct ext2fs_node {
 	struct ext2_data *data;
 	struct ext2_inode inode;
 	int ino;
 	int inode_read;
+	struct ext4_extent_map *extent_map;	/* built on first read */
 };
 
 /* Information about a "mounted" ext2 filesystem. */
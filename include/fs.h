@@ -9,6 +9,7 @@
 #include <rtc.h>
 
 struct cmd_tbl;
+struct disk_partition;
 
 #define FS_TYPE_ANY	0
 #define FS_TYPE_FAT	1
@@ -91,6 +92,71 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  */
 void fs_close(void);
 
+/**
+ * struct fs_mount_info - Information about an entry in the mount table
+ *
+ * @desc: Block device holding the filesystem
+ * @part: Partition number, 0 for the whole device
+ * @type: Name of the filesystem type
+ * @active: true if the filesystem driver state belongs to this mount
+ * @hits: Number of times the mount was reused without probing the device
+ */
+struct fs_mount_info {
+	struct blk_desc *desc;
+	int part;
+	const char *type;
+	bool active;
+	unsigned int hits;
+};
+
+#if CONFIG_IS_ENABLED(FS_MOUNT)
+/**
+ * fs_mount_invalidate() - Forget the mounts of a block device
+ *
+ * Called when a block device is written, erased or removed. If the mount
+ * is in use by a filesystem operation, it is closed once the operation
+ * finishes.
+ *
+ * @desc: Block device, or NULL for all mounts
+ */
+void fs_mount_invalidate(struct blk_desc *desc);
+
+/**
+ * fs_mount_get_info() - Get information about a mount table entry
+ *
+ * @idx: Index of the entry, starting at 0
+ * @info: Returns the information
+ * Return: 0 if OK, -ENOENT if there is no entry @idx
+ */
+int fs_mount_get_info(int idx, struct fs_mount_info *info);
+
+/**
+ * fs_set_blk_dev_drv() - Open a partition with one filesystem driver
+ *
+ * For callers which use a filesystem driver directly rather than through
+ * the fs_*() functions, e.g. fatinfo and the environment in FAT or ext4.
+ * Any filesystem left mounted is closed first.
+ *
+ * @probe: Probe function of the driver, e.g. fat_set_blk_dev()
+ * @desc: Block device
+ * @info: Partition to open
+ * Return: 0 if OK, non-zero if the driver cannot use the partition
+ */
+int fs_set_blk_dev_drv(int (*probe)(struct blk_desc *desc,
+				    struct disk_partition *info),
+		       struct blk_desc *desc, struct disk_partition *info);
+#else
+static inline void fs_mount_invalidate(struct blk_desc *desc) {}
+
+static inline int fs_set_blk_dev_drv(int (*probe)(struct blk_desc *desc,
+						  struct disk_partition *info),
+				     struct blk_desc *desc,
+				     struct disk_partition *info)
+{
+	return probe(desc, info);
+}
+#endif
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
@@ -289,6 +355,17 @@ int do_fs_uuid(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
  */
 int do_fs_type(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[]);
 
+/*
+ * List the mount table, or mount the specified filesystem so that later
+ * commands on it skip probing.
+ */
+int do_fs_mount(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[]);
+
+/*
+ * Drop the specified filesystem, or all of them, from the mount table.
+ */
+int do_fs_umount(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[]);
+
 /**
  * do_fs_types - List supported filesystems.
  *
@@ -74,6 +74,7 @@ struct bd_info;
 #define MMC_CAP_NONREMOVABLE	BIT(14)
 #define MMC_CAP_NEEDS_POLL	BIT(15)
 #define MMC_CAP_CD_ACTIVE_HIGH  BIT(16)
+#define MMC_CAP_CMD23		BIT(17)
 
 #define MMC_MODE_8BIT		BIT(30)
 #define MMC_MODE_4BIT		BIT(29)
@@ -82,6 +83,7 @@ struct bd_info;
 
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_CMD23_SUPPORT	0x00000002
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -706,6 +708,9 @@ struct mmc {
 	struct blk_desc block_dev;
 #endif
 	char op_cond_pending;	/* 1 if we are waiting on an op_cond command */
+	char sd_op_cond;	/* 1 if the pending op_cond is an SD ACMD41 */
+	char uhs_en;		/* 1 if the pending ACMD41 asks for 1.8V */
+	ulong op_cond_start;	/* get_timer() value of the first op_cond */
 	char init_in_progress;	/* 1 if we have done mmc_start_init() */
 	char preinit;		/* start init as early as possible */
 	int ddr_mode;
@@ -907,13 +912,36 @@ int mmc_get_op_cond(struct mmc *mmc, bool quiet);
  * Start device initialization and return immediately; it does not block on
  * polling OCR (operation condition register) status.  Then you should call
  * mmc_init, which would block on polling OCR status and complete the device
- * initializatin.
+ * initializatin, or mmc_poll_init() which does not block.
  *
  * @param mmc	Pointer to a MMC device struct
  * Return: 0 on success, <0 on error.
  */
 int mmc_start_init(struct mmc *mmc);
 
+/**
+ * Make progress on an initialization started with mmc_start_init()
+ *
+ * This checks the OCR status once. When the card has finished powering up
+ * the initialization is completed, as mmc_init() would do.
+ *
+ * @param mmc	Pointer to a MMC device struct
+ * Return: 0 when the device is initialized, -EAGAIN if the card is still
+ * powering up, other -ve value on error.
+ */
+int mmc_poll_init(struct mmc *mmc);
+
+/**
+ * Make progress on all MMC devices which are being initialized
+ *
+ * This calls mmc_poll_init() once for each such device. It may be called
+ * from anywhere during boot, so that cards finish initializing while other
+ * work is done.
+ *
+ * Return: number of devices still initializing
+ */
+int mmc_poll_init_all(void);
+
 /**
  * Set preinit flag of mmc device.
  *
@@ -928,6 +956,20 @@ int mmc_start_init(struct mmc *mmc);
  */
 void mmc_set_preinit(struct mmc *mmc, int preinit);
 
+/**
+ * Check whether a device should be pre-inited during mmc_initialize()
+ *
+ * This is the case if the preinit flag is set, or for all devices with
+ * CONFIG_MMC_DEFERRED_INIT.
+ *
+ * @param mmc	Pointer to a MMC device struct
+ * Return: true to start initializing the device early
+ */
+static inline bool mmc_want_preinit(struct mmc *mmc)
+{
+	return mmc->preinit || CONFIG_IS_ENABLED(MMC_DEFERRED_INIT);
+}
+
 #ifdef CONFIG_MMC_SPI
 #define mmc_host_is_spi(mmc)	((mmc)->cfg->host_caps & MMC_MODE_SPI)
 #else
@@ -136,7 +136,8 @@ enum eth_recv_flags {
  *	 packet buffer in the packetp parameter. If not, return an error or 0 to
  *	 indicate that the hardware receive FIFO is empty. If 0 is returned, the
  *	 network stack will not process the empty packet, but free_pkt() will be
- *	 called if supplied
+ *	 called if supplied. The buffer may be the one the hardware received
+ *	 into, see eth_alloc_rx_bufs(), so that the packet is not copied
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
@@ -180,6 +181,37 @@ unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
 void eth_halt_state_only(void); /* Set passive state */
+
+/**
+ * eth_alloc_rx_bufs() - get receive buffers of a device's own
+ *
+ * A driver may hand each packet to the network stack in the buffer the
+ * hardware received it into, and give the buffer back to the hardware from
+ * free_pkt(). Instead of the PKTBUFSRX buffers in net_rx_packets[], which
+ * all devices share, such a driver can ask for as many buffers as its
+ * receive ring has, typically from start(). Each buffer holds PKTSIZE_ALIGN
+ * bytes and is aligned for DMA. Asking again with the same @count returns
+ * the same buffers. They are freed when the device is removed.
+ *
+ * A pool of another size is never replaced behind the driver's back, as the
+ * hardware may still be receiving into it: the driver has to stop using it
+ * and call eth_free_rx_bufs() first.
+ *
+ * @dev: Ethernet device
+ * @count: Number of buffers
+ * Return: array of @count buffers, or NULL if out of memory or if the device
+ * already has a different number of buffers
+ */
+uchar **eth_alloc_rx_bufs(struct udevice *dev, int count);
+
+/**
+ * eth_free_rx_bufs() - free the receive buffers of a device
+ *
+ * The hardware must no longer be receiving into them.
+ *
+ * @dev: Ethernet device
+ */
+void eth_free_rx_bufs(struct udevice *dev);
 #endif
 
 #ifndef CONFIG_DM_ETH
@@ -365,6 +397,7 @@ struct vlan_ethernet_hdr {
 #define PROT_NCSI	0x88f8		/* NC-SI control packets        */
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -558,7 +591,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, UDP
+	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, UDP, WGET
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -689,14 +722,18 @@ static inline void net_send_packet(uchar *pkt, int len)
 }
 
 /*
- * Transmit "net_tx_packet" as UDP packet, performing ARP request if needed
- *  (ether will be populated)
+ * Transmit "net_tx_packet" as UDP or TCP packet, performing ARP request if
+ *  needed (ether will be populated)
  *
  * @param ether Raw packet buffer
  * @param dest IP address to send the datagram to
- * @param dport Destination UDP port
- * @param sport Source UDP port
- * @param payload_len Length of data after the UDP header
+ * @param dport Destination UDP/TCP port
+ * @param sport Source UDP/TCP port
+ * @param payload_len Length of data after the UDP/TCP header
+ * @param proto IPPROTO_UDP or IPPROTO_TCP
+ * @param action TCP flags
+ * @param tcp_seq_num TCP sequence number
+ * @param tcp_ack_num TCP acknowledgment number
  */
 int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		       int payload_len, int proto, u8 action, u32 tcp_seq_num,
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Minimal TCP client for the network loop
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <net.h>
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+#define TCP_URG		0x20
+
+/* TCP options */
+#define TCP_O_END	0
+#define TCP_O_NOP	1
+#define TCP_O_MSS	2
+#define TCP_O_WS	3
+
+/* Largest segment we accept: a 1500 byte MTU less IP and TCP headers */
+#define TCP_MSS		1460
+
+/*
+ *	Internet Protocol (IP) + TCP header.
+ */
+struct ip_tcp_hdr {
+	u8		ip_hl_v;	/* header length and version	*/
+	u8		ip_tos;		/* type of service		*/
+	u16		ip_len;		/* total length			*/
+	u16		ip_id;		/* identification		*/
+	u16		ip_off;		/* fragment offset field	*/
+	u8		ip_ttl;		/* time to live			*/
+	u8		ip_p;		/* protocol			*/
+	u16		ip_sum;		/* checksum			*/
+	struct in_addr	ip_src;		/* Source IP address		*/
+	struct in_addr	ip_dst;		/* Destination IP address	*/
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgment number	*/
+	u8		tcp_hlen;	/* 4 bits TCP header length/4	*/
+	u8		tcp_flags;	/* TCP flags			*/
+	u16		tcp_win;	/* Receive window		*/
+	u16		tcp_xsum;	/* Checksum			*/
+	u16		tcp_ugr;	/* Urgent pointer		*/
+} __attribute__((packed));
+
+#define IP_TCP_HDR_SIZE		(sizeof(struct ip_tcp_hdr))
+#define TCP_HDR_SIZE		(IP_TCP_HDR_SIZE - IP_HDR_SIZE)
+
+/**
+ * struct tcp_ops - callbacks of the application using the connection
+ *
+ * There is only ever one connection, driven from the network loop.
+ *
+ * @connected: the three-way handshake has completed, data may be sent
+ * @rx: store @len bytes of @data found at @offset in the received byte
+ *	stream. Segments past a hole are handed over as they arrive, so that
+ *	they need not be kept back while the sender fills the hole. Returns 0
+ *	if the data was stored; a segment that cannot be placed yet may be
+ *	refused with a negative value and is then received again later, but
+ *	refusing in-order data aborts the connection with that error.
+ * @advance: the stream has been received without holes up to @len bytes
+ * @closed: the connection is over. @err is 0 once both sides have sent
+ *	everything they wanted to (our FIN has been acknowledged), or a
+ *	negative error if it was reset or timed out.
+ */
+struct tcp_ops {
+	void (*connected)(void);
+	int (*rx)(u32 offset, const uchar *data, unsigned int len);
+	void (*advance)(u32 len);
+	void (*closed)(int err);
+};
+
+/**
+ * tcp_connect() - open a connection
+ *
+ * Sends the SYN and returns; @ops are called from the network loop as the
+ * connection makes progress. A FIN from the server is answered with our own
+ * FIN straight away, since the only thing we ever send is a request.
+ *
+ * @dest: server address
+ * @dport: server port
+ * @ops: application callbacks
+ */
+void tcp_connect(struct in_addr dest, int dport, const struct tcp_ops *ops);
+
+/**
+ * tcp_send() - send data on an established connection
+ *
+ * @data: data to send, copied so that it can be retransmitted
+ * @len: length of @data, at most one segment
+ * Return: 0 if sent, -EBUSY if earlier data has not been acknowledged yet,
+ *	-EINVAL if @len is too large, -ENOTCONN if not connected
+ */
+int tcp_send(const void *data, unsigned int len);
+
+/**
+ * tcp_close() - send our FIN
+ *
+ * @ops->closed is called once it has been acknowledged.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_abort() - reset the connection without calling @ops->closed
+ */
+void tcp_abort(void);
+
+/**
+ * net_set_tcp_header() - fill in the IP and TCP headers of a segment
+ *
+ * SYN segments carry the MSS and window scale options where the payload
+ * would otherwise go, so they must not have a payload.
+ *
+ * @pkt: start of the IP header
+ * @dest: destination address
+ * @dport: destination port
+ * @sport: source port
+ * @payload_len: length of the payload following the TCP header
+ * @action: TCP flags
+ * @tcp_seq_num: sequence number
+ * @tcp_ack_num: acknowledgment number
+ * Return: size of the IP and TCP headers including options
+ */
+int net_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num);
+
+/**
+ * tcp_receive() - handle a TCP segment from net_process_received_packet()
+ *
+ * @ip: IP header, checked already
+ * @len: length of the IP datagram
+ */
+void tcp_receive(struct ip_tcp_hdr *ip, int len);
+
+#endif /* __TCP_H__ */
@@ -7,6 +7,8 @@
 #ifndef __NVME_H__
 #define __NVME_H__
 
+#include <blk.h>
+
 struct nvme_dev;
 
 /**
@@ -90,4 +92,24 @@ int nvme_print_info(struct udevice *udev);
  */
 int nvme_get_namespace_id(struct udevice *udev, u32 *ns_id, u8 *eui64);
 
+/**
+ * nvme_bench - measure read throughput at different queue depths
+ *
+ * This reads the same range of blocks twice, first with one command in
+ * flight at a time and then with the I/O queues kept full, and returns
+ * the time taken by each pass.
+ *
+ * @udev:	NVMe block device
+ * @buffer:	Buffer to read into
+ * @blknr:	First block to read
+ * @blkcnt:	Number of blocks to read
+ * @us_qd1:	Returns the time of the single-command pass in microseconds
+ * @us_qdn:	Returns the time of the full-queue pass in microseconds
+ * @depth:	Returns the number of commands kept in flight in the second
+ *		pass
+ * @return:	0 on success, -ve on error
+ */
+int nvme_bench(struct udevice *udev, void *buffer, lbaint_t blknr,
+	       lbaint_t blkcnt, ulong *us_qd1, ulong *us_qdn, int *depth);
+
 #endif /* __NVME_H__ */
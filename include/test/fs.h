@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Tests for filesystem internals
+ */
+
+#ifndef __TEST_FS_H__
+#define __TEST_FS_H__
+
+#include <test/test.h>
+
+/* Declare a new filesystem test */
+#define FS_TEST(_name, _flags)	UNIT_TEST(_name, _flags, fs_test)
+
+#endif /* __TEST_FS_H__ */
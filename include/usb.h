@@ -55,6 +55,29 @@ struct devrequest {
 	__le16	length;
 } __attribute__ ((packed));
 
+/**
+ * struct usb_stream_xfer - one bulk transfer in a batch
+ *
+ * @pipe:	Bulk pipe to use
+ * @stream_id:	Stream to use on @pipe, or 0 if the endpoint has no streams
+ * @buffer:	Data buffer
+ * @length:	Buffer length in bytes
+ * @cancel:	Transfer of the same batch which is not waited for any more
+ *		once this one completes, or NULL. It is removed from the
+ *		hardware and ends with act_len and status both 0.
+ * @act_len:	Set to the number of bytes actually transferred
+ * @status:	Set to the USB_ST_... status of the transfer, 0 if OK
+ */
+struct usb_stream_xfer {
+	unsigned long pipe;
+	unsigned int stream_id;
+	void *buffer;
+	int length;
+	struct usb_stream_xfer *cancel;
+	int act_len;
+	unsigned long status;
+};
+
 /* Interface */
 struct usb_interface {
 	struct usb_interface_descriptor desc;
@@ -794,6 +817,37 @@ struct dm_usb_ops {
 	 */
 	int (*get_max_xfer_size)(struct udevice *bus, size_t *size);
 
+	/**
+	 * alloc_streams() - Set up bulk streams on some endpoints (USB 3.0)
+	 *
+	 * The endpoints must be idle. Each gets the same number of streams,
+	 * which must not exceed what their SuperSpeed endpoint companion
+	 * descriptors allow.
+	 *
+	 * @pipes: Bulk pipes whose endpoints should use streams
+	 * @num_pipes: Number of entries in @pipes
+	 * @num_streams: Number of streams wanted on each endpoint
+	 * @return number of streams set up (stream IDs 1..n), or -ve on error
+	 */
+	int (*alloc_streams)(struct udevice *bus, struct usb_device *udev,
+			     unsigned long *pipes, int num_pipes,
+			     unsigned int num_streams);
+
+	/**
+	 * bulk_streams() - Run a batch of bulk transfers
+	 *
+	 * All of @xfers are handed to the hardware, in array order, before
+	 * waiting for any of them, so that the device may complete them in
+	 * any order. This returns once every transfer has completed or
+	 * failed.
+	 *
+	 * @xfers: Transfers to run; each gets its act_len and status set
+	 * @count: Number of entries in @xfers
+	 * @return 0 if all transfers completed successfully, -ve on error
+	 */
+	int (*bulk_streams)(struct udevice *bus, struct usb_device *udev,
+			    struct usb_stream_xfer *xfers, int count);
+
 	/**
 	 * lock_async() - Keep async schedule after a transfer
 	 *
@@ -1007,6 +1061,33 @@ int usb_update_hub_device(struct usb_device *dev);
  */
 int usb_get_max_xfer_size(struct usb_device *dev, size_t *size);
 
+/**
+ * usb_alloc_streams() - Set up bulk streams on some endpoints of a device
+ *
+ * @dev:		USB device
+ * @pipes:		Bulk pipes whose endpoints should use streams
+ * @num_pipes:		Number of entries in @pipes
+ * @num_streams:	Number of streams wanted on each endpoint
+ * Return: number of streams set up (stream IDs 1..n), -ENOSYS if the host
+ *	controller does not do streams, other -ve on error
+ */
+int usb_alloc_streams(struct usb_device *dev, unsigned long *pipes,
+		      int num_pipes, unsigned int num_streams);
+
+/**
+ * usb_bulk_msg_streams() - Run a batch of bulk transfers
+ *
+ * All transfers are queued to the host controller, in array order, before
+ * waiting for them to complete in whatever order the device chooses.
+ *
+ * @dev:		USB device
+ * @xfers:		Transfers to run; each gets its act_len and status set
+ * @count:		Number of entries in @xfers
+ * Return: 0 if all transfers completed successfully, -ve on error
+ */
+int usb_bulk_msg_streams(struct usb_device *dev,
+			 struct usb_stream_xfer *xfers, int count);
+
 /**
  * usb_emul_setup_device() - Set up a new USB device emulation
  *
@@ -663,6 +663,23 @@ struct xhci_ep_ctx {
 /* deq bitmasks */
 #define EP_CTX_CYCLE_MASK		(1 << 0)
 
+/**
+ * struct xhci_stream_ctx
+ * Stream context; see section 6.2.4.1.
+ *
+ * @stream_ring:	64-bit stream ring address, cycle state, and stream type
+ */
+struct xhci_stream_ctx {
+	__le64	stream_ring;
+	/* offset 0x14 - 0x1f reserved for HC internal use */
+	__le32	reserved[2];
+};
+
+/* Stream Context Types (section 6.4.1) - bits 3:1 of stream ctx deq ptr */
+#define SCT_FOR_CTX(p)		(((p) & 0x7) << 1)
+/* Primary stream array type, dequeue pointer is to a transfer ring */
+#define SCT_PRI_TR		1
+
 /* reserved[0] bitmasks, MediaTek xHCI used */
 #define EP_BPKTS(p)	(((p) & 0x7f) << 0)
 #define EP_BBM(p)	(((p) & 0x1) << 11)
@@ -1060,6 +1077,10 @@ struct xhci_virt_ep {
 #define EP_HAS_STREAMS		(1 << 4)
 /* Transitioning the endpoint to not using streams, don't enqueue URBs */
 #define EP_GETTING_NO_STREAMS	(1 << 5)
+	/* Primary stream context array and one ring per stream, if any */
+	struct xhci_stream_ctx		*stream_ctx;
+	struct xhci_ring		**stream_rings;
+	unsigned int			num_stream_ctxs;
 };
 
 #define CTX_SIZE(_hcc) (HCC_64BYTE_CONTEXT(_hcc) ? 64 : 32)
@@ -1251,6 +1272,8 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		 int length, void *buffer);
 int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		 struct devrequest *req, int length, void *buffer);
+int xhci_bulk_streams_tx(struct usb_device *udev,
+			 struct usb_stream_xfer *xfers, int count);
 int xhci_check_maxpacket(struct usb_device *udev);
 void xhci_flush_cache(uintptr_t addr, u32 type_len);
 void xhci_inval_cache(uintptr_t addr, u32 type_len);
@@ -1258,6 +1281,9 @@ void xhci_cleanup(struct xhci_ctrl *ctrl);
 struct xhci_ring *xhci_ring_alloc(struct xhci_ctrl *ctrl, unsigned int num_segs,
 				  bool link_trbs);
 int xhci_alloc_virt_device(struct xhci_ctrl *ctrl, unsigned int slot_id);
+int xhci_alloc_stream_ctx(struct xhci_ctrl *ctrl, struct xhci_virt_ep *ep,
+			  unsigned int num_stream_ctxs);
+void xhci_free_stream_ctx(struct xhci_virt_ep *ep);
 int xhci_mem_init(struct xhci_ctrl *ctrl, struct xhci_hccr *hccr,
 		  struct xhci_hcor *hcor);
 
@@ -45,6 +45,7 @@
 #define US_PR_CB               1		/* Control/Bulk w/o interrupt */
 #define US_PR_CBI              0		/* Control/Bulk/Interrupt */
 #define US_PR_BULK             0x50		/* bulk only */
+#define US_PR_UAS              0x62		/* USB Attached SCSI */
 
 /* USB types */
 #define USB_TYPE_STANDARD   (0x00 << 5)
@@ -362,4 +363,71 @@ struct umass_bbb_csw {
 #define US_BBB_RESET		0xff
 #define US_BBB_GET_MAX_LUN	0xfe
 
+/*
+ * USB Attached SCSI (UAS)
+ */
+
+/* Pipe IDs, from the Pipe Usage descriptor following each endpoint */
+#define UAS_PIPE_CMD		1
+#define UAS_PIPE_STATUS		2
+#define UAS_PIPE_DATA_IN	3
+#define UAS_PIPE_DATA_OUT	4
+
+/* Information unit IDs */
+#define UAS_IU_COMMAND		0x01
+#define UAS_IU_SENSE		0x03
+#define UAS_IU_RESPONSE		0x04
+#define UAS_IU_TASK_MGMT	0x05
+#define UAS_IU_READ_READY	0x06
+#define UAS_IU_WRITE_READY	0x07
+
+/* Command IU */
+struct uas_command_iu {
+	__u8		iu_id;
+	__u8		rsvd1;
+	__be16		tag;
+	__u8		prio_attr;
+#	define UAS_SIMPLE_TAG	0
+	__u8		rsvd5;
+	__u8		len;		/* additional CDB length */
+	__u8		rsvd7;
+	__u8		lun[8];
+	__u8		cdb[16];
+} __attribute__ ((packed));
+
+/* Task management IU */
+struct uas_task_mgmt_iu {
+	__u8		iu_id;
+	__u8		rsvd1;
+	__be16		tag;
+	__u8		function;
+#	define UAS_TMF_LOGICAL_UNIT_RESET	0x08
+	__u8		rsvd2;
+	__be16		task_tag;
+	__u8		lun[8];
+} __attribute__ ((packed));
+
+/* Sense IU, the status of a command */
+struct uas_sense_iu {
+	__u8		iu_id;
+	__u8		rsvd1;
+	__be16		tag;
+	__be16		status_qual;
+	__u8		status;
+	__u8		rsvd7[7];
+	__be16		len;
+	__u8		sense[96];
+} __attribute__ ((packed));
+
+/* Response IU, the status of a task management function */
+struct uas_response_iu {
+	__u8		iu_id;
+	__u8		rsvd1;
+	__be16		tag;
+	__u8		add_response_info[3];
+	__u8		response_code;
+#	define UAS_RC_TMF_COMPLETE	0x00
+#	define UAS_RC_TMF_SUCCEEDED	0x08
+} __attribute__ ((packed));
+
 #endif /*_USB_DEFS_H_ */
@@ -90,6 +90,7 @@ struct vring {
  * @num_free: number of elements we expect to be able to fit
  * @vring: actual memory layout for this queue
  * @event: host publishes avail event idx
+ * @indirect: buffers may be passed in an indirect descriptor table
  * @free_head: head of free buffer list
  * @num_added: number we've added since last sync
  * @last_used_idx: last used index we've seen
@@ -103,6 +104,7 @@ struct virtqueue {
 	unsigned int num_free;
 	struct vring vring;
 	bool event;
+	bool indirect;
 	unsigned int free_head;
 	unsigned int num_added;
 	u16 last_used_idx;
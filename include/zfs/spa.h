@@ -240,6 +240,8 @@ typedef struct blkptr {
 		   ((zc1).zc_word[3] - (zc2).zc_word[3])))
 
 #define	DVA_IS_VALID(dva)	(DVA_GET_ASIZE(dva) != 0)
+#define	DVA_IS_EMPTY(dva)	((dva)->dva_word[0] == 0ULL &&	\
+				 (dva)->dva_word[1] == 0ULL)
 
 #define	ZIO_SET_CHECKSUM(zcp, w0, w1, w2, w3)	\
 	{											\
@@ -251,7 +253,8 @@ typedef struct blkptr {
 
 #define	BP_IDENTITY(bp)		(&(bp)->blk_dva[0])
 #define	BP_IS_GANG(bp)		DVA_GET_GANG(BP_IDENTITY(bp))
-#define	BP_IS_HOLE(bp)		((bp)->blk_birth == 0)
+/* with hole_birth, holes keep the txg they were punched in */
+#define	BP_IS_HOLE(bp)		DVA_IS_EMPTY(BP_IDENTITY(bp))
 
 /* BP_IS_RAIDZ(bp) assumes no block compression */
 #define	BP_IS_RAIDZ(bp)		(DVA_GET_ASIZE(&(bp)->blk_dva[0]) > \
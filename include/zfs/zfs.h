@@ -16,6 +16,14 @@
  */
 #define	SPA_VERSION			28ULL
 
+/*
+ * Pools using feature flags carry this version instead.  The features needed
+ * to read the pool are listed in its label, see check_pool_label().
+ */
+#define	SPA_VERSION_FEATURES		5000ULL
+#define	SPA_VERSION_IS_SUPPORTED(v)					\
+	((v) > 0 && ((v) <= SPA_VERSION || (v) == SPA_VERSION_FEATURES))
+
 /*
  * The following are configuration names used in the nvlist describing a pool's
  * configuration.
@@ -54,6 +62,7 @@
 #define	ZPOOL_CONFIG_DDT_HISTOGRAM	"ddt_histogram"
 #define	ZPOOL_CONFIG_DDT_OBJ_STATS	"ddt_object_stats"
 #define	ZPOOL_CONFIG_DDT_STATS		"ddt_stats"
+#define	ZPOOL_CONFIG_FEATURES_FOR_READ	"features_for_read"
 /*
  * The persistent vdev state is stored as separate values rather than a single
  * 'vdev_state' entry.  This is because a device can be in multiple states, such
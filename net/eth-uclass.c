@@ -13,7 +13,9 @@
 #include <dm.h>
 #include <env.h>
 #include <log.h>
+#include <malloc.h>
 #include <net.h>
+#include <asm/cache.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -27,10 +29,16 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @rx_pool: Memory of the receive buffers from eth_alloc_rx_bufs()
+ * @rx_bufs: The receive buffers within @rx_pool
+ * @rx_buf_count: Number of receive buffers, 0 if none were allocated
  */
 struct eth_device_priv {
 	enum eth_state_t state;
 	bool running;
+	uchar *rx_pool;
+	uchar **rx_bufs;
+	int rx_buf_count;
 };
 
 /**
@@ -415,6 +423,44 @@ int eth_rx(void)
 	return ret;
 }
 
+uchar **eth_alloc_rx_bufs(struct udevice *dev, int count)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+	size_t size = ALIGN(PKTSIZE_ALIGN, ARCH_DMA_MINALIGN);
+	int i;
+
+	/* start() asks again each time the device is brought up */
+	if (priv->rx_buf_count)
+		return priv->rx_buf_count == count ? priv->rx_bufs : NULL;
+
+	if (count <= 0)
+		return NULL;
+
+	priv->rx_pool = memalign(ARCH_DMA_MINALIGN, count * size);
+	priv->rx_bufs = calloc(count, sizeof(*priv->rx_bufs));
+	if (!priv->rx_pool || !priv->rx_bufs) {
+		eth_free_rx_bufs(dev);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++)
+		priv->rx_bufs[i] = priv->rx_pool + i * size;
+	priv->rx_buf_count = count;
+
+	return priv->rx_bufs;
+}
+
+void eth_free_rx_bufs(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	free(priv->rx_pool);
+	free(priv->rx_bufs);
+	priv->rx_pool = NULL;
+	priv->rx_bufs = NULL;
+	priv->rx_buf_count = 0;
+}
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
@@ -610,6 +656,7 @@ static int eth_pre_remove(struct udevice *dev)
 	struct eth_pdata *pdata = dev_get_plat(dev);
 
 	eth_get_ops(dev)->stop(dev);
+	eth_free_rx_bufs(dev);
 
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, ARP_HLEN);
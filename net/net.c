@@ -92,6 +92,7 @@
 #include <log.h>
 #include <net.h>
 #include <net/fastboot.h>
+#include <net/tcp.h>
 #include <net/tftp.h>
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
@@ -113,6 +114,7 @@
 #include "nfs.h"
 #include "ping.h"
 #include "rarp.h"
+#include "wget.h"
 #if defined(CONFIG_CMD_WOL)
 #include "wol.h"
 #endif
@@ -526,6 +528,11 @@ restart:
 		case WOL:
 			wol_start();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
 #endif
 		default:
 			break;
@@ -847,6 +854,14 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 		break;
+#if defined(CONFIG_PROT_TCP)
+	case IPPROTO_TCP:
+		pkt_hdr_size = eth_hdr_size +
+			net_set_tcp_header(pkt + eth_hdr_size, dest, dport,
+					   sport, payload_len, action,
+					   tcp_seq_num, tcp_ack_num);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
@@ -868,8 +883,8 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_request();
 		return 1;	/* waiting */
 	} else {
-		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
-			   &dest, ether);
+		debug_cond(DEBUG_DEV_PKT, "sending %s to %pI4/%pM\n",
+			   proto == IPPROTO_TCP ? "TCP" : "UDP", &dest, ether);
 		net_send_packet(net_tx_packet, pkt_hdr_size + payload_len);
 		return 0;	/* transmitted */
 	}
@@ -885,6 +900,9 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 
 #define IP_MAXUDP (IP_PKTSIZE - IP_HDR_SIZE)
 
+/* ms after its last fragment that a partial datagram is given up */
+#define IP_DEFRAG_TIMEOUT	1000
+
 /*
  * this is the packet being assembled, either data or frag control.
  * Fragments go by 8 bytes, so this union must be 8 bytes long
@@ -897,36 +915,95 @@ struct hole {
 	u16 unused;
 };
 
+/* A datagram being reassembled; total_len is 0 when the slot is free */
+struct ip_defrag {
+	uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
+	ulong time;		/* when the last fragment arrived */
+	u16 first_hole;
+	u16 total_len;
+};
+
+static struct ip_defrag ip_defrag[CONFIG_NET_DEFRAG_SLOTS];
+
+/*
+ * Find the datagram a fragment belongs to (RFC 791 goes by source,
+ * protocol and id), or else the slot to start collecting it in: a free one,
+ * one that has timed out, or the one that has waited longest for a fragment.
+ */
+static struct ip_defrag *ip_defrag_slot(struct ip_udp_hdr *ip)
+{
+	struct ip_defrag *d, *victim = NULL;
+	ulong now = get_timer(0);
+
+	for (d = ip_defrag; d < ip_defrag + CONFIG_NET_DEFRAG_SLOTS; d++) {
+		struct ip_udp_hdr *localip = (struct ip_udp_hdr *)d->pkt_buff;
+
+		if (d->total_len && now - d->time > IP_DEFRAG_TIMEOUT)
+			d->total_len = 0;
+
+		if (!d->total_len) {
+			if (!victim || victim->total_len)
+				victim = d;
+			continue;
+		}
+
+		if (localip->ip_id == ip->ip_id &&
+		    localip->ip_src.s_addr == ip->ip_src.s_addr &&
+		    localip->ip_p == ip->ip_p)
+			return d;
+
+		if (!victim || (victim->total_len &&
+				(long)(d->time - victim->time) < 0))
+			victim = d;
+	}
+
+	victim->total_len = 0;
+	return victim;
+}
+
 static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 {
-	static uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
-	static u16 first_hole, total_len;
+	struct ip_defrag *slot;
 	struct hole *payload, *thisfrag, *h, *newh;
-	struct ip_udp_hdr *localip = (struct ip_udp_hdr *)pkt_buff;
+	struct ip_udp_hdr *localip;
 	uchar *indata = (uchar *)ip;
 	int offset8, start, len, done = 0;
+	bool first;
 	u16 ip_off = ntohs(ip->ip_off);
 
-	if (ip->ip_len < IP_MIN_FRAG_DATAGRAM_SIZE)
+	if (ntohs(ip->ip_len) <= IP_HDR_SIZE)
 		return NULL;
 
-	/* payload starts after IP header, this fragment is in there */
-	payload = (struct hole *)(pkt_buff + IP_HDR_SIZE);
 	offset8 =  (ip_off & IP_OFFS);
-	thisfrag = payload + offset8;
 	start = offset8 * 8;
 	len = ntohs(ip->ip_len) - IP_HDR_SIZE;
 
+	/*
+	 * Only the last fragment may end off an 8-byte boundary; any other
+	 * would overwrite the hole descriptor that follows it.
+	 */
+	if ((ip_off & IP_FLAGS_MFRAG) &&
+	    (ntohs(ip->ip_len) < IP_MIN_FRAG_DATAGRAM_SIZE || len % 8))
+		return NULL;
+
 	if (start + len > IP_MAXUDP) /* fragment extends too far */
 		return NULL;
 
-	if (!total_len || localip->ip_id != ip->ip_id) {
-		/* new (or different) packet, reset structs */
-		total_len = 0xffff;
+	slot = ip_defrag_slot(ip);
+	slot->time = get_timer(0);
+	localip = (struct ip_udp_hdr *)slot->pkt_buff;
+
+	/* payload starts after IP header, this fragment is in there */
+	payload = (struct hole *)(slot->pkt_buff + IP_HDR_SIZE);
+	thisfrag = payload + offset8;
+
+	if (!slot->total_len) {
+		/* new packet, reset structs */
+		slot->total_len = 0xffff;
 		payload[0].last_byte = ~0;
 		payload[0].next_hole = 0;
 		payload[0].prev_hole = 0;
-		first_hole = 0;
+		slot->first_hole = 0;
 		/* any IP header will work, copy the first we received */
 		memcpy(localip, ip, IP_HDR_SIZE);
 	}
@@ -938,7 +1015,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	 * so it is represented as byte count, not as 8-byte blocks.
 	 */
 
-	h = payload + first_hole;
+	h = payload + slot->first_hole;
 	while (h->last_byte < start) {
 		if (!h->next_hole) {
 			/* no hole that far away */
@@ -955,7 +1032,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 
 	if (!(ip_off & IP_FLAGS_MFRAG)) {
 		/* no more fragmentss: truncate this (last) hole */
-		total_len = start + len;
+		slot->total_len = start + len;
 		h->last_byte = start + len;
 	}
 
@@ -963,16 +1040,19 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	 * There is some overlap: fix the hole list. This code doesn't
 	 * deal with a fragment that overlaps with two different holes
 	 * (thus being a superset of a previously-received fragment).
+	 * A hole may start at index 0, so a prev_hole of 0 is only "none"
+	 * for the first hole.
 	 */
+	first = (h - payload == slot->first_hole);
 
 	if ((h >= thisfrag) && (h->last_byte <= start + len)) {
 		/* complete overlap with hole: remove hole */
-		if (!h->prev_hole && !h->next_hole) {
+		if (first && !h->next_hole) {
 			/* last remaining hole */
 			done = 1;
-		} else if (!h->prev_hole) {
+		} else if (first) {
 			/* first hole */
-			first_hole = h->next_hole;
+			slot->first_hole = h->next_hole;
 			payload[h->next_hole].prev_hole = 0;
 		} else if (!h->next_hole) {
 			/* last hole */
@@ -994,10 +1074,10 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 		h = newh;
 		if (h->next_hole)
 			payload[h->next_hole].prev_hole = (h - payload);
-		if (h->prev_hole)
-			payload[h->prev_hole].next_hole = (h - payload);
+		if (first)
+			slot->first_hole = (h - payload);
 		else
-			first_hole = (h - payload);
+			payload[h->prev_hole].next_hole = (h - payload);
 
 	} else {
 		/* fragment sits in the middle: split the hole */
@@ -1015,8 +1095,10 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	if (!done)
 		return NULL;
 
-	localip->ip_len = htons(total_len);
-	*lenp = total_len + IP_HDR_SIZE;
+	/* free the slot; its buffer is only reused for a later fragment */
+	localip->ip_len = htons(slot->total_len);
+	*lenp = slot->total_len + IP_HDR_SIZE;
+	slot->total_len = 0;
 	return localip;
 }
 
@@ -1256,6 +1338,14 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			debug_cond(DEBUG_DEV_PKT,
+				   "received TCP (to=%pI4, from=%pI4, len=%d)\n",
+				   &dst_ip, &src_ip, len);
+			tcp_receive((struct ip_tcp_hdr *)ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1356,6 +1446,9 @@ static int net_check_prereq(enum proto_t protocol)
 
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
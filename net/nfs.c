@@ -39,6 +39,7 @@
 #include <time.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
+#define HASH_BYTES	(NFS_READ_SIZE / 2 * 10)	/* Bytes per hash	*/
 #define NFS_RETRY_COUNT 30
 
 #define NFS_RPC_ERR	1
@@ -46,8 +47,8 @@
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
+static unsigned int nfs_offset;	/* offset of the next read to send */
+static unsigned int nfs_len;	/* size of the reads */
 static const ulong nfs_timeout = CONFIG_NFS_TIMEOUT;
 
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
@@ -386,6 +387,159 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+/*
+ * Reads in flight.  Each one is matched to its reply by the RPC id, so
+ * replies are stored wherever they belong in whatever order they arrive, and
+ * each read is sent again on its own when its reply is late.
+ */
+struct nfs_read {
+	unsigned long id;	/* RPC id of the last request, 0 if unused */
+	unsigned int offset;
+	unsigned int len;
+	ulong time_sent;
+	int retries;
+};
+
+static struct nfs_read nfs_reads[CONFIG_NFS_READ_WINDOW];
+static unsigned int nfs_file_end;	/* size of the file, once known */
+static unsigned int nfs_read_bytes;	/* bytes received so far */
+static unsigned int nfs_hashes;
+
+static void nfs_read_send(struct nfs_read *rd)
+{
+	nfs_read_req(rd->offset, rd->len);
+	rd->id = rpc_id;
+	rd->time_sent = get_timer(0);
+}
+
+static struct nfs_read *nfs_read_find(unsigned long id)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_NFS_READ_WINDOW; i++) {
+		if (id && nfs_reads[i].id == id)
+			return &nfs_reads[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Number of reads to keep in flight.  Replies bigger than a frame arrive in
+ * fragments, and only CONFIG_NET_DEFRAG_SLOTS datagrams are reassembled at a
+ * time: any more would make their fragments push each other out.
+ */
+static int nfs_read_window(void)
+{
+#ifdef CONFIG_IP_DEFRAG
+	if (nfs_len > NFS_READ_SIZE)
+		return min(CONFIG_NFS_READ_WINDOW, CONFIG_NET_DEFRAG_SLOTS);
+#endif
+	return CONFIG_NFS_READ_WINDOW;
+}
+
+/*
+ * Send reads until the window is full or the end of the file is reached.
+ * Returns true once nothing is left to wait for.
+ */
+static bool nfs_read_fill(void)
+{
+	int window = nfs_read_window();
+	int busy = 0;
+	int i;
+
+	for (i = 0; i < CONFIG_NFS_READ_WINDOW; i++) {
+		struct nfs_read *rd = &nfs_reads[i];
+
+		/* reads past the end of the file have nothing to return */
+		if (rd->id && rd->offset >= nfs_file_end)
+			rd->id = 0;
+
+		if (rd->id)
+			busy++;
+	}
+
+	for (i = 0; i < CONFIG_NFS_READ_WINDOW && busy < window; i++) {
+		struct nfs_read *rd = &nfs_reads[i];
+
+		if (rd->id || nfs_offset >= nfs_file_end)
+			continue;
+
+		rd->offset = nfs_offset;
+		rd->len = nfs_len;
+		rd->retries = 0;
+		nfs_offset += nfs_len;
+		nfs_read_send(rd);
+		busy++;
+	}
+
+	return !busy;
+}
+
+static void nfs_timeout_handler(void);
+
+/* Come back when the oldest read is due to be sent again */
+static void nfs_read_set_timeout(void)
+{
+	ulong wait = nfs_timeout;
+	int i;
+
+	for (i = 0; i < CONFIG_NFS_READ_WINDOW; i++) {
+		struct nfs_read *rd = &nfs_reads[i];
+		ulong rto = nfs_timeout + nfs_timeout * rd->retries;
+		ulong elapsed;
+
+		if (!rd->id)
+			continue;
+		elapsed = get_timer(rd->time_sent);
+		if (elapsed >= rto)
+			wait = 0;
+		else if (rto - elapsed < wait)
+			wait = rto - elapsed;
+	}
+
+	net_set_timeout_handler(wait ? wait : 1, nfs_timeout_handler);
+}
+
+static void nfs_read_start(void)
+{
+	memset(nfs_reads, '\0', sizeof(nfs_reads));
+	nfs_offset = 0;
+	if (supported_nfs_versions & NFSV2_FLAG)
+		nfs_len = NFS_READ_SIZE;
+	else /* NFSV3_FLAG */
+		nfs_len = NFS3_READ_SIZE;
+	nfs_file_end = UINT_MAX;
+	nfs_read_bytes = 0;
+	nfs_hashes = 0;
+
+	nfs_read_fill();
+	nfs_read_set_timeout();
+}
+
+static void nfs_read_timeout(void)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_NFS_READ_WINDOW; i++) {
+		struct nfs_read *rd = &nfs_reads[i];
+
+		if (!rd->id || get_timer(rd->time_sent) <
+		    nfs_timeout + nfs_timeout * rd->retries)
+			continue;
+
+		if (++rd->retries > NFS_RETRY_COUNT) {
+			puts("\nRetry count exceeded; starting again\n");
+			net_start_again();
+			return;
+		}
+		puts("T ");
+		nfs_read_send(rd);
+	}
+
+	nfs_read_set_timeout();
+}
+
 /**************************************************************************
 RPC request dispatcher
 **************************************************************************/
@@ -416,7 +570,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_start();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -657,19 +811,59 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
+/* A read came back: rlen bytes, and eof if there is nothing after them */
+static void nfs_read_done(struct nfs_read *rd, unsigned int rlen, bool eof)
+{
+	nfs_read_bytes += rlen;
+	while (nfs_hashes < nfs_read_bytes / HASH_BYTES) {
+		if (nfs_hashes && !(nfs_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+		nfs_hashes++;
+	}
+
+	if (eof) {
+		if (rd->offset + rlen < nfs_file_end)
+			nfs_file_end = rd->offset + rlen;
+	} else if (rlen < rd->len) {
+		/*
+		 * The server caps the size of its replies: fetch the rest of
+		 * this read, and ask for no more than it sent from now on.
+		 */
+		if (rlen < nfs_len)
+			nfs_len = rlen;
+		rd->offset += rlen;
+		rd->len -= rlen;
+		rd->retries = 0;
+		nfs_read_send(rd);
+		return;
+	}
+
+	rd->id = 0;
+}
+
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
+	struct nfs_read *rd;
+	unsigned int rlen;
+	unsigned int hdr_len;
 	uchar *data_ptr;
+	bool eof;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/*
+	 * Only the headers are copied to be aligned; the data is stored
+	 * straight from the packet, which may be bigger than rpc_pkt.
+	 */
+	if (len < offsetof(struct rpc_t, u.reply.data[1]))
+		return -NFS_RPC_DROP;
+	memcpy(&rpc_pkt.u.data[0], pkt, min_t(unsigned int, len,
+					      sizeof(rpc_pkt.u.reply)));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	rd = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!rd)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -683,34 +877,34 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
 		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		/* NFSv2 only ever returns less than asked for at the end */
+		eof = rlen < rd->len;
 	} else {  /* NFSV3_FLAG */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		eof = rpc_pkt.u.reply.data[2 + nfsv3_data_offset] || !rlen;
 		/* Skip unused values :
-			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
 		data_ptr = (uchar *)
 			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
 	}
 
-	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
-			return -9999;
+	hdr_len = data_ptr - &rpc_pkt.u.data[0];
+	if (rlen > rd->len || hdr_len + rlen > len)
+		return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	/* an empty read past the end must not grow the file size */
+	if (rlen && store_block(pkt + hdr_len, rd->offset, rlen))
+		return -9999;
+
+	nfs_read_done(rd, rlen, eof);
 
 	return rlen;
 }
@@ -720,6 +914,11 @@ Interfaces of U-BOOT
 **************************************************************************/
 static void nfs_timeout_handler(void)
 {
+	if (nfs_state == STATE_READ_REQ) {
+		nfs_read_timeout();
+		return;
+	}
+
 	if (++nfs_timeout_count > NFS_RETRY_COUNT) {
 		puts("\nRetry count exceeded; starting again\n");
 		net_start_again();
@@ -740,7 +939,8 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	debug("%s\n", __func__);
 
-	if (len > sizeof(struct rpc_t))
+	/* replies to reads are only limited by IP reassembly */
+	if (len > sizeof(struct rpc_t) && nfs_state != STATE_READ_REQ)
 		return;
 
 	if (dest != nfs_our_port)
@@ -807,8 +1007,6 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
 			nfs_send();
 		}
 		break;
@@ -836,17 +1034,16 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
+		if (rlen >= 0 && !nfs_read_fill()) {
+			nfs_read_set_timeout();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
+			if (rlen >= 0)
 				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
+			else
 				debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
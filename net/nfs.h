@@ -42,6 +42,20 @@
  * case, most NFS servers are optimized for a power of 2.
  */
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
+
+/*
+ * NFSv3 puts no limit of its own on the size of a read, so when IP datagrams
+ * are reassembled ask for as many whole 4 KiB pages as a reassembled reply
+ * can carry next to its IP, UDP, RPC and NFS headers.  A server that caps
+ * its replies to less is then asked for no more than it sent.
+ */
+#define NFS_READ_OVERHEAD	256
+#if defined(CONFIG_IP_DEFRAG) && \
+	CONFIG_NET_MAXDEFRAG >= 4096 + NFS_READ_OVERHEAD
+#define NFS3_READ_SIZE	((CONFIG_NET_MAXDEFRAG - NFS_READ_OVERHEAD) & ~4095)
+#else
+#define NFS3_READ_SIZE	NFS_READ_SIZE
+#endif
 #define NFS_MAX_ATTRS	26
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
@@ -0,0 +1,554 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Minimal TCP client for the network loop
+ *
+ * Only what is needed to pull a file off a server is implemented: one
+ * connection at a time, opened by us, over which we send a short request
+ * and then receive a stream. The receive side is where the throughput
+ * matters:
+ *
+ * - the window is CONFIG_TCP_WINDOW_SIZE, scaled if need be, and is not
+ *   closed as data arrives since the application stores it straight away;
+ * - segments beyond a hole are handed to the application as they come and
+ *   remembered in a short list of ranges, so when the hole is filled the
+ *   acknowledgment jumps over all of them;
+ * - anything out of order is acknowledged at once, so that the duplicate
+ *   acknowledgments set off fast retransmit on the server without SACK.
+ *
+ * On the send side unacknowledged data is retransmitted on a timeout with
+ * exponential backoff, or after three duplicate acknowledgments.
+ */
+
+#include <common.h>
+#include <log.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/unaligned.h>
+
+/* Millisecs before retransmitting, doubled on every retry */
+#define TCP_RTO_MIN		1000UL
+#define TCP_RTO_MAX		8000UL
+/* Number of timeouts in a row before giving up */
+#define TCP_RETRIES		(CONFIG_NET_RETRY_COUNT * 2)
+/* Duplicate acknowledgments that trigger a fast retransmit */
+#define TCP_DUP_ACKS		3
+/* Number of holes we keep track of past the in-order data */
+#define TCP_OOO_RANGES		8
+/* Room for the options of our SYN: MSS, NOP and window scale */
+#define TCP_SYN_OPT_LEN		8
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT,		/* our FIN sent, theirs not yet received */
+	TCP_LAST_ACK,		/* both FINs sent, waiting for our ACK */
+};
+
+struct tcp_range {
+	u32 start;
+	u32 end;
+};
+
+static enum tcp_state tcp_state;
+static const struct tcp_ops *tcp_ops;
+
+static struct in_addr tcp_remote_ip;
+static uchar tcp_remote_ethaddr[6];
+static int tcp_remote_port;
+static int tcp_our_port;
+
+/* send side */
+static u32 tcp_iss;		/* initial send sequence number */
+static u32 tcp_snd_una;		/* oldest unacknowledged sequence number */
+static u32 tcp_snd_nxt;		/* next sequence number to send */
+static uchar tcp_tx_buf[TCP_MSS];
+static unsigned int tcp_tx_len;	/* length of the data last sent */
+static u32 tcp_tx_seq;		/* sequence number of tcp_tx_buf[0] */
+static bool tcp_fin_sent;
+static int tcp_snd_mss;
+static int tcp_dup_acks;
+
+/* receive side */
+static u32 tcp_irs;		/* initial receive sequence number */
+static u32 tcp_rcv_nxt;		/* next sequence number expected */
+static int tcp_rcv_wscale;	/* scale of the window we advertise */
+static bool tcp_fin_rcvd;
+static u32 tcp_fin_seq;
+static struct tcp_range tcp_ooo[TCP_OOO_RANGES];
+static int tcp_ooo_count;
+
+static ulong tcp_rto;
+static int tcp_retries;
+
+static inline bool tcp_before(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
+static inline bool tcp_after(u32 a, u32 b)
+{
+	return tcp_before(b, a);
+}
+
+static inline u32 tcp_seq_max(u32 a, u32 b)
+{
+	return tcp_after(a, b) ? a : b;
+}
+
+/* Checksum of the pseudo header: addresses, protocol and segment length */
+static uint tcp_pseudo_checksum(struct in_addr src, struct in_addr dest,
+				int len)
+{
+	u32 ph[3];
+
+	ph[0] = src.s_addr;
+	ph[1] = dest.s_addr;
+	ph[2] = htonl(IPPROTO_TCP << 16 | len);
+
+	return compute_ip_checksum(ph, sizeof(ph));
+}
+
+int net_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num)
+{
+	struct ip_tcp_hdr *ip = (struct ip_tcp_hdr *)pkt;
+	uchar *opt = pkt + IP_TCP_HDR_SIZE;
+	int hdr_len = TCP_HDR_SIZE;
+	uint win = CONFIG_TCP_WINDOW_SIZE;
+	uint csum;
+
+	if (action & TCP_SYN) {
+		opt[0] = TCP_O_MSS;
+		opt[1] = 4;
+		put_unaligned_be16(TCP_MSS, opt + 2);
+		opt[4] = TCP_O_NOP;
+		opt[5] = TCP_O_WS;
+		opt[6] = 3;
+		opt[7] = tcp_rcv_wscale;
+		hdr_len += TCP_SYN_OPT_LEN;
+		payload_len = 0;
+	} else {
+		/* the window in a SYN is never scaled */
+		win >>= tcp_rcv_wscale;
+	}
+
+	net_set_ip_header(pkt, dest, net_ip,
+			  IP_HDR_SIZE + hdr_len + payload_len, IPPROTO_TCP);
+
+	ip->tcp_src = htons(sport);
+	ip->tcp_dst = htons(dport);
+	ip->tcp_seq = htonl(tcp_seq_num);
+	ip->tcp_ack = (action & TCP_ACK) ? htonl(tcp_ack_num) : 0;
+	ip->tcp_hlen = (hdr_len / 4) << 4;
+	ip->tcp_flags = action;
+	ip->tcp_win = htons(min(win, 0xffffU));
+	ip->tcp_ugr = 0;
+	ip->tcp_xsum = 0;
+
+	csum = compute_ip_checksum(pkt + IP_HDR_SIZE, hdr_len + payload_len);
+	ip->tcp_xsum = add_ip_checksums(0, tcp_pseudo_checksum(net_ip, dest,
+						hdr_len + payload_len), csum);
+
+	return IP_HDR_SIZE + hdr_len;
+}
+
+static void tcp_send_segment(u8 action, u32 seq, const void *data,
+			     unsigned int len)
+{
+	uchar *payload = net_tx_packet + net_eth_hdr_size() + IP_TCP_HDR_SIZE;
+
+	debug_cond(DEBUG_DEV_PKT, "TCP: send %02x seq %u ack %u len %u\n",
+		   action, seq - tcp_iss, tcp_rcv_nxt - tcp_irs, len);
+
+	if (len)
+		memcpy(payload, data, len);
+	net_send_ip_packet(tcp_remote_ethaddr, tcp_remote_ip, tcp_remote_port,
+			   tcp_our_port, len, IPPROTO_TCP, action, seq,
+			   tcp_rcv_nxt);
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+/* Resend whatever has not been acknowledged, starting at snd_una */
+static void tcp_retransmit(void)
+{
+	u32 off = tcp_snd_una - tcp_tx_seq;
+	unsigned int len = 0;
+	u8 action = TCP_ACK;
+
+	if (tcp_state == TCP_SYN_SENT) {
+		tcp_send_segment(TCP_SYN, tcp_iss, NULL, 0);
+		return;
+	}
+
+	if (off < tcp_tx_len) {
+		len = min(tcp_tx_len - off, (unsigned int)tcp_snd_mss);
+		action |= TCP_PSH;
+	}
+	if (tcp_fin_sent && off + len == tcp_tx_len)
+		action |= TCP_FIN;
+
+	tcp_send_segment(action, tcp_snd_una, tcp_tx_buf + off, len);
+}
+
+static void tcp_finish(int err)
+{
+	const struct tcp_ops *ops = tcp_ops;
+
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	if (ops && ops->closed)
+		ops->closed(err);
+}
+
+static void tcp_timeout_handler(void)
+{
+	if (++tcp_retries > TCP_RETRIES) {
+		puts("\nTCP: connection timed out\n");
+		tcp_abort();
+		tcp_finish(-ETIMEDOUT);
+		return;
+	}
+
+	puts("T ");
+	tcp_rto = min(tcp_rto * 2, TCP_RTO_MAX);
+	net_set_timeout_handler(tcp_rto, tcp_timeout_handler);
+
+	if (tcp_snd_una != tcp_snd_nxt)
+		tcp_retransmit();
+	else
+		/* nothing of ours in flight: repeat where we are instead */
+		tcp_send_ack();
+}
+
+void tcp_connect(struct in_addr dest, int dport, const struct tcp_ops *ops)
+{
+	ulong ticks = get_ticks();
+
+	tcp_ops = ops;
+	tcp_remote_ip = dest;
+	tcp_remote_port = dport;
+	/* zero out the server ether in case the server ip has changed */
+	memset(tcp_remote_ethaddr, 0, sizeof(tcp_remote_ethaddr));
+
+	/* a fresh port each time, in case the last one is still lingering */
+	if (!tcp_our_port)
+		tcp_our_port = 1024 + (ticks % 3072);
+	else if (++tcp_our_port >= 4096)
+		tcp_our_port = 1024;
+
+	tcp_iss = ticks * 64000;
+	tcp_snd_una = tcp_iss;
+	tcp_snd_nxt = tcp_iss + 1;
+	tcp_tx_seq = tcp_iss + 1;
+	tcp_tx_len = 0;
+	tcp_fin_sent = false;
+	tcp_snd_mss = 536;
+	tcp_dup_acks = 0;
+
+	tcp_irs = 0;
+	tcp_rcv_nxt = 0;
+	tcp_fin_rcvd = false;
+	tcp_ooo_count = 0;
+	for (tcp_rcv_wscale = 0;
+	     (CONFIG_TCP_WINDOW_SIZE >> tcp_rcv_wscale) > 0xffff;
+	     tcp_rcv_wscale++)
+		;
+
+	tcp_rto = TCP_RTO_MIN;
+	tcp_retries = 0;
+	tcp_state = TCP_SYN_SENT;
+
+	net_set_timeout_handler(tcp_rto, tcp_timeout_handler);
+	tcp_send_segment(TCP_SYN, tcp_iss, NULL, 0);
+}
+
+int tcp_send(const void *data, unsigned int len)
+{
+	if (tcp_state != TCP_ESTABLISHED)
+		return -ENOTCONN;
+	if (tcp_snd_una != tcp_snd_nxt)
+		return -EBUSY;
+	if (len > sizeof(tcp_tx_buf))
+		return -EINVAL;
+
+	memcpy(tcp_tx_buf, data, len);
+	tcp_tx_seq = tcp_snd_nxt;
+	tcp_tx_len = len;
+	tcp_snd_nxt += len;
+	tcp_retransmit();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	if (tcp_state != TCP_ESTABLISHED)
+		return;
+
+	tcp_fin_sent = true;
+	tcp_snd_nxt++;
+	if (tcp_fin_rcvd && tcp_rcv_nxt == tcp_fin_seq + 1)
+		tcp_state = TCP_LAST_ACK;
+	else
+		tcp_state = TCP_FIN_WAIT;
+	tcp_retransmit();
+}
+
+void tcp_abort(void)
+{
+	if (tcp_state != TCP_CLOSED && tcp_state != TCP_SYN_SENT)
+		tcp_send_segment(TCP_RST | TCP_ACK, tcp_snd_nxt, NULL, 0);
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+}
+
+/* Parse the options of the SYN-ACK; we only care for MSS */
+static void tcp_parse_syn_options(const uchar *opt, int len)
+{
+	while (len > 0) {
+		int olen;
+
+		if (opt[0] == TCP_O_END)
+			break;
+		if (opt[0] == TCP_O_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2)
+			break;
+		olen = opt[1];
+		if (olen < 2 || olen > len)
+			break;
+		if (opt[0] == TCP_O_MSS && olen == 4)
+			tcp_snd_mss = min_t(int, get_unaligned_be16(opt + 2),
+					    TCP_MSS);
+		opt += olen;
+		len -= olen;
+	}
+}
+
+/*
+ * Remember that [start, end) has been received past a hole, merging it with
+ * the ranges it touches. Returns false if there is no room left for it.
+ */
+static bool tcp_ooo_add(u32 start, u32 end)
+{
+	struct tcp_range *r;
+	int i;
+
+	for (i = 0; i < tcp_ooo_count; i++)
+		if (!tcp_before(tcp_ooo[i].end, start))
+			break;
+
+	r = &tcp_ooo[i];
+	if (i < tcp_ooo_count && !tcp_after(r->start, end)) {
+		if (tcp_before(start, r->start))
+			r->start = start;
+		r->end = tcp_seq_max(r->end, end);
+		while (i + 1 < tcp_ooo_count && !tcp_after(r[1].start, r->end)) {
+			r->end = tcp_seq_max(r->end, r[1].end);
+			memmove(&r[1], &r[2],
+				(tcp_ooo_count - i - 2) * sizeof(*r));
+			tcp_ooo_count--;
+		}
+		return true;
+	}
+
+	if (tcp_ooo_count == TCP_OOO_RANGES)
+		return false;
+
+	memmove(&r[1], r, (tcp_ooo_count - i) * sizeof(*r));
+	r->start = start;
+	r->end = end;
+	tcp_ooo_count++;
+
+	return true;
+}
+
+/* Move rcv_nxt over the ranges that have become contiguous */
+static void tcp_ooo_advance(void)
+{
+	int i;
+
+	for (i = 0; i < tcp_ooo_count; i++) {
+		if (tcp_after(tcp_ooo[i].start, tcp_rcv_nxt))
+			break;
+		tcp_rcv_nxt = tcp_seq_max(tcp_rcv_nxt, tcp_ooo[i].end);
+	}
+	if (i) {
+		tcp_ooo_count -= i;
+		memmove(tcp_ooo, &tcp_ooo[i], tcp_ooo_count * sizeof(*tcp_ooo));
+	}
+}
+
+/* Returns 0, or a negative error from the application */
+static int tcp_rx_data(u32 seq, const uchar *data, unsigned int len)
+{
+	u32 wnd_end = tcp_rcv_nxt + CONFIG_TCP_WINDOW_SIZE;
+	u32 rcv_nxt = tcp_rcv_nxt;
+	int ret;
+
+	/* drop what we have already, and what does not fit the window */
+	if (tcp_before(seq, tcp_rcv_nxt)) {
+		u32 dup = tcp_rcv_nxt - seq;
+
+		if (dup >= len)
+			return 0;
+		seq += dup;
+		data += dup;
+		len -= dup;
+	}
+	if (!tcp_before(seq, wnd_end))
+		return 0;
+	if (tcp_after(seq + len, wnd_end))
+		len = wnd_end - seq;
+
+	ret = tcp_ops->rx(seq - tcp_irs - 1, data, len);
+	if (seq != tcp_rcv_nxt) {
+		if (!ret)
+			tcp_ooo_add(seq, seq + len);
+		return 0;
+	}
+	if (ret)
+		return ret;
+
+	tcp_rcv_nxt += len;
+	tcp_ooo_advance();
+	if (tcp_rcv_nxt != rcv_nxt && tcp_ops->advance)
+		tcp_ops->advance(tcp_rcv_nxt - tcp_irs - 1);
+
+	return 0;
+}
+
+void tcp_receive(struct ip_tcp_hdr *ip, int len)
+{
+	struct in_addr src = net_read_ip(&ip->ip_src);
+	int hdr_len = (ip->tcp_hlen >> 4) * 4;
+	u32 seq, ack;
+	uchar *data;
+	int data_len;
+	u8 flags;
+	int ret;
+
+	if (len < IP_TCP_HDR_SIZE || hdr_len < TCP_HDR_SIZE ||
+	    IP_HDR_SIZE + hdr_len > len)
+		return;
+
+	if (tcp_state == TCP_CLOSED || src.s_addr != tcp_remote_ip.s_addr ||
+	    ntohs(ip->tcp_src) != tcp_remote_port ||
+	    ntohs(ip->tcp_dst) != tcp_our_port)
+		return;
+
+	if (add_ip_checksums(0, tcp_pseudo_checksum(src, net_ip,
+						    len - IP_HDR_SIZE),
+			     compute_ip_checksum((uchar *)ip + IP_HDR_SIZE,
+						 len - IP_HDR_SIZE))) {
+		debug("TCP: bad checksum\n");
+		return;
+	}
+
+	flags = ip->tcp_flags;
+	seq = ntohl(ip->tcp_seq);
+	ack = ntohl(ip->tcp_ack);
+	data = (uchar *)ip + IP_HDR_SIZE + hdr_len;
+	data_len = len - IP_HDR_SIZE - hdr_len;
+
+	debug_cond(DEBUG_DEV_PKT, "TCP: recv %02x seq %u ack %u len %d\n",
+		   flags, seq - tcp_irs, ack - tcp_iss, data_len);
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if (!(flags & TCP_ACK) || ack != tcp_iss + 1)
+			return;
+		if (flags & TCP_RST) {
+			printf("\nTCP: connection refused by %pI4\n",
+			       &tcp_remote_ip);
+			tcp_finish(-ECONNREFUSED);
+			return;
+		}
+		if (!(flags & TCP_SYN))
+			return;
+
+		tcp_parse_syn_options((uchar *)ip + IP_TCP_HDR_SIZE,
+				      hdr_len - TCP_HDR_SIZE);
+		tcp_irs = seq;
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = ack;
+		tcp_state = TCP_ESTABLISHED;
+		tcp_retries = 0;
+		tcp_rto = TCP_RTO_MIN;
+		net_set_timeout_handler(tcp_rto, tcp_timeout_handler);
+		tcp_send_ack();
+		if (tcp_ops->connected)
+			tcp_ops->connected();
+		return;
+	}
+
+	if (flags & TCP_RST) {
+		if (tcp_before(seq, tcp_rcv_nxt) ||
+		    !tcp_before(seq, tcp_rcv_nxt + CONFIG_TCP_WINDOW_SIZE))
+			return;
+		printf("\nTCP: connection reset by %pI4\n", &tcp_remote_ip);
+		tcp_finish(-ECONNRESET);
+		return;
+	}
+
+	if (flags & TCP_SYN) {
+		/* our ACK of the SYN-ACK got lost */
+		tcp_send_ack();
+		return;
+	}
+
+	/* the server is alive, start timing from here again */
+	tcp_retries = 0;
+	tcp_rto = TCP_RTO_MIN;
+	net_set_timeout_handler(tcp_rto, tcp_timeout_handler);
+
+	if (flags & TCP_ACK) {
+		if (tcp_after(ack, tcp_snd_una) && !tcp_after(ack, tcp_snd_nxt)) {
+			tcp_snd_una = ack;
+			tcp_dup_acks = 0;
+		} else if (ack == tcp_snd_una && tcp_snd_una != tcp_snd_nxt &&
+			   !data_len && !(flags & TCP_FIN)) {
+			if (++tcp_dup_acks == TCP_DUP_ACKS)
+				tcp_retransmit();
+		}
+	}
+
+	if (data_len) {
+		ret = tcp_rx_data(seq, data, data_len);
+		if (ret) {
+			tcp_abort();
+			tcp_finish(ret);
+			return;
+		}
+	}
+
+	if (flags & TCP_FIN) {
+		tcp_fin_rcvd = true;
+		tcp_fin_seq = seq + data_len;
+	}
+
+	if (tcp_fin_rcvd && tcp_rcv_nxt == tcp_fin_seq) {
+		tcp_rcv_nxt++;
+		if (tcp_state == TCP_ESTABLISHED) {
+			/* nothing more to say either, FIN goes with the ACK */
+			tcp_close();
+			return;
+		}
+		if (tcp_state == TCP_FIN_WAIT)
+			tcp_state = TCP_LAST_ACK;
+	}
+
+	if (data_len || (flags & TCP_FIN))
+		tcp_send_ack();
+
+	if (tcp_fin_sent && tcp_snd_una == tcp_snd_nxt)
+		tcp_finish(0);
+}
@@ -29,6 +29,21 @@ DECLARE_GLOBAL_DATA_PTR;
 #define TIMEOUT		5000UL
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
+/* Millisecs floor for the timeout derived from the round trip time */
+#define TFTP_RTO_MIN	200UL
+/*
+ * Blocks past a hole that are kept, a power of two. The data itself goes
+ * straight to memory, only the fact that a block is in is recorded.
+ */
+#define TFTP_REORDER_SIZE	256
+#define TFTP_BLOCK_SEEN		1
+#define TFTP_BLOCK_LAST		2	/* short block ending the file */
+/*
+ * Ask for half the window next time above one resend per TFTP_LOSS_HIGH
+ * windows, and for twice as much below one per TFTP_LOSS_LOW windows
+ */
+#define TFTP_LOSS_HIGH		8
+#define TFTP_LOSS_LOW		32
 
 /*
  *	TFTP operations.
@@ -44,6 +59,25 @@ static ulong timeout_ms = TIMEOUT;
 static int timeout_count_max = (CONFIG_NET_RETRY_COUNT * 2);
 static ulong time_start;   /* Record time we started tftp */
 
+/*
+ * Round trip time between our ACK and the first block it prompts, in the
+ * scaled form of RFC 6298: tftp_srtt is 8 times and tftp_rttvar 4 times
+ * the actual value. tftp_rto is the timeout they give while receiving.
+ */
+static ulong tftp_srtt;
+static ulong tftp_rttvar;
+static ulong tftp_rtt_samples;
+static ulong tftp_rtt_start;
+static bool tftp_rtt_pending;
+static ulong tftp_rto = TIMEOUT;
+
+/* Counters for the transfer, shown at the end */
+static ulong tftp_stat_blocks;		/* blocks received */
+static ulong tftp_stat_reordered;	/* kept while a block before was missing */
+static ulong tftp_stat_dups;		/* received again */
+static ulong tftp_stat_resends;		/* times we asked the server to resend */
+static ulong tftp_stat_timeouts;
+
 /*
  * These globals govern the timeout behavior when attempting a connection to a
  * TFTP server. tftp_timeout_ms specifies the number of milliseconds to
@@ -98,6 +132,8 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Blocks received ahead of tftp_cur_block + 1, by block number */
+static u8	tftp_reorder[TFTP_REORDER_SIZE];
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -151,6 +187,10 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
+/* The window size we ask for, at most tftp_window_size_option */
+static unsigned short tftp_window_size_req;
+/* Window size learned from earlier transfers, 0 if none yet */
+static unsigned short tftp_window_size_next;
 
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
@@ -212,11 +252,25 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	memset(tftp_reorder, '\0', sizeof(tftp_reorder));
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
 }
 
+/* Clear the counters and round trip time estimate */
+static void new_stats(void)
+{
+	tftp_stat_blocks = 0;
+	tftp_stat_reordered = 0;
+	tftp_stat_dups = 0;
+	tftp_stat_resends = 0;
+	tftp_stat_timeouts = 0;
+	tftp_rtt_samples = 0;
+	tftp_rtt_pending = false;
+	tftp_rto = timeout_ms;
+}
+
 #ifdef CONFIG_CMD_TFTPPUT
 /**
  * Load the next block from memory to be sent over tftp.
@@ -305,6 +359,48 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/* Take in a round trip time sample and work out the timeout from it */
+static void tftp_rtt_update(ulong rtt)
+{
+	long err;
+
+	if (!tftp_rtt_samples++) {
+		tftp_srtt = rtt << 3;
+		tftp_rttvar = rtt << 1;
+	} else {
+		err = rtt - (tftp_srtt >> 3);
+		tftp_srtt += err;
+		tftp_rttvar += abs(err) - (tftp_rttvar >> 2);
+	}
+	tftp_rto = clamp_t(ulong, (tftp_srtt >> 3) + tftp_rttvar,
+			   TFTP_RTO_MIN, timeout_ms);
+}
+
+/*
+ * The window can only be negotiated when the transfer starts, so adjust the
+ * one we ask for next time: halve it if this transfer needed many resends,
+ * and double it back towards tftp_window_size_option if it needed few.
+ */
+static void tftp_adapt_window(void)
+{
+	ulong lost = tftp_stat_resends + tftp_stat_timeouts;
+	ulong windows;
+
+	/* not for tftpsrv, which never asks for a window */
+	if (tftp_window_size_option <= 1 || !tftp_window_size_req)
+		return;
+
+	windows = tftp_stat_blocks / tftp_window_size_req + 1;
+
+	if (lost * TFTP_LOSS_HIGH > windows)
+		tftp_window_size_next = max(tftp_window_size_req / 2, 1);
+	else if (lost * TFTP_LOSS_LOW < windows)
+		tftp_window_size_next = min(tftp_window_size_req * 2,
+					    (int)tftp_window_size_option);
+	else
+		tftp_window_size_next = tftp_window_size_req;
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -323,6 +419,14 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+	if (!tftp_put_active) {
+		printf("\n\t %lu blocks, %lu out of order, %lu duplicate, %lu resent, %lu timeouts",
+		       tftp_stat_blocks, tftp_stat_reordered, tftp_stat_dups,
+		       tftp_stat_resends, tftp_stat_timeouts);
+		if (tftp_rtt_samples)
+			printf(", rtt %lu ms", tftp_srtt >> 3);
+		tftp_adapt_window();
+	}
 	puts("\ndone\n");
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
@@ -380,9 +484,9 @@ static void tftp_send(void)
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_req > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_size_req, 0);
 		len = pkt - xp;
 		break;
 
@@ -405,6 +509,11 @@ static void tftp_send(void)
 			tftp_put_final_block_sent = (loaded < toload);
 		}
 #endif
+		if (!tftp_put_active) {
+			/* time how long the next block takes to arrive */
+			tftp_rtt_start = get_timer(0);
+			tftp_rtt_pending = true;
+		}
 		len = pkt - xp;
 		break;
 
@@ -466,6 +575,85 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+/*
+ * Acknowledge the blocks received without holes, which makes the server
+ * carry on from the first one missing
+ */
+static void tftp_send_resend(void)
+{
+	tftp_send();
+	tftp_stat_resends++;
+	tftp_last_nack = tftp_cur_block;
+	tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+}
+
+/*
+ * Handle a block that is not the next one expected during a windowed
+ * transfer. A block ahead of it is stored where it belongs and marked in
+ * tftp_reorder, so that once the hole is filled the acknowledgment moves
+ * past it at once. The server is only asked to resend when it gets to the
+ * end of its window, instead of on the first block out of order. Blocks we
+ * already have are dropped: should our ACK have been lost, the timeout
+ * sends it again. Returns false if the block is too far ahead to keep.
+ */
+static bool tftp_reorder_block(ushort block, uchar *src, unsigned int len)
+{
+	ushort ahead = block - (ushort)tftp_cur_block;
+	u8 *slot = &tftp_reorder[block % TFTP_REORDER_SIZE];
+
+	if (!ahead || ahead >= TFTP_SEQUENCE_SIZE / 2) {
+		tftp_stat_dups++;
+		return true;
+	}
+	if (ahead >= TFTP_REORDER_SIZE)
+		return false;
+
+	if (*slot) {
+		tftp_stat_dups++;
+	} else {
+		if (store_block(tftp_cur_block + ahead, src, len)) {
+			eth_halt();
+			net_set_state(NETLOOP_FAIL);
+			return true;
+		}
+		*slot = len < tftp_block_size ? TFTP_BLOCK_LAST :
+						TFTP_BLOCK_SEEN;
+		tftp_stat_reordered++;
+	}
+
+	/* the server waits for our ACK after this one */
+	if (*slot == TFTP_BLOCK_LAST || (short)(block - tftp_next_ack) >= 0)
+		tftp_send_resend();
+
+	return true;
+}
+
+/*
+ * Move tftp_cur_block past the blocks kept in tftp_reorder that follow it.
+ * Returns true if that gets to the end of the file.
+ */
+static bool tftp_reorder_advance(void)
+{
+	u8 *slot;
+	bool last;
+
+	for (;;) {
+		slot = &tftp_reorder[(tftp_cur_block + 1) % TFTP_REORDER_SIZE];
+		if (!*slot)
+			return false;
+
+		last = *slot == TFTP_BLOCK_LAST;
+		*slot = 0;
+		tftp_cur_block++;
+		tftp_cur_block %= TFTP_SEQUENCE_SIZE;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+		tftp_stat_blocks++;
+		if (last)
+			return true;
+	}
+}
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
@@ -473,6 +661,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	__be16 *s;
 	int i;
 	u16 timeout_val_rcvd;
+	ushort block;
 
 	if (dest != tftp_our_port) {
 			return;
@@ -600,22 +789,21 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			return;
 		len -= 2;
 
-		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
+		block = ntohs(*(__be16 *)pkt);
+		if (block != (ushort)(tftp_cur_block + 1)) {
 			debug("Received unexpected block: %d, expected: %d\n",
-			      ntohs(*(__be16 *)pkt),
-			      (ushort)(tftp_cur_block + 1));
+			      block, (ushort)(tftp_cur_block + 1));
+			if (tftp_state == STATE_DATA && tftp_windowsize > 1 &&
+			    tftp_reorder_block(block, pkt + 2, len))
+				break;
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
 			 * that will arrive will cause a sending NACK.
 			 * This just overwellms the server, let's just send one.
 			 */
-			if (tftp_last_nack != tftp_cur_block) {
-				tftp_send();
-				tftp_last_nack = tftp_cur_block;
-				tftp_next_ack = (ushort)(tftp_cur_block +
-							 tftp_windowsize);
-			}
+			if (tftp_last_nack != tftp_cur_block)
+				tftp_send_resend();
 			break;
 		}
 
@@ -651,8 +839,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		update_block_number();
 		tftp_prev_block = tftp_cur_block;
+		tftp_stat_blocks++;
+		if (tftp_rtt_pending) {
+			tftp_rtt_pending = false;
+			tftp_rtt_update(get_timer(tftp_rtt_start));
+		}
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		net_set_timeout_handler(tftp_rto, tftp_timeout_handler);
 
 		if (store_block(tftp_cur_block, pkt + 2, len)) {
 			eth_halt();
@@ -660,7 +853,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
-		if (len < tftp_block_size) {
+		if (len < tftp_block_size || tftp_reorder_advance()) {
 			tftp_send();
 			tftp_complete();
 			break;
@@ -668,11 +861,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. Blocks kept from before
+		 *	may have taken us past the end of the window.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((short)(ushort)(tftp_cur_block - tftp_next_ack) >= 0) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
 		}
 		break;
 
@@ -704,6 +899,20 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	tftp_stat_timeouts++;
+	if (tftp_rto < timeout_ms) {
+		/*
+		 * The timeout from the round trip time may be too short:
+		 * back off towards the full one before counting retries
+		 */
+		tftp_rto = min(tftp_rto * 2, timeout_ms);
+		net_set_timeout_handler(tftp_rto, tftp_timeout_handler);
+		tftp_send();
+		/* an answer cannot be told apart from one to the last ACK */
+		tftp_rtt_pending = false;
+		return;
+	}
+
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
@@ -711,6 +920,7 @@ static void tftp_timeout_handler(void)
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
+		tftp_rtt_pending = false;
 	}
 }
 
@@ -772,8 +982,12 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
+	tftp_window_size_req = tftp_window_size_option;
+	if (tftp_window_size_next && tftp_window_size_next < tftp_window_size_req)
+		tftp_window_size_req = tftp_window_size_next;
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_option, tftp_window_size_req, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename, MAX_LEN)) {
@@ -846,6 +1060,7 @@ void tftp_start(enum proto_t protocol)
 
 	time_start = get_timer(0);
 	timeout_count_max = tftp_timeout_count_max;
+	new_stats();
 
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 	net_set_udp_handler(tftp_handler);
@@ -900,6 +1115,8 @@ void tftp_start_server(void)
 	timeout_count_max = tftp_timeout_count_max;
 	timeout_count = 0;
 	timeout_ms = TIMEOUT;
+	tftp_window_size_req = 0;
+	new_stats();
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
 	/* Revert tftp_block_size to dflt */
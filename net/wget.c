@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * HTTP download over TCP
+ *
+ * Sends a single HTTP/1.1 GET and streams the body of the response into
+ * memory at the load address. Body data is stored where it belongs as soon
+ * as it arrives, even past a hole in the stream, so nothing is copied twice
+ * and segments received out of order need not be sent again.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <efi_loader.h>
+#include <env.h>
+#include <image.h>
+#include <lmb.h>
+#include <log.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/global_data.h>
+#include "wget.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Room for the status line and headers of the response */
+#define WGET_HDR_SIZE		2048
+/* Bytes per hash mark and hash marks per line of progress */
+#define WGET_HASH_BYTES		0x10000
+#define WGET_HASHES_PER_LINE	65
+
+enum wget_state {
+	WGET_HEADER,
+	WGET_BODY,
+};
+
+static enum wget_state wget_state;
+static struct in_addr wget_server_ip;
+static int wget_server_port;
+static char wget_path[256];
+
+static ulong wget_load_addr;
+#ifdef CONFIG_LMB
+static ulong wget_load_size;
+#endif
+
+static char wget_hdr[WGET_HDR_SIZE];
+static unsigned int wget_hdr_len;
+static u32 wget_body_start;	/* offset of the body in the TCP stream */
+static bool wget_has_length;
+static ulong wget_content_len;
+static ulong wget_rcvd;		/* body bytes received without holes */
+static ulong wget_hashes;
+static ulong time_start;
+
+/* Initialize wget_load_addr and wget_load_size from image_load_addr and lmb */
+static int wget_init_load_addr(void)
+{
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+	phys_size_t max_size;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+
+	max_size = lmb_get_free_size(&lmb, image_load_addr);
+	if (!max_size)
+		return -1;
+
+	wget_load_size = max_size;
+#endif
+	wget_load_addr = image_load_addr;
+	return 0;
+}
+
+static void wget_fail(void)
+{
+	tcp_abort();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_connected(void)
+{
+	char req[TCP_MSS];
+	int len;
+
+	len = snprintf(req, sizeof(req),
+		       "GET %s%s HTTP/1.1\r\n"
+		       "Host: %pI4\r\n"
+		       "User-Agent: U-Boot\r\n"
+		       "Connection: close\r\n\r\n",
+		       wget_path[0] == '/' ? "" : "/", wget_path,
+		       &wget_server_ip);
+
+	if (tcp_send(req, len)) {
+		puts("\nHTTP: cannot send request\n");
+		wget_fail();
+	}
+}
+
+/* Check the status line and pick up the headers we care for */
+static int wget_parse_header(char *end)
+{
+	char *line, *next;
+	ulong status;
+
+	next = strstr(wget_hdr, "\r\n");
+	*next = '\0';
+	if (strncmp(wget_hdr, "HTTP/1.", 7) || !strchr(wget_hdr, ' ')) {
+		printf("\nHTTP: bad response '%s'\n", wget_hdr);
+		return -EPROTO;
+	}
+
+	status = simple_strtoul(strchr(wget_hdr, ' ') + 1, NULL, 10);
+	if (status != 200) {
+		printf("\nHTTP error: %s\n", wget_hdr);
+		return -EIO;
+	}
+
+	wget_has_length = false;
+	for (line = next + 2; line < end; line = next + 2) {
+		char *value;
+
+		next = strstr(line, "\r\n");
+		*next = '\0';
+		value = strchr(line, ':');
+		if (!value)
+			continue;
+		for (value++; *value == ' ' || *value == '\t'; value++)
+			;
+
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			wget_content_len = simple_strtoul(value, NULL, 10);
+			wget_has_length = true;
+		} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			   strncasecmp(value, "identity", 8)) {
+			printf("\nHTTP: transfer encoding '%s' not supported\n",
+			       value);
+			return -EPROTONOSUPPORT;
+		}
+	}
+
+#ifdef CONFIG_LMB
+	if (wget_has_length && wget_content_len > wget_load_size) {
+		puts("\nHTTP error: trying to overwrite reserved memory...\n");
+		return -ENOSPC;
+	}
+#endif
+
+	return 0;
+}
+
+static int wget_store(ulong offset, const uchar *data, unsigned int len)
+{
+	void *ptr;
+
+	if (wget_has_length) {
+		if (offset >= wget_content_len)
+			return 0;
+		len = min_t(ulong, len, wget_content_len - offset);
+	}
+
+#ifdef CONFIG_LMB
+	if (offset + len > wget_load_size) {
+		puts("\nHTTP error: trying to overwrite reserved memory...\n");
+		return -ENOSPC;
+	}
+#endif
+
+	ptr = map_sysmem(wget_load_addr + offset, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+
+	return 0;
+}
+
+static int wget_rx(u32 offset, const uchar *data, unsigned int len)
+{
+	unsigned int n, skip;
+	char *end;
+	int ret;
+
+	if (wget_state == WGET_HEADER) {
+		/* headers are only looked at in order */
+		if (offset != wget_hdr_len)
+			return -EAGAIN;
+
+		n = min_t(uint, len, sizeof(wget_hdr) - 1 - wget_hdr_len);
+		memcpy(wget_hdr + wget_hdr_len, data, n);
+		end = wget_hdr + (wget_hdr_len > 3 ? wget_hdr_len - 3 : 0);
+		wget_hdr_len += n;
+		wget_hdr[wget_hdr_len] = '\0';
+
+		end = strstr(end, "\r\n\r\n");
+		if (!end) {
+			if (n < len || wget_hdr_len == sizeof(wget_hdr) - 1) {
+				puts("\nHTTP: response header too long\n");
+				return -E2BIG;
+			}
+			return 0;
+		}
+
+		wget_body_start = end + 4 - wget_hdr;
+		ret = wget_parse_header(end + 2);
+		if (ret)
+			return ret;
+		wget_state = WGET_BODY;
+
+		/* the rest of the segment is the start of the body */
+		skip = wget_body_start - offset;
+		if (skip >= len)
+			return 0;
+		offset += skip;
+		data += skip;
+		len -= skip;
+	}
+
+	return wget_store(offset - wget_body_start, data, len);
+}
+
+static void wget_advance(u32 len)
+{
+	if (wget_state != WGET_BODY)
+		return;
+
+	wget_rcvd = len - wget_body_start;
+	if (wget_has_length && wget_rcvd > wget_content_len)
+		wget_rcvd = wget_content_len;
+
+	while (wget_hashes < wget_rcvd / WGET_HASH_BYTES) {
+		putc('#');
+		if (!(++wget_hashes % WGET_HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+
+	/* the server closes the connection too, but need not wait for it */
+	if (wget_has_length && wget_rcvd == wget_content_len)
+		tcp_close();
+}
+
+static void wget_closed(int err)
+{
+	if (err) {
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	if (wget_state != WGET_BODY) {
+		puts("\nHTTP: connection closed before the response\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	if (wget_has_length && wget_rcvd < wget_content_len) {
+		printf("\nHTTP: connection closed after 0x%lx of 0x%lx bytes\n",
+		       wget_rcvd, wget_content_len);
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	net_boot_file_size = wget_rcvd;
+	time_start = get_timer(time_start);
+	if (time_start > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(net_boot_file_size / time_start * 1000, "/s");
+	}
+	puts("\ndone\n");
+	if (IS_ENABLED(CONFIG_CMD_BOOTEFI))
+		efi_set_bootdev("Net", "", wget_path,
+				map_sysmem(wget_load_addr, 0),
+				net_boot_file_size);
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static const struct tcp_ops wget_tcp_ops = {
+	.connected	= wget_connected,
+	.rx		= wget_rx,
+	.advance	= wget_advance,
+	.closed		= wget_closed,
+};
+
+void wget_start(void)
+{
+	char *ep;
+
+	wget_server_ip = net_server_ip;
+	if (!net_parse_bootfile(&wget_server_ip, wget_path,
+				sizeof(wget_path))) {
+		puts("*** ERROR: no file name given\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	wget_server_port = WGET_HTTP_PORT;
+	ep = env_get("httpdstp");
+	if (ep)
+		wget_server_port = simple_strtoul(ep, NULL, 10);
+
+	if (wget_init_load_addr()) {
+		eth_halt();
+		net_set_state(NETLOOP_FAIL);
+		puts("\nHTTP error: trying to overwrite reserved memory...\n");
+		return;
+	}
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4:%d; our IP address is %pI4\n",
+	       &wget_server_ip, wget_server_port, &net_ip);
+	printf("Filename '%s'.\n", wget_path);
+	printf("Load address: 0x%lx\n", wget_load_addr);
+	puts("Loading: *\b");
+
+	wget_state = WGET_HEADER;
+	wget_hdr_len = 0;
+	wget_has_length = false;
+	wget_content_len = 0;
+	wget_rcvd = 0;
+	wget_hashes = 0;
+	time_start = get_timer(0);
+
+	tcp_connect(wget_server_ip, wget_server_port, &wget_tcp_ops);
+}
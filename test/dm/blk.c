@@ -334,3 +334,188 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+static void blk_test_complete(struct blk_request *req)
+{
+	int *count = req->priv;
+
+	(*count)++;
+}
+
+/* Test asynchronous requests on a driver without native support */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	struct blk_request req[2];
+	struct blk_desc *desc;
+	char write[1024], read[1024];
+	int count = 0;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	ut_asserteq(1, blk_get_queue_depth(desc->bdev));
+
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i;
+
+	memset(req, '\0', sizeof(req));
+	req[0].op = BLK_REQ_WRITE;
+	req[0].start = 4;
+	req[0].blkcnt = 2;
+	req[0].buffer = write;
+	req[0].complete = blk_test_complete;
+	req[0].priv = &count;
+	ut_assertok(blk_submit(desc->bdev, &req[0]));
+	ut_asserteq(2, blk_wait(&req[0]));
+
+	req[1].op = BLK_REQ_READ;
+	req[1].start = 4;
+	req[1].blkcnt = 2;
+	req[1].buffer = read;
+	req[1].complete = blk_test_complete;
+	req[1].priv = &count;
+	ut_assertok(blk_submit(desc->bdev, &req[1]));
+	ut_assertok(blk_wait_all(desc->bdev));
+	ut_assert(req[1].done);
+	ut_asserteq(2, req[1].result);
+	ut_asserteq_mem(write, read, sizeof(write));
+	ut_asserteq(2, count);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+static int find_cache_dev_stats(int iftype, int devnum,
+				struct block_cache_dev_stats *stats)
+{
+	int i;
+
+	for (i = 0; !blkcache_dev_stats(i, stats); i++)
+		if (stats->iftype == iftype && stats->devnum == devnum)
+			return 0;
+
+	return -ENOENT;
+}
+
+/* Test the block cache hit, miss and eviction accounting */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_dev_stats dstats;
+	struct block_cache_stats stats;
+	char buf[4 * 512], out[4 * 512];
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+
+	/* room for exactly four blocks, including overhead */
+	blkcache_configure(4, 4 * 600);
+	blkcache_stats(&stats);
+
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 0, 10, 2, 512, out));
+	blkcache_fill(IF_TYPE_HOST, 0, 10, 2, 512, buf);
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 0, 10, 2, 512, out));
+	ut_asserteq_mem(buf, out, 2 * 512);
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 0, 11, 1, 512, out));
+	ut_asserteq_mem(buf + 512, out, 512);
+
+	/* a partially cached request is a miss */
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 0, 11, 2, 512, out));
+
+	/* another device with the same block numbers does not hit */
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 1, 10, 1, 512, out));
+
+	/* filling beyond the budget evicts the least recently used block */
+	blkcache_fill(IF_TYPE_HOST, 1, 20, 3, 512, buf + 512);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 0, 10, 1, 512, out));
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 0, 11, 1, 512, out));
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 1, 20, 3, 512, out));
+	ut_asserteq_mem(buf + 512, out, 3 * 512);
+
+	ut_assertok(find_cache_dev_stats(IF_TYPE_HOST, 0, &dstats));
+	ut_asserteq(3, dstats.hits);
+	ut_asserteq(2, dstats.misses);
+	ut_asserteq(1, dstats.evictions);
+	ut_asserteq(1, dstats.entries);
+	ut_assertok(find_cache_dev_stats(IF_TYPE_HOST, 1, &dstats));
+	ut_asserteq(1, dstats.hits);
+	ut_asserteq(3, dstats.entries);
+
+	blkcache_stats(&stats);
+	ut_asserteq(4, stats.hits);
+	ut_asserteq(4, stats.misses);
+	ut_asserteq(1, stats.evictions);
+	ut_asserteq(4, stats.entries);
+
+	/* writes drop everything cached for the device */
+	blkcache_invalidate(IF_TYPE_HOST, 1);
+	ut_asserteq(0, blkcache_read(IF_TYPE_HOST, 1, 20, 1, 512, out));
+	ut_asserteq(1, blkcache_read(IF_TYPE_HOST, 0, 11, 1, 512, out));
+
+	blkcache_configure(8, CONFIG_BLOCK_CACHE_SIZE);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, 0);
+#endif
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/* Test that sequential reads are served from the readahead buffer */
+static int dm_test_blk_readahead(struct unit_test_state *uts)
+{
+	char data[16 * 512], stale[512], buf[512];
+	struct blk_request req;
+	struct blk_desc *desc;
+	const struct blk_ops *ops;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	ops = blk_get_ops(desc->bdev);
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i / 3;
+	memset(stale, 0xa5, sizeof(stale));
+	ut_asserteq(16, blk_dwrite(desc, 8, 16, data));
+
+	/* the second sequential read fills the buffer */
+	ut_asserteq(1, blk_dread(desc, 8, 1, buf));
+	ut_asserteq_mem(data, buf, 512);
+	ut_asserteq(1, blk_dread(desc, 9, 1, buf));
+	ut_asserteq_mem(data + 512, buf, 512);
+
+	/* change the medium behind the buffer, which must still be used */
+	ut_asserteq(1, ops->write(desc->bdev, 11, 1, stale));
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq_mem(data + 2 * 512, buf, 512);
+	ut_asserteq(1, blk_dread(desc, 11, 1, buf));
+	ut_asserteq_mem(data + 3 * 512, buf, 512);
+
+	/* a write anywhere on the device drops the buffer */
+	ut_asserteq(1, blk_dwrite(desc, 100, 1, data));
+	ut_asserteq(1, blk_dread(desc, 11, 1, buf));
+	ut_asserteq_mem(stale, buf, 512);
+
+	/*
+	 * likewise for a write submitted as a request, which the mmc driver
+	 * has no submit() for, so that it is carried out through blk_dwrite()
+	 */
+	ut_asserteq(1, blk_dread(desc, 12, 1, buf));
+	ut_asserteq_mem(data + 4 * 512, buf, 512);
+	ut_asserteq(1, ops->write(desc->bdev, 13, 1, stale));
+	ut_asserteq(1, blk_dread(desc, 13, 1, buf));
+	ut_asserteq_mem(data + 5 * 512, buf, 512);
+
+	memset(&req, '\0', sizeof(req));
+	req.op = BLK_REQ_WRITE;
+	req.start = 100;
+	req.blkcnt = 1;
+	req.buffer = data;
+	ut_assertok(blk_submit(desc->bdev, &req));
+	ut_asserteq(1, blk_wait(&req));
+	ut_asserteq(1, blk_dread(desc, 13, 1, buf));
+	ut_asserteq_mem(stale, buf, 512);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_readahead, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for IP reassembly
+ *
+ * Two UDP datagrams are cut into fragments which are received through the
+ * sandbox Ethernet driver interleaved and out of order, so that both have to
+ * be collected at the same time.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define DEFRAG_TEST_LEN		3000	/* UDP data in each datagram */
+#define DEFRAG_TEST_FRAG_LEN	1480	/* IP payload of a full fragment */
+#define DEFRAG_TEST_PORT	4000
+#define DEFRAG_TEST_ID		0x4d00
+#define DEFRAG_TEST_NUM		2
+
+/* Fragments as (datagram, index) pairs, in the order they are received */
+static const int defrag_test_order[][2] = {
+	{ 0, 1 }, { 1, 2 }, { 1, 1 }, { 0, 2 },
+	{ 0, 0 },	/* completes the first datagram */
+	{ 1, 0 },	/* the start of the second one comes last */
+};
+
+static struct {
+	/* the datagrams, the IP header apart from the UDP part left blank */
+	u8 sent[DEFRAG_TEST_NUM][IP_UDP_HDR_SIZE + DEFRAG_TEST_LEN];
+	u8 received[DEFRAG_TEST_NUM][DEFRAG_TEST_LEN];
+	int count[DEFRAG_TEST_NUM];
+} defrag_test;
+
+static void defrag_test_handler(uchar *pkt, unsigned int dport,
+				struct in_addr sip, unsigned int sport,
+				unsigned int len)
+{
+	int n = dport - DEFRAG_TEST_PORT;
+
+	if (n < 0 || n >= DEFRAG_TEST_NUM || len != DEFRAG_TEST_LEN)
+		return;
+
+	memcpy(defrag_test.received[n], pkt, len);
+	defrag_test.count[n]++;
+}
+
+/* Queue fragment @index of datagram @n on the sandbox device */
+static int sb_defrag_send(struct udevice *dev, int n, int index)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ip;
+	int start = index * DEFRAG_TEST_FRAG_LEN;
+	int len = min_t(int, UDP_HDR_SIZE + DEFRAG_TEST_LEN - start,
+			DEFRAG_TEST_FRAG_LEN);
+	u16 ip_off = start / 8;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	if (start + len < UDP_HDR_SIZE + DEFRAG_TEST_LEN)
+		ip_off |= IP_FLAGS_MFRAG;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth_recv + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, net_ip, string_to_ip("1.1.2.2"),
+			  IP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->ip_id = htons(DEFRAG_TEST_ID + n);
+	ip->ip_off = htons(ip_off);
+	ip->ip_sum = 0;
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+	memcpy((uchar *)ip + IP_HDR_SIZE,
+	       defrag_test.sent[n] + IP_HDR_SIZE + start, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int dm_test_ip_defrag(struct unit_test_state *uts)
+{
+	struct ip_udp_hdr *ip;
+	struct udevice *dev;
+	int i, n;
+
+	memset(&defrag_test, '\0', sizeof(defrag_test));
+	for (n = 0; n < DEFRAG_TEST_NUM; n++) {
+		ip = (void *)defrag_test.sent[n];
+		ip->udp_src = htons(DEFRAG_TEST_PORT);
+		ip->udp_dst = htons(DEFRAG_TEST_PORT + n);
+		ip->udp_len = htons(UDP_HDR_SIZE + DEFRAG_TEST_LEN);
+		ip->udp_xsum = 0;
+		for (i = 0; i < DEFRAG_TEST_LEN; i++)
+			defrag_test.sent[n][IP_UDP_HDR_SIZE + i] = i * 7 + n;
+	}
+
+	env_set("ethact", "eth@10002000");
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	ut_assertok(eth_init());
+	net_set_udp_handler(defrag_test_handler);
+
+	for (i = 0; i < ARRAY_SIZE(defrag_test_order); i++) {
+		if (i && !(i % PKTBUFSRX))
+			ut_assertok(eth_rx());
+		ut_assertok(sb_defrag_send(dev, defrag_test_order[i][0],
+					   defrag_test_order[i][1]));
+	}
+	ut_assertok(eth_rx());
+
+	net_set_udp_handler(NULL);
+	eth_halt();
+
+	for (n = 0; n < DEFRAG_TEST_NUM; n++) {
+		ut_asserteq(1, defrag_test.count[n]);
+		ut_asserteq_mem(defrag_test.sent[n] + IP_UDP_HDR_SIZE,
+				defrag_test.received[n], DEFRAG_TEST_LEN);
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_ip_defrag, UT_TESTF_SCAN_FDT);
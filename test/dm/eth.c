@@ -431,3 +431,54 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 }
 
 DM_TEST(dm_test_eth_async_ping_reply, UT_TESTF_SCAN_FDT);
+
+/* Receive buffers of a device's own, handed to the stack without copies */
+static int dm_test_eth_rx_bufs(struct unit_test_state *uts)
+{
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+	uchar **bufs;
+	int i, j;
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+
+	bufs = eth_alloc_rx_bufs(dev, 2 * PKTBUFSRX);
+	ut_assertnonnull(bufs);
+	for (i = 0; i < 2 * PKTBUFSRX; i++) {
+		ut_asserteq(0, (ulong)bufs[i] % ARCH_DMA_MINALIGN);
+		if (i)
+			ut_assert(bufs[i] >= bufs[i - 1] + PKTSIZE_ALIGN);
+	}
+	ut_asserteq_ptr(bufs, eth_alloc_rx_bufs(dev, 2 * PKTBUFSRX));
+
+	/* a pool of another size is not swapped in while this one is held */
+	ut_assertnull(eth_alloc_rx_bufs(dev, PKTBUFSRX));
+	ut_asserteq_ptr(bufs, eth_alloc_rx_bufs(dev, 2 * PKTBUFSRX));
+
+	/* nor does the driver get one when started, until it is freed */
+	ut_asserteq(-ENOMEM, eth_get_ops(dev)->start(dev));
+	eth_free_rx_bufs(dev);
+
+	/* the sandbox driver asks for PKTBUFSRX buffers when started */
+	net_ping_ip = string_to_ip("1.1.2.2");
+	env_set("ethact", "eth@10002000");
+	ut_assertok(net_loop(PING));
+
+	/* and passes them around rather than copying the packets */
+	priv = dev_get_priv(dev);
+	bufs = eth_alloc_rx_bufs(dev, PKTBUFSRX);
+	ut_assertnonnull(bufs);
+	for (i = 0; i < PKTBUFSRX; i++) {
+		for (j = 0; j < PKTBUFSRX; j++) {
+			if (priv->recv_packet_buffer[i] == bufs[j])
+				break;
+		}
+		ut_assert(j < PKTBUFSRX);
+	}
+	ut_assertnull(eth_alloc_rx_bufs(dev, 2 * PKTBUFSRX));
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_rx_bufs, UT_TESTF_SCAN_FDT);
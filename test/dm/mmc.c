@@ -52,3 +52,30 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+static int dm_test_mmc_poll_init(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct mmc *mmc;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assertnonnull(mmc);
+
+	/* Start over; the emulated card reports busy for two ACMD41s */
+	mmc->has_init = 0;
+	ut_assertok(mmc_start_init(mmc));
+	ut_asserteq(1, mmc->init_in_progress);
+
+	/* The card is still powering up, so neither call may block */
+	ut_asserteq(1, mmc_poll_init_all());
+	ut_asserteq(0, mmc->has_init);
+
+	ut_assertok(mmc_poll_init(mmc));
+	ut_asserteq(1, mmc->has_init);
+	ut_asserteq(0, mmc->init_in_progress);
+	ut_asserteq(0, mmc_poll_init_all());
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_poll_init, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
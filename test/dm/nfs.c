@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for loading a file over NFS with several reads in flight
+ *
+ * The sandbox Ethernet driver plays the portmapper, mount and NFS servers.
+ * Replies to reads are held back and sent newest first, the server returns
+ * less than it is asked for, and a read left on its own is only answered
+ * once U-Boot has given up on it and asked again, so that the stale reply
+ * arrives after the fresh one.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <asm/unaligned.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../net/nfs.h"
+
+#define NFS_TEST_ADDR		0x1000000
+#define NFS_TEST_LEN		3000
+/* The most the server returns for one read */
+#define NFS_TEST_MAX_COUNT	1024
+#define NFS_TEST_MOUNT_PORT	635
+#define NFS_TEST_NFS_PORT	2049
+#define NFS_TEST_MAX_READS	32
+#define NFS_TEST_FH		0x5a5a5a5a
+
+struct nfs_test_read {
+	u32 id;
+	u32 offset;
+	u32 count;
+};
+
+static struct {
+	struct unit_test_state *uts;
+	int port;		/* U-Boot's port */
+	u8 data[NFS_TEST_LEN];
+	struct nfs_test_read reads[NFS_TEST_MAX_READS];	/* every read seen */
+	int num_reads;
+	struct nfs_test_read pending[NFS_TEST_MAX_READS]; /* not answered yet */
+	int num_pending;
+	int resent;		/* reads sent again */
+	bool continued;		/* read of the rest of a short reply seen */
+} nfs_test;
+
+/* Queue an RPC reply carrying @nwords words and then @len bytes of @data */
+static int sb_nfs_reply(struct udevice *dev, void *packet, int sport, u32 id,
+			u32 astatus, const u32 *words, int nwords,
+			const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ip;
+	u32 hdr[6];
+	uchar *rpc;
+	int rpc_len = sizeof(hdr) + nwords * sizeof(u32) + len;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	hdr[0] = htonl(id);
+	hdr[1] = htonl(MSG_REPLY);
+	hdr[2] = 0;		/* accepted */
+	hdr[3] = 0;		/* AUTH_NONE verifier */
+	hdr[4] = 0;
+	hdr[5] = htonl(astatus);
+
+	ip = (void *)eth_recv + ETHER_HDR_SIZE;
+	rpc = (uchar *)ip + IP_UDP_HDR_SIZE;
+	memcpy(rpc, hdr, sizeof(hdr));
+	memcpy(rpc + sizeof(hdr), words, nwords * sizeof(u32));
+	memcpy(rpc + sizeof(hdr) + nwords * sizeof(u32), data, len);
+	net_set_ip_header((uchar *)ip, net_ip, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + rpc_len, IPPROTO_UDP);
+	ip->udp_src = htons(sport);
+	ip->udp_dst = htons(nfs_test.port);
+	ip->udp_len = htons(UDP_HDR_SIZE + rpc_len);
+	ip->udp_xsum = 0;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + rpc_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* Answer an NFSv3 read the way a server capping its replies would */
+static int sb_nfs_read_reply(struct udevice *dev, void *packet,
+			     struct nfs_test_read *rd)
+{
+	u32 count = 0;
+	u32 words[5];
+
+	if (rd->offset < NFS_TEST_LEN)
+		count = min3(rd->count, (u32)NFS_TEST_LEN - rd->offset,
+			     (u32)NFS_TEST_MAX_COUNT);
+
+	words[0] = 0;			/* NFS3_OK */
+	words[1] = 0;			/* no attributes follow */
+	words[2] = htonl(count);
+	words[3] = htonl(rd->offset + count >= NFS_TEST_LEN);	/* eof */
+	words[4] = htonl(count);
+
+	return sb_nfs_reply(dev, packet, NFS_TEST_NFS_PORT, rd->id, 0, words,
+			    ARRAY_SIZE(words),
+			    count ? nfs_test.data + rd->offset : NULL, count);
+}
+
+/*
+ * Answer the reads held back, newest first, as far as there is room.  A read
+ * on its own is held until U-Boot times out and sends it again, which the
+ * next receive makes happen straight away.
+ */
+static int sb_nfs_flush(struct udevice *dev, void *packet)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct nfs_test_read *rd;
+	int ret;
+
+	if (nfs_test.num_pending == 1) {
+		sandbox_eth_skip_timeout();
+		return 0;
+	}
+
+	while (nfs_test.num_pending && priv->recv_packets < PKTBUFSRX) {
+		rd = &nfs_test.pending[--nfs_test.num_pending];
+		ret = sb_nfs_read_reply(dev, packet, rd);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int sb_nfs_read(struct udevice *dev, void *packet, u32 id,
+		       const uchar *args)
+{
+	struct unit_test_state *uts = nfs_test.uts;
+	struct nfs_test_read rd;
+	int fh_words = get_unaligned_be32(args) / 4;
+	int i;
+
+	rd.id = id;
+	/* the upper half of the 64-bit offset is always 0 here */
+	rd.offset = get_unaligned_be32(args + (fh_words + 2) * 4);
+	rd.count = get_unaligned_be32(args + (fh_words + 3) * 4);
+	ut_asserteq(NFS_TEST_FH, get_unaligned_be32(args + 4));
+
+	for (i = 0; i < nfs_test.num_reads; i++) {
+		if (nfs_test.reads[i].offset == rd.offset &&
+		    nfs_test.reads[i].count == rd.count)
+			nfs_test.resent++;
+	}
+	if (rd.offset == NFS_TEST_MAX_COUNT)
+		nfs_test.continued = true;
+
+	ut_assert(nfs_test.num_reads < NFS_TEST_MAX_READS);
+	nfs_test.reads[nfs_test.num_reads++] = rd;
+	nfs_test.pending[nfs_test.num_pending++] = rd;
+
+	return sb_nfs_flush(dev, packet);
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct unit_test_state *uts = nfs_test.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	const uchar *call = (uchar *)ip + IP_UDP_HDR_SIZE;
+	const uchar *args = call + 6 * 4;
+	u32 id, prog, vers, proc;
+	u32 words[10];
+	int i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	nfs_test.port = ntohs(ip->udp_src);
+	id = get_unaligned_be32(call);
+	ut_asserteq(MSG_CALL, get_unaligned_be32(call + 4));
+	prog = get_unaligned_be32(call + 12);
+	vers = get_unaligned_be32(call + 16);
+	proc = get_unaligned_be32(call + 20);
+
+	if (prog == PROG_PORTMAP) {
+		ut_asserteq(SUNRPC_PORT, ntohs(ip->udp_dst));
+		ut_asserteq(PORTMAP_GETPORT, proc);
+		/* the program asked for follows an empty credential */
+		words[0] = htonl(get_unaligned_be32(args + 16) == PROG_MOUNT ?
+				 NFS_TEST_MOUNT_PORT : NFS_TEST_NFS_PORT);
+		return sb_nfs_reply(dev, packet, SUNRPC_PORT, id, 0, words, 1,
+				    NULL, 0);
+	}
+
+	/* skip the credential and the empty verifier */
+	args += 8 + get_unaligned_be32(args + 4) + 8;
+
+	if (prog == PROG_MOUNT) {
+		ut_asserteq(NFS_TEST_MOUNT_PORT, ntohs(ip->udp_dst));
+		if (proc == MOUNT_UMOUNTALL)
+			return sb_nfs_reply(dev, packet, NFS_TEST_MOUNT_PORT,
+					    id, 0, NULL, 0, NULL, 0);
+		ut_asserteq(MOUNT_ADDENTRY, proc);
+		ut_asserteq(strlen("/export"), get_unaligned_be32(args));
+		ut_asserteq_mem("/export", args + 4, strlen("/export"));
+		words[0] = 0;
+		for (i = 1; i <= NFS_FHSIZE / 4; i++)
+			words[i] = htonl(NFS_TEST_FH);
+		return sb_nfs_reply(dev, packet, NFS_TEST_MOUNT_PORT, id, 0,
+				    words, 1 + NFS_FHSIZE / 4, NULL, 0);
+	}
+
+	ut_asserteq(PROG_NFS, prog);
+	ut_asserteq(NFS_TEST_NFS_PORT, ntohs(ip->udp_dst));
+	if (vers == 2) {
+		/* only NFSv3 is served, so that reads may come back short */
+		words[0] = htonl(3);
+		words[1] = htonl(3);
+		return sb_nfs_reply(dev, packet, NFS_TEST_NFS_PORT, id,
+				    NFS_RPC_PROG_MISMATCH, words, 2, NULL, 0);
+	}
+
+	ut_asserteq(3, vers);
+	if (proc == NFS_READ)
+		return sb_nfs_read(dev, packet, id, args);
+
+	ut_asserteq(NFS3PROC_LOOKUP, proc);
+	args += 4 + get_unaligned_be32(args);	/* directory handle */
+	ut_asserteq(strlen("file.bin"), get_unaligned_be32(args));
+	ut_asserteq_mem("file.bin", args + 4, strlen("file.bin"));
+	words[0] = 0;
+	words[1] = htonl(NFS_FHSIZE);
+	for (i = 2; i < 2 + NFS_FHSIZE / 4; i++)
+		words[i] = htonl(NFS_TEST_FH);
+	return sb_nfs_reply(dev, packet, NFS_TEST_NFS_PORT, id, 0, words,
+			    2 + NFS_FHSIZE / 4, NULL, 0);
+}
+
+static int dm_test_nfs_read_window(struct unit_test_state *uts)
+{
+	char cmd[64];
+	void *buf;
+	int i;
+
+	memset(&nfs_test, '\0', sizeof(nfs_test));
+	nfs_test.uts = uts;
+	for (i = 0; i < NFS_TEST_LEN; i++)
+		nfs_test.data[i] = i * 7 + i / NFS_TEST_MAX_COUNT;
+
+	buf = map_sysmem(NFS_TEST_ADDR, NFS_TEST_LEN);
+	memset(buf, '\0', NFS_TEST_LEN);
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	env_set("ethact", "eth@10002000");
+	snprintf(cmd, sizeof(cmd), "nfs %x 1.1.2.2:/export/file.bin",
+		 NFS_TEST_ADDR);
+	ut_assertok(run_command(cmd, 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	/* several reads were in flight, and the rest of a short one asked for */
+	ut_assert(nfs_test.num_reads > 2);
+	ut_assert(nfs_test.continued);
+	ut_assert(nfs_test.resent > 0);
+	ut_asserteq(NFS_TEST_LEN, env_get_hex("filesize", 0));
+	ut_asserteq_mem(nfs_test.data, buf, NFS_TEST_LEN);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_nfs_read_window, UT_TESTF_SCAN_FDT);
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for windowed TFTP transfers
+ *
+ * The sandbox Ethernet driver plays the TFTP server: each ACK sent by U-Boot
+ * is answered straight away from the tx handler with the next window, whose
+ * blocks are delivered out of order so that those past a hole have to be
+ * kept until the hole is filled.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <linux/stringify.h>
+#include <asm/eth.h>
+#include <asm/unaligned.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TFTP_TEST_ADDR		0x1000000
+#define TFTP_TEST_BLKSIZE	512
+#define TFTP_TEST_WINDOW	3
+/* eight full blocks and a short one ending the file */
+#define TFTP_TEST_BLOCKS	9
+#define TFTP_TEST_LEN		((TFTP_TEST_BLOCKS - 1) * TFTP_TEST_BLKSIZE + 100)
+#define TFTP_TEST_PORT		1069
+#define TFTP_TEST_MAX_ACKS	16
+
+/* The order the blocks of each window are sent in, by the ACK before it */
+static const int tftp_test_windows[][TFTP_TEST_WINDOW] = {
+	{ 1, 2, 3 },	/* the first block has to come first */
+	{ 5, 4, 6 },	/* 5 is kept, then 4 and 5 are acked with 6 */
+	{ 8, 9, 7 },	/* the kept short block 9 ends the transfer */
+};
+
+static struct {
+	struct unit_test_state *uts;
+	int port;		/* U-Boot's port */
+	u8 data[TFTP_TEST_LEN];
+	int acks[TFTP_TEST_MAX_ACKS];
+	int num_acks;
+	bool rrq_seen;
+} tftp_test;
+
+/* Queue a TFTP packet from the server on the sandbox device */
+static int sb_tftp_reply(struct udevice *dev, void *packet, int sport,
+			 const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ip;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth_recv + ETHER_HDR_SIZE;
+	memcpy((uchar *)ip + IP_UDP_HDR_SIZE, data, len);
+	net_set_ip_header((uchar *)ip, net_ip, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->udp_src = htons(sport);
+	ip->udp_dst = htons(tftp_test.port);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* Queue data block @block, numbered from 1 */
+static int sb_tftp_send_block(struct udevice *dev, void *packet, int block)
+{
+	u8 buf[4 + TFTP_TEST_BLKSIZE];
+	int offset = (block - 1) * TFTP_TEST_BLKSIZE;
+	int len = min(TFTP_TEST_LEN - offset, TFTP_TEST_BLKSIZE);
+
+	put_unaligned_be16(3, buf);	/* DATA */
+	put_unaligned_be16(block, buf + 2);
+	memcpy(buf + 4, tftp_test.data + offset, len);
+
+	return sb_tftp_reply(dev, packet, TFTP_TEST_PORT, buf, 4 + len);
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct unit_test_state *uts = tftp_test.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	static const char oack[] = "\0\6"
+		"blksize\0" __stringify(TFTP_TEST_BLKSIZE) "\0"
+		"windowsize\0" __stringify(TFTP_TEST_WINDOW);
+	u8 *tftp = (u8 *)ip + IP_UDP_HDR_SIZE;
+	int ack, window, i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	switch (get_unaligned_be16(tftp)) {
+	case 1:		/* RRQ */
+		ut_asserteq(69, ntohs(ip->udp_dst));
+		ut_asserteq_str("file.bin", (char *)tftp + 2);
+		tftp_test.port = ntohs(ip->udp_src);
+		tftp_test.rrq_seen = true;
+		return sb_tftp_reply(dev, packet, TFTP_TEST_PORT, oack,
+				     sizeof(oack));
+	case 4:		/* ACK */
+		ut_asserteq(TFTP_TEST_PORT, ntohs(ip->udp_dst));
+		ut_assert(tftp_test.num_acks < TFTP_TEST_MAX_ACKS);
+		ack = get_unaligned_be16(tftp + 2);
+		tftp_test.acks[tftp_test.num_acks++] = ack;
+
+		/* answer the first ACK at the end of each window only */
+		for (i = 0; i < tftp_test.num_acks - 1; i++)
+			if (tftp_test.acks[i] == ack)
+				return 0;
+		if (ack % TFTP_TEST_WINDOW)
+			return 0;
+		window = ack / TFTP_TEST_WINDOW;
+		if (window >= ARRAY_SIZE(tftp_test_windows))
+			return 0;
+		for (i = 0; i < TFTP_TEST_WINDOW; i++)
+			ut_assertok(sb_tftp_send_block(dev, packet,
+					tftp_test_windows[window][i]));
+		return 0;
+	}
+
+	return 0;
+}
+
+static int dm_test_tftp_reorder(struct unit_test_state *uts)
+{
+	/* ACKs for the prefix, the resend asked for by the short block */
+	static const int acks[] = { 0, 3, 6, 6, 9 };
+	char cmd[64];
+	void *buf;
+	int i;
+
+	memset(&tftp_test, '\0', sizeof(tftp_test));
+	tftp_test.uts = uts;
+	for (i = 0; i < TFTP_TEST_LEN; i++)
+		tftp_test.data[i] = i * 7 + i / TFTP_TEST_BLKSIZE;
+
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_TEST_LEN);
+	memset(buf, '\0', TFTP_TEST_LEN);
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("tftpblocksize", __stringify(TFTP_TEST_BLKSIZE));
+	env_set("tftpwindowsize", __stringify(TFTP_TEST_WINDOW));
+	snprintf(cmd, sizeof(cmd), "tftpboot %x 1.1.2.2:file.bin",
+		 TFTP_TEST_ADDR);
+	ut_assertok(run_command(cmd, 0));
+	env_set("tftpwindowsize", NULL);
+	env_set("tftpblocksize", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	ut_assert(tftp_test.rrq_seen);
+	ut_asserteq(ARRAY_SIZE(acks), tftp_test.num_acks);
+	for (i = 0; i < ARRAY_SIZE(acks); i++)
+		ut_asserteq(acks[i], tftp_test.acks[i]);
+	ut_asserteq(TFTP_TEST_LEN, env_get_hex("filesize", 0));
+	ut_asserteq_mem(tftp_test.data, buf, TFTP_TEST_LEN);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_reorder, UT_TESTF_SCAN_FDT);
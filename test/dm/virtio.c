@@ -130,3 +130,61 @@ static int dm_test_virtio_remove(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_virtio_remove, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test passing buffers through an indirect descriptor table */
+static int dm_test_virtio_ring_indirect(struct unit_test_state *uts)
+{
+	struct udevice *bus, *dev;
+	struct virtio_dev_priv *uc_priv;
+	struct virtqueue *vqs[1], *vq;
+	u8 buf1[16], buf2[16], buf3[16];
+	struct virtio_sg sg1 = { buf1, sizeof(buf1) };
+	struct virtio_sg sg2 = { buf2, sizeof(buf2) };
+	struct virtio_sg sg3 = { buf3, sizeof(buf3) };
+	struct virtio_sg *sgs[] = { &sg1, &sg2, &sg3 };
+	struct vring_desc *table;
+	unsigned int num_free;
+
+	ut_assertok(uclass_first_device(UCLASS_VIRTIO, &bus));
+	ut_assertok(device_find_first_child(bus, &dev));
+	ut_assertnonnull(dev);
+
+	/* fake the virtio device probe, as in dm_test_virtio_all_ops() */
+	uc_priv = dev_get_uclass_priv(bus);
+	uc_priv->vdev = dev;
+
+	ut_assertok(virtio_find_vqs(dev, 1, vqs));
+	vq = vqs[0];
+	vq->indirect = true;
+	num_free = vq->num_free;
+
+	/* three buffers only take a single descriptor of the ring */
+	ut_assertok(virtqueue_add(vq, sgs, 1, 2));
+	ut_asserteq(num_free - 1, vq->num_free);
+	ut_asserteq(VRING_DESC_F_INDIRECT,
+		    virtio16_to_cpu(dev, vq->vring.desc[0].flags));
+	ut_asserteq(3 * sizeof(struct vring_desc),
+		    virtio32_to_cpu(dev, vq->vring.desc[0].len));
+	table = (void *)(uintptr_t)virtio64_to_cpu(dev, vq->vring.desc[0].addr);
+	ut_asserteq_ptr(buf1, (void *)(uintptr_t)virtio64_to_cpu(dev,
+								  table[0].addr));
+	ut_asserteq(VRING_DESC_F_NEXT | VRING_DESC_F_WRITE,
+		    virtio16_to_cpu(dev, table[1].flags));
+	ut_asserteq(VRING_DESC_F_WRITE, virtio16_to_cpu(dev, table[2].flags));
+
+	/* pretend the device has used the buffers */
+	vq->vring.used->ring[0].id = cpu_to_virtio32(dev, 0);
+	vq->vring.used->idx = cpu_to_virtio16(dev, 1);
+	ut_asserteq_ptr(buf1, virtqueue_get_buf(vq, NULL));
+	ut_asserteq(num_free, vq->num_free);
+
+	/* without indirect descriptors each buffer takes a descriptor */
+	vq->indirect = false;
+	ut_assertok(virtqueue_add(vq, sgs, 1, 2));
+	ut_asserteq(num_free - 3, vq->num_free);
+
+	ut_assertok(virtio_del_vqs(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_ring_indirect, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
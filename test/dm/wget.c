@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for the wget command and the TCP client below it
+ *
+ * The sandbox Ethernet driver plays the HTTP server: each segment sent by
+ * U-Boot is answered straight away from the tx handler, and the body of the
+ * response is delivered out of order so that the data past the hole has to
+ * be kept until the hole is filled.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define WGET_TEST_ADDR		0x1000000
+#define WGET_TEST_BODY_LEN	2000
+#define WGET_TEST_ISS		0x12345678
+#define WGET_TEST_PORT		80
+#define WGET_TEST_REQUEST	"GET /file.bin HTTP/1.1\r\n"
+
+static struct {
+	struct unit_test_state *uts;
+	int port;		/* U-Boot's port */
+	u32 rcv_nxt;		/* next sequence number expected from U-Boot */
+	char hdr[128];
+	int hdr_len;
+	char body[WGET_TEST_BODY_LEN];
+	bool request_seen;
+	bool fin_seen;
+} wget_test;
+
+/* Queue a segment from the server on the sandbox device */
+static int sb_wget_reply(struct udevice *dev, void *packet, u8 flags,
+			 u32 seq, const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ethernet_hdr *eth_recv;
+	struct ip_tcp_hdr *tcp;
+	int hdr_len = TCP_HDR_SIZE;
+	uint csum;
+	u32 ph[3];
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	tcp = (void *)eth_recv + ETHER_HDR_SIZE;
+	if (flags & TCP_SYN) {
+		uchar *opt = (uchar *)tcp + IP_TCP_HDR_SIZE;
+
+		opt[0] = TCP_O_MSS;
+		opt[1] = 4;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		hdr_len += 4;
+	}
+	memcpy((uchar *)tcp + IP_HDR_SIZE + hdr_len, data, len);
+
+	net_set_ip_header((uchar *)tcp, net_ip, priv->fake_host_ipaddr,
+			  IP_HDR_SIZE + hdr_len + len, IPPROTO_TCP);
+	tcp->tcp_src = htons(WGET_TEST_PORT);
+	tcp->tcp_dst = htons(wget_test.port);
+	tcp->tcp_seq = htonl(seq);
+	tcp->tcp_ack = htonl(wget_test.rcv_nxt);
+	tcp->tcp_hlen = (hdr_len / 4) << 4;
+	tcp->tcp_flags = flags | TCP_ACK;
+	tcp->tcp_win = htons(0xffff);
+	tcp->tcp_xsum = 0;
+	tcp->tcp_ugr = 0;
+
+	ph[0] = priv->fake_host_ipaddr.s_addr;
+	ph[1] = net_ip.s_addr;
+	ph[2] = htonl(IPPROTO_TCP << 16 | (hdr_len + len));
+	csum = compute_ip_checksum((uchar *)tcp + IP_HDR_SIZE, hdr_len + len);
+	tcp->tcp_xsum = add_ip_checksums(0, compute_ip_checksum(ph, sizeof(ph)),
+					 csum);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_HDR_SIZE + hdr_len + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int sb_wget_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct unit_test_state *uts = wget_test.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	u32 body_seq = WGET_TEST_ISS + 1 + wget_test.hdr_len;
+	u32 seq, end;
+	int data_len;
+	int half = WGET_TEST_BODY_LEN / 2;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return 0;
+
+	ut_asserteq(WGET_TEST_PORT, ntohs(tcp->tcp_dst));
+	seq = ntohl(tcp->tcp_seq);
+	data_len = ntohs(tcp->ip_len) - IP_HDR_SIZE - (tcp->tcp_hlen >> 4) * 4;
+	end = body_seq + WGET_TEST_BODY_LEN;
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		wget_test.port = ntohs(tcp->tcp_src);
+		wget_test.rcv_nxt = seq + 1;
+		return sb_wget_reply(dev, packet, TCP_SYN, WGET_TEST_ISS,
+				     NULL, 0);
+	}
+
+	if (data_len && !wget_test.request_seen) {
+		ut_asserteq(wget_test.rcv_nxt, seq);
+		ut_asserteq_mem(WGET_TEST_REQUEST,
+				packet + len - data_len,
+				strlen(WGET_TEST_REQUEST));
+		wget_test.request_seen = true;
+		wget_test.rcv_nxt += data_len;
+
+		/* the header, then the second half of the body, then the first */
+		ut_assertok(sb_wget_reply(dev, packet, TCP_PSH,
+					  WGET_TEST_ISS + 1, wget_test.hdr,
+					  wget_test.hdr_len));
+		ut_assertok(sb_wget_reply(dev, packet, TCP_PSH, body_seq + half,
+					  wget_test.body + half,
+					  WGET_TEST_BODY_LEN - half));
+		return sb_wget_reply(dev, packet, TCP_PSH, body_seq,
+				     wget_test.body, half);
+	}
+
+	if (tcp->tcp_flags & TCP_FIN) {
+		/* U-Boot only closes once it has the whole body */
+		ut_asserteq(end, ntohl(tcp->tcp_ack));
+		wget_test.fin_seen = true;
+		wget_test.rcv_nxt = seq + data_len + 1;
+		return sb_wget_reply(dev, packet, TCP_FIN, end, NULL, 0);
+	}
+
+	return 0;
+}
+
+static int dm_test_wget(struct unit_test_state *uts)
+{
+	char cmd[64];
+	void *buf;
+	int i;
+
+	memset(&wget_test, '\0', sizeof(wget_test));
+	wget_test.uts = uts;
+	for (i = 0; i < WGET_TEST_BODY_LEN; i++)
+		wget_test.body[i] = i * 7;
+	wget_test.hdr_len = snprintf(wget_test.hdr, sizeof(wget_test.hdr),
+				     "HTTP/1.1 200 OK\r\n"
+				     "Content-Length: %d\r\n\r\n",
+				     WGET_TEST_BODY_LEN);
+
+	buf = map_sysmem(WGET_TEST_ADDR, WGET_TEST_BODY_LEN);
+	memset(buf, '\0', WGET_TEST_BODY_LEN);
+
+	sandbox_eth_set_tx_handler(0, sb_wget_handler);
+	env_set("ethact", "eth@10002000");
+	snprintf(cmd, sizeof(cmd), "wget %x 1.1.2.2:/file.bin",
+		 WGET_TEST_ADDR);
+	ut_assertok(run_command(cmd, 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	ut_assert(wget_test.request_seen);
+	ut_assert(wget_test.fin_seen);
+	ut_asserteq(WGET_TEST_BODY_LEN, env_get_hex("filesize", 0));
+	ut_asserteq_mem(wget_test.body, buf, WGET_TEST_BODY_LEN);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_wget, UT_TESTF_SCAN_FDT);
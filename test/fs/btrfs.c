@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the btrfs tree block cache
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <test/fs.h>
+#include <test/ut.h>
+#include "../../fs/btrfs/ctree.h"
+
+#define TEST_BLOCKSIZE	4096
+#define TEST_CACHE_SIZE	(8 * TEST_BLOCKSIZE)
+
+/* Test that the extent buffer LRU stays within its budget */
+static int fs_test_btrfs_tree_cache(struct unit_test_state *uts)
+{
+	struct extent_buffer *eb, *held;
+	struct btrfs_fs_info *fs_info;
+	struct extent_io_tree *tree;
+	int i;
+
+	fs_info = calloc(1, sizeof(*fs_info));
+	ut_assertnonnull(fs_info);
+	tree = &fs_info->extent_cache;
+	extent_io_tree_init(tree);
+	tree->max_cache_size = TEST_CACHE_SIZE;
+
+	/* keep a reference to the first buffer */
+	held = alloc_extent_buffer(fs_info, 0, TEST_BLOCKSIZE);
+	ut_assertnonnull(held);
+	memset(held->data, 0xa5, TEST_BLOCKSIZE);
+
+	for (i = 1; i < 32; i++) {
+		eb = alloc_extent_buffer(fs_info, i * TEST_BLOCKSIZE,
+					 TEST_BLOCKSIZE);
+		ut_assertnonnull(eb);
+		memset(eb->data, i, TEST_BLOCKSIZE);
+		free_extent_buffer(eb);
+		ut_assert(tree->cache_size < TEST_CACHE_SIZE);
+	}
+
+	/* the least recently used buffers went, the referenced one stayed */
+	ut_assertnull(find_extent_buffer(tree, TEST_BLOCKSIZE, TEST_BLOCKSIZE));
+	eb = find_extent_buffer(tree, 0, TEST_BLOCKSIZE);
+	ut_asserteq_ptr(held, eb);
+	ut_asserteq(0xa5, ((u8 *)eb->data)[TEST_BLOCKSIZE - 1]);
+	free_extent_buffer(eb);
+	eb = find_extent_buffer(tree, 31 * TEST_BLOCKSIZE, TEST_BLOCKSIZE);
+	ut_assertnonnull(eb);
+	ut_asserteq(31, ((u8 *)eb->data)[0]);
+
+	/* a lookup makes a buffer the most recently used one */
+	free_extent_buffer(eb);
+	eb = find_extent_buffer(tree, 28 * TEST_BLOCKSIZE, TEST_BLOCKSIZE);
+	ut_assertnonnull(eb);
+	free_extent_buffer(eb);
+	for (i = 32; i < 36; i++) {
+		eb = alloc_extent_buffer(fs_info, i * TEST_BLOCKSIZE,
+					 TEST_BLOCKSIZE);
+		ut_assertnonnull(eb);
+		free_extent_buffer(eb);
+	}
+	eb = find_extent_buffer(tree, 28 * TEST_BLOCKSIZE, TEST_BLOCKSIZE);
+	ut_assertnonnull(eb);
+	free_extent_buffer(eb);
+	ut_assertnull(find_extent_buffer(tree, 29 * TEST_BLOCKSIZE,
+					 TEST_BLOCKSIZE));
+
+	/* an evicted block comes back empty, to be read again */
+	eb = alloc_extent_buffer(fs_info, TEST_BLOCKSIZE, TEST_BLOCKSIZE);
+	ut_assertnonnull(eb);
+	ut_asserteq(0, eb->flags & EXTENT_UPTODATE);
+	ut_asserteq(0, ((u8 *)eb->data)[0]);
+	free_extent_buffer(eb);
+
+	free_extent_buffer(held);
+	extent_io_tree_cleanup(tree);
+	ut_asserteq(0, tree->cache_size);
+	free(fs_info);
+
+	return 0;
+}
+FS_TEST(fs_test_btrfs_tree_cache, 0);
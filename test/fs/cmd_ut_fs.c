@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for filesystem internals
+ */
+
+#include <common.h>
+#include <command.h>
+#include <test/fs.h>
+#include <test/suites.h>
+#include <test/ut.h>
+
+int do_ut_fs(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
+{
+	struct unit_test *tests = UNIT_TEST_SUITE_START(fs_test);
+	const int n_ents = UNIT_TEST_SUITE_COUNT(fs_test);
+
+	return cmd_ut_category("fs", "fs_test_", tests, n_ents, argc, argv);
+}
@@ -0,0 +1,89 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0+
+
+# This script measures how the cost of looking up a file in a FAT directory
+# grows with the size of the directory.
+#
+# FAT directories are unsorted lists of entries, so finding a name means
+# reading the directory and rebuilding the long name of each entry. U-Boot
+# indexes the names of a directory the first time it is searched and keeps
+# the index while the filesystem stays mounted, so only the first lookup in
+# a directory should depend on its size.
+#
+# To execute the benchmark, simply run it from the U-Boot source root
+# directory:
+#
+#    cd u-boot
+#    ./test/fs/fat-dirindex-bench.sh
+#
+# It creates a FAT image holding directories of increasing size, builds
+# U-Boot sandbox and times the lookup of the last file of each directory
+# three times: right after mounting (which builds the index), a second time
+# (which uses it), and once more after 'umount' (linear scan plus rebuild).
+# Each lookup is done with 'size' under the 'time' command, e.g.:
+#
+#    => time size host 0:0 /dir4000/file-4000-with-a-long-name.txt
+#
+#    time: 0.084 seconds
+#    => time size host 0:0 /dir4000/file-4000-with-a-long-name.txt
+#
+#    time: 0.000 seconds
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree, like test/fs/fat-noncontig-test.sh does.
+
+odir=sandbox
+img=${odir}/fat-dirindex.img
+src=${odir}/fat-dirindex
+sizes="10 100 1000 4000"
+
+for prereq in mkfs.fat mcopy mmd; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8
+
+if [ ! -f ${img} ]; then
+    rm -rf ${src}
+    for n in ${sizes}; do
+        mkdir -p ${src}/dir${n}
+        for ((i = 1; i <= n; i++)); do
+            echo ${i} > ${src}/dir${n}/file-${i}-with-a-long-name.txt
+        done
+    done
+
+    mkfs.fat -C -F 32 ${img} $((64 * 1024)) >/dev/null
+    if [ $? -ne 0 ]; then
+        echo Could not create FAT filesystem
+        exit 1
+    fi
+    mcopy -s -i ${img} ${src}/* ::/
+    if [ $? -ne 0 ]; then
+        echo Could not populate FAT filesystem
+        exit 1
+    fi
+    rm -rf ${src}
+fi
+
+cmds="host bind 0 ${img}"
+for n in ${sizes}; do
+    f=/dir${n}/file-${n}-with-a-long-name.txt
+    cmds="${cmds}
+echo dir${n}: first lookup, second lookup, lookup after umount
+time size host 0:0 ${f}
+time size host 0:0 ${f}
+umount
+time size host 0:0 ${f}"
+done
+
+./${odir}/u-boot << EOF
+${cmds}
+reset
+EOF
+if [ $? -ne 0 ]; then
+    echo U-Boot exit status indicates an error
+    exit 1
+fi
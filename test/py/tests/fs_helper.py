@@ -0,0 +1,59 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Helpers for the filesystem tests which build their own image
+
+"""
+Helpers for tests which populate a source directory, turn it into a
+filesystem image with the tools of that filesystem and look files up in it
+from U-Boot.
+"""
+
+import os
+import shutil
+
+def file_name(i):
+    """
+    Returns the i-th of a series of names long enough to need more than one
+    directory entry on filesystems with short entries.
+    """
+    return 'file-{}-with-a-long-name.txt'.format(i)
+
+def make_src_dir(build_dir, src_dir, nr_files, data):
+    """
+    Creates src_dir/dir at build_dir holding files 1 to nr_files, named by
+    file_name() and filled with data(i), and returns the path of src_dir.
+    """
+    root = os.path.join(build_dir, src_dir)
+    os.makedirs(os.path.join(root, 'dir'))
+    for i in range(1, nr_files + 1):
+        with open(os.path.join(root, 'dir', file_name(i)), 'w') as f:
+            f.write(data(i))
+
+    return root
+
+def clean_image(build_dir, src_dir, image_name):
+    """
+    Deletes the image and src_dir at build_dir.
+    """
+    shutil.rmtree(os.path.join(build_dir, src_dir), ignore_errors=True)
+    image_path = os.path.join(build_dir, image_name)
+    if os.path.exists(image_path):
+        os.remove(image_path)
+
+def check_size(u_boot_console, name, size):
+    """
+    Checks that the file name in /dir on host 0 has the given size.
+    """
+    output = u_boot_console.run_command_list([
+        'setenv filesize',
+        'size host 0 /dir/{}'.format(name),
+        'printenv filesize'])
+    assert 'filesize={:x}'.format(size) in ''.join(output)
+
+def check_missing(u_boot_console, name):
+    """
+    Checks that there is no file name in /dir on host 0.
+    """
+    output = u_boot_console.run_command(
+        'size host 0 /dir/{}; echo rc=$?'.format(name))
+    assert 'rc=1' in output
@@ -0,0 +1,86 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: btrfs tree block cache test
+
+"""
+This test verifies that files are read correctly from a btrfs filesystem
+whose metadata is several times larger than the tree block cache, so that
+tree blocks are evicted and read again, and that listing a large directory,
+which reads leaves ahead, sees every entry.
+"""
+
+import hashlib
+import os
+import pytest
+import re
+import subprocess
+from fstest_defs import *
+from tests.fs_helper import clean_image
+
+BTRFS_SRC_DIR = 'btrfs_cache_src'
+BTRFS_IMAGE_NAME = 'btrfs_cache.img'
+BTRFS_NR_FILES = 8000
+
+def file_name(i):
+    return 'f{}'.format(i)
+
+def file_data(i):
+    # small enough to be stored inline in the tree leaves
+    return ('{:06d}'.format(i) * 300).encode()
+
+def make_btrfs_image(build_dir):
+    """
+    Makes a btrfs image with a directory of inline files, about 16 MiB of
+    leaves in all.
+    """
+    root = os.path.join(build_dir, BTRFS_SRC_DIR)
+    os.makedirs(os.path.join(root, 'dir'))
+    for i in range(BTRFS_NR_FILES):
+        with open(os.path.join(root, 'dir', file_name(i)), 'wb') as f:
+            f.write(file_data(i))
+
+    image_path = os.path.join(build_dir, BTRFS_IMAGE_NAME)
+    with open(image_path, 'wb') as f:
+        f.truncate(256 << 20)
+    subprocess.run(['mkfs.btrfs', '-q', '-r', root, image_path], check=True,
+                   stdout=subprocess.DEVNULL)
+
+    return image_path
+
+def check_file(u_boot_console, i):
+    data = file_data(i)
+    output = u_boot_console.run_command_list([
+        'load host 0 {:x} /dir/{}'.format(ADDR, file_name(i)),
+        'md5sum {:x} {:x}'.format(ADDR, len(data))])
+    assert hashlib.md5(data).hexdigest() in ''.join(output)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_md5sum')
+@pytest.mark.buildconfigspec('fs_btrfs')
+@pytest.mark.requiredtool('mkfs.btrfs')
+@pytest.mark.slow
+def test_btrfs_cache(u_boot_console):
+    """
+    Reads files from all over a large directory before and after listing
+    it.
+    """
+    build_dir = u_boot_console.config.build_dir
+    picks = [0, 1, BTRFS_NR_FILES // 2, 17, BTRFS_NR_FILES - 1, 4321, 2]
+
+    try:
+        image_path = make_btrfs_image(build_dir)
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+
+        for i in picks:
+            check_file(u_boot_console, i)
+
+        # reading every leaf pushes the blocks read so far out of the cache
+        output = u_boot_console.run_command('ls host 0 /dir')
+        names = set(re.findall(r'\s(f\d+)\s*$', output, re.MULTILINE))
+        assert len(names) == BTRFS_NR_FILES
+
+        for i in picks:
+            check_file(u_boot_console, i)
+    finally:
+        clean_image(build_dir, BTRFS_SRC_DIR, BTRFS_IMAGE_NAME)
@@ -0,0 +1,74 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: EROFS compressed file test
+
+"""
+This test verifies that files compressed with each of the supported
+algorithms into big pclusters read back correctly, both whole and from an
+offset in the middle of a pcluster.
+"""
+
+import hashlib
+import os
+import pytest
+import random
+import subprocess
+from tests.fs_helper import clean_image
+
+ZIP_SRC_DIR = 'erofs_zip_src_dir'
+ZIP_IMAGE_NAME = 'erofs_zip.img'
+ZIP_FILE_SIZE = 1024 * 1024
+
+def make_zip_image(build_dir, alg):
+    """
+    Makes an EROFS image holding one compressible file, or returns False if
+    mkfs.erofs was built without support for the algorithm.
+    """
+    root = os.path.join(build_dir, ZIP_SRC_DIR)
+    os.makedirs(root)
+
+    words = [b'erofs', b'pcluster', b'u-boot', b' ', b'\n', b'0123456789']
+    rand = random.Random(alg)
+    data = b''
+    while len(data) < ZIP_FILE_SIZE:
+        data += rand.choice(words)
+    with open(os.path.join(root, 'file'), 'wb') as f:
+        f.write(data[:ZIP_FILE_SIZE])
+
+    image_path = os.path.join(build_dir, ZIP_IMAGE_NAME)
+    ret = subprocess.run(['mkfs.erofs -z{} -C65536 {} {}'.format(
+                          alg, image_path, root)], shell=True,
+                         stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return ret.returncode == 0
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_erofs')
+@pytest.mark.buildconfigspec('fs_erofs_zip_lzma')
+@pytest.mark.buildconfigspec('fs_erofs_zip_deflate')
+@pytest.mark.buildconfigspec('fs_erofs_zip_zstd')
+@pytest.mark.requiredtool('mkfs.erofs')
+@pytest.mark.parametrize('alg', ['lz4hc', 'lzma', 'deflate', 'zstd'])
+def test_erofs_zip(u_boot_console, alg):
+    """
+    Loads a compressed file whole and in part.
+    """
+    build_dir = u_boot_console.config.build_dir
+
+    try:
+        if not make_zip_image(build_dir, alg):
+            pytest.skip('mkfs.erofs does not support {}'.format(alg))
+        image_path = os.path.join(build_dir, ZIP_IMAGE_NAME)
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+
+        path = os.path.join(build_dir, ZIP_SRC_DIR, 'file')
+        expected = open(path, 'rb').read()
+        for (size, pos) in [(ZIP_FILE_SIZE, 0), (100000, 300000), (10, 65541)]:
+            output = u_boot_console.run_command_list([
+                'erofsload host 0 $kernel_addr_r file {:x} {:x}'.format(size, pos),
+                'md5sum $kernel_addr_r {:x}'.format(size)])
+            assert '{} bytes read'.format(size) in ''.join(output)
+            md5 = hashlib.md5(expected[pos:pos + size]).hexdigest()
+            assert md5 in ''.join(output)
+    finally:
+        clean_image(build_dir, ZIP_SRC_DIR, ZIP_IMAGE_NAME)
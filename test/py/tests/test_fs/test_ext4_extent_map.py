@@ -0,0 +1,134 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: ext4 extent map test
+
+"""
+This test verifies reads of a fragmented file through the extent map that
+ext4 builds for extent-mapped inodes. The same file is also read from an
+image without extents, which maps every block separately, and both must
+match the source data.
+"""
+
+import hashlib
+import os
+import pytest
+import re
+import shutil
+import subprocess
+from fstest_defs import *
+
+EXTMAP_SRC_DIR = 'extmap_src_dir'
+EXTMAP_IMAGE_NAME = 'extmap_{}.img'
+EXTMAP_NR_FILL = 600
+EXTMAP_FILL_SIZE = 8192
+EXTMAP_FILE = 'frag.bin'
+EXTMAP_FILE_SIZE = 1536 * 1024 + 123
+
+def make_extmap_image(build_dir, name, features):
+    """
+    Makes an ext4 image holding a fragmented file.
+
+    Every other filler file is removed before the file is written, so that
+    debugfs has to spread it over the holes left behind.
+    """
+    root = os.path.join(build_dir, EXTMAP_SRC_DIR)
+    image_path = os.path.join(build_dir, EXTMAP_IMAGE_NAME.format(name))
+    subprocess.run(['mkfs.ext4 -q -b 1024 -O {} -d {} {} 16M'.format(
+                    features, os.path.join(root, 'fs'), image_path)],
+                   shell=True, check=True, stdout=subprocess.DEVNULL)
+
+    cmds = os.path.join(root, 'cmds')
+    with open(cmds, 'w') as f:
+        for i in range(0, EXTMAP_NR_FILL, 2):
+            f.write('rm /fill/f{}\n'.format(i))
+        f.write('write {} {}\n'.format(os.path.join(root, EXTMAP_FILE),
+                                       EXTMAP_FILE))
+    subprocess.run(['debugfs -w -f {} {}'.format(cmds, image_path)],
+                   shell=True, check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+
+    return image_path
+
+def make_extmap_source(build_dir):
+    """
+    Creates the filler files and the data of the fragmented file, and
+    returns the data.
+    """
+    root = os.path.join(build_dir, EXTMAP_SRC_DIR)
+    os.makedirs(os.path.join(root, 'fs', 'fill'))
+    for i in range(EXTMAP_NR_FILL):
+        with open(os.path.join(root, 'fs', 'fill', 'f{}'.format(i)),
+                  'wb') as f:
+            f.write(bytes([i & 0xff]) * EXTMAP_FILL_SIZE)
+
+    data = os.urandom(EXTMAP_FILE_SIZE)
+    with open(os.path.join(root, EXTMAP_FILE), 'wb') as f:
+        f.write(data)
+
+    return data
+
+def nr_extents(image_path):
+    """
+    Returns the number of leaf extents of the fragmented file.
+    """
+    out = subprocess.run(['debugfs -R "ex /{}" {}'.format(EXTMAP_FILE,
+                                                          image_path)],
+                         shell=True, check=True, capture_output=True,
+                         text=True).stdout
+    leaves = 0
+    for line in out.splitlines():
+        # the first column is the level of the entry and the tree depth
+        m = re.match(r'\s*(\d+)/\s*(\d+)', line)
+        if m and m.group(1) == m.group(2):
+            leaves += 1
+    return leaves
+
+def clean_extmap_images(build_dir):
+    """
+    Deletes the images and src_dir at build_dir.
+    """
+    shutil.rmtree(os.path.join(build_dir, EXTMAP_SRC_DIR), ignore_errors=True)
+    for name in ['extents', 'blocks']:
+        image_path = os.path.join(build_dir, EXTMAP_IMAGE_NAME.format(name))
+        if os.path.exists(image_path):
+            os.remove(image_path)
+
+def load_md5(u_boot_console, pos, length):
+    output = u_boot_console.run_command_list([
+        'load host 0:0 {:x} /{} {:x} {:x}'.format(ADDR, EXTMAP_FILE, length,
+                                                 pos),
+        'md5sum {:x} {:x}'.format(ADDR, length)])
+    return ''.join(output)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_md5sum')
+@pytest.mark.buildconfigspec('fs_ext4')
+@pytest.mark.requiredtool('mkfs.ext4')
+@pytest.mark.requiredtool('debugfs')
+def test_ext4_extent_map(u_boot_console):
+    """
+    Reads a fragmented file whole and in pieces, twice, with and without
+    the extent map.
+    """
+    build_dir = u_boot_console.config.build_dir
+    reads = [(0, EXTMAP_FILE_SIZE), (0, 1000), (5000, 300000),
+             (EXTMAP_FILL_SIZE * 3 - 10, 20),
+             (EXTMAP_FILE_SIZE - 777, 777)]
+
+    try:
+        data = make_extmap_source(build_dir)
+        images = [make_extmap_image(build_dir, 'extents', 'extent'),
+                  make_extmap_image(build_dir, 'blocks',
+                                    '^extent,^64bit')]
+        # more extents than fit in the inode, so the map comes from a tree
+        assert nr_extents(images[0]) > 4
+
+        for image_path in images:
+            u_boot_console.run_command('host bind 0 {}'.format(image_path))
+            for _ in range(2):
+                for pos, length in reads:
+                    md5 = hashlib.md5(data[pos:pos + length]).hexdigest()
+                    assert md5 in load_md5(u_boot_console, pos, length)
+    finally:
+        clean_extmap_images(build_dir)
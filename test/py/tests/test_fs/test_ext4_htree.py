@@ -0,0 +1,66 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: ext4 HTree (dx_dir) lookup test
+
+"""
+This test verifies that names are found in an ext4 directory that carries a
+hash tree index, for each of the hash algorithms ext4 supports.
+"""
+
+import os
+import pytest
+import subprocess
+from tests.fs_helper import file_name, make_src_dir, clean_image
+from tests.fs_helper import check_size, check_missing
+
+HTREE_SRC_DIR = 'htree_src_dir'
+HTREE_IMAGE_NAME = 'htree.img'
+HTREE_NR_FILES = 3000
+
+def make_htree_image(build_dir, hash_alg):
+    """
+    Makes an ext4 image with a single large indexed directory.
+
+    e2fsck -D rebuilds every directory with an index using the default hash
+    of the superblock, so set that first.
+    """
+    root = make_src_dir(build_dir, HTREE_SRC_DIR, HTREE_NR_FILES,
+                        lambda i: 'x' * i)
+
+    image_path = os.path.join(build_dir, HTREE_IMAGE_NAME)
+    subprocess.run(['mkfs.ext4 -q -b 1024 -d {} {} 32M'.format(root, image_path)],
+                   shell=True, check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(['debugfs -w -R "ssv def_hash_version {}" {}'.format(
+                    hash_alg, image_path)], shell=True, check=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    # e2fsck exits with 1 when it modified the filesystem
+    subprocess.run(['e2fsck -fyD {}'.format(image_path)], shell=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    out = subprocess.run(['debugfs -R "htree /dir" {}'.format(image_path)],
+                         shell=True, check=True, capture_output=True,
+                         text=True)
+    assert 'Indirect levels' in out.stdout
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('fs_ext4')
+@pytest.mark.requiredtool('mkfs.ext4')
+@pytest.mark.requiredtool('debugfs')
+@pytest.mark.requiredtool('e2fsck')
+@pytest.mark.parametrize('hash_alg', ['legacy', 'half_md4', 'tea'])
+def test_ext4_htree(u_boot_console, hash_alg):
+    """
+    Looks up names all over an indexed directory and a missing one.
+    """
+    build_dir = u_boot_console.config.build_dir
+
+    try:
+        make_htree_image(build_dir, hash_alg)
+        image_path = os.path.join(build_dir, HTREE_IMAGE_NAME)
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+
+        for i in [1, 2, 777, 1500, HTREE_NR_FILES - 1, HTREE_NR_FILES]:
+            check_size(u_boot_console, file_name(i), i)
+        check_missing(u_boot_console, 'no-such-file')
+    finally:
+        clean_image(build_dir, HTREE_SRC_DIR, HTREE_IMAGE_NAME)
@@ -0,0 +1,135 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: FAT directory name index test
+
+"""
+This test verifies that lookups through the FAT directory name index find the
+same entries a linear scan of the directory would: long names, the short
+aliases of long names, short-only names, names matched case-insensitively,
+names whose hashes collide, and no deleted entries.
+"""
+
+import os
+import pytest
+import subprocess
+from tests.fs_helper import file_name, make_src_dir, clean_image
+from tests.fs_helper import check_size, check_missing
+
+DIRINDEX_SRC_DIR = 'fat_dirindex_src'
+DIRINDEX_IMAGE_NAME = 'fat_dirindex.img'
+DIRINDEX_NR_FILES = 300
+
+def name_hash(name):
+    """
+    Returns the FNV-1a hash of the lower-cased name, as U-Boot computes it.
+    """
+    h = 0x811c9dc5
+    for c in name.lower().encode():
+        h = ((h ^ c) * 0x01000193) & 0xffffffff
+    return h
+
+def colliding_names():
+    """
+    Finds two long names with the same hash.
+    """
+    seen = {}
+    i = 0
+    while True:
+        name = 'collide-{}.dat'.format(i)
+        h = name_hash(name)
+        if h in seen:
+            return seen[h], name
+        seen[h] = name
+        i += 1
+
+def short_alias(image_path, long_name):
+    """
+    Returns the short name mtools generated for a long name in /dir.
+    """
+    out = subprocess.run(['mdir', '-i', image_path, '::/dir'], check=True,
+                         capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        if line.endswith(' ' + long_name):
+            base, ext = line[:8].strip(), line[9:12].strip()
+            return base + '.' + ext if ext else base
+    assert False, 'no short name for ' + long_name
+
+def make_dirindex_image(build_dir, collide):
+    """
+    Makes a FAT image with one directory holding long names, short-only
+    names, two names with colliding hashes and some deleted entries.
+    """
+    root = make_src_dir(build_dir, DIRINDEX_SRC_DIR, DIRINDEX_NR_FILES,
+                        lambda i: 'x' * i)
+    for i in range(1, 6):
+        with open(os.path.join(root, 'dir', 'SHORT{}.TXT'.format(i)),
+                  'w') as f:
+            f.write('s' * (1000 + i))
+    for i, name in enumerate(collide):
+        with open(os.path.join(root, 'dir', name), 'w') as f:
+            f.write('c' * (2000 + i))
+
+    image_path = os.path.join(build_dir, DIRINDEX_IMAGE_NAME)
+    subprocess.run(['mkfs.vfat', '-C', image_path, '8192'], check=True,
+                   stdout=subprocess.DEVNULL)
+    subprocess.run(['mcopy', '-s', '-i', image_path,
+                    os.path.join(root, 'dir'), '::/'], check=True)
+    # leave deleted entries between the live ones
+    for i in range(10, 20):
+        subprocess.run(['mdel', '-i', image_path,
+                        '::/dir/{}'.format(file_name(i))], check=True)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('fs_fat')
+@pytest.mark.buildconfigspec('fat_write')
+@pytest.mark.buildconfigspec('fs_mount')
+@pytest.mark.requiredtool('mkfs.vfat')
+@pytest.mark.requiredtool('mcopy')
+@pytest.mark.requiredtool('mdel')
+@pytest.mark.requiredtool('mdir')
+def test_fat_dirindex(u_boot_console):
+    """
+    Looks up names all over an indexed directory.
+    """
+    build_dir = u_boot_console.config.build_dir
+    collide = colliding_names()
+
+    try:
+        make_dirindex_image(build_dir, collide)
+        image_path = os.path.join(build_dir, DIRINDEX_IMAGE_NAME)
+        alias = short_alias(image_path, file_name(7))
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+
+        # long names, the first lookup builds the index
+        for i in [DIRINDEX_NR_FILES, 1, 2, 20, 150, DIRINDEX_NR_FILES - 1]:
+            check_size(u_boot_console, file_name(i), i)
+
+        # short alias of a long name, short-only names, any case
+        check_size(u_boot_console, alias, 7)
+        check_size(u_boot_console, alias.lower(), 7)
+        check_size(u_boot_console, 'SHORT3.TXT', 1003)
+        check_size(u_boot_console, 'short4.txt', 1004)
+        check_size(u_boot_console, 'Short5.Txt', 1005)
+        check_size(u_boot_console, file_name(42).upper(), 42)
+
+        # both names of a hash collision resolve to their own entry
+        assert name_hash(collide[0]) == name_hash(collide[1])
+        check_size(u_boot_console, collide[0], 2000)
+        check_size(u_boot_console, collide[1], 2001)
+        check_size(u_boot_console, collide[1].upper(), 2001)
+
+        # deleted entries and names which never existed
+        for i in [10, 15, 19]:
+            check_missing(u_boot_console, file_name(i))
+        check_missing(u_boot_console, 'no-such-file')
+        check_missing(u_boot_console, file_name(3)[:-1])
+
+        # removing a file drops the index, which is then rebuilt
+        u_boot_console.run_command('fatrm host 0 /dir/{}'.format(
+            file_name(5)))
+        check_missing(u_boot_console, file_name(5))
+        check_size(u_boot_console, file_name(6), 6)
+        check_size(u_boot_console, collide[1], 2001)
+    finally:
+        clean_image(build_dir, DIRINDEX_SRC_DIR, DIRINDEX_IMAGE_NAME)
@@ -0,0 +1,58 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: mount table test
+
+"""
+This test verifies that a filesystem stays mounted between commands and is
+dropped again when its block device goes away.
+"""
+
+import pytest
+import re
+from fstest_defs import *
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('fs_mount')
+@pytest.mark.slow
+class TestFsMount(object):
+    def test_mount1(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 1 - a second command reuses the mount
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 1 - reuse'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'umount',
+                'size host 0:0 /%s' % SMALL_FILE,
+                'size host 0:0 /%s' % SMALL_FILE,
+                'mount'])
+            assert(re.search('host 0:0 type \w+ \(open, hits=1\)',
+                             ''.join(output)))
+
+    def test_mount2(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 2 - rebinding the device drops the mount
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 2 - rebind'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'mount host 0:0',
+                'host bind 0 %s' % fs_img,
+                'mount'])
+            assert('host 0:0' not in ''.join(output))
+
+    def test_mount3(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 3 - umount drops the mount
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 3 - umount'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'mount host 0:0',
+                'umount host 0',
+                'mount'])
+            assert('host 0:0' not in ''.join(output))
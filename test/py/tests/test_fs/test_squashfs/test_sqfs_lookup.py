@@ -0,0 +1,61 @@
+# SPDX-License-Identifier: GPL-2.0
+#
+# U-Boot File System: SquashFS large directory lookup test
+
+"""
+This test verifies that names are found all over a directory whose listing
+spans several metadata blocks, and that files sharing fragment blocks read
+back correctly when loaded one after the other.
+"""
+
+import hashlib
+import os
+import pytest
+
+from sqfs_common import check_mksquashfs_version, mksquashfs
+from tests.fs_helper import file_name, make_src_dir, clean_image
+from tests.fs_helper import check_missing
+
+LOOKUP_SRC_DIR = 'sqfs_lookup_src_dir'
+LOOKUP_IMAGE_NAME = 'sqfs_lookup.img'
+LOOKUP_NR_FILES = 2000
+
+def make_lookup_image(build_dir):
+    """
+    Makes a SquashFS image with a single large directory of small files.
+    """
+    root = make_src_dir(build_dir, LOOKUP_SRC_DIR, LOOKUP_NR_FILES,
+                        lambda i: chr(ord('a') + i % 26) * i)
+
+    image_path = os.path.join(build_dir, LOOKUP_IMAGE_NAME)
+    mksquashfs('{} {} -noappend -comp gzip'.format(root, image_path))
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('fs_squashfs')
+@pytest.mark.requiredtool('mksquashfs')
+def test_sqfs_lookup(u_boot_console):
+    """
+    Loads files all over a large directory and looks up a missing one.
+    """
+    build_dir = u_boot_console.config.build_dir
+
+    try:
+        check_mksquashfs_version()
+        make_lookup_image(build_dir)
+        image_path = os.path.join(build_dir, LOOKUP_IMAGE_NAME)
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+
+        for i in [1, 2, 3, 777, 1000, LOOKUP_NR_FILES - 1, LOOKUP_NR_FILES]:
+            path = os.path.join(build_dir, LOOKUP_SRC_DIR, 'dir', file_name(i))
+            expected = open(path, 'rb').read()
+            output = u_boot_console.run_command_list([
+                'sqfsload host 0 $kernel_addr_r /dir/{}'.format(file_name(i)),
+                'md5sum $kernel_addr_r {:x}'.format(i)])
+            assert '{} bytes read'.format(i) in ''.join(output)
+            assert hashlib.md5(expected).hexdigest() in ''.join(output)
+
+        check_missing(u_boot_console, 'no-such-file')
+    finally:
+        clean_image(build_dir, LOOKUP_SRC_DIR, LOOKUP_IMAGE_NAME)
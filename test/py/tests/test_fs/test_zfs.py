@@ -0,0 +1,136 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: ZFS test
+
+"""
+This test verifies that files are read correctly from ZFS pools: a file whose
+indirect blocks take up more than the metadata cache, so that they are
+evicted and read again, blocks compressed with LZ4, and a file with holes.
+It also checks that a pool needing an unsupported feature is refused.
+
+Creating a pool needs the zfs tools and module, and root through sudo.
+"""
+
+import hashlib
+import os
+import pytest
+from subprocess import call, check_call, CalledProcessError
+from fstest_defs import *
+
+ZFS_IMAGE_NAME = 'zfs_{}.img'
+ZFS_POOL_NAME = 'ubtest{}'
+
+# 512-byte records give 1024 data blocks per 128 KiB indirect block, so the
+# indirect blocks of this file add up to 6 MiB, more than the cache
+ZFS_BIG_SIZE = 24 << 20
+
+def big_data():
+    return b''.join(i.to_bytes(4, 'little') for i in range(ZFS_BIG_SIZE // 4))
+
+def lz4_data():
+    return b''.join('line {} of the text\n'.format(i).encode()
+                    for i in range(100000))
+
+def sparse_data():
+    return b'a' * 4096 + b'\0' * (1 << 20) + b'b' * 4096
+
+def make_pool(build_dir, name, features):
+    """
+    Creates a pool in an image file with the given features enabled, and
+    returns the pool name and the image path.
+    """
+    image_path = os.path.join(build_dir, ZFS_IMAGE_NAME.format(name))
+    pool = ZFS_POOL_NAME.format(name)
+    with open(image_path, 'wb') as f:
+        f.truncate(128 << 20)
+    args = ' '.join('-o feature@{}=enabled'.format(f) for f in features)
+    check_call('sudo zpool create -d {} -R {} {} {}'.format(
+        args, os.path.join(build_dir, pool), pool, image_path), shell=True)
+    return pool, image_path
+
+def write_file(build_dir, pool, path, data):
+    tmp = os.path.join(build_dir, 'zfs_tmp')
+    with open(tmp, 'wb') as f:
+        f.write(data)
+    check_call('sudo cp --sparse=always {} {}'.format(
+        tmp, os.path.join(build_dir, pool, pool, path)), shell=True)
+    os.remove(tmp)
+
+def destroy_pool(build_dir, name):
+    """
+    Exports the pool if it is still imported and deletes its image.
+    """
+    pool = ZFS_POOL_NAME.format(name)
+    call('sudo zpool export {} 2>/dev/null'.format(pool), shell=True)
+    # only the empty mount points are left once the pool is exported
+    call('sudo rm -rf {}'.format(os.path.join(build_dir, pool)), shell=True)
+    image_path = os.path.join(build_dir, ZFS_IMAGE_NAME.format(name))
+    if os.path.exists(image_path):
+        os.remove(image_path)
+
+def zfs_load_md5(u_boot_console, path, length):
+    output = u_boot_console.run_command_list([
+        'zfsload host 0 {:x} {}'.format(ADDR, path),
+        'md5sum {:x} {:x}'.format(ADDR, length)])
+    return ''.join(output)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_zfs')
+@pytest.mark.buildconfigspec('lz4')
+@pytest.mark.buildconfigspec('cmd_md5sum')
+@pytest.mark.requiredtool('zpool')
+@pytest.mark.requiredtool('zfs')
+@pytest.mark.slow
+def test_zfs(u_boot_console):
+    """
+    Reads a large, an LZ4 compressed and a sparse file, twice.
+    """
+    build_dir = u_boot_console.config.build_dir
+    files = {'/fs/@/big': big_data(), '/lz/@/text': lz4_data(),
+             '/fs/@/sparse': sparse_data()}
+
+    try:
+        try:
+            pool, image_path = make_pool(build_dir, 'read',
+                                         ['lz4_compress', 'hole_birth'])
+            check_call('sudo zfs create -o recordsize=512 {}/fs'.format(pool),
+                       shell=True)
+            check_call('sudo zfs create -o compression=lz4 {}/lz'.format(pool),
+                       shell=True)
+            for path, data in files.items():
+                write_file(build_dir, pool, path[1:].replace('/@', ''),
+                           data)
+            check_call('sudo zpool export {}'.format(pool), shell=True)
+        except CalledProcessError as err:
+            pytest.skip('Creating the ZFS pool failed: {}'.format(err))
+
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+        for _ in range(2):
+            for path, data in files.items():
+                md5 = hashlib.md5(data).hexdigest()
+                assert md5 in zfs_load_md5(u_boot_console, path, len(data))
+    finally:
+        destroy_pool(build_dir, 'read')
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_zfs')
+@pytest.mark.requiredtool('zpool')
+def test_zfs_unsupported_feature(u_boot_console):
+    """
+    Refuses a pool which needs a feature we can't read.
+    """
+    build_dir = u_boot_console.config.build_dir
+
+    try:
+        try:
+            pool, image_path = make_pool(build_dir, 'feature',
+                                         ['embedded_data'])
+            check_call('sudo zpool export {}'.format(pool), shell=True)
+        except CalledProcessError as err:
+            pytest.skip('Creating the ZFS pool failed: {}'.format(err))
+
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+        output = u_boot_console.run_command('zfsls host 0 /')
+        assert 'unsupported feature com.delphix:embedded_data' in output
+    finally:
+        destroy_pool(build_dir, 'feature')